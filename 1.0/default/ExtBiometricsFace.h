@@ -6,12 +6,15 @@
 #include <android/log.h>
 #include <hardware/hardware.h>
 #include <hardware/face.h>
-#include <vendor/sprd/hardware/face/1.0/IExtBiometricsFace.h>
 #include <vendor/sprd/hardware/face/1.0/IExtBiometricsFaceClientCallback.h>
+#include <vendor/sprd/hardware/face/1.1/IExtBiometricsFace.h>
+#include <vendor/sprd/hardware/face/1.1/IExtBiometricsFaceClientCallback.h>
 #include <hidl/MQDescriptor.h>
 #include <hidl/Status.h>
-#include <media/stagefright/foundation/AHandler.h>
-#include <media/stagefright/foundation/AMessage.h>
+#include <functional>
+#include <memory>
+#include "FaceCodes.h"
+#include "FaceService.h"
 
 namespace vendor {
 namespace sprd {
@@ -27,28 +30,67 @@ using ::android::hardware::biometrics::face::V1_0::Feature;
 using ::android::hardware::biometrics::face::V1_0::FaceError;
 using ::android::hardware::biometrics::face::V1_0::FaceAcquiredInfo;
 using ::android::hardware::hidl_array;
+using ::android::hardware::hidl_handle;
 using ::android::hardware::hidl_memory;
 using ::android::hardware::hidl_string;
 using ::android::hardware::hidl_vec;
 using ::android::hardware::Return;
 using ::android::hardware::Void;
 using ::android::sp;
-using ::vendor::sprd::hardware::face::V1_0::IExtBiometricsFace;
+using ::android::wp;
+using ::android::hidl::base::V1_0::IBase;
 using ::vendor::sprd::hardware::face::V1_0::IExtBiometricsFaceClientCallback;
-using ::android::AHandler;
-using ::android::ALooper;
-using ::android::AMessage;
+using ::vendor::sprd::hardware::face::V1_1::IExtBiometricsFace;
+using ::vendor::sprd::hardware::face::V1_1::FaceSessionOutcome;
+using ::vendor::sprd::hardware::face::V1_1::FaceSessionRecord;
 
-struct FaceHandler : public AHandler {
-    FaceHandler() {}
-    ~FaceHandler() {}
+// Hands the events of the service to the HIDL callback of one client,
+// with the codes translated to HIDL.
+class FaceHidlClient : public FaceClientCallback {
+public:
+    FaceHidlClient(const sp<IBiometricsFaceClientCallback>& callback, uint64_t deviceId,
+            FaceCodeTranslator& codes);
+
+    const sp<IBiometricsFaceClientCallback>& callback() const { return mCallback; }
+    // CLIENT_* flags of what the callback can take.
+    uint32_t flags() const;
+
+    void onEnrollResult(uint32_t faceId, int32_t userId, uint32_t remaining) override;
+    void onAuthenticated(uint32_t faceId, int32_t userId, const uint8_t* token, size_t size) override;
+    void onAcquired(int32_t userId, int32_t acquired) override;
+    void onError(int32_t userId, int32_t error) override;
+    void onRemoved(const uint32_t* faceIds, size_t count, int32_t userId) override;
+    void onEnumerate(const uint32_t* faceIds, size_t count, int32_t userId) override;
+    void onLockoutChanged(uint64_t durationMs) override;
+    void onEnrollProcessed(int64_t addr) override;
+    void onAuthProcessed(int64_t main, int64_t sub) override;
+    void onRecommendedFrameRate(uint32_t fps) override;
+
+private:
+    sp<IBiometricsFaceClientCallback> mCallback;
+    sp<IExtBiometricsFaceClientCallback> mExtCallback;
+    // Only a @1.1 callback is recommended frame rates.
+    sp<::vendor::sprd::hardware::face::V1_1::IExtBiometricsFaceClientCallback> mFrameRateCallback;
+    const uint64_t mDeviceId;
+    FaceCodeTranslator& mCodes;
+};
 
-    void onMessageReceived(const sp<AMessage> &msg);
+// Reports the death of a client process, the cookie is the client id.
+class FaceClientDeathRecipient : public ::android::hardware::hidl_death_recipient {
+public:
+    typedef std::function<void(uint32_t client)> DeathCallback;
+
+    explicit FaceClientDeathRecipient(DeathCallback callback) : mCallback(callback) {}
+
+    void serviceDied(uint64_t cookie, const wp<IBase>&) override {
+        mCallback(static_cast<uint32_t>(cookie));
+    }
 
 private:
-    DISALLOW_EVIL_CONSTRUCTORS(FaceHandler);
+    DeathCallback mCallback;
 };
 
+// The HIDL front end of FaceService.
 struct ExtBiometricsFace : public IExtBiometricsFace {
 public:
     ExtBiometricsFace();
@@ -57,6 +99,15 @@ public:
     // Method to wrap legacy HAL with ExtBiometricsFace class
     static IExtBiometricsFace* getInstance();
     face_device_t* getDevice();
+    void onServiceRegistered();
+    // Opens the vendor module in the calling process.
+    static face_device_t* openHal(FaceNotifyFn notify);
+    // Registers the callback of an AIDL session in this process. It takes
+    // no frames; its sessions run on those of the camera client.
+    Status setSessionCallback(const sp<IBiometricsFaceClientCallback>& clientCallback, uint32_t* clientId);
+    // Forgets the callback of a session that was closed or whose framework
+    // died, and cancels what it runs.
+    void clearSessionCallback(uint32_t clientId);
 
     // Methods from ::android::hardware::biometrics::face::V1_0::IBiometricsFace follow.
     Return<void> setCallback(const sp<IBiometricsFaceClientCallback>& clientCallback, setCallback_cb _hidl_cb) override;
@@ -79,25 +130,27 @@ public:
     Return<Status> doAuthenticateProcess(int64_t main, int64_t sub, int64_t otp, const hidl_vec<int32_t>& info, const hidl_vec<int8_t>& byteInfo) override;
     Return<Status> updateLivenessMode(int32_t value, int32_t userId) override;
 
+    // Methods from ::vendor::sprd::hardware::face::V1_1::IExtBiometricsFace follow.
+    Return<void> getSessionRecords(getSessionRecords_cb _hidl_cb) override;
+    Return<Status> updateScreenState(bool interactive) override;
+    Return<void> submitEnrollFrame(int64_t addr, const hidl_vec<int32_t>& info, const hidl_vec<int8_t>& byteInfo) override;
+    Return<void> submitAuthenticateFrame(int64_t main, int64_t sub, int64_t otp, const hidl_vec<int32_t>& info, const hidl_vec<int8_t>& byteInfo) override;
+
+    // Methods from ::android::hidl::base::V1_0::IBase follow.
+    Return<void> debug(const hidl_handle& fd, const hidl_vec<hidl_string>& args) override;
+
 private:
-    static face_device_t* openHal();
-    static void notify(const face_msg_t *msg); /* Static callback for legacy HAL implementation */
-    static Return<Status> ErrorFilter(int32_t error);
-    static FaceError VendorErrorFilter(int32_t error, int32_t* vendorCode);
-    static FaceAcquiredInfo VendorAcquiredFilter(int32_t error, int32_t* vendorCode);
+    static pid_t callingPid();
+    uint32_t addClient(pid_t pid, const sp<IBiometricsFaceClientCallback>& clientCallback, uint64_t deviceId,
+            uint32_t flagMask);
+    Status ErrorFilter(int32_t error);
+
     static ExtBiometricsFace* sInstance;
 
-    std::mutex mClientCallbackMutex;
-    sp<IBiometricsFaceClientCallback> mClientCallback;
-    sp<IExtBiometricsFaceClientCallback> mExtClientCallback;
-    int32_t mUserId;
-    face_device_t *mDevice;
-    sp<ALooper> mLooper;
-    sp<FaceHandler> mHandler;
-    bool mCancelled;
-    std::mutex mCancelledMutex;
-
-    friend struct FaceHandler;
+    // Outlives the service, whose threads translate through it.
+    FaceCodeTranslator mCodes;
+    std::unique_ptr<FaceService> mService;
+    sp<FaceClientDeathRecipient> mDeathRecipient;
 };
 
 }  // namespace implementation
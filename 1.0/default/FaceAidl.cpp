@@ -0,0 +1,435 @@
+// FIXME: your file license if you have one
+
+#define LOG_TAG "vendor.sprd.hardware.face-aidl"
+
+#include <log/log.h>
+#include <cutils/properties.h>
+#include <endian.h>
+#include <limits.h>
+#include <hardware/hw_auth_token.h>
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include "FaceAidl.h"
+
+namespace vendor {
+namespace sprd {
+namespace hardware {
+namespace face {
+namespace V1_0 {
+namespace implementation {
+
+using ::android::hardware::hidl_string;
+using ::android::hardware::Void;
+using ::android::hardware::biometrics::face::V1_0::Feature;
+using ::android::hardware::biometrics::face::V1_0::OptionalBool;
+using ::android::hardware::biometrics::face::V1_0::OptionalUint64;
+using ::android::hardware::biometrics::face::V1_0::Status;
+
+// SensorStrength of the face sensor: 0 convenience, 1 weak, 2 strong
+#define PROP_SENSOR_STRENGTH "ro.vendor.faceid.sensor_strength"
+#define DEFAULT_SENSOR_STRENGTH 1
+
+static const int32_t kSensorId = 0;
+static const int32_t kMaxEnrollmentsPerUser = 1;
+// What the framework asked the HIDL service for; AIDL leaves them to the HAL.
+static const uint32_t kChallengeTimeoutSec = 600;
+static const uint32_t kEnrollTimeoutSec = 75;
+static const char kStorePathFormat[] = "/data/vendor_de/%d/facedata";
+
+// HIDL FaceAcquiredInfo is AIDL AcquiredInfo less UNKNOWN, one lower.
+static_assert(static_cast<int32_t>(aidlface::AcquiredInfo::GOOD) ==
+        static_cast<int32_t>(FaceAcquiredInfo::GOOD) + 1, "AcquiredInfo moved");
+static_assert(static_cast<int32_t>(aidlface::AcquiredInfo::VENDOR) ==
+        static_cast<int32_t>(FaceAcquiredInfo::VENDOR) + 1, "AcquiredInfo moved");
+
+static aidlface::AcquiredInfo toAidl(FaceAcquiredInfo info) {
+    return static_cast<aidlface::AcquiredInfo>(static_cast<int32_t>(info) + 1);
+}
+
+static aidlface::Error toAidl(FaceError error) {
+    switch (error) {
+        case FaceError::HW_UNAVAILABLE:
+            return aidlface::Error::HW_UNAVAILABLE;
+        case FaceError::UNABLE_TO_PROCESS:
+            return aidlface::Error::UNABLE_TO_PROCESS;
+        case FaceError::TIMEOUT:
+            return aidlface::Error::TIMEOUT;
+        case FaceError::NO_SPACE:
+            return aidlface::Error::NO_SPACE;
+        case FaceError::CANCELED:
+            return aidlface::Error::CANCELED;
+        case FaceError::UNABLE_TO_REMOVE:
+            return aidlface::Error::UNABLE_TO_REMOVE;
+        case FaceError::VENDOR:
+            return aidlface::Error::VENDOR;
+        default:
+            return aidlface::Error::UNKNOWN;
+    }
+}
+
+// An AIDL token with a MAC of the wrong size turns into an empty one,
+// which the service rejects like any malformed HIDL token.
+static hidl_vec<uint8_t> toHidl(const HardwareAuthToken& hat) {
+    hw_auth_token_t token;
+    if (hat.mac.size() != sizeof(token.hmac)) {
+        return hidl_vec<uint8_t>();
+    }
+    memset(&token, 0, sizeof(token));
+    token.version = HW_AUTH_TOKEN_VERSION;
+    token.challenge = hat.challenge;
+    token.user_id = hat.userId;
+    token.authenticator_id = hat.authenticatorId;
+    token.authenticator_type = htobe32(static_cast<uint32_t>(hat.authenticatorType));
+    token.timestamp = htobe64(hat.timestamp.milliSeconds);
+    memcpy(token.hmac, hat.mac.data(), sizeof(token.hmac));
+    hidl_vec<uint8_t> bytes(sizeof(token));
+    memcpy(bytes.data(), &token, sizeof(token));
+    return bytes;
+}
+
+static HardwareAuthToken toAidl(const hidl_vec<uint8_t>& bytes) {
+    HardwareAuthToken hat;
+    hw_auth_token_t token;
+    if (bytes.size() != sizeof(token)) {
+        return hat;
+    }
+    memcpy(&token, bytes.data(), sizeof(token));
+    hat.challenge = token.challenge;
+    hat.userId = token.user_id;
+    hat.authenticatorId = token.authenticator_id;
+    hat.authenticatorType = static_cast<::aidl::android::hardware::keymaster::HardwareAuthenticatorType>(
+            be32toh(token.authenticator_type));
+    hat.timestamp.milliSeconds = be64toh(token.timestamp);
+    hat.mac.assign(token.hmac, token.hmac + sizeof(token.hmac));
+    return hat;
+}
+
+static std::vector<int32_t> toAidl(const hidl_vec<uint32_t>& ids) {
+    return std::vector<int32_t>(ids.begin(), ids.end());
+}
+
+FaceAidlCallback::FaceAidlCallback(const std::shared_ptr<aidlface::ISessionCallback>& cb)
+        : mCb(cb), mOperation(NONE), mEnrollmentId(0), mLockoutMs(0) {}
+
+Return<void> FaceAidlCallback::onEnrollResult(uint64_t, uint32_t faceId, int32_t, uint32_t remaining) {
+    if (remaining == 0) {
+        mOperation = NONE;
+        mEnrollmentId = faceId;
+    }
+    mCb->onEnrollmentProgress(faceId, remaining);
+    return Void();
+}
+
+Return<void> FaceAidlCallback::onAuthenticated(uint64_t, uint32_t faceId, int32_t, const hidl_vec<uint8_t>& token) {
+    if (faceId == 0) {
+        mCb->onAuthenticationFailed();
+        return Void();
+    }
+    mOperation = NONE;
+    mCb->onAuthenticationSucceeded(faceId, toAidl(token));
+    return Void();
+}
+
+Return<void> FaceAidlCallback::onAcquired(uint64_t, int32_t, FaceAcquiredInfo acquiredInfo, int32_t vendorCode) {
+    aidlface::BaseFrame frame;
+    frame.acquiredInfo = toAidl(acquiredInfo);
+    frame.vendorCode = vendorCode;
+    if (mOperation == ENROLL) {
+        aidlface::EnrollmentFrame enrollment;
+        enrollment.data = frame;
+        mCb->onEnrollmentFrame(enrollment);
+    } else {
+        aidlface::AuthenticationFrame authentication;
+        authentication.data = frame;
+        mCb->onAuthenticationFrame(authentication);
+    }
+    return Void();
+}
+
+// AIDL ends an authenticate during lockout with a lockout event, not an
+// error. The service announces the time left just before.
+Return<void> FaceAidlCallback::onError(uint64_t, int32_t, FaceError error, int32_t vendorCode) {
+    mOperation = NONE;
+    if (error == FaceError::LOCKOUT) {
+        mCb->onLockoutTimed(mLockoutMs);
+    } else if (error == FaceError::LOCKOUT_PERMANENT) {
+        mCb->onLockoutPermanent();
+    } else {
+        mCb->onError(toAidl(error), vendorCode);
+    }
+    return Void();
+}
+
+Return<void> FaceAidlCallback::onRemoved(uint64_t, const hidl_vec<uint32_t>& removed, int32_t) {
+    if (std::find(removed.begin(), removed.end(), mEnrollmentId.load()) != removed.end()) {
+        mEnrollmentId = 0;
+    }
+    mCb->onEnrollmentsRemoved(toAidl(removed));
+    return Void();
+}
+
+Return<void> FaceAidlCallback::onEnumerate(uint64_t, const hidl_vec<uint32_t>& faceIds, int32_t) {
+    mEnrollmentId = faceIds.size() > 0 ? faceIds[0] : 0;
+    mCb->onEnrollmentsEnumerated(toAidl(faceIds));
+    return Void();
+}
+
+// Timed and permanent lockouts reach the session through onError() of the
+// authenticate they end; only the end of a lockout is sent from here.
+Return<void> FaceAidlCallback::onLockoutChanged(uint64_t duration) {
+    if (duration == 0) {
+        mLockoutMs = 0;
+        mCb->onLockoutCleared();
+    } else if (duration != UINT64_MAX) {
+        mLockoutMs = (int64_t)duration;
+    }
+    return Void();
+}
+
+// The session is registered without CLIENT_FRAMES, the buffers go back
+// to the camera client.
+Return<void> FaceAidlCallback::onEnrollProcessed(uint64_t, int64_t) {
+    return Void();
+}
+
+Return<void> FaceAidlCallback::onAuthProcessed(uint64_t, int64_t, int64_t) {
+    return Void();
+}
+
+::ndk::ScopedAStatus FaceAidlCancellation::cancel() {
+    mFace->cancel();
+    return ::ndk::ScopedAStatus::ok();
+}
+
+FaceAidlSession::FaceAidlSession(const sp<ExtBiometricsFace>& face, int32_t userId,
+        const std::shared_ptr<aidlface::ISessionCallback>& cb)
+        : mFace(face), mUserId(userId), mCb(cb), mCallback(new FaceAidlCallback(cb)), mClientId(kNoClient),
+          mDeathRecipient(AIBinder_DeathRecipient_new(onCallbackDied)) {}
+
+// The camera client sends the frames of the session from its own process.
+bool FaceAidlSession::open() {
+    if (mFace->setSessionCallback(mCallback, &mClientId) != Status::OK) {
+        ALOGE("Can't register the session of user %d", mUserId);
+        return false;
+    }
+    char storePath[PATH_MAX];
+    snprintf(storePath, sizeof(storePath), kStorePathFormat, mUserId);
+    if (mFace->setActiveUser(mUserId, hidl_string(storePath)) != Status::OK) {
+        ALOGE("Can't switch to user %d", mUserId);
+        return false;
+    }
+    // The session may be gone by the time the framework dies, the cookie
+    // is the client id.
+    AIBinder_linkToDeath(mCb->asBinder().get(), mDeathRecipient.get(), clientCookie(mClientId));
+    return true;
+}
+
+void* FaceAidlSession::clientCookie(uint32_t clientId) {
+    return reinterpret_cast<void*>(static_cast<uintptr_t>(clientId));
+}
+
+// The framework went away, maybe with an operation running; the service
+// cancels it with the client.
+void FaceAidlSession::onCallbackDied(void* cookie) {
+    uint32_t clientId = static_cast<uint32_t>(reinterpret_cast<uintptr_t>(cookie));
+    ALOGE("Session callback of client %u died", clientId);
+    static_cast<ExtBiometricsFace*>(ExtBiometricsFace::getInstance())->clearSessionCallback(clientId);
+}
+
+::ndk::ScopedAStatus FaceAidlSession::generateChallenge() {
+    mFace->generateChallenge(kChallengeTimeoutSec, [this](const OptionalUint64& result) {
+        if (result.status == Status::OK) {
+            mCb->onChallengeGenerated(result.value);
+        } else {
+            mCb->onError(aidlface::Error::UNABLE_TO_PROCESS, 0);
+        }
+    });
+    return ::ndk::ScopedAStatus::ok();
+}
+
+::ndk::ScopedAStatus FaceAidlSession::revokeChallenge(int64_t challenge) {
+    mFace->revokeChallenge();
+    mCb->onChallengeRevoked(challenge);
+    return ::ndk::ScopedAStatus::ok();
+}
+
+::ndk::ScopedAStatus FaceAidlSession::getEnrollmentConfig(aidlface::EnrollmentType,
+        std::vector<aidlface::EnrollmentStageConfig>* configs) {
+    configs->clear();
+    return ::ndk::ScopedAStatus::ok();
+}
+
+// AIDL lists the features to turn on, HIDL the ones to turn off.
+::ndk::ScopedAStatus FaceAidlSession::enroll(const HardwareAuthToken& hat, aidlface::EnrollmentType,
+        const std::vector<aidlface::Feature>& features,
+        const std::optional<::aidl::android::hardware::common::NativeHandle>&,
+        std::shared_ptr<aidlcommon::ICancellationSignal>* cancellation) {
+    std::vector<Feature> disabled;
+    if (std::find(features.begin(), features.end(), aidlface::Feature::REQUIRE_ATTENTION) == features.end()) {
+        disabled.push_back(Feature::REQUIRE_ATTENTION);
+    }
+    if (std::find(features.begin(), features.end(), aidlface::Feature::REQUIRE_DIVERSE_POSES) == features.end()) {
+        disabled.push_back(Feature::REQUIRE_DIVERSITY);
+    }
+    mCallback->setOperation(FaceAidlCallback::ENROLL);
+    if (mFace->enroll(toHidl(hat), kEnrollTimeoutSec, disabled) != Status::OK) {
+        mCallback->setOperation(FaceAidlCallback::NONE);
+        mCb->onError(aidlface::Error::UNABLE_TO_PROCESS, 0);
+    }
+    *cancellation = ::ndk::SharedRefBase::make<FaceAidlCancellation>(mFace);
+    return ::ndk::ScopedAStatus::ok();
+}
+
+::ndk::ScopedAStatus FaceAidlSession::authenticate(int64_t operationId,
+        std::shared_ptr<aidlcommon::ICancellationSignal>* cancellation) {
+    mCallback->setOperation(FaceAidlCallback::AUTHENTICATE);
+    if (mFace->authenticate(operationId) != Status::OK) {
+        mCallback->setOperation(FaceAidlCallback::NONE);
+        mCb->onError(aidlface::Error::UNABLE_TO_PROCESS, 0);
+    }
+    *cancellation = ::ndk::SharedRefBase::make<FaceAidlCancellation>(mFace);
+    return ::ndk::ScopedAStatus::ok();
+}
+
+// Not in SensorProps, the framework never asks.
+::ndk::ScopedAStatus FaceAidlSession::detectInteraction(
+        std::shared_ptr<aidlcommon::ICancellationSignal>* cancellation) {
+    mCb->onError(aidlface::Error::UNABLE_TO_PROCESS, 0);
+    *cancellation = ::ndk::SharedRefBase::make<FaceAidlCancellation>(mFace);
+    return ::ndk::ScopedAStatus::ok();
+}
+
+::ndk::ScopedAStatus FaceAidlSession::enumerateEnrollments() {
+    if (mFace->enumerate() != Status::OK) {
+        mCb->onError(aidlface::Error::UNABLE_TO_PROCESS, 0);
+    }
+    return ::ndk::ScopedAStatus::ok();
+}
+
+// The framework waits for one onEnrollmentsRemoved() per call. A user has
+// one template at most, so a list that is not empty names all of them:
+// one remove of everything answers it.
+::ndk::ScopedAStatus FaceAidlSession::removeEnrollments(const std::vector<int32_t>& enrollmentIds) {
+    if (enrollmentIds.empty()) {
+        mCb->onEnrollmentsRemoved({});
+    } else if (mFace->remove(0) != Status::OK) {
+        mCb->onError(aidlface::Error::UNABLE_TO_REMOVE, 0);
+    }
+    return ::ndk::ScopedAStatus::ok();
+}
+
+::ndk::ScopedAStatus FaceAidlSession::getFeatures() {
+    static const std::pair<Feature, aidlface::Feature> kFeatures[] = {
+        { Feature::REQUIRE_ATTENTION, aidlface::Feature::REQUIRE_ATTENTION },
+        { Feature::REQUIRE_DIVERSITY, aidlface::Feature::REQUIRE_DIVERSE_POSES },
+    };
+    std::vector<aidlface::Feature> enabled;
+    bool ok = true;
+    for (auto& f : kFeatures) {
+        mFace->getFeature(f.first, mCallback->enrollmentId(), [&](const OptionalBool& result) {
+            ok = ok && result.status == Status::OK;
+            if (result.status == Status::OK && result.value) {
+                enabled.push_back(f.second);
+            }
+        });
+    }
+    if (ok) {
+        mCb->onFeaturesRetrieved(enabled);
+    } else {
+        mCb->onError(aidlface::Error::UNABLE_TO_PROCESS, 0);
+    }
+    return ::ndk::ScopedAStatus::ok();
+}
+
+::ndk::ScopedAStatus FaceAidlSession::setFeature(const HardwareAuthToken& hat, aidlface::Feature feature,
+        bool enabled) {
+    Status status = Status::ILLEGAL_ARGUMENT;
+    if (feature == aidlface::Feature::REQUIRE_ATTENTION) {
+        status = mFace->setFeature(Feature::REQUIRE_ATTENTION, enabled, toHidl(hat), mCallback->enrollmentId());
+    } else if (feature == aidlface::Feature::REQUIRE_DIVERSE_POSES) {
+        status = mFace->setFeature(Feature::REQUIRE_DIVERSITY, enabled, toHidl(hat), mCallback->enrollmentId());
+    }
+    if (status == Status::OK) {
+        mCb->onFeatureSet(feature);
+    } else {
+        mCb->onError(aidlface::Error::UNABLE_TO_PROCESS, 0);
+    }
+    return ::ndk::ScopedAStatus::ok();
+}
+
+::ndk::ScopedAStatus FaceAidlSession::getAuthenticatorId() {
+    mFace->getAuthenticatorId([this](const OptionalUint64& result) {
+        if (result.status == Status::OK) {
+            mCb->onAuthenticatorIdRetrieved(result.value);
+        } else {
+            mCb->onError(aidlface::Error::UNABLE_TO_PROCESS, 0);
+        }
+    });
+    return ::ndk::ScopedAStatus::ok();
+}
+
+// The vendor library renews the id itself when the templates change; the
+// one it has now is all there is to report.
+::ndk::ScopedAStatus FaceAidlSession::invalidateAuthenticatorId() {
+    mFace->getAuthenticatorId([this](const OptionalUint64& result) {
+        if (result.status == Status::OK) {
+            mCb->onAuthenticatorIdInvalidated(result.value);
+        } else {
+            mCb->onError(aidlface::Error::UNABLE_TO_PROCESS, 0);
+        }
+    });
+    return ::ndk::ScopedAStatus::ok();
+}
+
+::ndk::ScopedAStatus FaceAidlSession::resetLockout(const HardwareAuthToken& hat) {
+    if (mFace->resetLockout(toHidl(hat)) == Status::OK) {
+        mCb->onLockoutCleared();
+    } else {
+        mCb->onError(aidlface::Error::UNABLE_TO_PROCESS, 0);
+    }
+    return ::ndk::ScopedAStatus::ok();
+}
+
+// Nothing is sent to the session after onSessionClosed().
+::ndk::ScopedAStatus FaceAidlSession::close() {
+    AIBinder_unlinkToDeath(mCb->asBinder().get(), mDeathRecipient.get(), clientCookie(mClientId));
+    mFace->clearSessionCallback(mClientId);
+    mCb->onSessionClosed();
+    return ::ndk::ScopedAStatus::ok();
+}
+
+::ndk::ScopedAStatus FaceAidl::getSensorProps(std::vector<aidlface::SensorProps>* props) {
+    aidlface::SensorProps sensor;
+    sensor.commonProps.sensorId = kSensorId;
+    sensor.commonProps.sensorStrength = static_cast<aidlcommon::SensorStrength>(
+            property_get_int32(PROP_SENSOR_STRENGTH, DEFAULT_SENSOR_STRENGTH));
+    sensor.commonProps.maxEnrollmentsPerUser = kMaxEnrollmentsPerUser;
+    sensor.sensorType = aidlface::FaceSensorType::RGB;
+    sensor.halControlsPreview = false;
+    sensor.supportsDetectInteraction = false;
+    *props = { sensor };
+    return ::ndk::ScopedAStatus::ok();
+}
+
+// A new session takes over the service from the one before, as a second
+// setCallback() from the same process did.
+::ndk::ScopedAStatus FaceAidl::createSession(int32_t sensorId, int32_t userId,
+        const std::shared_ptr<aidlface::ISessionCallback>& cb, std::shared_ptr<aidlface::ISession>* session) {
+    if (sensorId != kSensorId || cb == nullptr) {
+        return ::ndk::ScopedAStatus::fromExceptionCode(EX_ILLEGAL_ARGUMENT);
+    }
+    std::shared_ptr<FaceAidlSession> created = ::ndk::SharedRefBase::make<FaceAidlSession>(mFace, userId, cb);
+    if (!created->open()) {
+        return ::ndk::ScopedAStatus::fromExceptionCode(EX_ILLEGAL_STATE);
+    }
+    *session = created;
+    return ::ndk::ScopedAStatus::ok();
+}
+
+}  // namespace implementation
+}  // namespace V1_0
+}  // namespace face
+}  // namespace hardware
+}  // namespace sprd
+}  // namespace vendor
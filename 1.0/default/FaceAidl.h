@@ -0,0 +1,146 @@
+// FIXME: your file license if you have one
+
+#pragma once
+
+#include <aidl/android/hardware/biometrics/common/BnCancellationSignal.h>
+#include <aidl/android/hardware/biometrics/face/BnFace.h>
+#include <aidl/android/hardware/biometrics/face/BnSession.h>
+#include <aidl/android/hardware/biometrics/face/ISessionCallback.h>
+#include <vendor/sprd/hardware/face/1.0/IExtBiometricsFaceClientCallback.h>
+#include <atomic>
+#include <memory>
+#include <optional>
+#include <vector>
+#include "ExtBiometricsFace.h"
+
+namespace vendor {
+namespace sprd {
+namespace hardware {
+namespace face {
+namespace V1_0 {
+namespace implementation {
+
+namespace aidlface = ::aidl::android::hardware::biometrics::face;
+namespace aidlcommon = ::aidl::android::hardware::biometrics::common;
+using ::aidl::android::hardware::keymaster::HardwareAuthToken;
+using ::android::hardware::biometrics::face::V1_0::FaceAcquiredInfo;
+using ::android::hardware::biometrics::face::V1_0::FaceError;
+using ::android::hardware::hidl_vec;
+using ::android::hardware::Return;
+using ::android::sp;
+using ::vendor::sprd::hardware::face::V1_0::IExtBiometricsFaceClientCallback;
+
+// The HIDL client callback an AIDL session registers with the service in
+// the same process; it hands the events on to the session's
+// ISessionCallback. Frame buffers and frame rates go to the camera client
+// that sends the frames.
+class FaceAidlCallback : public IExtBiometricsFaceClientCallback {
+public:
+    enum Operation {
+        NONE,
+        ENROLL,
+        AUTHENTICATE,
+    };
+
+    explicit FaceAidlCallback(const std::shared_ptr<aidlface::ISessionCallback>& cb);
+
+    void setOperation(Operation operation) { mOperation = operation; }
+    // A template of the user, for the HIDL calls that take one.
+    uint32_t enrollmentId() const { return mEnrollmentId; }
+
+    Return<void> onEnrollResult(uint64_t deviceId, uint32_t faceId, int32_t userId, uint32_t remaining) override;
+    Return<void> onAuthenticated(uint64_t deviceId, uint32_t faceId, int32_t userId,
+            const hidl_vec<uint8_t>& token) override;
+    Return<void> onAcquired(uint64_t deviceId, int32_t userId, FaceAcquiredInfo acquiredInfo,
+            int32_t vendorCode) override;
+    Return<void> onError(uint64_t deviceId, int32_t userId, FaceError error, int32_t vendorCode) override;
+    Return<void> onRemoved(uint64_t deviceId, const hidl_vec<uint32_t>& removed, int32_t userId) override;
+    Return<void> onEnumerate(uint64_t deviceId, const hidl_vec<uint32_t>& faceIds, int32_t userId) override;
+    Return<void> onLockoutChanged(uint64_t duration) override;
+    Return<void> onEnrollProcessed(uint64_t deviceId, int64_t addr) override;
+    Return<void> onAuthProcessed(uint64_t deviceId, int64_t main, int64_t sub) override;
+
+private:
+    std::shared_ptr<aidlface::ISessionCallback> mCb;
+    std::atomic<int> mOperation;
+    std::atomic<uint32_t> mEnrollmentId;
+    // Length of the last timed lockout the service announced.
+    std::atomic<int64_t> mLockoutMs;
+};
+
+// Cancels whatever the service runs for the session that handed it out.
+class FaceAidlCancellation : public aidlcommon::BnCancellationSignal {
+public:
+    explicit FaceAidlCancellation(const sp<IExtBiometricsFace>& face) : mFace(face) {}
+
+    ::ndk::ScopedAStatus cancel() override;
+
+private:
+    sp<IExtBiometricsFace> mFace;
+};
+
+// One user's session of the AIDL front end. Each call maps onto the HIDL
+// method of the shared service, called in process, so both front ends run
+// the same scheduler, frame pipeline and vendor adapter.
+class FaceAidlSession : public aidlface::BnSession {
+public:
+    FaceAidlSession(const sp<ExtBiometricsFace>& face, int32_t userId,
+            const std::shared_ptr<aidlface::ISessionCallback>& cb);
+
+    // Registers the session's callback and switches to its user.
+    bool open();
+
+    ::ndk::ScopedAStatus generateChallenge() override;
+    ::ndk::ScopedAStatus revokeChallenge(int64_t challenge) override;
+    ::ndk::ScopedAStatus getEnrollmentConfig(aidlface::EnrollmentType type,
+            std::vector<aidlface::EnrollmentStageConfig>* configs) override;
+    ::ndk::ScopedAStatus enroll(const HardwareAuthToken& hat, aidlface::EnrollmentType type,
+            const std::vector<aidlface::Feature>& features,
+            const std::optional<::aidl::android::hardware::common::NativeHandle>& previewSurface,
+            std::shared_ptr<aidlcommon::ICancellationSignal>* cancellation) override;
+    ::ndk::ScopedAStatus authenticate(int64_t operationId,
+            std::shared_ptr<aidlcommon::ICancellationSignal>* cancellation) override;
+    ::ndk::ScopedAStatus detectInteraction(std::shared_ptr<aidlcommon::ICancellationSignal>* cancellation) override;
+    ::ndk::ScopedAStatus enumerateEnrollments() override;
+    ::ndk::ScopedAStatus removeEnrollments(const std::vector<int32_t>& enrollmentIds) override;
+    ::ndk::ScopedAStatus getFeatures() override;
+    ::ndk::ScopedAStatus setFeature(const HardwareAuthToken& hat, aidlface::Feature feature, bool enabled) override;
+    ::ndk::ScopedAStatus getAuthenticatorId() override;
+    ::ndk::ScopedAStatus invalidateAuthenticatorId() override;
+    ::ndk::ScopedAStatus resetLockout(const HardwareAuthToken& hat) override;
+    ::ndk::ScopedAStatus close() override;
+
+private:
+    static void* clientCookie(uint32_t clientId);
+    static void onCallbackDied(void* cookie);
+
+    sp<ExtBiometricsFace> mFace;
+    int32_t mUserId;
+    std::shared_ptr<aidlface::ISessionCallback> mCb;
+    sp<FaceAidlCallback> mCallback;
+    // The service's client of mCallback.
+    uint32_t mClientId;
+    ::ndk::ScopedAIBinder_DeathRecipient mDeathRecipient;
+};
+
+// The stable AIDL face HAL, served next to IExtBiometricsFace which the
+// camera client keeps submitting its frames to.
+class FaceAidl : public aidlface::BnFace {
+public:
+    explicit FaceAidl(const sp<ExtBiometricsFace>& face) : mFace(face) {}
+
+    ::ndk::ScopedAStatus getSensorProps(std::vector<aidlface::SensorProps>* props) override;
+    ::ndk::ScopedAStatus createSession(int32_t sensorId, int32_t userId,
+            const std::shared_ptr<aidlface::ISessionCallback>& cb,
+            std::shared_ptr<aidlface::ISession>* session) override;
+
+private:
+    sp<ExtBiometricsFace> mFace;
+};
+
+}  // namespace implementation
+}  // namespace V1_0
+}  // namespace face
+}  // namespace hardware
+}  // namespace sprd
+}  // namespace vendor
@@ -0,0 +1,111 @@
+// FIXME: your file license if you have one
+
+#define LOG_TAG "vendor.sprd.hardware.face@1.0-service"
+
+#include <log/log.h>
+#include <endian.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+#include "FaceAuthToken.h"
+
+namespace vendor {
+namespace sprd {
+namespace hardware {
+namespace face {
+namespace V1_0 {
+namespace implementation {
+
+static const char* const kVerdictNames[FaceAuthTokenFilter::VERDICT_COUNT] = {
+    "valid",
+    "bad_size",
+    "bad_version",
+    "wrong_challenge",
+    "stale",
+    "rejected_before",
+};
+
+const size_t FaceAuthTokenFilter::kRejectedSlots;
+
+FaceAuthTokenFilter::FaceAuthTokenFilter()
+        : mMaxAgeMs(0), mChallenge(0), mRejectedCount(0), mNextRejected(0), mVerdicts(), mVendorRejected(0) {}
+
+void FaceAuthTokenFilter::setMaxAgeMs(int64_t maxAgeMs) {
+    std::lock_guard<std::mutex> lock(mMutex);
+    mMaxAgeMs = maxAgeMs;
+}
+
+void FaceAuthTokenFilter::setChallenge(uint64_t challenge) {
+    std::lock_guard<std::mutex> lock(mMutex);
+    if (challenge != mChallenge) {
+        mChallenge = challenge;
+        mRejectedCount = 0;
+        mNextRejected = 0;
+    }
+}
+
+FaceAuthTokenFilter::Verdict FaceAuthTokenFilter::check(const uint8_t* token, size_t size, bool needsChallenge,
+        int64_t nowMs) {
+    std::lock_guard<std::mutex> lock(mMutex);
+    Verdict verdict = VALID;
+    hw_auth_token_t hat;
+    if (size != sizeof(hat)) {
+        verdict = BAD_SIZE;
+    } else {
+        memcpy(&hat, token, sizeof(hat));
+        // The timestamp is in network order.
+        int64_t ageMs = nowMs - (int64_t)be64toh(hat.timestamp);
+        if (hat.version != HW_AUTH_TOKEN_VERSION) {
+            verdict = BAD_VERSION;
+        } else if (needsChallenge && mChallenge != 0 && hat.challenge != mChallenge) {
+            verdict = WRONG_CHALLENGE;
+        } else if (mMaxAgeMs > 0 && (ageMs > mMaxAgeMs || ageMs < -mMaxAgeMs)) {
+            verdict = STALE;
+        } else {
+            for (size_t i = 0; i < mRejectedCount; i++) {
+                if (memcmp(mRejected[i], hat.hmac, sizeof(hat.hmac)) == 0) {
+                    verdict = REJECTED_BEFORE;
+                    break;
+                }
+            }
+        }
+    }
+    mVerdicts[verdict]++;
+    if (verdict != VALID) {
+        ALOGE("auth token rejected: %s (%zu bytes)", kVerdictNames[verdict], size);
+    }
+    return verdict;
+}
+
+void FaceAuthTokenFilter::onVendorVerdict(const uint8_t* token, size_t size, bool accepted) {
+    if (accepted || size != sizeof(hw_auth_token_t)) {
+        return;
+    }
+    std::lock_guard<std::mutex> lock(mMutex);
+    mVendorRejected++;
+    memcpy(mRejected[mNextRejected], token + offsetof(hw_auth_token_t, hmac), sizeof(mRejected[0]));
+    mNextRejected = (mNextRejected + 1) % kRejectedSlots;
+    if (mRejectedCount < kRejectedSlots) {
+        mRejectedCount++;
+    }
+}
+
+const char* FaceAuthTokenFilter::verdictName(Verdict verdict) {
+    return verdict < VERDICT_COUNT ? kVerdictNames[verdict] : "unknown";
+}
+
+void FaceAuthTokenFilter::dump(int fd) const {
+    std::lock_guard<std::mutex> lock(mMutex);
+    dprintf(fd, "auth tokens: max_age=%" PRId64 "ms challenge=%d vendor_rejected=%u remembered=%zu\n",
+            mMaxAgeMs, mChallenge != 0, mVendorRejected, mRejectedCount);
+    for (int i = 0; i < VERDICT_COUNT; i++) {
+        dprintf(fd, "  %s=%u\n", kVerdictNames[i], mVerdicts[i]);
+    }
+}
+
+}  // namespace implementation
+}  // namespace V1_0
+}  // namespace face
+}  // namespace hardware
+}  // namespace sprd
+}  // namespace vendor
@@ -0,0 +1,76 @@
+// FIXME: your file license if you have one
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <hardware/hw_auth_token.h>
+#include <mutex>
+
+namespace vendor {
+namespace sprd {
+namespace hardware {
+namespace face {
+namespace V1_0 {
+namespace implementation {
+
+// Screens the hardware auth tokens of enroll(), setFeature() and
+// resetLockout() before they go to the vendor library. The service can't
+// check the HMAC, only the vendor's TEE holds the key, but it can turn
+// away what is malformed, signed for another challenge, out of date, or
+// was already rejected by the vendor, without a vendor round trip.
+//
+// The HMACs the vendor rejected are remembered for the outstanding
+// challenge only; a new challenge starts over. Only calls whose other
+// arguments the service knows to be good report what the vendor made of a
+// token: enroll and resetLockout, not setFeature, which the vendor also
+// fails for an unknown face id.
+class FaceAuthTokenFilter {
+public:
+    enum Verdict {
+        VALID,
+        BAD_SIZE,
+        BAD_VERSION,
+        WRONG_CHALLENGE,
+        STALE,
+        REJECTED_BEFORE,
+        VERDICT_COUNT,
+    };
+
+    FaceAuthTokenFilter();
+
+    // 0 accepts a token of any age.
+    void setMaxAgeMs(int64_t maxAgeMs);
+    // The challenge generateChallenge() handed out, 0 once revoked.
+    void setChallenge(uint64_t challenge);
+
+    // |nowMs| is CLOCK_BOOTTIME. The token is stamped by the TEE, whose
+    // clock only matches it on some devices; the age check is off unless
+    // a maximum age was set. With no challenge outstanding the vendor
+    // decides about the token's.
+    Verdict check(const uint8_t* token, size_t size, bool needsChallenge, int64_t nowMs);
+    // What the vendor made of a token that passed check().
+    void onVendorVerdict(const uint8_t* token, size_t size, bool accepted);
+
+    static const char* verdictName(Verdict verdict);
+    void dump(int fd) const;
+
+private:
+    static const size_t kRejectedSlots = 4;
+
+    mutable std::mutex mMutex;
+    int64_t mMaxAgeMs;
+    uint64_t mChallenge;
+    uint8_t mRejected[kRejectedSlots][sizeof(((hw_auth_token_t*)nullptr)->hmac)];
+    size_t mRejectedCount;
+    size_t mNextRejected;
+    uint32_t mVerdicts[VERDICT_COUNT];
+    uint32_t mVendorRejected;
+};
+
+}  // namespace implementation
+}  // namespace V1_0
+}  // namespace face
+}  // namespace hardware
+}  // namespace sprd
+}  // namespace vendor
@@ -0,0 +1,206 @@
+// FIXME: your file license if you have one
+
+#define LOG_TAG "vendor.sprd.hardware.face@1.0-service"
+
+#include <log/log.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <stddef.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#include <zlib.h>
+#include "FaceCapture.h"
+#include "FaceStats.h"
+
+namespace vendor {
+namespace sprd {
+namespace hardware {
+namespace face {
+namespace V1_0 {
+namespace implementation {
+
+static const uint32_t kCaptureMagic = 0x50434653; // "SFCP"
+static const uint32_t kCaptureVersion = 1;
+
+static size_t payloadSize(size_t infoCount, size_t byteInfoCount, size_t frameSize) {
+    return infoCount * sizeof(int32_t) + byteInfoCount + frameSize;
+}
+
+static uint32_t recordCrc(const FaceCaptureRecord& record, const void* payload[3], const size_t sizes[3]) {
+    uLong crc = crc32(0L, reinterpret_cast<const Bytef*>(&record), offsetof(FaceCaptureRecord, crc));
+    for (int i = 0; i < 3; i++) {
+        if (sizes[i] > 0) {
+            crc = crc32(crc, reinterpret_cast<const Bytef*>(payload[i]), sizes[i]);
+        }
+    }
+    return (uint32_t)crc;
+}
+
+FaceCaptureWriter::FaceCaptureWriter()
+        : mOpen(false), mFd(-1), mLastUs(0), mBytes(0), mMaxBytes(0) {}
+
+FaceCaptureWriter::~FaceCaptureWriter() {
+    close();
+}
+
+bool FaceCaptureWriter::open(const std::string& path, int64_t maxBytes) {
+    std::lock_guard<std::mutex> lock(mMutex);
+    if (mFd >= 0) {
+        return true;
+    }
+    int fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+    if (fd < 0) {
+        ALOGE("can't create capture %s: %s", path.c_str(), strerror(errno));
+        return false;
+    }
+    FaceCaptureFileHeader header = {
+        kCaptureMagic, kCaptureVersion, sizeof(FaceCaptureFileHeader),
+        sizeof(FaceCaptureRecord), bootTimeUs() };
+    if (write(fd, &header, sizeof(header)) != sizeof(header)) {
+        ALOGE("can't write capture header: %s", strerror(errno));
+        ::close(fd);
+        return false;
+    }
+    mFd = fd;
+    mLastUs = monotonicUs();
+    mBytes = sizeof(header);
+    mMaxBytes = maxBytes;
+    mOpen = true;
+    ALOGD("recording to %s", path.c_str());
+    return true;
+}
+
+void FaceCaptureWriter::close() {
+    std::lock_guard<std::mutex> lock(mMutex);
+    if (mFd < 0) {
+        return;
+    }
+    mOpen = false;
+    ::close(mFd);
+    mFd = -1;
+    ALOGD("recording stopped after %" PRId64 " bytes", mBytes);
+}
+
+void FaceCaptureWriter::append(uint32_t type, const int64_t args[4], const int32_t* info, size_t infoCount,
+        const int8_t* byteInfo, size_t byteInfoCount, const void* frame, size_t frameSize) {
+    std::lock_guard<std::mutex> lock(mMutex);
+    if (mFd < 0) {
+        return;
+    }
+    size_t unpadded = sizeof(FaceCaptureRecord) + payloadSize(infoCount, byteInfoCount, frameSize);
+    size_t size = (unpadded + 7) & ~(size_t)7;
+    if (mMaxBytes > 0 && mBytes + (int64_t)size > mMaxBytes) {
+        ALOGE("capture reached %" PRId64 " bytes, stopping", mMaxBytes);
+        mOpen = false;
+        ::close(mFd);
+        mFd = -1;
+        return;
+    }
+
+    int64_t now = monotonicUs();
+    FaceCaptureRecord record;
+    memset(&record, 0, sizeof(record));
+    record.type = type;
+    record.size = (uint32_t)size;
+    record.deltaUs = now - mLastUs;
+    if (args != nullptr) {
+        memcpy(record.args, args, sizeof(record.args));
+    }
+    record.infoCount = (uint32_t)infoCount;
+    record.byteInfoCount = (uint32_t)byteInfoCount;
+    record.frameSize = (uint32_t)frameSize;
+    const void* payload[3] = { info, byteInfo, frame };
+    const size_t sizes[3] = { infoCount * sizeof(int32_t), byteInfoCount, frameSize };
+    record.crc = recordCrc(record, payload, sizes);
+    mLastUs = now;
+
+    static const uint8_t kPadding[8] = {};
+    struct iovec iov[5] = {
+        { &record, sizeof(record) },
+        { const_cast<void*>(payload[0]), sizes[0] },
+        { const_cast<void*>(payload[1]), sizes[1] },
+        { const_cast<void*>(payload[2]), sizes[2] },
+        { const_cast<uint8_t*>(kPadding), size - unpadded },
+    };
+    ssize_t written = writev(mFd, iov, 5);
+    if (written != (ssize_t)size) {
+        ALOGE("capture write failed, stopping: %s", strerror(errno));
+        mOpen = false;
+        ::close(mFd);
+        mFd = -1;
+        return;
+    }
+    mBytes += size;
+}
+
+FaceCaptureReader::FaceCaptureReader()
+        : mBase(MAP_FAILED), mSize(0), mOffset(0), mHeader(nullptr) {}
+
+FaceCaptureReader::~FaceCaptureReader() {
+    if (mBase != MAP_FAILED) {
+        munmap(mBase, mSize);
+    }
+}
+
+bool FaceCaptureReader::open(const std::string& path) {
+    int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        ALOGE("can't open capture %s: %s", path.c_str(), strerror(errno));
+        return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(FaceCaptureFileHeader)) {
+        ALOGE("capture %s is too short", path.c_str());
+        ::close(fd);
+        return false;
+    }
+    mSize = st.st_size;
+    mBase = mmap(nullptr, mSize, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (mBase == MAP_FAILED) {
+        ALOGE("can't map capture %s: %s", path.c_str(), strerror(errno));
+        return false;
+    }
+    madvise(mBase, mSize, MADV_SEQUENTIAL);
+    mHeader = reinterpret_cast<const FaceCaptureFileHeader*>(mBase);
+    if (mHeader->magic != kCaptureMagic || mHeader->version != kCaptureVersion ||
+            mHeader->recordHeaderSize != sizeof(FaceCaptureRecord) || mHeader->headerSize > mSize) {
+        ALOGE("%s is not a face capture", path.c_str());
+        mHeader = nullptr;
+        return false;
+    }
+    mOffset = mHeader->headerSize;
+    return true;
+}
+
+const FaceCaptureRecord* FaceCaptureReader::next() {
+    if (mHeader == nullptr || mSize - mOffset < sizeof(FaceCaptureRecord)) {
+        return nullptr;
+    }
+    const FaceCaptureRecord* record = reinterpret_cast<const FaceCaptureRecord*>(
+            static_cast<const uint8_t*>(mBase) + mOffset);
+    size_t needed = sizeof(FaceCaptureRecord) +
+            payloadSize(record->infoCount, record->byteInfoCount, record->frameSize);
+    if (record->size < needed || record->size > mSize - mOffset) {
+        return nullptr;
+    }
+    const void* payload[3] = { record->info(), record->byteInfo(), record->frame() };
+    const size_t sizes[3] = { record->infoCount * sizeof(int32_t), record->byteInfoCount, record->frameSize };
+    if (recordCrc(*record, payload, sizes) != record->crc) {
+        ALOGE("damaged capture record at offset %zu", mOffset);
+        return nullptr;
+    }
+    mOffset += record->size;
+    return record;
+}
+
+}  // namespace implementation
+}  // namespace V1_0
+}  // namespace face
+}  // namespace hardware
+}  // namespace sprd
+}  // namespace vendor
@@ -0,0 +1,105 @@
+// FIXME: your file license if you have one
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <atomic>
+#include <mutex>
+#include <string>
+
+namespace vendor {
+namespace sprd {
+namespace hardware {
+namespace face {
+namespace V1_0 {
+namespace implementation {
+
+// Capture of the requests of enroll and authenticate sessions, replayed by
+// face_replay. The file is only ever appended to while recording and is
+// read back through a mapping.
+struct FaceCaptureFileHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t headerSize;
+    uint32_t recordHeaderSize;
+    int64_t startBootUs;
+};
+
+enum {
+    CAPTURE_ENROLL = 1,         // args[0] timeoutSec, info disabled features, byteInfo HAT
+    CAPTURE_AUTHENTICATE,       // args[0] operationId
+    CAPTURE_ENROLL_FRAME,       // args[0] addr
+    CAPTURE_AUTHENTICATE_FRAME, // args[0..2] main, sub, otp
+    CAPTURE_CANCEL,
+};
+
+// Records follow each other, each padded to 8 bytes, so a capture cut
+// short by a crash is readable up to its last complete record. The
+// payload is the info values, then the byteInfo values, then the frame.
+struct FaceCaptureRecord {
+    uint32_t type;
+    uint32_t size; // whole record, padding included
+    int64_t deltaUs; // since the previous record
+    int64_t args[4];
+    uint32_t infoCount;
+    uint32_t byteInfoCount;
+    uint32_t frameSize; // 0 when the frame contents were not captured
+    uint32_t crc; // crc32 of the record header up to this field and the payload
+
+    const int32_t* info() const {
+        return reinterpret_cast<const int32_t*>(this + 1);
+    }
+    const int8_t* byteInfo() const {
+        return reinterpret_cast<const int8_t*>(info() + infoCount);
+    }
+    const uint8_t* frame() const {
+        return reinterpret_cast<const uint8_t*>(byteInfo() + byteInfoCount);
+    }
+};
+
+class FaceCaptureWriter {
+public:
+    FaceCaptureWriter();
+    ~FaceCaptureWriter();
+
+    bool open(const std::string& path, int64_t maxBytes);
+    void close();
+    bool isOpen() const { return mOpen.load(std::memory_order_relaxed); }
+
+    // Safe to call from any binder thread.
+    void append(uint32_t type, const int64_t args[4], const int32_t* info, size_t infoCount,
+            const int8_t* byteInfo, size_t byteInfoCount, const void* frame, size_t frameSize);
+
+private:
+    std::mutex mMutex;
+    std::atomic<bool> mOpen;
+    int mFd;
+    int64_t mLastUs;
+    int64_t mBytes;
+    int64_t mMaxBytes;
+};
+
+class FaceCaptureReader {
+public:
+    FaceCaptureReader();
+    ~FaceCaptureReader();
+
+    bool open(const std::string& path);
+    const FaceCaptureFileHeader* header() const { return mHeader; }
+    // Returns nullptr at the end of the capture or at the first damaged record.
+    const FaceCaptureRecord* next();
+
+private:
+    void* mBase;
+    size_t mSize;
+    size_t mOffset;
+    const FaceCaptureFileHeader* mHeader;
+};
+
+}  // namespace implementation
+}  // namespace V1_0
+}  // namespace face
+}  // namespace hardware
+}  // namespace sprd
+}  // namespace vendor
@@ -0,0 +1,163 @@
+// FIXME: your file license if you have one
+
+#include <inttypes.h>
+#include <stdio.h>
+#include "FaceClients.h"
+
+namespace vendor {
+namespace sprd {
+namespace hardware {
+namespace face {
+namespace V1_0 {
+namespace implementation {
+
+FaceClient::FaceClient(uint32_t id, pid_t pid)
+        : id(id), pid(pid), flags(0), session(0), sessions(0), preempted(0), parked(0), parkedUs(0),
+          deviceUs(0), frames(0), frameUs(0), rejectedFrames(0) {}
+
+void FaceClient::inherit(const FaceClient& other) {
+    session = other.session.load();
+    sessions = other.sessions.load();
+    preempted = other.preempted.load();
+    parked = other.parked.load();
+    parkedUs = other.parkedUs.load();
+    deviceUs = other.deviceUs.load();
+    frames = other.frames.load();
+    frameUs = other.frameUs.load();
+    rejectedFrames = other.rejectedFrames.load();
+}
+
+FaceClientRegistry::FaceClientRegistry()
+        : mClients(std::make_shared<const ClientList>()), mNextId(kNoClient + 1), mLatestId(kNoClient), mDied(0) {}
+
+void FaceClientRegistry::publish(ClientList* clients) {
+    std::atomic_store(&mClients, std::shared_ptr<const ClientList>(
+            std::make_shared<const ClientList>(std::move(*clients))));
+}
+
+std::shared_ptr<FaceClient> FaceClientRegistry::add(pid_t pid, const std::shared_ptr<FaceClientCallback>& callback,
+        uint32_t flags, std::shared_ptr<FaceClient>* replaced) {
+    std::lock_guard<std::mutex> lock(mMutex);
+    replaced->reset();
+    std::shared_ptr<const ClientList> current = load();
+    ClientList clients;
+    for (auto& c : *current) {
+        if (c->pid == pid) {
+            *replaced = c;
+        } else {
+            clients.push_back(c);
+        }
+    }
+    // Keeping the id keeps the sessions and requests it has in flight.
+    std::shared_ptr<FaceClient> client = std::make_shared<FaceClient>(
+            *replaced != nullptr ? (*replaced)->id : mNextId++, pid);
+    if (*replaced != nullptr) {
+        client->inherit(**replaced);
+    }
+    client->callback = callback;
+    client->flags = flags;
+    clients.push_back(client);
+    publish(&clients);
+    mLatestId = client->id;
+    return client;
+}
+
+std::shared_ptr<FaceClient> FaceClientRegistry::remove(uint32_t id) {
+    std::lock_guard<std::mutex> lock(mMutex);
+    std::shared_ptr<FaceClient> removed;
+    std::shared_ptr<const ClientList> current = load();
+    ClientList clients;
+    for (auto& c : *current) {
+        if (c->id == id) {
+            removed = c;
+        } else {
+            clients.push_back(c);
+        }
+    }
+    if (removed == nullptr) {
+        return nullptr;
+    }
+    mDied++;
+    // The latest registration that is still alive takes over.
+    mLatestId = clients.empty() ? kNoClient : clients.back()->id;
+    publish(&clients);
+    return removed;
+}
+
+std::shared_ptr<FaceClient> FaceClientRegistry::find(pid_t pid) const {
+    std::shared_ptr<const ClientList> clients = load();
+    uint32_t latestId = mLatestId;
+    std::shared_ptr<FaceClient> latest;
+    for (auto& c : *clients) {
+        if (c->pid == pid) {
+            return c;
+        }
+        if (c->id == latestId) {
+            latest = c;
+        }
+    }
+    return latest;
+}
+
+std::shared_ptr<FaceClient> FaceClientRegistry::latest() const {
+    return get(mLatestId);
+}
+
+// The list is in the order of registration.
+std::shared_ptr<FaceClient> FaceClientRegistry::latestWith(uint32_t flag) const {
+    std::shared_ptr<const ClientList> clients = load();
+    for (auto it = clients->rbegin(); it != clients->rend(); ++it) {
+        if ((*it)->has(flag)) {
+            return *it;
+        }
+    }
+    return nullptr;
+}
+
+std::shared_ptr<FaceClient> FaceClientRegistry::get(uint32_t id) const {
+    if (id == kNoClient) {
+        return nullptr;
+    }
+    std::shared_ptr<const ClientList> clients = load();
+    for (auto& c : *clients) {
+        if (c->id == id) {
+            return c;
+        }
+    }
+    return nullptr;
+}
+
+std::shared_ptr<const std::vector<std::shared_ptr<FaceClient>>> FaceClientRegistry::all() const {
+    return load();
+}
+
+static int64_t average(int64_t total, uint32_t count) {
+    return count > 0 ? total / count : 0;
+}
+
+void FaceClientRegistry::dump(int fd) const {
+    std::shared_ptr<const ClientList> clients = load();
+    uint32_t latestId = mLatestId;
+    dprintf(fd, "clients: %zu died=%u\n", clients->size(), mDied.load(std::memory_order_relaxed));
+    for (auto& c : *clients) {
+        uint32_t frames = c->frames.load(std::memory_order_relaxed);
+        uint32_t parked = c->parked.load(std::memory_order_relaxed);
+        int64_t deviceUs = c->deviceUs.load(std::memory_order_relaxed);
+        dprintf(fd, "  #%u pid=%d%s sessions=%u preempted=%u parked=%u avg=%" PRId64 "us device=%" PRId64
+                "ms frames=%u (%.1f/s) avg=%" PRId64 "us rejected=%u\n",
+                c->id, c->pid, c->id == latestId ? " latest" : "",
+                c->sessions.load(std::memory_order_relaxed),
+                c->preempted.load(std::memory_order_relaxed), parked,
+                average(c->parkedUs.load(std::memory_order_relaxed), parked), deviceUs / 1000,
+                frames, deviceUs > 0 ? frames * 1e6 / deviceUs : 0.0,
+                average(c->frameUs.load(std::memory_order_relaxed), frames),
+                c->rejectedFrames.load(std::memory_order_relaxed));
+    }
+}
+
+}  // namespace implementation
+}  // namespace V1_0
+}  // namespace face
+}  // namespace hardware
+}  // namespace sprd
+}  // namespace vendor
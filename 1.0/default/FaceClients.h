@@ -0,0 +1,125 @@
+// FIXME: your file license if you have one
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include "FaceSession.h"
+
+namespace vendor {
+namespace sprd {
+namespace hardware {
+namespace face {
+namespace V1_0 {
+namespace implementation {
+
+// What the service tells a client, in face.h codes; each front end turns
+// them into the calls of its own client callback.
+class FaceClientCallback {
+public:
+    virtual ~FaceClientCallback() {}
+
+    virtual void onEnrollResult(uint32_t faceId, int32_t userId, uint32_t remaining) = 0;
+    // |token| is only valid during the call; a rejection has none.
+    virtual void onAuthenticated(uint32_t faceId, int32_t userId, const uint8_t* token, size_t size) = 0;
+    virtual void onAcquired(int32_t userId, int32_t acquired) = 0;
+    virtual void onError(int32_t userId, int32_t error) = 0;
+    virtual void onRemoved(const uint32_t* faceIds, size_t count, int32_t userId) = 0;
+    virtual void onEnumerate(const uint32_t* faceIds, size_t count, int32_t userId) = 0;
+    virtual void onLockoutChanged(uint64_t durationMs) = 0;
+    // Hand a frame buffer back, only to clients with CLIENT_FRAMES.
+    virtual void onEnrollProcessed(int64_t addr) = 0;
+    virtual void onAuthProcessed(int64_t main, int64_t sub) = 0;
+    // Only to clients with CLIENT_FRAME_RATE.
+    virtual void onRecommendedFrameRate(uint32_t fps) = 0;
+};
+
+// What a client can take besides the session events.
+enum {
+    // Submits frames and takes their buffers back. The sessions of a client
+    // without it run on the frames of the clients with it.
+    CLIENT_FRAMES = 1 << 0,
+    // Is told the frame rate to deliver at.
+    CLIENT_FRAME_RATE = 1 << 1,
+};
+
+// One process that registered a callback. Its sessions, frames and the
+// events they cause are kept apart from the other clients'.
+struct FaceClient {
+    FaceClient(uint32_t id, pid_t pid);
+
+    // Carries the counters over from the client this one replaces.
+    void inherit(const FaceClient& other);
+
+    bool has(uint32_t flag) const { return (flags & flag) != 0; }
+
+    const uint32_t id;
+    const pid_t pid;
+    // Never change once the client is published; a new registration of
+    // the same process is a new client object with the same id.
+    std::shared_ptr<FaceClientCallback> callback;
+    uint32_t flags;
+    // Trace session id of the last enroll or authenticate it asked for;
+    // its frames are tagged with it.
+    std::atomic<uint32_t> session;
+
+    std::atomic<uint32_t> sessions;
+    std::atomic<uint32_t> preempted;
+    std::atomic<uint32_t> parked;
+    std::atomic<int64_t> parkedUs;
+    std::atomic<int64_t> deviceUs;
+    std::atomic<uint32_t> frames;
+    std::atomic<int64_t> frameUs;
+    std::atomic<uint32_t> rejectedFrames;
+};
+
+// Clients by calling process. A process registering again replaces its
+// client, as setCallback() always replaced the callback; other processes
+// are added.
+//
+// Lookups never lock: writers publish a new copy of the client list and
+// readers keep whichever copy they loaded, so a callback stays valid
+// while it is being called even if its client goes away meanwhile.
+class FaceClientRegistry {
+public:
+    FaceClientRegistry();
+
+    // Returns the new client and, in |replaced|, the one it took over from.
+    std::shared_ptr<FaceClient> add(pid_t pid, const std::shared_ptr<FaceClientCallback>& callback,
+            uint32_t flags, std::shared_ptr<FaceClient>* replaced);
+    std::shared_ptr<FaceClient> remove(uint32_t id);
+    // The client of |pid|, or the last one registered for callers that
+    // never did themselves.
+    std::shared_ptr<FaceClient> find(pid_t pid) const;
+    std::shared_ptr<FaceClient> latest() const;
+    // The last one registered with |flag|.
+    std::shared_ptr<FaceClient> latestWith(uint32_t flag) const;
+    std::shared_ptr<FaceClient> get(uint32_t id) const;
+    std::shared_ptr<const std::vector<std::shared_ptr<FaceClient>>> all() const;
+    void dump(int fd) const;
+
+private:
+    typedef std::vector<std::shared_ptr<FaceClient>> ClientList;
+
+    std::shared_ptr<const ClientList> load() const { return std::atomic_load(&mClients); }
+    void publish(ClientList* clients);
+
+    // Serializes writers only.
+    std::mutex mMutex;
+    std::shared_ptr<const ClientList> mClients;
+    uint32_t mNextId;
+    std::atomic<uint32_t> mLatestId;
+    std::atomic<uint32_t> mDied;
+};
+
+}  // namespace implementation
+}  // namespace V1_0
+}  // namespace face
+}  // namespace hardware
+}  // namespace sprd
+}  // namespace vendor
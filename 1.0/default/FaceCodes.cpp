@@ -0,0 +1,200 @@
+// FIXME: your file license if you have one
+
+#define LOG_TAG "vendor.sprd.hardware.face@1.0-service"
+
+#include <log/log.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include "FaceCodes.h"
+#include "FaceService.h"
+
+namespace vendor {
+namespace sprd {
+namespace hardware {
+namespace face {
+namespace V1_0 {
+namespace implementation {
+
+using namespace facecodes;
+
+static constexpr FaceCodeEntry<Status> kStatusEntries[] = {
+    { FACE_OK, Status::OK },
+    { FACE_ILLEGAL_ARGUMENT, Status::ILLEGAL_ARGUMENT },
+    { FACE_OPERATION_NOT_SUPPORTED, Status::OPERATION_NOT_SUPPORTED },
+    { FACE_NOT_ENROLLED, Status::NOT_ENROLLED },
+};
+
+static constexpr FaceCodeEntry<FaceError> kErrorEntries[] = {
+    { FACE_ERROR_HW_UNAVAILABLE, FaceError::HW_UNAVAILABLE },
+    { FACE_ERROR_UNABLE_TO_PROCESS, FaceError::UNABLE_TO_PROCESS },
+    { FACE_ERROR_TIMEOUT, FaceError::TIMEOUT },
+    { FACE_ERROR_NO_SPACE, FaceError::NO_SPACE },
+    { FACE_ERROR_CANCELED, FaceError::CANCELED },
+    { FACE_ERROR_UNABLE_TO_REMOVE, FaceError::UNABLE_TO_REMOVE },
+    { FACE_ERROR_LOCKOUT, FaceError::LOCKOUT },
+    { FACE_ERROR_LOCKOUT_PERMANENT, FaceError::LOCKOUT_PERMANENT },
+};
+
+static constexpr FaceCodeEntry<FaceAcquiredInfo> kAcquiredEntries[] = {
+    { FACE_ACQUIRED_GOOD, FaceAcquiredInfo::GOOD },
+    { FACE_ACQUIRED_INSUFFICIENT, FaceAcquiredInfo::INSUFFICIENT },
+    { FACE_ACQUIRED_TOO_BRIGHT, FaceAcquiredInfo::TOO_BRIGHT },
+    { FACE_ACQUIRED_TOO_DARK, FaceAcquiredInfo::TOO_DARK },
+    { FACE_ACQUIRED_TOO_CLOSE, FaceAcquiredInfo::TOO_CLOSE },
+    { FACE_ACQUIRED_TOO_FAR, FaceAcquiredInfo::TOO_FAR },
+    { FACE_ACQUIRED_FACE_TOO_HIGH, FaceAcquiredInfo::FACE_TOO_HIGH },
+    { FACE_ACQUIRED_FACE_TOO_LOW, FaceAcquiredInfo::FACE_TOO_LOW },
+    { FACE_ACQUIRED_FACE_TOO_RIGHT, FaceAcquiredInfo::FACE_TOO_RIGHT },
+    { FACE_ACQUIRED_FACE_TOO_LEFT, FaceAcquiredInfo::FACE_TOO_LEFT },
+    { FACE_ACQUIRED_POOR_GAZE, FaceAcquiredInfo::POOR_GAZE },
+    { FACE_ACQUIRED_NOT_DETECTED, FaceAcquiredInfo::NOT_DETECTED },
+    { FACE_ACQUIRED_TOO_MUCH_MOTION, FaceAcquiredInfo::TOO_MUCH_MOTION },
+    { FACE_ACQUIRED_RECALIBRATE, FaceAcquiredInfo::RECALIBRATE },
+    { FACE_ACQUIRED_TOO_DIFFERENT, FaceAcquiredInfo::TOO_DIFFERENT },
+    { FACE_ACQUIRED_TOO_SIMILAR, FaceAcquiredInfo::TOO_SIMILAR },
+    { FACE_ACQUIRED_PAN_TOO_EXTREME, FaceAcquiredInfo::PAN_TOO_EXTREME },
+    { FACE_ACQUIRED_TILT_TOO_EXTREME, FaceAcquiredInfo::TILT_TOO_EXTREME },
+    { FACE_ACQUIRED_ROLL_TOO_EXTREME, FaceAcquiredInfo::ROLL_TOO_EXTREME },
+    { FACE_ACQUIRED_FACE_OBSCURED, FaceAcquiredInfo::FACE_OBSCURED },
+    { FACE_ACQUIRED_START, FaceAcquiredInfo::START },
+    { FACE_ACQUIRED_SENSOR_DIRTY, FaceAcquiredInfo::SENSOR_DIRTY },
+};
+
+// A face.h or HIDL update that adds a code fails here until it is mapped.
+static_assert(distinctBelow(kStatusEntries, INT32_MAX), "face.h status listed twice");
+static_assert(covers(kStatusEntries, Status::INTERNAL_ERROR), "HIDL Status without a face.h code");
+static_assert(distinctBelow(kErrorEntries, FACE_ERROR_VENDOR_BASE), "face.h error listed twice or vendor");
+static_assert(covers(kErrorEntries, FaceError::VENDOR), "FaceError without a face.h code");
+static_assert(distinctBelow(kAcquiredEntries, FACE_ACQUIRED_VENDOR_BASE), "face.h acquired listed twice or vendor");
+static_assert(covers(kAcquiredEntries, FaceAcquiredInfo::VENDOR), "FaceAcquiredInfo without a face.h code");
+static_assert(span(kAcquiredEntries) <= 256 && span(kErrorEntries) <= 256 && span(kStatusEntries) <= 256,
+        "face.h codes too sparse for a lookup table");
+static_assert(FACE_ERROR_VERIFY_TOKEN_FAIL >= FACE_ERROR_VENDOR_BASE, "token failures are vendor errors");
+
+static constexpr auto kStatusTable = makeTable<Status, span(kStatusEntries)>(kStatusEntries);
+static constexpr auto kErrorTable = makeTable<FaceError, span(kErrorEntries)>(kErrorEntries);
+static constexpr auto kAcquiredTable = makeTable<FaceAcquiredInfo, span(kAcquiredEntries)>(kAcquiredEntries);
+
+template <typename T>
+static bool parseName(const char* name, int32_t* value) {
+    for (T v : ::android::hardware::hidl_enum_range<T>()) {
+        if (toString(v) == name) {
+            *value = static_cast<int32_t>(v);
+            return true;
+        }
+    }
+    return false;
+}
+
+const int32_t FaceCodeTranslator::kNotRemapped;
+
+FaceCodeTranslator::FaceCodeTranslator()
+        : mErrorRemap(kMaxVendorCodes, kNotRemapped), mAcquiredRemap(kMaxVendorCodes, kNotRemapped),
+          mRemaps(0), mUnmappedStatus(0), mUnmappedErrors(0), mUnmappedAcquired(0), mLastUnmapped(0) {
+    // Keeps its vendor code, as it always did.
+    mErrorRemap[FACE_ERROR_VERIFY_TOKEN_FAIL - FACE_ERROR_VENDOR_BASE] =
+            static_cast<int32_t>(FaceError::UNABLE_TO_PROCESS);
+}
+
+void FaceCodeTranslator::loadRemap(const char* path) {
+    FILE* file = fopen(path, "re");
+    if (file == nullptr) {
+        return;
+    }
+    char line[128];
+    int lineNo = 0;
+    while (fgets(line, sizeof(line), file) != nullptr) {
+        lineNo++;
+        char kind[16];
+        char name[64];
+        int32_t code;
+        if (line[0] == '#' || sscanf(line, "%15s %" SCNd32 " %63s", kind, &code, name) != 3) {
+            continue;
+        }
+        int32_t value;
+        std::vector<int32_t>* remap;
+        int32_t base;
+        if (!strcmp(kind, "error") && parseName<FaceError>(name, &value)) {
+            remap = &mErrorRemap;
+            base = FACE_ERROR_VENDOR_BASE;
+        } else if (!strcmp(kind, "acquired") && parseName<FaceAcquiredInfo>(name, &value)) {
+            remap = &mAcquiredRemap;
+            base = FACE_ACQUIRED_VENDOR_BASE;
+        } else {
+            ALOGE("%s:%d: unknown kind or name", path, lineNo);
+            continue;
+        }
+        if (code < base || (size_t)(code - base) >= kMaxVendorCodes) {
+            ALOGE("%s:%d: %d is not a vendor code", path, lineNo, code);
+            continue;
+        }
+        (*remap)[code - base] = value;
+        mRemaps++;
+    }
+    fclose(file);
+    ALOGD("%u vendor codes remapped by %s", mRemaps, path);
+}
+
+Status FaceCodeTranslator::status(int32_t code) {
+    Status value;
+    if (kStatusTable.lookup(code, &value)) {
+        return value;
+    }
+    if (code == kFaceInternalError) {
+        return Status::INTERNAL_ERROR; // the vendor was never asked
+    }
+    mUnmappedStatus++;
+    mLastUnmapped = code;
+    return Status::INTERNAL_ERROR;
+}
+
+FaceError FaceCodeTranslator::error(int32_t code, int32_t* vendorCode) {
+    *vendorCode = 0;
+    FaceError value;
+    if (kErrorTable.lookup(code, &value)) {
+        return value;
+    }
+    if (code >= FACE_ERROR_VENDOR_BASE) {
+        *vendorCode = code - FACE_ERROR_VENDOR_BASE;
+        if ((size_t)*vendorCode < kMaxVendorCodes && mErrorRemap[*vendorCode] != kNotRemapped) {
+            return static_cast<FaceError>(mErrorRemap[*vendorCode]);
+        }
+        return FaceError::VENDOR;
+    }
+    mUnmappedErrors++;
+    mLastUnmapped = code;
+    return FaceError::UNABLE_TO_PROCESS;
+}
+
+FaceAcquiredInfo FaceCodeTranslator::acquired(int32_t code, int32_t* vendorCode) {
+    *vendorCode = 0;
+    FaceAcquiredInfo value;
+    if (kAcquiredTable.lookup(code, &value)) {
+        return value;
+    }
+    if (code >= FACE_ACQUIRED_VENDOR_BASE) {
+        *vendorCode = code - FACE_ACQUIRED_VENDOR_BASE;
+        if ((size_t)*vendorCode < kMaxVendorCodes && mAcquiredRemap[*vendorCode] != kNotRemapped) {
+            return static_cast<FaceAcquiredInfo>(mAcquiredRemap[*vendorCode]);
+        }
+        return FaceAcquiredInfo::VENDOR;
+    }
+    mUnmappedAcquired++;
+    mLastUnmapped = code;
+    return FaceAcquiredInfo::INSUFFICIENT;
+}
+
+void FaceCodeTranslator::dump(int fd) const {
+    dprintf(fd, "vendor codes: remapped=%u unmapped status=%u error=%u acquired=%u last=%d\n", mRemaps,
+            mUnmappedStatus.load(std::memory_order_relaxed), mUnmappedErrors.load(std::memory_order_relaxed),
+            mUnmappedAcquired.load(std::memory_order_relaxed), mLastUnmapped.load(std::memory_order_relaxed));
+}
+
+}  // namespace implementation
+}  // namespace V1_0
+}  // namespace face
+}  // namespace hardware
+}  // namespace sprd
+}  // namespace vendor
@@ -0,0 +1,151 @@
+// FIXME: your file license if you have one
+
+#pragma once
+
+#include <hardware/face.h>
+#include <hidl/HidlSupport.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <android/hardware/biometrics/face/1.0/types.h>
+#include <atomic>
+#include <vector>
+
+namespace vendor {
+namespace sprd {
+namespace hardware {
+namespace face {
+namespace V1_0 {
+namespace implementation {
+
+using ::android::hardware::biometrics::face::V1_0::FaceAcquiredInfo;
+using ::android::hardware::biometrics::face::V1_0::FaceError;
+using ::android::hardware::biometrics::face::V1_0::Status;
+
+// A face.h code and the HIDL value it stands for.
+template <typename T>
+struct FaceCodeEntry {
+    int32_t code;
+    T value;
+};
+
+// Dense lookup table over the span of face.h codes it was built from.
+template <typename T, size_t N>
+struct FaceCodeTable {
+    int32_t minCode;
+    T values[N];
+    bool mapped[N];
+
+    bool lookup(int32_t code, T* value) const {
+        uint32_t i = (uint32_t)(code - minCode);
+        if (i >= N || !mapped[i]) {
+            return false;
+        }
+        *value = values[i];
+        return true;
+    }
+};
+
+namespace facecodes {
+
+template <typename T, size_t Count>
+constexpr int32_t minCode(const FaceCodeEntry<T> (&entries)[Count]) {
+    int32_t min = entries[0].code;
+    for (auto& e : entries) {
+        min = e.code < min ? e.code : min;
+    }
+    return min;
+}
+
+template <typename T, size_t Count>
+constexpr size_t span(const FaceCodeEntry<T> (&entries)[Count]) {
+    int32_t max = entries[0].code;
+    for (auto& e : entries) {
+        max = e.code > max ? e.code : max;
+    }
+    return (size_t)(max - minCode(entries)) + 1;
+}
+
+// No face.h code listed twice, none reaching into the vendor range.
+template <typename T, size_t Count>
+constexpr bool distinctBelow(const FaceCodeEntry<T> (&entries)[Count], int32_t vendorBase) {
+    for (size_t i = 0; i < Count; i++) {
+        if (entries[i].code >= vendorBase) {
+            return false;
+        }
+        for (size_t j = i + 1; j < Count; j++) {
+            if (entries[i].code == entries[j].code) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+// Every HIDL value but |except| is what some face.h code stands for.
+template <typename T, size_t Count>
+constexpr bool covers(const FaceCodeEntry<T> (&entries)[Count], T except) {
+    for (T value : ::android::hardware::hidl_enum_range<T>()) {
+        bool found = value == except;
+        for (auto& e : entries) {
+            found = found || e.value == value;
+        }
+        if (!found) {
+            return false;
+        }
+    }
+    return true;
+}
+
+template <typename T, size_t N, size_t Count>
+constexpr FaceCodeTable<T, N> makeTable(const FaceCodeEntry<T> (&entries)[Count]) {
+    FaceCodeTable<T, N> table = {};
+    table.minCode = minCode(entries);
+    for (auto& e : entries) {
+        table.values[e.code - table.minCode] = e.value;
+        table.mapped[e.code - table.minCode] = true;
+    }
+    return table;
+}
+
+}  // namespace facecodes
+
+// Translates the status, error and acquired codes of the vendor library to
+// HIDL. Standard codes go through tables checked at compile time; codes in
+// the vendor ranges may be remapped per device by a config file, the rest
+// are reported as VENDOR. Codes that map to nothing are counted for
+// debug() instead of logged, the acquired path runs for every frame.
+class FaceCodeTranslator {
+public:
+    FaceCodeTranslator();
+
+    // Reads "<error|acquired> <vendor code> <HIDL name>" lines, e.g.
+    //     acquired 1003 TOO_DARK
+    // A missing file leaves the built-in mapping.
+    void loadRemap(const char* path);
+
+    Status status(int32_t code);
+    FaceError error(int32_t code, int32_t* vendorCode);
+    FaceAcquiredInfo acquired(int32_t code, int32_t* vendorCode);
+
+    void dump(int fd) const;
+
+private:
+    // Vendor codes past this offset from the vendor base can't be remapped.
+    static const size_t kMaxVendorCodes = 256;
+    static const int32_t kNotRemapped = -1;
+
+    std::vector<int32_t> mErrorRemap;
+    std::vector<int32_t> mAcquiredRemap;
+    uint32_t mRemaps;
+    std::atomic<uint32_t> mUnmappedStatus;
+    std::atomic<uint32_t> mUnmappedErrors;
+    std::atomic<uint32_t> mUnmappedAcquired;
+    std::atomic<int32_t> mLastUnmapped;
+};
+
+}  // namespace implementation
+}  // namespace V1_0
+}  // namespace face
+}  // namespace hardware
+}  // namespace sprd
+}  // namespace vendor
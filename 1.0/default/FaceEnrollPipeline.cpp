@@ -0,0 +1,130 @@
+// FIXME: your file license if you have one
+
+#include <pthread.h>
+#include <stdio.h>
+#include <utility>
+#include "FaceEnrollPipeline.h"
+#include "FaceStats.h"
+
+namespace vendor {
+namespace sprd {
+namespace hardware {
+namespace face {
+namespace V1_0 {
+namespace implementation {
+
+// Yaw and pitch, in degrees, beyond which a frame leaves the center bin.
+static const int32_t kYawEdge = 10;
+static const int32_t kPitchEdge = 8;
+
+static int binOf(int32_t angle, int32_t edge) {
+    return angle < -edge ? 0 : angle > edge ? 2 : 1;
+}
+
+void FaceEnrollCoverage::reset() {
+    for (auto& frames : mFrames) {
+        frames.store(0, std::memory_order_relaxed);
+    }
+}
+
+bool FaceEnrollCoverage::add(const FaceEnrollQuality& quality) {
+    int bin = binOf(quality.pitch, kPitchEdge) * 3 + binOf(quality.yaw, kYawEdge);
+    return mFrames[bin].fetch_add(1, std::memory_order_relaxed) == 0;
+}
+
+int FaceEnrollCoverage::coveredBins() const {
+    int covered = 0;
+    for (auto& frames : mFrames) {
+        if (frames.load(std::memory_order_relaxed) > 0) {
+            covered++;
+        }
+    }
+    return covered;
+}
+
+void FaceEnrollCoverage::dump(int fd) const {
+    dprintf(fd, "  coverage %d/%d (frames per bin, up/center/down rows, left to right):", coveredBins(), kBins);
+    for (int i = 0; i < kBins; i++) {
+        dprintf(fd, "%s%u", i % 3 ? " " : "  ", mFrames[i].load(std::memory_order_relaxed));
+    }
+    dprintf(fd, "\n");
+}
+
+FaceEnrollPipeline::FaceEnrollPipeline(ExtractCallback extract)
+        : mExtract(extract), mQualities(), mPushedUs(), mHead(0), mCount(0), mExtracting(false),
+          mExiting(false) {}
+
+FaceEnrollPipeline::~FaceEnrollPipeline() {
+    if (mThread.joinable()) {
+        {
+            std::lock_guard<std::mutex> lock(mMutex);
+            mExiting = true;
+        }
+        mCondition.notify_all();
+        mThread.join();
+    }
+}
+
+void FaceEnrollPipeline::start() {
+    mThread = std::thread(&FaceEnrollPipeline::loop, this);
+}
+
+bool FaceEnrollPipeline::push(FaceRequest& request, const FaceEnrollQuality& quality) {
+    std::lock_guard<std::mutex> lock(mMutex);
+    if (mCount == kDepth) {
+        return false;
+    }
+    size_t i = (mHead + mCount) % kDepth;
+    FaceRequest& frame = mFrames[i];
+    frame.what = request.what;
+    frame.client = request.client;
+    frame.session = request.session;
+    frame.frame = request.frame;
+    frame.postedUs = request.postedUs;
+    for (size_t j = 0; j < sizeof(frame.args) / sizeof(frame.args[0]); j++) {
+        frame.args[j] = request.args[j];
+    }
+    // Swapping keeps the capacity of both vectors in use.
+    std::swap(frame.info, request.info);
+    std::swap(frame.byteInfo, request.byteInfo);
+    mQualities[i] = quality;
+    mPushedUs[i] = monotonicUs();
+    mCount++;
+    mCondition.notify_one();
+    return true;
+}
+
+void FaceEnrollPipeline::drain() {
+    std::unique_lock<std::mutex> lock(mMutex);
+    mDrainedCondition.wait(lock, [this] { return mCount == 0 && !mExtracting; });
+}
+
+void FaceEnrollPipeline::loop() {
+    pthread_setname_np(pthread_self(), "FaceEnrollPipe");
+    std::unique_lock<std::mutex> lock(mMutex);
+    for (;;) {
+        mCondition.wait(lock, [this] { return mExiting || mCount > 0; });
+        if (mExiting) {
+            return;
+        }
+        size_t i = mHead;
+        mExtracting = true;
+        lock.unlock();
+        // The slot stays owned by this thread until mCount drops.
+        mExtract(mFrames[i], mQualities[i], monotonicUs() - mPushedUs[i]);
+        lock.lock();
+        mHead = (mHead + 1) % kDepth;
+        mCount--;
+        mExtracting = false;
+        if (mCount == 0) {
+            mDrainedCondition.notify_all();
+        }
+    }
+}
+
+}  // namespace implementation
+}  // namespace V1_0
+}  // namespace face
+}  // namespace hardware
+}  // namespace sprd
+}  // namespace vendor
@@ -0,0 +1,95 @@
+// FIXME: your file license if you have one
+
+#pragma once
+
+#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include "FaceRequestQueue.h"
+
+namespace vendor {
+namespace sprd {
+namespace hardware {
+namespace face {
+namespace V1_0 {
+namespace implementation {
+
+// Filled by face_enroll_check(), laid out for C
+struct FaceEnrollQuality {
+    int32_t yaw;    // degrees, positive turned right
+    int32_t pitch;  // degrees, positive looking up
+    int32_t roll;   // degrees
+    int32_t score;  // 0 to 100
+};
+
+// Pose bins the accepted frames of an enrollment fall in, 3x3 over yaw
+// and pitch, kept as the frames are checked.
+class FaceEnrollCoverage {
+public:
+    static const int kBins = 9;
+
+    FaceEnrollCoverage() { reset(); }
+
+    void reset();
+    // Returns true if the frame is the first one in its bin.
+    bool add(const FaceEnrollQuality& quality);
+    int coveredBins() const;
+    void dump(int fd) const;
+
+private:
+    std::atomic<uint32_t> mFrames[kBins];
+};
+
+// Overlaps the two halves of enrolling a frame: the request thread checks
+// the quality and pose of frame N+1 with face_enroll_check() while this
+// stage extracts the features of frame N with face_enroll_extract(). Only
+// the check ever runs alongside an extraction, every other vendor call
+// waits for drain() first.
+class FaceEnrollPipeline {
+public:
+    typedef std::function<void(FaceRequest& frame, const FaceEnrollQuality& quality,
+            int64_t waitUs)> ExtractCallback;
+
+    explicit FaceEnrollPipeline(ExtractCallback extract);
+    ~FaceEnrollPipeline();
+
+    void start();
+    // The extraction thread, once started.
+    pthread_t nativeThread() { return mThread.native_handle(); }
+    // Takes over a checked frame, swapping its metadata out of |request|.
+    // Returns false if the stage is full.
+    bool push(FaceRequest& request, const FaceEnrollQuality& quality);
+    // Waits until every frame taken over has gone through the callback.
+    void drain();
+
+private:
+    // A frame being extracted and one waiting for it.
+    static const size_t kDepth = 2;
+
+    void loop();
+
+    ExtractCallback mExtract;
+    std::mutex mMutex;
+    std::condition_variable mCondition;
+    std::condition_variable mDrainedCondition;
+    FaceRequest mFrames[kDepth];
+    FaceEnrollQuality mQualities[kDepth];
+    int64_t mPushedUs[kDepth];
+    size_t mHead;
+    size_t mCount;
+    bool mExtracting;
+    bool mExiting;
+    std::thread mThread;
+};
+
+}  // namespace implementation
+}  // namespace V1_0
+}  // namespace face
+}  // namespace hardware
+}  // namespace sprd
+}  // namespace vendor
@@ -0,0 +1,105 @@
+// FIXME: your file license if you have one
+
+#include <cutils/properties.h>
+#include <stdlib.h>
+#include "FaceFrameRate.h"
+
+namespace vendor {
+namespace sprd {
+namespace hardware {
+namespace face {
+namespace V1_0 {
+namespace implementation {
+
+// Highest frame rate recommended to the camera client, 0 disables the feedback
+#define PROP_MAX_FPS "persist.vendor.faceid.max_fps"
+#define DEFAULT_MAX_FPS 30
+// Lowest frame rate recommended to the camera client
+#define PROP_MIN_FPS "persist.vendor.faceid.min_fps"
+#define DEFAULT_MIN_FPS 5
+
+// Weight of a new sample in the moving average, as a shift.
+static const int kAverageShift = 3;
+// Share of the processing capacity recommended, in percent.
+static const int64_t kHeadroomPercent = 90;
+// Smallest change worth a callback, in percent of the last one sent.
+static const uint32_t kHysteresisPercent = 10;
+// Callbacks are sent at most that often within a session.
+static const int64_t kMinUpdateIntervalUs = 500000;
+
+FaceFrameRateController::FaceFrameRateController()
+        : mMinFps(DEFAULT_MIN_FPS), mMaxFps(0), mSentFps(0), mSentUs(0), mAverageUs(0),
+          mRecommendedFps(0), mUpdatesSent(0) {}
+
+void FaceFrameRateController::init() {
+    mMaxFps = (uint32_t)property_get_int32(PROP_MAX_FPS, DEFAULT_MAX_FPS);
+    mMinFps = (uint32_t)property_get_int32(PROP_MIN_FPS, DEFAULT_MIN_FPS);
+    if (mMinFps < 1) {
+        mMinFps = 1;
+    }
+    if (mMinFps > mMaxFps) {
+        mMinFps = mMaxFps;
+    }
+}
+
+uint32_t FaceFrameRateController::onSessionStart(int64_t nowUs) {
+    mSentFps = 0;
+    if (!enabled() || mAverageUs.load(std::memory_order_relaxed) <= 0) {
+        return 0;
+    }
+    uint32_t fps = target(0);
+    mRecommendedFps.store(fps, std::memory_order_relaxed);
+    return send(fps, nowUs);
+}
+
+uint32_t FaceFrameRateController::onFrameProcessed(int64_t latencyUs, size_t queued, int64_t nowUs) {
+    if (!enabled()) {
+        return 0;
+    }
+    int64_t average = mAverageUs.load(std::memory_order_relaxed);
+    average = average <= 0 ? latencyUs : average + ((latencyUs - average) >> kAverageShift);
+    mAverageUs.store(average, std::memory_order_relaxed);
+
+    uint32_t fps = target(queued);
+    mRecommendedFps.store(fps, std::memory_order_relaxed);
+    if (mSentFps != 0) {
+        if (fps == mSentFps || (uint32_t)abs((int)fps - (int)mSentFps) * 100 < mSentFps * kHysteresisPercent) {
+            return 0;
+        }
+        if (nowUs - mSentUs < kMinUpdateIntervalUs) {
+            return 0;
+        }
+    }
+    return send(fps, nowUs);
+}
+
+// Every frame still waiting adds half a processing time of latency to
+// the next ones; lower the rate until the backlog drains.
+uint32_t FaceFrameRateController::target(size_t queued) const {
+    int64_t average = mAverageUs.load(std::memory_order_relaxed);
+    if (average <= 0) {
+        return mMaxFps;
+    }
+    int64_t fps = 1000000 * kHeadroomPercent / 100 * 2 / (average * (2 + (int64_t)queued));
+    if (fps < mMinFps) {
+        return mMinFps;
+    }
+    if (fps > mMaxFps) {
+        return mMaxFps;
+    }
+    return (uint32_t)fps;
+}
+
+uint32_t FaceFrameRateController::send(uint32_t fps, int64_t nowUs) {
+    mSentFps = fps;
+    mSentUs = nowUs;
+    mUpdatesSent.fetch_add(1, std::memory_order_relaxed);
+    return fps;
+}
+
+}  // namespace implementation
+}  // namespace V1_0
+}  // namespace face
+}  // namespace hardware
+}  // namespace sprd
+}  // namespace vendor
@@ -0,0 +1,58 @@
+// FIXME: your file license if you have one
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <atomic>
+
+namespace vendor {
+namespace sprd {
+namespace hardware {
+namespace face {
+namespace V1_0 {
+namespace implementation {
+
+// Recommends the rate the camera client should submit frames at, from a
+// moving average of the vendor processing time and the frames waiting in
+// the queue. Fed on the request thread only; the getters are for debug().
+class FaceFrameRateController {
+public:
+    FaceFrameRateController();
+
+    // Reads the configuration. A maximum of 0 disables the feedback.
+    void init();
+    bool enabled() const { return mMaxFps > 0; }
+
+    // Returns the recommendation to send at the start of a session, 0 if
+    // there is no estimate yet.
+    uint32_t onSessionStart(int64_t nowUs);
+    // Returns the new recommendation once it moved enough to be worth
+    // telling the client, 0 otherwise.
+    uint32_t onFrameProcessed(int64_t latencyUs, size_t queued, int64_t nowUs);
+
+    // The lowest rate ever recommended, 0 when disabled.
+    uint32_t minFps() const { return enabled() ? mMinFps : 0; }
+    uint32_t recommendedFps() const { return mRecommendedFps.load(std::memory_order_relaxed); }
+    int64_t averageLatencyUs() const { return mAverageUs.load(std::memory_order_relaxed); }
+    uint32_t updatesSent() const { return mUpdatesSent.load(std::memory_order_relaxed); }
+
+private:
+    uint32_t target(size_t queued) const;
+    uint32_t send(uint32_t fps, int64_t nowUs);
+
+    uint32_t mMinFps;
+    uint32_t mMaxFps;
+    uint32_t mSentFps;
+    int64_t mSentUs;
+    std::atomic<int64_t> mAverageUs;
+    std::atomic<uint32_t> mRecommendedFps;
+    std::atomic<uint32_t> mUpdatesSent;
+};
+
+}  // namespace implementation
+}  // namespace V1_0
+}  // namespace face
+}  // namespace hardware
+}  // namespace sprd
+}  // namespace vendor
@@ -0,0 +1,163 @@
+// FIXME: your file license if you have one
+
+#define LOG_TAG "vendor.sprd.hardware.face@1.0-service"
+
+#include <log/log.h>
+#include <cutils/properties.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+#include "FaceIdlePolicy.h"
+#include "FaceStats.h"
+
+namespace vendor {
+namespace sprd {
+namespace hardware {
+namespace face {
+namespace V1_0 {
+namespace implementation {
+
+// Inactivity after which pools and vendor models are released, 0 disables.
+// Off until the vendor library's trim is validated on the device.
+#define PROP_IDLE_TRIM_MS "persist.vendor.faceid.idle_trim_ms"
+#define DEFAULT_IDLE_TRIM_MS 0
+// Memory stall per PSI window that triggers a trim, 0 disables. Off until
+// sepolicy lets the service write /proc/pressure/memory.
+#define PROP_PSI_STALL_MS "persist.vendor.faceid.psi_stall_ms"
+#define DEFAULT_PSI_STALL_MS 0
+
+// Unprivileged PSI triggers need a window that is a multiple of 2s.
+static const int64_t kPsiWindowUs = 2000000;
+// Pressure usually lasts several windows, one trim per burst is enough.
+static const int64_t kPressureTrimIntervalUs = 10000000;
+
+FaceIdlePolicy::FaceIdlePolicy(TrimCallback callback)
+        : mCallback(callback), mIdleMs(0), mPsiStallMs(0), mEventFd(-1), mPsiFd(-1),
+          mLastActivityUs(0), mIdleFired(false), mExiting(false) {}
+
+FaceIdlePolicy::~FaceIdlePolicy() {
+    if (mThread.joinable()) {
+        mExiting = true;
+        wake();
+        mThread.join();
+    }
+    if (mPsiFd >= 0) {
+        close(mPsiFd);
+    }
+    if (mEventFd >= 0) {
+        close(mEventFd);
+    }
+}
+
+void FaceIdlePolicy::start() {
+    mIdleMs = property_get_int32(PROP_IDLE_TRIM_MS, DEFAULT_IDLE_TRIM_MS);
+    mPsiStallMs = property_get_int32(PROP_PSI_STALL_MS, DEFAULT_PSI_STALL_MS);
+    mLastActivityUs = monotonicUs();
+    if (mPsiStallMs > 0 && !openPsiTrigger()) {
+        mPsiStallMs = 0;
+    }
+    if (mIdleMs <= 0 && mPsiFd < 0) {
+        ALOGD("idle trimming disabled");
+        return;
+    }
+    mEventFd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    if (mEventFd < 0) {
+        ALOGE("idle policy can't create eventfd: %s", strerror(errno));
+        return;
+    }
+    ALOGD("idle trim after %dms, psi stall %dms", mIdleMs, mPsiStallMs);
+    mThread = std::thread(&FaceIdlePolicy::loop, this);
+}
+
+void FaceIdlePolicy::noteActivity() {
+    mLastActivityUs.store(monotonicUs(), std::memory_order_relaxed);
+    if (mIdleFired.load(std::memory_order_relaxed) && mIdleFired.exchange(false)) {
+        // The monitor sleeps without a timeout once it has fired, re-arm it.
+        wake();
+    }
+}
+
+// A full counter already wakes the monitor, only other failures matter.
+void FaceIdlePolicy::wake() {
+    uint64_t one = 1;
+    if (TEMP_FAILURE_RETRY(write(mEventFd, &one, sizeof(one))) != (ssize_t)sizeof(one) && errno != EAGAIN) {
+        ALOGE("idle policy can't wake its monitor: %s", strerror(errno));
+    }
+}
+
+bool FaceIdlePolicy::openPsiTrigger() {
+    int fd = open("/proc/pressure/memory", O_RDWR | O_NONBLOCK | O_CLOEXEC);
+    if (fd < 0) {
+        ALOGE("PSI not available: %s", strerror(errno));
+        return false;
+    }
+    char trigger[64];
+    int len = snprintf(trigger, sizeof(trigger), "some %lld %lld",
+            (long long)mPsiStallMs * 1000, (long long)kPsiWindowUs);
+    if (write(fd, trigger, len + 1) < 0) {
+        ALOGE("can't register PSI trigger \"%s\": %s", trigger, strerror(errno));
+        close(fd);
+        return false;
+    }
+    mPsiFd = fd;
+    return true;
+}
+
+void FaceIdlePolicy::loop() {
+    int64_t lastPressureTrimUs = 0;
+    while (!mExiting) {
+        int timeoutMs = -1;
+        if (mIdleMs > 0 && !mIdleFired.load(std::memory_order_relaxed)) {
+            int64_t now = monotonicUs();
+            int64_t deadline = mLastActivityUs.load(std::memory_order_relaxed) + (int64_t)mIdleMs * 1000;
+            if (deadline <= now) {
+                mIdleFired = true;
+                mCallback(TRIM_IDLE);
+                continue;
+            }
+            timeoutMs = (int)((deadline - now + 999) / 1000);
+        }
+
+        struct pollfd pfds[2] = {
+            { mEventFd, POLLIN, 0 },
+            { mPsiFd, POLLPRI, 0 },
+        };
+        int n = poll(pfds, mPsiFd >= 0 ? 2 : 1, timeoutMs);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            ALOGE("idle policy poll failed: %s", strerror(errno));
+            return;
+        }
+        if (pfds[0].revents & POLLIN) {
+            uint64_t count;
+            if (TEMP_FAILURE_RETRY(read(mEventFd, &count, sizeof(count))) != (ssize_t)sizeof(count) && errno != EAGAIN) {
+                ALOGE("idle policy can't read its eventfd: %s", strerror(errno));
+                return;
+            }
+        }
+        if (mPsiFd >= 0 && (pfds[1].revents & POLLERR)) {
+            ALOGE("PSI trigger went away");
+            close(mPsiFd);
+            mPsiFd = -1;
+        } else if (mPsiFd >= 0 && (pfds[1].revents & POLLPRI)) {
+            int64_t now = monotonicUs();
+            if (now - lastPressureTrimUs >= kPressureTrimIntervalUs) {
+                lastPressureTrimUs = now;
+                mCallback(TRIM_MEMORY_PRESSURE);
+            }
+        }
+    }
+}
+
+}  // namespace implementation
+}  // namespace V1_0
+}  // namespace face
+}  // namespace hardware
+}  // namespace sprd
+}  // namespace vendor
@@ -0,0 +1,59 @@
+// FIXME: your file license if you have one
+
+#pragma once
+
+#include <stdint.h>
+#include <atomic>
+#include <functional>
+#include <thread>
+
+namespace vendor {
+namespace sprd {
+namespace hardware {
+namespace face {
+namespace V1_0 {
+namespace implementation {
+
+// Decides when the service gives memory back: once nothing has been
+// enrolled or authenticated for a while, and whenever the kernel reports
+// memory pressure through PSI. The callback only schedules the trim, the
+// work itself is done on the request looper.
+class FaceIdlePolicy {
+public:
+    enum {
+        TRIM_IDLE,
+        TRIM_MEMORY_PRESSURE,
+    };
+    typedef std::function<void(int reason)> TrimCallback;
+
+    explicit FaceIdlePolicy(TrimCallback callback);
+    ~FaceIdlePolicy();
+
+    // Reads the configuration and starts monitoring, unless both idle
+    // trimming and the PSI trigger are disabled, as they are by default.
+    void start();
+    // Restarts the inactivity period. Cheap enough to be called per frame.
+    void noteActivity();
+
+private:
+    void loop();
+    void wake();
+    bool openPsiTrigger();
+
+    TrimCallback mCallback;
+    int32_t mIdleMs;
+    int32_t mPsiStallMs;
+    int mEventFd;
+    int mPsiFd;
+    std::atomic<int64_t> mLastActivityUs;
+    std::atomic<bool> mIdleFired;
+    std::atomic<bool> mExiting;
+    std::thread mThread;
+};
+
+}  // namespace implementation
+}  // namespace V1_0
+}  // namespace face
+}  // namespace hardware
+}  // namespace sprd
+}  // namespace vendor
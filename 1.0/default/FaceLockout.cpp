@@ -0,0 +1,265 @@
+// FIXME: your file license if you have one
+
+#define LOG_TAG "vendor.sprd.hardware.face@1.0-service"
+
+#include <log/log.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <zlib.h>
+#include "FaceLockout.h"
+
+namespace vendor {
+namespace sprd {
+namespace hardware {
+namespace face {
+namespace V1_0 {
+namespace implementation {
+
+static const uint32_t kLockoutMagic = 0x4b4c4653; // "SFLK"
+static const uint32_t kLockoutVersion = 1;
+static const char kLockoutFileName[] = "/face_lockout.bin";
+static const char kLockoutTmpSuffix[] = ".tmp";
+// FaceLockoutFile::permanent, by who locked the user out.
+static const uint32_t kVendorPermanent = 1;
+static const uint32_t kServicePermanent = 2;
+
+const int64_t FaceLockoutTracker::kPermanentUs;
+
+static int64_t realtimeMs() {
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return (int64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+// A rename is only durable once the directory holding it is synced.
+static bool syncDir(const std::string& dir) {
+    int fd = TEMP_FAILURE_RETRY(::open(dir.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC));
+    if (fd < 0) {
+        return false;
+    }
+    bool ok = fsync(fd) == 0;
+    close(fd);
+    return ok;
+}
+
+static uint32_t checksum(const void* data, size_t size) {
+    return (uint32_t)crc32(0L, reinterpret_cast<const Bytef*>(data), size);
+}
+
+FaceLockoutTracker::FaceLockoutTracker()
+        : mLockedUntilUs(0), mDirty(false), mUserId(-1), mFailures(0), mTimedUs(0), mServicePermanent(false), mTimedFailures(0),
+          mPermanentFailures(0), mDefaultTimedUs(0), mTimedLockouts(0), mPermanentLockouts(0) {}
+
+void FaceLockoutTracker::setThresholds(uint32_t timedFailures, uint32_t permanentFailures, int64_t timedUs) {
+    std::lock_guard<std::mutex> lock(mMutex);
+    mTimedFailures = timedFailures;
+    mPermanentFailures = permanentFailures;
+    mDefaultTimedUs = timedUs;
+}
+
+void FaceLockoutTracker::open(int32_t userId, const std::string& storePath, int64_t nowUs) {
+    std::lock_guard<std::mutex> lock(mMutex);
+    if (mDirty.exchange(false)) {
+        saveLocked(nowUs);
+    }
+    mDir = storePath;
+    mPath = storePath + kLockoutFileName;
+    mTmpPath = mPath + kLockoutTmpSuffix;
+    mUserId = userId;
+    mFailures = 0;
+    mTimedUs = 0;
+    mServicePermanent = false;
+    mLockedUntilUs = 0;
+    FaceLockoutFile file;
+    int fd = TEMP_FAILURE_RETRY(::open(mPath.c_str(), O_RDONLY | O_CLOEXEC));
+    if (fd < 0) {
+        if (errno != ENOENT) {
+            ALOGE("Can't open lockout state %s: %s", mPath.c_str(), strerror(errno));
+        }
+        return;
+    }
+    ssize_t n = TEMP_FAILURE_RETRY(read(fd, &file, sizeof(file)));
+    close(fd);
+    if (n != sizeof(file) || file.magic != kLockoutMagic || file.version != kLockoutVersion ||
+            file.userId != userId || file.crc != checksum(&file, offsetof(FaceLockoutFile, crc))) {
+        ALOGE("Lockout state %s is corrupted, user %d starts unlocked", mPath.c_str(), userId);
+        return;
+    }
+    mFailures = file.failures;
+    if (file.permanent) {
+        mLockedUntilUs = kPermanentUs;
+        mServicePermanent = file.permanent == kServicePermanent;
+    } else if (file.lockedUntilMs > realtimeMs()) {
+        // The wall clock may have been set back meanwhile; never longer
+        // than the lockout was.
+        int64_t remainingMs = file.lockedUntilMs - realtimeMs();
+        mTimedUs = (int64_t)file.timedMs * 1000;
+        mLockedUntilUs = nowUs + (remainingMs < file.timedMs ? remainingMs : file.timedMs) * 1000;
+    }
+    ALOGD("Lockout state of user %d: failures=%u locked=%d", userId, mFailures, check(nowUs));
+}
+
+FaceLockoutTracker::Lockout FaceLockoutTracker::check(int64_t nowUs) const {
+    int64_t until = mLockedUntilUs.load(std::memory_order_acquire);
+    if (until == 0) {
+        return NONE;
+    }
+    if (until == kPermanentUs) {
+        return PERMANENT;
+    }
+    return nowUs < until ? TIMED : NONE;
+}
+
+int64_t FaceLockoutTracker::remainingUs(int64_t nowUs) const {
+    int64_t until = mLockedUntilUs.load(std::memory_order_acquire);
+    if (until == kPermanentUs) {
+        return kPermanentUs;
+    }
+    return until > nowUs ? until - nowUs : 0;
+}
+
+FaceLockoutTracker::Lockout FaceLockoutTracker::onRejected(int64_t nowUs) {
+    std::lock_guard<std::mutex> lock(mMutex);
+    mFailures++;
+    Lockout caused = NONE;
+    if (check(nowUs) == NONE) {
+        if (mPermanentFailures > 0 && mFailures >= mPermanentFailures) {
+            lockLocked(kPermanentUs, nowUs);
+            mServicePermanent = true;
+            caused = PERMANENT;
+        } else if (mTimedFailures > 0 && mFailures % mTimedFailures == 0) {
+            lockLocked(mDefaultTimedUs, nowUs);
+            caused = TIMED;
+        }
+    }
+    mDirty.store(true, std::memory_order_release);
+    return caused;
+}
+
+void FaceLockoutTracker::onAccepted(int64_t nowUs) {
+    std::lock_guard<std::mutex> lock(mMutex);
+    if (mFailures != 0) {
+        mFailures = 0;
+        mDirty.store(true, std::memory_order_release);
+    }
+}
+
+void FaceLockoutTracker::onVendorLockout(int64_t durationUs, int64_t nowUs) {
+    if (durationUs < 0) {
+        return;
+    }
+    std::lock_guard<std::mutex> lock(mMutex);
+    if (durationUs == 0) {
+        unlockLocked(false);
+    } else {
+        lockLocked(durationUs, nowUs);
+    }
+    mDirty.store(true, std::memory_order_release);
+}
+
+void FaceLockoutTracker::reset() {
+    std::lock_guard<std::mutex> lock(mMutex);
+    unlockLocked(true);
+    mFailures = 0;
+    mDirty.store(false, std::memory_order_release);
+    saveLocked(0);
+}
+
+void FaceLockoutTracker::save(int64_t nowUs) {
+    std::lock_guard<std::mutex> lock(mMutex);
+    if (mDirty.exchange(false)) {
+        saveLocked(nowUs);
+    }
+}
+
+// Under mMutex. A permanent lockout only ends with a reset.
+void FaceLockoutTracker::lockLocked(int64_t durationUs, int64_t nowUs) {
+    if (mLockedUntilUs.load(std::memory_order_relaxed) == kPermanentUs) {
+        return;
+    }
+    if (durationUs == kPermanentUs) {
+        mPermanentLockouts++;
+        mLockedUntilUs.store(kPermanentUs, std::memory_order_release);
+        return;
+    }
+    mTimedLockouts++;
+    mTimedUs = durationUs;
+    mLockedUntilUs.store(nowUs + durationUs, std::memory_order_release);
+}
+
+// Under mMutex. The end of a timed lockout keeps the failures counting
+// towards a permanent one; the vendor ending a permanent one was a reset.
+// One the service's thresholds caused only ends with resetLockout().
+void FaceLockoutTracker::unlockLocked(bool reset) {
+    if (mLockedUntilUs.load(std::memory_order_relaxed) == kPermanentUs) {
+        if (mServicePermanent && !reset) {
+            return;
+        }
+        mFailures = 0;
+    }
+    mServicePermanent = false;
+    mTimedUs = 0;
+    mLockedUntilUs.store(0, std::memory_order_release);
+}
+
+// Under mMutex.
+void FaceLockoutTracker::saveLocked(int64_t nowUs) {
+    if (mPath.empty()) {
+        return;
+    }
+    int64_t until = mLockedUntilUs.load(std::memory_order_relaxed);
+    FaceLockoutFile file;
+    memset(&file, 0, sizeof(file));
+    file.magic = kLockoutMagic;
+    file.version = kLockoutVersion;
+    file.userId = mUserId;
+    file.failures = mFailures;
+    if (until == kPermanentUs) {
+        file.permanent = mServicePermanent ? kServicePermanent : kVendorPermanent;
+    }
+    if (!file.permanent && until > nowUs && nowUs > 0) {
+        file.timedMs = (uint32_t)(mTimedUs / 1000);
+        file.lockedUntilMs = realtimeMs() + (until - nowUs) / 1000;
+    }
+    file.crc = checksum(&file, offsetof(FaceLockoutFile, crc));
+
+    const std::string& tmpPath = mTmpPath;
+    int fd = TEMP_FAILURE_RETRY(::open(tmpPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600));
+    if (fd < 0) {
+        ALOGE("Can't create %s: %s", tmpPath.c_str(), strerror(errno));
+        return;
+    }
+    bool ok = TEMP_FAILURE_RETRY(write(fd, &file, sizeof(file))) == sizeof(file) && fsync(fd) == 0;
+    close(fd);
+    if (!ok || rename(tmpPath.c_str(), mPath.c_str()) != 0) {
+        ALOGE("Can't save lockout state %s: %s", mPath.c_str(), strerror(errno));
+        unlink(tmpPath.c_str());
+        return;
+    }
+    if (!syncDir(mDir)) {
+        ALOGE("Can't sync %s: %s", mDir.c_str(), strerror(errno));
+    }
+}
+
+void FaceLockoutTracker::dump(int fd, int64_t nowUs) const {
+    std::lock_guard<std::mutex> lock(mMutex);
+    Lockout lockout = check(nowUs);
+    dprintf(fd, "lockout: user=%d %s remaining=%" PRId64 "ms failures=%u thresholds timed=%u permanent=%u "
+            "lockouts timed=%u permanent=%u\n", mUserId,
+            lockout == PERMANENT ? "permanent" : lockout == TIMED ? "timed" : "none",
+            lockout == TIMED ? remainingUs(nowUs) / 1000 : 0, mFailures, mTimedFailures, mPermanentFailures,
+            mTimedLockouts, mPermanentLockouts);
+}
+
+}  // namespace implementation
+}  // namespace V1_0
+}  // namespace face
+}  // namespace hardware
+}  // namespace sprd
+}  // namespace vendor
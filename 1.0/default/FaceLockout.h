@@ -0,0 +1,111 @@
+// FIXME: your file license if you have one
+
+#pragma once
+
+#include <stdint.h>
+#include <atomic>
+#include <mutex>
+#include <string>
+
+namespace vendor {
+namespace sprd {
+namespace hardware {
+namespace face {
+namespace V1_0 {
+namespace implementation {
+
+// On-disk lockout state of one user, next to its template store. Replaced
+// as a whole like the template store.
+struct FaceLockoutFile {
+    uint32_t magic;
+    uint32_t version;
+    int32_t userId;
+    uint32_t failures;
+    // 0, or who locked the user out for good: 1 the vendor, 2 the service.
+    uint32_t permanent;
+    uint32_t timedMs;
+    // CLOCK_REALTIME, the boot time clock restarts with the device.
+    int64_t lockedUntilMs;
+    uint32_t reserved;
+    uint32_t crc; // crc32 of the file up to this field
+};
+
+// Lockout state of the active user, kept in the service so that an
+// authenticate or a frame during lockout never reaches the vendor library.
+// The vendor stays the authority: its lockout errors and events set the
+// state and a successful resetLockout() clears it. With thresholds set,
+// failed attempts lock out by themselves as well.
+//
+// Times are CLOCK_BOOTTIME, lockouts run out during suspend. check() is an
+// atomic load and a compare, for the binder threads; the rest is called
+// from the vendor's callback and binder threads under a mutex. Only
+// reset() writes the state out itself: the changes the vendor's callback
+// makes wait for save() on the request thread.
+class FaceLockoutTracker {
+public:
+    enum Lockout {
+        NONE,
+        TIMED,
+        PERMANENT,
+    };
+
+    // Duration of a permanent lockout.
+    static const int64_t kPermanentUs = INT64_MAX;
+
+    FaceLockoutTracker();
+
+    // 0 failures turns either threshold off.
+    void setThresholds(uint32_t timedFailures, uint32_t permanentFailures, int64_t timedUs);
+    // Switches to |userId| once the previous user's changes are saved,
+    // reading its state from under |storePath|; with none stored the user
+    // starts unlocked.
+    void open(int32_t userId, const std::string& storePath, int64_t nowUs);
+
+    Lockout check(int64_t nowUs) const;
+    int64_t remainingUs(int64_t nowUs) const;
+
+    // Returns the lockout the attempt caused, NONE if it caused none.
+    Lockout onRejected(int64_t nowUs);
+    void onAccepted(int64_t nowUs);
+    // |durationUs| 0 if the vendor's lockout ended, kPermanentUs if it is
+    // permanent, -1 if the vendor did not say how long it lasts: then it
+    // keeps answering authenticates itself until it reports the duration.
+    void onVendorLockout(int64_t durationUs, int64_t nowUs);
+    void reset();
+
+    bool needsSave() const { return mDirty.load(std::memory_order_acquire); }
+    // Writes the state out if it changed since the last save.
+    void save(int64_t nowUs);
+
+    void dump(int fd, int64_t nowUs) const;
+
+private:
+    void lockLocked(int64_t durationUs, int64_t nowUs);
+    void unlockLocked(bool reset);
+    void saveLocked(int64_t nowUs);
+
+    // 0 unlocked, kPermanentUs permanent, else the end of a timed lockout.
+    std::atomic<int64_t> mLockedUntilUs;
+    std::atomic<bool> mDirty;
+    mutable std::mutex mMutex;
+    std::string mDir;
+    std::string mPath;
+    std::string mTmpPath;
+    int32_t mUserId;
+    uint32_t mFailures;
+    int64_t mTimedUs;
+    // The permanent lockout is the service's own.
+    bool mServicePermanent;
+    uint32_t mTimedFailures;
+    uint32_t mPermanentFailures;
+    int64_t mDefaultTimedUs;
+    uint32_t mTimedLockouts;
+    uint32_t mPermanentLockouts;
+};
+
+}  // namespace implementation
+}  // namespace V1_0
+}  // namespace face
+}  // namespace hardware
+}  // namespace sprd
+}  // namespace vendor
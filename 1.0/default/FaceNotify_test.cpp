@@ -0,0 +1,360 @@
+// FIXME: your file license if you have one
+
+// Checks the claim on FaceService::notify(): once the template store's
+// queue has grown to the changes one session reports, no event allocates.
+// The service runs in the test process on the simulated vendor library
+// (1.0/sim) with its requests handled on the test thread, so every event
+// the simulator reports reaches notify() and the client on that thread.
+// The notify function handed to the simulator counts what the thread
+// allocates while it runs, in any form of operator new. A first round of
+// sessions grows the queues; the second one is held to no allocation.
+//
+// notify() also hands every frame buffer back to the client that sent the
+// frame, which for an AIDL session is the camera client in another
+// process; the second test runs such a session.
+
+#include <gtest/gtest.h>
+#include <hardware/face.h>
+#include <hardware/hardware.h>
+#include <hardware/hw_auth_token.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <memory>
+#include <new>
+#include "FaceService.h"
+
+using namespace ::vendor::sprd::hardware::face::V1_0::implementation;
+
+extern "C" {
+extern face_module_t HAL_MODULE_INFO_SYM;
+}
+
+static thread_local bool sCountAllocations;
+static thread_local uint64_t sAllocations;
+
+static void* allocate(size_t size, size_t alignment) {
+    if (sCountAllocations) {
+        sAllocations++;
+    }
+    if (size == 0) {
+        size = 1;
+    }
+    if (alignment <= alignof(std::max_align_t)) {
+        return malloc(size);
+    }
+    void* p = nullptr;
+    return posix_memalign(&p, alignment, size) == 0 ? p : nullptr;
+}
+
+static void* allocateOrAbort(size_t size, size_t alignment) {
+    void* p = allocate(size, alignment);
+    if (p == nullptr) {
+        abort();
+    }
+    return p;
+}
+
+void* operator new(size_t size) {
+    return allocateOrAbort(size, 0);
+}
+
+void* operator new[](size_t size) {
+    return allocateOrAbort(size, 0);
+}
+
+void* operator new(size_t size, std::align_val_t alignment) {
+    return allocateOrAbort(size, static_cast<size_t>(alignment));
+}
+
+void* operator new[](size_t size, std::align_val_t alignment) {
+    return allocateOrAbort(size, static_cast<size_t>(alignment));
+}
+
+void* operator new(size_t size, const std::nothrow_t&) noexcept {
+    return allocate(size, 0);
+}
+
+void* operator new[](size_t size, const std::nothrow_t&) noexcept {
+    return allocate(size, 0);
+}
+
+void* operator new(size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept {
+    return allocate(size, static_cast<size_t>(alignment));
+}
+
+void* operator new[](size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept {
+    return allocate(size, static_cast<size_t>(alignment));
+}
+
+void operator delete(void* p) noexcept {
+    free(p);
+}
+
+void operator delete[](void* p) noexcept {
+    free(p);
+}
+
+void operator delete(void* p, size_t) noexcept {
+    free(p);
+}
+
+void operator delete[](void* p, size_t) noexcept {
+    free(p);
+}
+
+void operator delete(void* p, std::align_val_t) noexcept {
+    free(p);
+}
+
+void operator delete[](void* p, std::align_val_t) noexcept {
+    free(p);
+}
+
+void operator delete(void* p, size_t, std::align_val_t) noexcept {
+    free(p);
+}
+
+void operator delete[](void* p, size_t, std::align_val_t) noexcept {
+    free(p);
+}
+
+void operator delete(void* p, const std::nothrow_t&) noexcept {
+    free(p);
+}
+
+void operator delete[](void* p, const std::nothrow_t&) noexcept {
+    free(p);
+}
+
+void operator delete(void* p, std::align_val_t, const std::nothrow_t&) noexcept {
+    free(p);
+}
+
+void operator delete[](void* p, std::align_val_t, const std::nothrow_t&) noexcept {
+    free(p);
+}
+
+#ifdef __ANDROID__
+static const char kStorePath[] = "/data/local/tmp/face_notify_test";
+#else
+static const char kStorePath[] = "/tmp/face_notify_test";
+#endif
+
+static const pid_t kClientPid = 1000;
+// An AIDL session, registered by the service's own process.
+static const pid_t kSessionPid = 2000;
+
+// The message types the simulator reports.
+static const int32_t kEventTypes[] = {
+    FACE_ERROR,
+    FACE_ACQUIRED,
+    FACE_TEMPLATE_ENROLLING,
+    FACE_TEMPLATE_REMOVED,
+    FACE_AUTHENTICATED,
+    FACE_TEMPLATE_ENUMERATED,
+    FACE_LOCKOUT_CHANGED,
+    FACE_ENROLL_PROCESSED,
+    FACE_AUTHENTICATE_PROCESSED,
+};
+static const size_t kEventTypeCount = sizeof(kEventTypes) / sizeof(kEventTypes[0]);
+
+// Events notify() got and what it allocated for them, per type of
+// kEventTypes, in the running round.
+static uint32_t sEvents[kEventTypeCount];
+static uint64_t sEventAllocations[kEventTypeCount];
+
+static void countingNotify(const face_msg_t* msg) {
+    uint64_t before = sAllocations;
+    sCountAllocations = true;
+    FaceService::notify(msg);
+    sCountAllocations = false;
+    for (size_t i = 0; i < kEventTypeCount; i++) {
+        if (kEventTypes[i] == msg->type) {
+            sEvents[i]++;
+            sEventAllocations[i] += sAllocations - before;
+            break;
+        }
+    }
+}
+
+static face_device_t* openSimulator(FaceNotifyFn) {
+    hw_device_t* device = nullptr;
+    if (HAL_MODULE_INFO_SYM.common.methods->open(&HAL_MODULE_INFO_SYM.common, FACE_HARDWARE_MODULE_ID,
+            &device) != 0) {
+        return nullptr;
+    }
+    face_device_t* face = reinterpret_cast<face_device_t*>(device);
+    face->set_notify(face, countingNotify);
+    return face;
+}
+
+// Counts the callbacks it gets, allocating nothing itself.
+class CountingClient : public FaceClientCallback {
+public:
+    CountingClient() : received(0), enrolledId(0), authenticatedId(0), enrollBuffers(0), authBuffers(0) {}
+
+    void onEnrollResult(uint32_t faceId, int32_t, uint32_t) override {
+        received++;
+        if (faceId != 0) {
+            enrolledId = faceId;
+        }
+    }
+    void onAuthenticated(uint32_t faceId, int32_t, const uint8_t*, size_t) override {
+        received++;
+        authenticatedId = faceId;
+    }
+    void onAcquired(int32_t, int32_t) override { received++; }
+    void onError(int32_t, int32_t) override { received++; }
+    void onRemoved(const uint32_t*, size_t, int32_t) override { received++; }
+    void onEnumerate(const uint32_t*, size_t, int32_t) override { received++; }
+    void onLockoutChanged(uint64_t) override { received++; }
+    void onEnrollProcessed(int64_t) override {
+        received++;
+        enrollBuffers++;
+    }
+    void onAuthProcessed(int64_t, int64_t) override {
+        received++;
+        authBuffers++;
+    }
+    void onRecommendedFrameRate(uint32_t) override { received++; }
+
+    uint32_t received;
+    uint32_t enrolledId;
+    uint32_t authenticatedId;
+    uint32_t enrollBuffers;
+    uint32_t authBuffers;
+};
+
+class FaceNotifyTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        mkdir(kStorePath, 0700);
+        FaceService::Options options;
+        options.manualLooper = true;
+        mService.reset(new FaceService(openSimulator, options));
+        ASSERT_NE(nullptr, mService->waitForDevice()) << "simulated vendor library did not open";
+        mClient = std::make_shared<CountingClient>();
+        std::shared_ptr<FaceClient> replaced;
+        mService->addClient(kClientPid, mClient, CLIENT_FRAMES | CLIENT_FRAME_RATE, &replaced);
+    }
+
+    void TearDown() override {
+        mService.reset();
+    }
+
+    void handleRequests() {
+        while (mService->handleNextRequest()) {
+        }
+    }
+
+    // An enroll, a match, an enumerate, a cancelled authenticate and a
+    // remove: every event type the simulator has.
+    void runSessions() {
+        ASSERT_EQ(FACE_OK, mService->setActiveUser(0, kStorePath));
+
+        uint64_t challenge = 0;
+        ASSERT_EQ(FACE_OK, mService->generateChallenge(60, &challenge));
+        hw_auth_token_t hat;
+        memset(&hat, 0, sizeof(hat));
+        hat.version = HW_AUTH_TOKEN_VERSION;
+        hat.challenge = challenge;
+        mClient->enrolledId = 0;
+        ASSERT_EQ(FACE_OK, mService->enroll(kClientPid, reinterpret_cast<const uint8_t*>(&hat), sizeof(hat),
+                60, nullptr, 0));
+        handleRequests();
+        for (int64_t addr = 1; addr < 20 && mClient->enrolledId == 0; addr++) {
+            mService->doEnrollProcess(kClientPid, addr, nullptr, 0, nullptr, 0);
+            handleRequests();
+        }
+        ASSERT_NE(0u, mClient->enrolledId) << "simulator did not enroll";
+        mService->revokeChallenge();
+
+        mClient->authenticatedId = 0;
+        ASSERT_EQ(FACE_OK, mService->authenticate(kClientPid, 1));
+        handleRequests();
+        for (int64_t addr = 1; addr < 20 && mClient->authenticatedId == 0; addr++) {
+            mService->doAuthenticateProcess(kClientPid, addr, addr, 0, nullptr, 0, nullptr, 0);
+            handleRequests();
+        }
+        ASSERT_EQ(mClient->enrolledId, mClient->authenticatedId) << "simulator did not match";
+
+        ASSERT_EQ(FACE_OK, mService->enumerate(kClientPid));
+        handleRequests();
+
+        ASSERT_EQ(FACE_OK, mService->authenticate(kClientPid, 2));
+        handleRequests();
+        mService->doAuthenticateProcess(kClientPid, 1, 1, 0, nullptr, 0, nullptr, 0);
+        handleRequests();
+        ASSERT_EQ(FACE_OK, mService->cancel(kClientPid));
+        handleRequests();
+
+        ASSERT_EQ(FACE_OK, mService->remove(kClientPid, mClient->enrolledId));
+        handleRequests();
+    }
+
+    std::unique_ptr<FaceService> mService;
+    std::shared_ptr<CountingClient> mClient;
+};
+
+TEST_F(FaceNotifyTest, NoEventAllocates) {
+    for (int round = 0; round < 2; round++) {
+        SCOPED_TRACE(round);
+        memset(sEvents, 0, sizeof(sEvents));
+        memset(sEventAllocations, 0, sizeof(sEventAllocations));
+        uint32_t received = mClient->received;
+        ASSERT_NO_FATAL_FAILURE(runSessions());
+        EXPECT_LT(received, mClient->received);
+        for (size_t i = 0; i < kEventTypeCount; i++) {
+            SCOPED_TRACE(kEventTypes[i]);
+            EXPECT_NE(0u, sEvents[i]) << "the simulator never reported it";
+            if (round > 0) {
+                EXPECT_EQ(0u, sEventAllocations[i]);
+            }
+        }
+    }
+}
+
+// The session client sends no frames; the camera client sends them, by
+// its pid and oneway, and gets every buffer back.
+TEST_F(FaceNotifyTest, SessionRunsOnFramesOfAnotherClient) {
+    std::shared_ptr<CountingClient> session = std::make_shared<CountingClient>();
+    std::shared_ptr<FaceClient> replaced;
+    mService->addClient(kSessionPid, session, 0, &replaced);
+    ASSERT_EQ(FACE_OK, mService->setActiveUser(0, kStorePath));
+
+    uint64_t challenge = 0;
+    ASSERT_EQ(FACE_OK, mService->generateChallenge(60, &challenge));
+    hw_auth_token_t hat;
+    memset(&hat, 0, sizeof(hat));
+    hat.version = HW_AUTH_TOKEN_VERSION;
+    hat.challenge = challenge;
+    ASSERT_EQ(FACE_OK, mService->enroll(kSessionPid, reinterpret_cast<const uint8_t*>(&hat), sizeof(hat),
+            60, nullptr, 0));
+    handleRequests();
+    uint32_t frames = 0;
+    for (int64_t addr = 1; addr < 20 && session->enrolledId == 0; addr++, frames++) {
+        mService->doEnrollProcess(kClientPid, addr, nullptr, 0, nullptr, 0);
+        handleRequests();
+    }
+    mService->revokeChallenge();
+    ASSERT_NE(0u, session->enrolledId) << "the session did not get the camera's frames";
+    EXPECT_EQ(frames, mClient->enrollBuffers);
+    EXPECT_EQ(0u, mClient->enrolledId);
+
+    ASSERT_EQ(FACE_OK, mService->authenticate(kSessionPid, 1));
+    handleRequests();
+    frames = 0;
+    for (int64_t addr = 1; addr < 20 && session->authenticatedId == 0; addr++, frames++) {
+        mService->submitAuthenticateFrame(addr, addr, 0, nullptr, 0, nullptr, 0);
+        handleRequests();
+    }
+    EXPECT_EQ(session->enrolledId, session->authenticatedId);
+    // The simulator hands back all but the frame it matches on.
+    EXPECT_EQ(frames - 1, mClient->authBuffers);
+    EXPECT_EQ(0u, mClient->authenticatedId);
+    EXPECT_EQ(0u, session->enrollBuffers + session->authBuffers);
+
+    ASSERT_EQ(FACE_OK, mService->remove(kSessionPid, session->enrolledId));
+    handleRequests();
+}
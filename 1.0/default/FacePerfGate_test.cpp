@@ -0,0 +1,518 @@
+// FIXME: your file license if you have one
+
+// Performance gate of the service core. FaceService runs against the
+// simulated vendor library (1.0/sim) with its requests handled on the test
+// thread and on a virtual clock: camera frame arrivals, algorithm
+// latencies and callback delays are scripted, so every run gives the same
+// numbers, on the host as on a device. The p99 time to authenticate, the
+// deepest frame queue and the allocations per frame of each scenario are
+// held against face_perf_baseline.txt, and the test fails once one of them
+// is over its budget.
+//
+// After a change that is meant to move them, FACE_PERF_UPDATE=<file>
+// writes the measured numbers to <file> instead of checking them. On a
+// device the vendor.faceid.sim.* properties have to be unset.
+
+#include <gtest/gtest.h>
+#include <hardware/face.h>
+#include <hardware/hardware.h>
+#include <hardware/hw_auth_token.h>
+#include <inttypes.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <algorithm>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+#include "FaceRequests.h"
+#include "FaceService.h"
+
+using namespace ::vendor::sprd::hardware::face::V1_0::implementation;
+
+extern "C" {
+extern face_module_t HAL_MODULE_INFO_SYM;
+void face_sim_set_delay(void (*delay)(int32_t ms));
+}
+
+// Allocations made while sCountAllocations is set: the frame path, once
+// the harness is past its warm up sessions.
+static bool sCountAllocations;
+static uint64_t sAllocations;
+
+void* operator new(size_t size) {
+    if (sCountAllocations) {
+        sAllocations++;
+    }
+    void* p = malloc(size > 0 ? size : 1);
+    if (p == nullptr) {
+        abort();
+    }
+    return p;
+}
+
+void operator delete(void* p) noexcept {
+    free(p);
+}
+
+void operator delete(void* p, size_t) noexcept {
+    free(p);
+}
+
+// The clock of the service, and of everything else in the harness.
+static int64_t sNowUs;
+
+static int64_t virtualUs() {
+    return sNowUs;
+}
+
+#ifdef __ANDROID__
+static const char kStorePath[] = "/data/local/tmp";
+#else
+static const char kStorePath[] = "/tmp";
+#endif
+
+static const pid_t kCameraPid = 1000;
+// Buffers the camera client cycles through; a frame is lost when all of
+// them are still with the service.
+static const size_t kCameraBuffers = 4;
+static const uint32_t kCameraFps = 30;
+// Between the frames of a burst.
+static const int64_t kBurstGapUs = 1000;
+// Metadata of each frame, sized like the camera client's.
+static const size_t kInfoCount = 32;
+static const size_t kByteInfoCount = 64;
+// A session that has not matched by then is a failure, not a sample.
+static const int64_t kSessionLimitUs = 10000000;
+// The first sessions warm the slots of the queue up and are not measured.
+static const int kWarmUpSessions = 4;
+// Times may move that much over their budget; counts may not move at all.
+static const double kTimeSlack = 0.05;
+
+// One scripted workload; the patterns are cycled through frame by frame.
+struct Scenario {
+    const char* name;
+    int sessions;
+    // From authenticate() to the first frame of the camera.
+    int64_t cameraStartUs;
+    // Frames the camera delivers back to back, at the rate recommended.
+    int burst;
+    std::vector<int32_t> jitterUs;
+    // Time the vendor library spends on each frame.
+    std::vector<int32_t> latencyUs;
+    // Delivery delay of each callback to the camera client.
+    std::vector<int32_t> callbackUs;
+    // Between the match and the next authenticate.
+    int64_t idleUs;
+};
+
+static const Scenario kScenarios[] = {
+    // A library well within the frame interval.
+    { "steady", 200, 40000, 1, { 0, 1500, -1000, 2500, -2000 }, { 22000, 24000, 23000, 26000 },
+            { 800, 1200 }, 500000 },
+    // A library slower than the camera, stalling now and then; the frame
+    // rate feedback has to keep the queue short.
+    { "slow_vendor", 200, 40000, 1, { 0, 800, -600 }, { 48000, 52000, 45000, 50000, 47000, 140000 },
+            { 1000, 1500, 20000 }, 500000 },
+    // A camera that delivers its frames four at a time.
+    { "bursty_camera", 200, 40000, 4, { 0, 3000, -2000 }, { 30000, 28000, 33000 },
+            { 1000, 1000, 1000, 15000 }, 500000 },
+};
+
+struct Metrics {
+    int64_t p50TtaUs;
+    int64_t p99TtaUs;
+    size_t maxQueueDepth;
+    double allocsPerFrame;
+    uint64_t frames;
+    uint64_t dropped;
+    uint64_t lost;
+    uint32_t minFps;
+};
+
+// A camera client, the request thread of the service and the simulated
+// vendor library, all on one thread: the vendor's delays advance the
+// clock, delivering the frames that arrive in the meantime.
+class PerfRun {
+public:
+    explicit PerfRun(const Scenario& scenario)
+            : mScenario(scenario), mSession(0), mStartUs(0), mMatched(false), mMatchedUs(0), mEnrolled(false),
+              mStreaming(false), mSubmitting(false), mNextFrameUs(0), mInBurst(0), mFps(kCameraFps),
+              mMinFps(kCameraFps), mJitter(0), mPattern(0), mCallbacks(0), mMeasuring(false), mMaxQueued(0),
+              mFrames(0), mDropped(0), mLost(0) {
+        for (size_t i = 0; i < kInfoCount; i++) {
+            mInfo[i] = (int32_t)i;
+        }
+        memset(mByteInfo, 0x11, sizeof(mByteInfo));
+        for (int64_t& freeUs : mBufferFreeUs) {
+            freeUs = 0;
+        }
+        sRun = this;
+        sNowUs = 0;
+        face_sim_set_delay(onVendorDelay);
+    }
+
+    ~PerfRun() {
+        mService.reset();
+        face_sim_set_delay(nullptr);
+        sRun = nullptr;
+    }
+
+    // Starts the service on the simulator and enrolls the face the
+    // sessions will match.
+    bool open() {
+        FaceService::Options options;
+        options.clock = virtualUs;
+        options.manualLooper = true;
+        mService.reset(new FaceService(openSimulator, options));
+        if (mService->waitForDevice() == nullptr) {
+            return false;
+        }
+        std::shared_ptr<FaceClient> replaced;
+        mService->addClient(kCameraPid, std::make_shared<Camera>(this), CLIENT_FRAMES | CLIENT_FRAME_RATE,
+                &replaced);
+        if (mService->setActiveUser(0, kStorePath) != FACE_OK) {
+            return false;
+        }
+        uint64_t challenge = 0;
+        mService->generateChallenge(60, &challenge);
+        hw_auth_token_t hat;
+        memset(&hat, 0, sizeof(hat));
+        hat.version = HW_AUTH_TOKEN_VERSION;
+        hat.challenge = challenge;
+        mService->enroll(kCameraPid, reinterpret_cast<const uint8_t*>(&hat), sizeof(hat), 60, nullptr, 0);
+        for (int i = 0; i < 100 && !mEnrolled; i++) {
+            mService->doEnrollProcess(kCameraPid, i, mInfo, kInfoCount, mByteInfo, kByteInfoCount);
+            while (mService->handleNextRequest()) {
+            }
+        }
+        mService->revokeChallenge();
+        return mEnrolled;
+    }
+
+    Metrics run() {
+        mTtaUs.reserve(mScenario.sessions);
+        for (int i = 0; i < kWarmUpSessions + mScenario.sessions; i++) {
+            mMeasuring = i >= kWarmUpSessions;
+            if (!runSession()) {
+                break;
+            }
+        }
+        mMeasuring = false;
+
+        Metrics metrics;
+        std::vector<int64_t> sorted(mTtaUs);
+        std::sort(sorted.begin(), sorted.end());
+        metrics.p50TtaUs = percentile(sorted, 50);
+        metrics.p99TtaUs = percentile(sorted, 99);
+        metrics.maxQueueDepth = mMaxQueued;
+        metrics.allocsPerFrame = mFrames > 0 ? (double)sAllocations / mFrames : 0;
+        metrics.frames = mFrames;
+        metrics.dropped = mDropped;
+        metrics.lost = mLost;
+        metrics.minFps = mMinFps;
+        return metrics;
+    }
+
+private:
+    // The callback the camera client registered.
+    class Camera : public FaceClientCallback {
+    public:
+        explicit Camera(PerfRun* run) : mRun(run) {}
+
+        void onEnrollResult(uint32_t faceId, int32_t, uint32_t) override {
+            if (faceId != 0) {
+                mRun->mEnrolled = true;
+            }
+        }
+        void onAuthenticated(uint32_t faceId, int32_t, const uint8_t*, size_t) override {
+            mRun->onAuthenticated(faceId);
+        }
+        void onAcquired(int32_t, int32_t) override {}
+        void onError(int32_t, int32_t error) override {
+            ADD_FAILURE() << mRun->mScenario.name << ": error " << error << " in session " << mRun->mSession;
+        }
+        void onRemoved(const uint32_t*, size_t, int32_t) override {}
+        void onEnumerate(const uint32_t*, size_t, int32_t) override {}
+        void onLockoutChanged(uint64_t) override {}
+        void onEnrollProcessed(int64_t) override {}
+        void onAuthProcessed(int64_t main, int64_t) override {
+            mRun->onAuthProcessed(main);
+        }
+        void onRecommendedFrameRate(uint32_t fps) override {
+            mRun->mFps = fps;
+            mRun->mMinFps = std::min(mRun->mMinFps, fps);
+        }
+
+    private:
+        PerfRun* mRun;
+    };
+
+    static face_device_t* openSimulator(FaceNotifyFn notify) {
+        hw_device_t* device = nullptr;
+        if (HAL_MODULE_INFO_SYM.common.methods->open(&HAL_MODULE_INFO_SYM.common, FACE_HARDWARE_MODULE_ID,
+                &device) != 0) {
+            return nullptr;
+        }
+        face_device_t* face = reinterpret_cast<face_device_t*>(device);
+        face->set_notify(face, notify);
+        return face;
+    }
+
+    static int64_t percentile(const std::vector<int64_t>& sorted, int p) {
+        if (sorted.empty()) {
+            return 0;
+        }
+        size_t rank = (sorted.size() * p + 99) / 100;
+        return sorted[rank > 0 ? rank - 1 : 0];
+    }
+
+    // One authenticate, from the call to the match reaching the client.
+    bool runSession() {
+        mSession++;
+        mStartUs = sNowUs;
+        mMatched = false;
+        mService->authenticate(kCameraPid, mSession);
+
+        mStreaming = true;
+        mNextFrameUs = sNowUs + mScenario.cameraStartUs;
+        mInBurst = 0;
+        for (int64_t& freeUs : mBufferFreeUs) {
+            freeUs = 0;
+        }
+        while (!mMatched) {
+            if (sNowUs - mStartUs > kSessionLimitUs) {
+                ADD_FAILURE() << mScenario.name << ": session " << mSession << " never matched";
+                return false;
+            }
+            // Only the frames are held to no allocation, not the session
+            // start or the state persisted after a match.
+            bool counting = sCountAllocations;
+            sCountAllocations = mMeasuring && mService->queuedRequests(CONTROL_CLASS) == 0 &&
+                    mService->queuedRequests(BACKGROUND_CLASS) == 0;
+            bool handled = mService->handleNextRequest();
+            sCountAllocations = counting;
+            if (!handled) {
+                sNowUs = mNextFrameUs;
+                onFrameArrived();
+            }
+        }
+
+        // The camera stops with the match; what it had queued goes stale
+        // and is handed back once the service released the device.
+        mStreaming = false;
+        while (mService->handleNextRequest()) {
+        }
+        if (mMeasuring) {
+            mTtaUs.push_back(mMatchedUs - mStartUs);
+        }
+        sNowUs = std::max(sNowUs, mMatchedUs) + mScenario.idleUs;
+        return true;
+    }
+
+    int64_t nextPattern(const std::vector<int32_t>& pattern, uint64_t* index) {
+        return pattern.empty() ? 0 : pattern[(*index)++ % pattern.size()];
+    }
+
+    // Frames arrive for FaceService::doAuthenticateProcess().
+    void onFrameArrived() {
+        int64_t at = mNextFrameUs;
+        int64_t periodUs = 1000000 / mFps;
+        if (++mInBurst < mScenario.burst) {
+            mNextFrameUs = at + kBurstGapUs;
+        } else {
+            mInBurst = 0;
+            mNextFrameUs = at + periodUs * mScenario.burst - kBurstGapUs * (mScenario.burst - 1) +
+                    nextPattern(mScenario.jitterUs, &mJitter);
+        }
+
+        size_t buffer = kCameraBuffers;
+        for (size_t i = 0; i < kCameraBuffers; i++) {
+            if (mBufferFreeUs[i] <= at) {
+                buffer = i;
+                break;
+            }
+        }
+        if (buffer == kCameraBuffers) {
+            mLost += mMeasuring;
+            return;
+        }
+
+        // A frame the service can't queue comes back before the call returns.
+        bool counting = sCountAllocations;
+        sCountAllocations = mMeasuring;
+        mBufferFreeUs[buffer] = LLONG_MAX;
+        mSubmitting = true;
+        mService->doAuthenticateProcess(kCameraPid, (int64_t)buffer, (int64_t)buffer, 0, mInfo, kInfoCount,
+                mByteInfo, kByteInfoCount);
+        mSubmitting = false;
+        if (mMeasuring) {
+            mMaxQueued = std::max(mMaxQueued, mService->queuedRequests(AUTH_FRAME_CLASS));
+        }
+        sCountAllocations = counting;
+    }
+
+    int64_t callbackDelayUs() {
+        return nextPattern(mScenario.callbackUs, &mCallbacks);
+    }
+
+    void onAuthenticated(uint32_t faceId) {
+        if (faceId == 0) {
+            return;
+        }
+        mMatched = true;
+        mMatchedUs = sNowUs + callbackDelayUs();
+    }
+
+    void onAuthProcessed(int64_t buffer) {
+        if (mSubmitting) {
+            mDropped += mMeasuring;
+            mBufferFreeUs[buffer] = sNowUs;
+            return;
+        }
+        mBufferFreeUs[buffer] = sNowUs + callbackDelayUs();
+    }
+
+    // The vendor library is busy with a frame for a scripted time instead
+    // of the simulator's; frames keep arriving while it is.
+    void advance() {
+        mFrames += mMeasuring;
+        int64_t until = sNowUs + nextPattern(mScenario.latencyUs, &mPattern);
+        while (mStreaming && mNextFrameUs <= until) {
+            sNowUs = mNextFrameUs;
+            onFrameArrived();
+        }
+        sNowUs = until;
+    }
+
+    static void onVendorDelay(int32_t) {
+        sRun->advance();
+    }
+
+    static PerfRun* sRun;
+
+    const Scenario& mScenario;
+    std::unique_ptr<FaceService> mService;
+
+    uint32_t mSession;
+    int64_t mStartUs;
+    bool mMatched;
+    int64_t mMatchedUs;
+    bool mEnrolled;
+
+    bool mStreaming;
+    bool mSubmitting;
+    int64_t mNextFrameUs;
+    int mInBurst;
+    uint32_t mFps;
+    uint32_t mMinFps;
+    int64_t mBufferFreeUs[kCameraBuffers];
+    int32_t mInfo[kInfoCount];
+    int8_t mByteInfo[kByteInfoCount];
+
+    uint64_t mJitter;
+    uint64_t mPattern;
+    uint64_t mCallbacks;
+
+    bool mMeasuring;
+    std::vector<int64_t> mTtaUs;
+    size_t mMaxQueued;
+    uint64_t mFrames;
+    uint64_t mDropped;
+    uint64_t mLost;
+};
+
+PerfRun* PerfRun::sRun;
+
+static std::string baselinePath() {
+    const char* path = getenv("FACE_PERF_BASELINE");
+    if (path != nullptr) {
+        return path;
+    }
+    // Installed next to the test.
+    char exe[PATH_MAX];
+    ssize_t size = readlink("/proc/self/exe", exe, sizeof(exe) - 1);
+    if (size <= 0) {
+        return "face_perf_baseline.txt";
+    }
+    exe[size] = '\0';
+    std::string dir(exe);
+    return dir.substr(0, dir.rfind('/') + 1) + "face_perf_baseline.txt";
+}
+
+// "<scenario> <metric> <budget>" per line; # starts a comment.
+static bool loadBaseline(const std::string& path, std::map<std::string, double>* budgets) {
+    FILE* file = fopen(path.c_str(), "r");
+    if (file == nullptr) {
+        return false;
+    }
+    char line[256];
+    while (fgets(line, sizeof(line), file) != nullptr) {
+        char scenario[64];
+        char metric[64];
+        double budget;
+        if (line[0] == '#' || sscanf(line, "%63s %63s %lf", scenario, metric, &budget) != 3) {
+            continue;
+        }
+        (*budgets)[std::string(scenario) + " " + metric] = budget;
+    }
+    fclose(file);
+    return true;
+}
+
+static void checkBudget(const std::map<std::string, double>& budgets, const std::string& key, double measured,
+        double slack) {
+    auto it = budgets.find(key);
+    if (it == budgets.end()) {
+        ADD_FAILURE() << "no budget for " << key << " in the baseline";
+        return;
+    }
+    EXPECT_LE(measured, it->second * (1 + slack))
+            << key << " regressed to " << measured << ", its budget is " << it->second;
+}
+
+TEST(FacePerfGateTest, StaysWithinTheBaseline) {
+    const char* update = getenv("FACE_PERF_UPDATE");
+    std::map<std::string, double> budgets;
+    std::string path = baselinePath();
+    if (update == nullptr) {
+        ASSERT_TRUE(loadBaseline(path, &budgets)) << "can't read " << path;
+    }
+
+    std::string measured;
+    for (const Scenario& scenario : kScenarios) {
+        SCOPED_TRACE(scenario.name);
+        sAllocations = 0;
+        PerfRun run(scenario);
+        ASSERT_TRUE(run.open()) << "simulated vendor library did not enroll";
+        Metrics metrics = run.run();
+        printf("%s: p50_tta=%" PRId64 "us p99_tta=%" PRId64 "us max_queue_depth=%zu allocs_per_frame=%.3f "
+                "frames=%" PRIu64 " dropped=%" PRIu64 " lost=%" PRIu64 " min_fps=%u\n",
+                scenario.name, metrics.p50TtaUs, metrics.p99TtaUs, metrics.maxQueueDepth,
+                metrics.allocsPerFrame, metrics.frames, metrics.dropped, metrics.lost, metrics.minFps);
+
+        char lines[256];
+        snprintf(lines, sizeof(lines), "%s p99_tta_us %" PRId64 "\n%s max_queue_depth %zu\n"
+                "%s allocs_per_frame %.3f\n", scenario.name, metrics.p99TtaUs, scenario.name,
+                metrics.maxQueueDepth, scenario.name, metrics.allocsPerFrame);
+        measured += lines;
+        if (update == nullptr) {
+            std::string name(scenario.name);
+            checkBudget(budgets, name + " p99_tta_us", metrics.p99TtaUs, kTimeSlack);
+            checkBudget(budgets, name + " max_queue_depth", metrics.maxQueueDepth, 0);
+            checkBudget(budgets, name + " allocs_per_frame", metrics.allocsPerFrame, 0);
+        }
+    }
+
+    if (update != nullptr) {
+        FILE* file = fopen(update, "w");
+        ASSERT_NE(nullptr, file) << "can't write " << update;
+        fprintf(file, "# Budgets of FacePerfGate_test.cpp: <scenario> <metric> <budget>.\n"
+                "# Regenerate with FACE_PERF_UPDATE=<file> after a change meant to move them.\n");
+        fputs(measured.c_str(), file);
+        fclose(file);
+    }
+}
@@ -0,0 +1,256 @@
+// FIXME: your file license if you have one
+
+#define LOG_TAG "vendor.sprd.hardware.face@1.0-service"
+
+#include <log/log.h>
+#include <inttypes.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <unistd.h>
+#include "FaceRequestQueue.h"
+#include "FaceStats.h"
+
+namespace vendor {
+namespace sprd {
+namespace hardware {
+namespace face {
+namespace V1_0 {
+namespace implementation {
+
+// Yields before sleeping while a class is full.
+static const uint32_t kFullSpins = 64;
+// Upper bounds of the wait time histogram buckets, the last one is open.
+static const int64_t kWaitBucketUs[] = {
+    1000, 2000, 5000, 10000, 20000, 50000, 100000, 200000, 500000,
+};
+
+FaceRequestQueue::FaceRequestQueue(const char* name, const FaceRequestClass* classes, size_t count, Handler handler)
+        : mName(name), mHandler(handler), mClock(monotonicUs), mWaiting(false), mExiting(false) {
+    for (size_t i = 0; i < count; i++) {
+        size_t slots = classes[i].slots;
+        // The slot index is taken from the low bits of the position.
+        LOG_ALWAYS_FATAL_IF(slots == 0 || (slots & (slots - 1)) != 0,
+                "request class %s: %zu slots is not a power of two", classes[i].name, slots);
+        std::unique_ptr<Class> c(new Class());
+        c->config = classes[i];
+        c->slots.reset(new Slot[slots]);
+        for (size_t j = 0; j < slots; j++) {
+            c->slots[j].seq.store(j, std::memory_order_relaxed);
+            c->slots[j].enqueuedUs = 0;
+        }
+        c->enqueuePos = 0;
+        c->dequeuePos = 0;
+        for (size_t j = 0; j < kWaitBuckets; j++) {
+            c->waits[j] = 0;
+        }
+        c->maxWaitUs = 0;
+        c->aged = 0;
+        mClasses.push_back(std::move(c));
+    }
+}
+
+FaceRequestQueue::~FaceRequestQueue() {
+    stop();
+}
+
+void FaceRequestQueue::start() {
+    mThread = std::thread(&FaceRequestQueue::loop, this);
+}
+
+void FaceRequestQueue::stop() {
+    if (mThread.joinable()) {
+        {
+            std::lock_guard<std::mutex> lock(mMutex);
+            mExiting = true;
+        }
+        mCondition.notify_all();
+        mThread.join();
+    }
+}
+
+FaceRequest* FaceRequestQueue::beginPush(size_t cls) {
+    return claim(*mClasses[cls], true);
+}
+
+FaceRequest* FaceRequestQueue::tryBeginPush(size_t cls) {
+    return claim(*mClasses[cls], false);
+}
+
+FaceRequest* FaceRequestQueue::claim(Class& c, bool wait) {
+    size_t mask = c.config.slots - 1;
+    size_t pos = c.enqueuePos.load(std::memory_order_relaxed);
+    uint32_t fullRetries = 0;
+    for (;;) {
+        Slot& slot = c.slots[pos & mask];
+        size_t seq = slot.seq.load(std::memory_order_acquire);
+        intptr_t diff = (intptr_t)seq - (intptr_t)pos;
+        if (diff == 0) {
+            if (c.enqueuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                slot.request.reset();
+                return &slot.request;
+            }
+        } else if (diff < 0) {
+            if (!wait) {
+                return nullptr;
+            }
+            // Never drop a request that was asked to wait, the handler
+            // frees a slot soon.
+            if (++fullRetries < kFullSpins) {
+                std::this_thread::yield();
+            } else {
+                usleep(500);
+            }
+            pos = c.enqueuePos.load(std::memory_order_relaxed);
+        } else {
+            pos = c.enqueuePos.load(std::memory_order_relaxed);
+        }
+    }
+}
+
+void FaceRequestQueue::endPush(FaceRequest* request) {
+    Slot* slot = nullptr;
+    for (auto& c : mClasses) {
+        Slot* first = &c->slots[0];
+        if (reinterpret_cast<char*>(request) >= reinterpret_cast<char*>(first) &&
+                reinterpret_cast<char*>(request) < reinterpret_cast<char*>(first + c->config.slots)) {
+            slot = first + (reinterpret_cast<char*>(request) - reinterpret_cast<char*>(first)) / sizeof(Slot);
+            break;
+        }
+    }
+    LOG_ALWAYS_FATAL_IF(slot == nullptr, "request %p not from queue %s", request, mName.c_str());
+    slot->enqueuedUs = mClock();
+    // The slot was claimed at the position its sequence still holds.
+    size_t pos = slot->seq.load(std::memory_order_relaxed);
+    slot->seq.store(pos + 1, std::memory_order_release);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (mWaiting.load(std::memory_order_relaxed)) {
+        std::lock_guard<std::mutex> lock(mMutex);
+        mCondition.notify_one();
+    }
+}
+
+size_t FaceRequestQueue::size() const {
+    size_t size = 0;
+    for (auto& c : mClasses) {
+        size += c->enqueuePos.load(std::memory_order_relaxed) - c->dequeuePos.load(std::memory_order_relaxed);
+    }
+    return size;
+}
+
+size_t FaceRequestQueue::size(size_t cls) const {
+    const Class& c = *mClasses[cls];
+    return c.enqueuePos.load(std::memory_order_relaxed) - c.dequeuePos.load(std::memory_order_relaxed);
+}
+
+FaceRequestQueue::Slot* FaceRequestQueue::head(Class& c) {
+    size_t pos = c.dequeuePos.load(std::memory_order_relaxed);
+    Slot& slot = c.slots[pos & (c.config.slots - 1)];
+    return slot.seq.load(std::memory_order_acquire) == pos + 1 ? &slot : nullptr;
+}
+
+FaceRequestQueue::Class* FaceRequestQueue::pick(int64_t nowUs) {
+    Class* first = nullptr;
+    Class* aged = nullptr;
+    int64_t agedBy = 0;
+    for (auto& c : mClasses) {
+        Slot* slot = head(*c);
+        if (slot == nullptr) {
+            continue;
+        }
+        if (first == nullptr) {
+            first = c.get();
+        }
+        if (c->config.maxWaitMs > 0) {
+            int64_t over = nowUs - slot->enqueuedUs - (int64_t)c->config.maxWaitMs * 1000;
+            if (over > agedBy) {
+                aged = c.get();
+                agedBy = over;
+            }
+        }
+    }
+    if (aged != nullptr && aged != first) {
+        aged->aged.fetch_add(1, std::memory_order_relaxed);
+        return aged;
+    }
+    return first;
+}
+
+bool FaceRequestQueue::handleNext() {
+    LOG_ALWAYS_FATAL_IF(mThread.joinable(), "queue %s is handled on its own thread", mName.c_str());
+    int64_t now = mClock();
+    Class* c = pick(now);
+    if (c == nullptr) {
+        return false;
+    }
+    handle(*c, now);
+    return true;
+}
+
+void FaceRequestQueue::handle(Class& c, int64_t nowUs) {
+    Slot* slot = head(c);
+    int64_t waitUs = nowUs - slot->enqueuedUs;
+    size_t bucket = 0;
+    while (bucket < kWaitBuckets - 1 && waitUs >= kWaitBucketUs[bucket]) {
+        bucket++;
+    }
+    c.waits[bucket].fetch_add(1, std::memory_order_relaxed);
+    if (waitUs > c.maxWaitUs.load(std::memory_order_relaxed)) {
+        c.maxWaitUs.store(waitUs, std::memory_order_relaxed);
+    }
+
+    mHandler(slot->request);
+    size_t pos = c.dequeuePos.load(std::memory_order_relaxed);
+    slot->seq.store(pos + c.config.slots, std::memory_order_release);
+    c.dequeuePos.store(pos + 1, std::memory_order_relaxed);
+}
+
+void FaceRequestQueue::loop() {
+    pthread_setname_np(pthread_self(), mName.substr(0, 15).c_str());
+    while (!mExiting) {
+        int64_t now = mClock();
+        Class* c = pick(now);
+        if (c == nullptr) {
+            std::unique_lock<std::mutex> lock(mMutex);
+            mWaiting.store(true, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            // Either the producer publishing a request sees mWaiting and
+            // notifies, or the sequence it stored is seen here.
+            mCondition.wait(lock, [this] {
+                if (mExiting) {
+                    return true;
+                }
+                for (auto& c : mClasses) {
+                    if (head(*c) != nullptr) {
+                        return true;
+                    }
+                }
+                return false;
+            });
+            mWaiting.store(false, std::memory_order_relaxed);
+            continue;
+        }
+        handle(*c, now);
+    }
+}
+
+void FaceRequestQueue::dump(int fd) const {
+    dprintf(fd, "requests (wait ms: <1 <2 <5 <10 <20 <50 <100 <200 <500 >=500):\n");
+    for (auto& c : mClasses) {
+        size_t queued = c->enqueuePos.load(std::memory_order_relaxed) - c->dequeuePos.load(std::memory_order_relaxed);
+        dprintf(fd, "  %s: queued=%zu/%zu aged=%" PRIu64 " max_wait=%" PRId64 "us waits=",
+                c->config.name, queued, c->config.slots,
+                c->aged.load(std::memory_order_relaxed),
+                c->maxWaitUs.load(std::memory_order_relaxed));
+        for (size_t i = 0; i < kWaitBuckets; i++) {
+            dprintf(fd, "%s%" PRIu64, i ? " " : "", c->waits[i].load(std::memory_order_relaxed));
+        }
+        dprintf(fd, "\n");
+    }
+}
+
+}  // namespace implementation
+}  // namespace V1_0
+}  // namespace face
+}  // namespace hardware
+}  // namespace sprd
+}  // namespace vendor
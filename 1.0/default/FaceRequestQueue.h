@@ -0,0 +1,150 @@
+// FIXME: your file license if you have one
+
+#pragma once
+
+#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace vendor {
+namespace sprd {
+namespace hardware {
+namespace face {
+namespace V1_0 {
+namespace implementation {
+
+// One request for the vendor device. Requests live in the slots of a
+// FaceRequestQueue and are filled and handled in place; the vectors keep
+// their capacity from one use of the slot to the next, so a frame does not
+// allocate once the queue has warmed up. Requests can be moved but never
+// copied, a frame's metadata has exactly one owner.
+struct FaceRequest {
+    FaceRequest() : what(0), client(0), session(0), frame(0), postedUs(0), args() {}
+    FaceRequest(const FaceRequest&) = delete;
+    FaceRequest& operator=(const FaceRequest&) = delete;
+    FaceRequest(FaceRequest&&) = default;
+    FaceRequest& operator=(FaceRequest&&) = default;
+
+    void reset() {
+        what = 0;
+        client = 0;
+        session = 0;
+        frame = 0;
+        postedUs = 0;
+        for (int64_t& arg : args) {
+            arg = 0;
+        }
+        info.clear();
+        byteInfo.clear();
+    }
+
+    uint32_t what;
+    uint32_t client;
+    uint32_t session;
+    uint32_t frame;
+    int64_t postedUs;
+    int64_t args[4];
+    std::vector<int32_t> info;
+    std::vector<int8_t> byteInfo;
+};
+
+// Priority class of requests, in decreasing priority order.
+struct FaceRequestClass {
+    const char* name;
+    // Power of two; also the most requests of the class that can be queued.
+    size_t slots;
+    // Once its oldest request has waited that long, the class is served
+    // ahead of higher ones. 0 never ages.
+    int32_t maxWaitMs;
+};
+
+// Bounded multi producer, single consumer queues of requests, one per
+// priority class, handled on a dedicated thread. Producers claim a slot,
+// fill it and publish it without taking a lock; the handler thread takes
+// the highest class with a request ready, unless a lower one has aged,
+// and only sleeps when every class is empty. Requests of one class are
+// handled in order.
+class FaceRequestQueue {
+public:
+    typedef std::function<void(FaceRequest& request)> Handler;
+    typedef int64_t (*Clock)();
+
+    FaceRequestQueue(const char* name, const FaceRequestClass* classes, size_t count, Handler handler);
+    ~FaceRequestQueue();
+
+    // Requests pushed before start() are kept and handled once it runs.
+    void start();
+    // Joins the consumer thread; requests still queued are never handled.
+    void stop();
+    // The consumer thread, once started.
+    pthread_t nativeThread() { return mThread.native_handle(); }
+    // Wait times and aging are measured on monotonicUs() unless the queue
+    // runs on a virtual clock. Set before the first push.
+    void setClock(Clock clock) { mClock = clock; }
+    // Handles the highest request ready on the calling thread, for a queue
+    // that was never started. Returns false if every class is empty.
+    bool handleNext();
+
+    // Claims a reset slot of |cls|, waiting for room if the class is full.
+    FaceRequest* beginPush(size_t cls);
+    // Same, but returns nullptr right away if the class is full.
+    FaceRequest* tryBeginPush(size_t cls);
+    void endPush(FaceRequest* request);
+
+    // Requests pushed but not handled yet, in all classes or in |cls|.
+    size_t size() const;
+    size_t size(size_t cls) const;
+    // Per class wait time histograms.
+    void dump(int fd) const;
+
+private:
+    static const size_t kWaitBuckets = 10;
+
+    struct Slot {
+        std::atomic<size_t> seq;
+        int64_t enqueuedUs;
+        FaceRequest request;
+    };
+
+    struct Class {
+        FaceRequestClass config;
+        std::unique_ptr<Slot[]> slots;
+        std::atomic<size_t> enqueuePos;
+        std::atomic<size_t> dequeuePos;
+        std::atomic<uint64_t> waits[kWaitBuckets];
+        std::atomic<int64_t> maxWaitUs;
+        std::atomic<uint64_t> aged;
+    };
+
+    FaceRequest* claim(Class& c, bool wait);
+    Slot* head(Class& c);
+    Class* pick(int64_t nowUs);
+    void handle(Class& c, int64_t nowUs);
+    void loop();
+
+    std::string mName;
+    std::vector<std::unique_ptr<Class>> mClasses;
+    Handler mHandler;
+    Clock mClock;
+
+    std::mutex mMutex;
+    std::condition_variable mCondition;
+    std::atomic<bool> mWaiting;
+    std::atomic<bool> mExiting;
+    std::thread mThread;
+};
+
+}  // namespace implementation
+}  // namespace V1_0
+}  // namespace face
+}  // namespace hardware
+}  // namespace sprd
+}  // namespace vendor
@@ -0,0 +1,125 @@
+// FIXME: your file license if you have one
+
+// Per message dispatch cost of a frame request: the AMessage/ALooper path
+// the service used before against FaceRequestQueue. Each iteration builds
+// and posts one doAuthenticateProcess-like request; the handler reads all
+// of its fields. The AMessage half only builds for Android targets.
+
+#include <benchmark/benchmark.h>
+#ifdef __ANDROID__
+#include <media/stagefright/foundation/AHandler.h>
+#include <media/stagefright/foundation/ALooper.h>
+#include <media/stagefright/foundation/AMessage.h>
+#endif
+#include <stdlib.h>
+#include <string.h>
+#include <atomic>
+#include <thread>
+#include <vector>
+#include "FaceRequestQueue.h"
+
+using namespace ::vendor::sprd::hardware::face::V1_0::implementation;
+
+static const size_t kInfoCount = 32;
+
+static std::atomic<int64_t> sHandled;
+static std::atomic<int64_t> sChecksum;
+
+static void waitHandled(int64_t count) {
+    while (sHandled.load(std::memory_order_acquire) < count) {
+        std::this_thread::yield();
+    }
+}
+
+#ifdef __ANDROID__
+using ::android::AHandler;
+using ::android::ALooper;
+using ::android::AMessage;
+using ::android::sp;
+
+struct BenchHandler : public AHandler {
+    void onMessageReceived(const sp<AMessage>& msg) override {
+        int64_t main = 0;
+        int64_t sub = 0;
+        int64_t otp = 0;
+        size_t infoSize = 0;
+        int32_t* pInfo = nullptr;
+        size_t byteInfoSize = 0;
+        int8_t* pByteInfo = nullptr;
+        msg->findInt64("main", &main);
+        msg->findInt64("sub", &sub);
+        msg->findInt64("otp", &otp);
+        msg->findSize("infoSize", &infoSize);
+        msg->findPointer("pInfo", (void**)&pInfo);
+        msg->findSize("byteInfoSize", &byteInfoSize);
+        msg->findPointer("pByteInfo", (void**)&pByteInfo);
+        sChecksum.fetch_add(main + sub + otp + pInfo[0] + pByteInfo[byteInfoSize - 1] + infoSize,
+                std::memory_order_relaxed);
+        free(pInfo);
+        free(pByteInfo);
+        sHandled.fetch_add(1, std::memory_order_release);
+    }
+};
+
+static void BM_AMessageDispatch(benchmark::State& state) {
+    std::vector<int32_t> info(kInfoCount, 1);
+    std::vector<int8_t> byteInfo(state.range(0), 2);
+    sp<ALooper> looper = new ALooper;
+    sp<BenchHandler> handler = new BenchHandler;
+    looper->registerHandler(handler);
+    looper->start();
+    sHandled = 0;
+    int64_t posted = 0;
+    for (auto _ : state) {
+        sp<AMessage> msg = new AMessage(0, handler);
+        void* pInfo = malloc(info.size() * sizeof(int32_t));
+        memcpy(pInfo, info.data(), info.size() * sizeof(int32_t));
+        void* pByteInfo = malloc(byteInfo.size());
+        memcpy(pByteInfo, byteInfo.data(), byteInfo.size());
+        msg->setInt64("main", posted);
+        msg->setInt64("sub", posted);
+        msg->setInt64("otp", 0);
+        msg->setSize("infoSize", info.size());
+        msg->setPointer("pInfo", pInfo);
+        msg->setSize("byteInfoSize", byteInfo.size());
+        msg->setPointer("pByteInfo", pByteInfo);
+        msg->post(0);
+        posted++;
+    }
+    waitHandled(posted);
+    looper->stop();
+    state.SetItemsProcessed(posted);
+}
+BENCHMARK(BM_AMessageDispatch)->Arg(64)->Arg(4096)->UseRealTime();
+#endif
+
+static const FaceRequestClass kBenchClass = { "bench", 64, 0 };
+
+static void BM_FaceRequestQueueDispatch(benchmark::State& state) {
+    std::vector<int32_t> info(kInfoCount, 1);
+    std::vector<int8_t> byteInfo(state.range(0), 2);
+    sHandled = 0;
+    FaceRequestQueue queue("bench", &kBenchClass, 1, [](FaceRequest& request) {
+        sChecksum.fetch_add(request.args[0] + request.args[1] + request.args[2] + request.info[0] +
+                request.byteInfo.back() + request.info.size(), std::memory_order_relaxed);
+        sHandled.fetch_add(1, std::memory_order_release);
+    });
+    queue.start();
+    int64_t posted = 0;
+    for (auto _ : state) {
+        FaceRequest* request = queue.beginPush(0);
+        request->what = 0;
+        request->args[0] = posted;
+        request->args[1] = posted;
+        request->args[2] = 0;
+        request->info.assign(info.begin(), info.end());
+        request->byteInfo.assign(byteInfo.begin(), byteInfo.end());
+        queue.endPush(request);
+        posted++;
+    }
+    waitHandled(posted);
+    state.SetItemsProcessed(posted);
+}
+BENCHMARK(BM_FaceRequestQueueDispatch)->Arg(64)->Arg(4096)->UseRealTime();
+
+BENCHMARK_MAIN();
@@ -0,0 +1,62 @@
+// FIXME: your file license if you have one
+
+#include "FaceRequests.h"
+
+namespace vendor {
+namespace sprd {
+namespace hardware {
+namespace face {
+namespace V1_0 {
+namespace implementation {
+
+// Session starts share the class of cancel so a cancel never overtakes the
+// session it cancels. A frame that finds its class full is answered right
+// away instead of queued behind stale ones; the other classes wait for
+// room.
+const FaceRequestClass kRequestClasses[REQUEST_CLASS_COUNT] = {
+    { "control", 16, 0 },
+    { "auth_frame", 8, 0 },
+    { "enroll_frame", 8, 200 },
+    { "background", 16, 2000 },
+};
+
+const uint8_t kRequestClassOf[REQUEST_COUNT] = {
+    CONTROL_CLASS,       // ENROLL_REQUEST
+    CONTROL_CLASS,       // AUTH_REQUEST
+    BACKGROUND_CLASS,    // ENUMERATE_REQUEST
+    BACKGROUND_CLASS,    // REMOVE_REQUEST
+    CONTROL_CLASS,       // CANCEL_REQUEST
+    ENROLL_FRAME_CLASS,  // ENROLL_PROCESS_REQUEST
+    AUTH_FRAME_CLASS,    // AUTH_PROCESS_REQUEST
+    BACKGROUND_CLASS,    // TRIM_REQUEST
+    CONTROL_CLASS,       // WARM_UP_REQUEST
+    CONTROL_CLASS,       // SCHEDULE_REQUEST
+    CONTROL_CLASS,       // SPECULATE_REQUEST
+    BACKGROUND_CLASS,    // PERSIST_REQUEST
+};
+
+static const char* const kRequestNames[REQUEST_COUNT] = {
+    "ENROLL_REQUEST",
+    "AUTH_REQUEST",
+    "ENUMERATE_REQUEST",
+    "REMOVE_REQUEST",
+    "CANCEL_REQUEST",
+    "ENROLL_PROCESS_REQUEST",
+    "AUTH_PROCESS_REQUEST",
+    "TRIM_REQUEST",
+    "WARM_UP_REQUEST",
+    "SCHEDULE_REQUEST",
+    "SPECULATE_REQUEST",
+    "PERSIST_REQUEST",
+};
+
+const char* requestName(uint32_t what) {
+    return what < REQUEST_COUNT ? kRequestNames[what] : "UNKNOWN_REQUEST";
+}
+
+}  // namespace implementation
+}  // namespace V1_0
+}  // namespace face
+}  // namespace hardware
+}  // namespace sprd
+}  // namespace vendor
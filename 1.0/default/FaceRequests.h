@@ -0,0 +1,54 @@
+// FIXME: your file license if you have one
+
+#pragma once
+
+#include <stdint.h>
+#include "FaceRequestQueue.h"
+
+namespace vendor {
+namespace sprd {
+namespace hardware {
+namespace face {
+namespace V1_0 {
+namespace implementation {
+
+// What a FaceRequest asks the request thread of FaceService for.
+enum {
+    ENROLL_REQUEST,
+    AUTH_REQUEST,
+    ENUMERATE_REQUEST,
+    REMOVE_REQUEST,
+    CANCEL_REQUEST,
+    ENROLL_PROCESS_REQUEST,
+    AUTH_PROCESS_REQUEST,
+    TRIM_REQUEST,
+    WARM_UP_REQUEST,
+    SCHEDULE_REQUEST,
+    SPECULATE_REQUEST,
+    PERSIST_REQUEST,
+    REQUEST_COUNT,
+};
+
+// Indexes of kRequestClasses.
+enum {
+    CONTROL_CLASS,
+    AUTH_FRAME_CLASS,
+    ENROLL_FRAME_CLASS,
+    BACKGROUND_CLASS,
+    REQUEST_CLASS_COUNT,
+};
+
+// The classes the request queue of the service is built with, in priority
+// order.
+extern const FaceRequestClass kRequestClasses[REQUEST_CLASS_COUNT];
+// Class of each request.
+extern const uint8_t kRequestClassOf[REQUEST_COUNT];
+
+const char* requestName(uint32_t what);
+
+}  // namespace implementation
+}  // namespace V1_0
+}  // namespace face
+}  // namespace hardware
+}  // namespace sprd
+}  // namespace vendor
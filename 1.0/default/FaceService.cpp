@@ -0,0 +1,1943 @@
+// FIXME: your file license if you have one
+
+#define LOG_TAG "vendor.sprd.hardware.face@1.0-service"
+#define ATRACE_TAG ATRACE_TAG_HAL
+
+#include <hardware/hw_auth_token.h>
+
+#include <hardware/hardware.h>
+#include <hardware/face.h>
+#include <cutils/properties.h>
+#include <utils/CallStack.h>
+#include <inttypes.h>
+#include <malloc.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <algorithm>
+#include "FaceService.h"
+#include "FaceTrace.h"
+
+namespace vendor {
+namespace sprd {
+namespace hardware {
+namespace face {
+namespace V1_0 {
+namespace implementation {
+
+#define ACTIVE_USER_STORE_PATH_MIN_LEN 2
+
+// Register the service before the vendor module is opened
+#define PROP_LAZY_OPEN "ro.vendor.faceid.lazy_open"
+// How long a synchronous call waits for the vendor module to finish opening
+#define PROP_OPEN_TIMEOUT_MS "ro.vendor.faceid.open_timeout_ms"
+#define DEFAULT_OPEN_TIMEOUT_MS 3000
+
+// Run the vendor library in a supervised worker process. Only the trim and
+// warm-up hooks reach it there: enroll runs unpipelined, matches are never
+// confirmed from the cache and recordings hold no frames.
+#define PROP_ISOLATE "ro.vendor.faceid.isolate"
+
+// Deadline of a single vendor control call (enroll, authenticate, set_active_group...)
+#define PROP_CONTROL_DEADLINE_MS "persist.vendor.faceid.control_deadline_ms"
+#define DEFAULT_CONTROL_DEADLINE_MS 2000
+// Deadline of a single do_enroll_process/do_authenticate_process call
+#define PROP_FRAME_DEADLINE_MS "persist.vendor.faceid.frame_deadline_ms"
+#define DEFAULT_FRAME_DEADLINE_MS 1000
+// Log the stack of a thread stuck in the vendor library
+#define PROP_DUMP_STACK_ON_OVERRUN "persist.vendor.faceid.dump_stack_on_overrun"
+
+// Answer enumerate() from the service template store instead of the vendor library
+#define PROP_STORE_ENUMERATE "persist.vendor.faceid.store_enumerate"
+
+// Overlap enroll frame checks with feature extraction when the vendor library exports both halves
+#define PROP_ENROLL_PIPELINE "persist.vendor.faceid.enroll_pipeline"
+
+// Directory enroll and authenticate sessions are recorded to, for face_replay
+#define PROP_RECORD_DIR "vendor.faceid.record_dir"
+// Size limit of one capture file
+#define PROP_RECORD_MAX_MB "vendor.faceid.record_max_mb"
+#define DEFAULT_RECORD_MAX_MB 256
+// Also record the frame contents, which are biometric data, through face_copy_frame()
+#define PROP_RECORD_FRAMES "vendor.faceid.record_frames"
+
+// Start a background authenticate on userActivity() for authenticate() to join
+#define PROP_SPECULATIVE_AUTH "persist.vendor.faceid.speculative_auth"
+// How long a speculative authenticate runs without authenticate() joining it
+#define PROP_SPECULATIVE_TIMEOUT_MS "persist.vendor.faceid.speculative_timeout_ms"
+#define DEFAULT_SPECULATIVE_TIMEOUT_MS 3000
+// How long a match made ahead of authenticate() may still be handed out
+#define PROP_SPECULATIVE_WINDOW_MS "persist.vendor.faceid.speculative_window_ms"
+#define DEFAULT_SPECULATIVE_WINDOW_MS 1000
+
+// How long after a match another authenticate may be confirmed on one frame; 0 turns it off
+#define PROP_MATCH_CACHE_MS "persist.vendor.faceid.match_cache_ms"
+#define DEFAULT_MATCH_CACHE_MS 0
+// Lowest vendor liveness score of a match that may be confirmed that way
+#define PROP_MATCH_CACHE_MIN_LIVENESS "persist.vendor.faceid.match_cache_min_liveness"
+#define DEFAULT_MATCH_CACHE_MIN_LIVENESS 0
+
+// Every so many failed authenticates the service locks the user out for a while; 0 leaves it to the vendor
+#define PROP_LOCKOUT_TIMED_FAILURES "persist.vendor.faceid.lockout_timed_failures"
+// Failed authenticates to a permanent lockout; 0 leaves it to the vendor
+#define PROP_LOCKOUT_PERMANENT_FAILURES "persist.vendor.faceid.lockout_permanent_failures"
+// Length of a timed lockout the service's thresholds cause
+#define PROP_LOCKOUT_TIMED_MS "persist.vendor.faceid.lockout_timed_ms"
+#define DEFAULT_LOCKOUT_TIMED_MS 30000
+
+// Oldest auth token, by its timestamp, enroll, setFeature and resetLockout take; 0 takes any.
+// Only for devices whose TEE stamps tokens on the CLOCK_BOOTTIME timeline.
+#define PROP_HAT_MAX_AGE_MS "persist.vendor.faceid.hat_max_age_ms"
+#define DEFAULT_HAT_MAX_AGE_MS 0
+
+void FaceService::onRequest(FaceRequest& request) {
+    face_device_t* device = mDevice;
+    uint32_t frame = request.frame;
+    ATRACE_INT("face.looper_queue", --mQueueDepth);
+    uint32_t what = request.what;
+    FaceTraceScope trace(requestName(what), request.session, frame);
+    if (what != ENROLL_PROCESS_REQUEST) {
+        // Nothing but the check of the next frame runs alongside an
+        // extraction.
+        mEnrollPipeline.drain();
+    }
+    updateSessions();
+    switch (what) {
+    case ENROLL_REQUEST:
+    case AUTH_REQUEST:
+    {
+        ALOGD("onRequest %s", requestName(what));
+        admitSession(request);
+        break;
+    }
+    case ENUMERATE_REQUEST:
+    {
+        ALOGD("onRequest ENUMERATE_REQUEST");
+        mMaintenanceClient = request.client;
+        ATRACE_NAME("vendor enumerate");
+        FaceWatchdog::Scope scope(mWatchdog, "enumerate", mControlDeadlineMs);
+        device->enumerate(device);
+        break;
+    }
+    case REMOVE_REQUEST:
+    {
+        ALOGD("onRequest REMOVE_REQUEST");
+        uint32_t faceId = (uint32_t)request.args[0];
+        mMaintenanceClient = request.client;
+        mHeldMatch.clear();
+        mMatchCache.clear(FaceMatchCache::TEMPLATES_CHANGED);
+        ATRACE_NAME("vendor remove");
+        FaceWatchdog::Scope scope(mWatchdog, "remove", mControlDeadlineMs);
+        device->remove(device, faceId);
+        break;
+    }
+    case CANCEL_REQUEST:
+    {
+        ALOGD("onRequest CANCEL_REQUEST");
+        cancelSession(request.client);
+        break;
+    }
+    case ENROLL_PROCESS_REQUEST:
+    {
+        ALOGD("onRequest ENROLL_PROCESS_REQUEST");
+        int64_t addr = request.args[0];
+        mCurrentFrame = frame;
+        {
+            std::lock_guard<std::mutex> lock(mCancelledMutex);
+            if(mCancelled) {
+                mSessionLog.addFrame(request.session, FaceSessionLog::SKIPPED);
+                endFrameTrace(frame);
+                return;
+            }
+        }
+        if (!acceptFrame(request)) {
+            replyEnrollProcessed(request.client, addr);
+            endFrameTrace(frame);
+            return;
+        }
+        if(!mAlgoInitialized) {
+            ALOGD("doEnrollProcess ignore as not initialized");
+            mSessionLog.addFrame(request.session, FaceSessionLog::SKIPPED);
+            replyEnrollProcessed(request.client, addr);
+        } else if (mEnrollPipelined) {
+            // The extraction stage ends the frame.
+            checkEnrollFrame(request);
+            break;
+        } else {
+            int64_t start = mClock();
+            mFrameClient = request.client;
+            int err;
+            {
+                ATRACE_NAME("vendor do_enroll_process");
+                FaceWatchdog::Scope scope(mWatchdog, "do_enroll_process", mFrameDeadlineMs);
+                err = device->do_enroll_process(device, addr, request.info.data(), request.info.size(),
+                        request.byteInfo.data(), request.byteInfo.size());
+            }
+            if (err != 0) {
+                // The vendor never saw the frame, or never will report it
+                // processed: a worker that died, hung or had no room.
+                dropVendorFrame(request, "do_enroll_process", err);
+                replyEnrollProcessed(request.client, addr);
+                endFrameTrace(frame);
+                break;
+            }
+            int64_t latencyUs = mClock() - start;
+            mStats.enrollExtracts++;
+            mStats.enrollExtractUs += latencyUs;
+            onFrameProcessed(request, latencyUs, ENROLL_FRAME_CLASS);
+        }
+        endFrameTrace(frame);
+        break;
+    }
+    case AUTH_PROCESS_REQUEST:
+    {
+        ALOGD("onRequest AUTH_PROCESS_REQUEST");
+        int64_t main = request.args[0];
+        int64_t sub = request.args[1];
+        int64_t otp = request.args[2];
+        mCurrentFrame = frame;
+        {
+            std::lock_guard<std::mutex> lock(mCancelledMutex);
+            if(mCancelled) {
+                mSessionLog.addFrame(request.session, FaceSessionLog::SKIPPED);
+                endFrameTrace(frame);
+                return;
+            }
+        }
+        if (!acceptFrame(request)) {
+            replyAuthProcessed(request.client, main, sub);
+            endFrameTrace(frame);
+            return;
+        }
+        if(!mAlgoInitialized) {
+            ALOGD("doAuthenticateProcess ignore as not initialized");
+            mSessionLog.addFrame(request.session, FaceSessionLog::SKIPPED);
+            replyAuthProcessed(request.client, main, sub);
+        } else {
+            int64_t start = mClock();
+            mLastAuthFrameUs = start;
+            mFrameClient = request.client;
+            int err;
+            {
+                ATRACE_NAME("vendor do_authenticate_process");
+                FaceWatchdog::Scope scope(mWatchdog, "do_authenticate_process", mFrameDeadlineMs);
+                err = device->do_authenticate_process(device, main, sub, otp, request.info.data(),
+                        request.info.size(), request.byteInfo.data(), request.byteInfo.size());
+            }
+            if (err != 0) {
+                dropVendorFrame(request, "do_authenticate_process", err);
+                replyAuthProcessed(request.client, main, sub);
+            } else {
+                onFrameProcessed(request, mClock() - start, AUTH_FRAME_CLASS);
+            }
+        }
+        endFrameTrace(frame);
+        break;
+    }
+    case TRIM_REQUEST:
+    {
+        ALOGD("onRequest TRIM_REQUEST");
+        trimResources((int)request.args[0]);
+        break;
+    }
+    case WARM_UP_REQUEST:
+    {
+        ALOGD("onRequest WARM_UP_REQUEST");
+        warmUpIfTrimmed();
+        break;
+    }
+    case SCHEDULE_REQUEST:
+        // updateSessions() did the work.
+        break;
+    case SPECULATE_REQUEST:
+    {
+        ALOGD("onRequest SPECULATE_REQUEST");
+        startSpeculation(request);
+        break;
+    }
+    case PERSIST_REQUEST:
+    {
+        ALOGD("onRequest PERSIST_REQUEST");
+        mPersistPosted = false;
+        mTemplateStore.flush();
+        mLockout.save(bootTimeUs());
+        break;
+    }
+    default:
+        break;
+    }
+}
+
+FaceService* FaceService::sInstance = nullptr;
+
+FaceService::FaceService(Opener opener, const Options& options)
+        : mClock(options.clock != nullptr ? options.clock : monotonicUs), mManualLooper(options.manualLooper),
+        mMaintenanceClient(kNoClient), mFrameClient(kNoClient), mEndedSession(0), mSwallowCancel(false),
+        mTimeoutPending(false), mTimedOutSession(0), mExpiredSpeculation(0),
+        mClientsGone(false), mPersistPosted(false),
+        mUserId(-1), mDevice(nullptr), mCancelled(false), mSessionStale(false),
+        mDisabledFeatureMask(0), mAlgoInitialized(false),
+        mWatchdog([this](const char* name, pid_t tid) { onDeadlineExceeded(name, tid); }),
+        mHalState(HAL_OPENING), mHooks(),
+        mIdlePolicy([this](int reason) {
+            FaceRequest* request = obtainRequest(TRIM_REQUEST);
+            request->args[0] = reason;
+            post(request);
+        }),
+        mTrimmed(false), mAuthStartUs(0), mAuthCold(false), mCaptureFrames(false),
+        mEnrollPipeline([this](FaceRequest& frame, const FaceEnrollQuality& quality, int64_t waitUs) {
+            extractEnrollFrame(frame, quality, waitUs);
+        }),
+        mEnrollPipelined(false), mEnrollStartUs(0), mLastExtractUs(0),
+        mSpeculative(false), mSpeculativeTimeoutMs(0), mSpeculativeWindowUs(0), mSpeculating(false),
+        mSpeculationRejected(false), mMatchCacheWindowUs(0), mMatchCacheMinLiveness(0), mLastAuthFrameUs(0),
+        mConfirmingMatch(false),
+        mSessionId(0), mTracedSessionId(0), mFrameSeq(0), mCurrentFrame(0),
+        mQueueDepth(0), mFramesInFlight(0) {
+    sInstance = this; // keep track of the most recent instance
+    mControlDeadlineMs = property_get_int32(PROP_CONTROL_DEADLINE_MS, DEFAULT_CONTROL_DEADLINE_MS);
+    mFrameDeadlineMs = property_get_int32(PROP_FRAME_DEADLINE_MS, DEFAULT_FRAME_DEADLINE_MS);
+    mSpeculative = property_get_bool(PROP_SPECULATIVE_AUTH, false);
+    mSpeculativeTimeoutMs = property_get_int32(PROP_SPECULATIVE_TIMEOUT_MS, DEFAULT_SPECULATIVE_TIMEOUT_MS);
+    mSpeculativeWindowUs = (int64_t)property_get_int32(PROP_SPECULATIVE_WINDOW_MS, DEFAULT_SPECULATIVE_WINDOW_MS) * 1000;
+    mMatchCacheWindowUs = (int64_t)property_get_int32(PROP_MATCH_CACHE_MS, DEFAULT_MATCH_CACHE_MS) * 1000;
+    mMatchCacheMinLiveness = property_get_int32(PROP_MATCH_CACHE_MIN_LIVENESS, DEFAULT_MATCH_CACHE_MIN_LIVENESS);
+    mLockout.setThresholds(property_get_int32(PROP_LOCKOUT_TIMED_FAILURES, 0),
+            property_get_int32(PROP_LOCKOUT_PERMANENT_FAILURES, 0),
+            (int64_t)property_get_int32(PROP_LOCKOUT_TIMED_MS, DEFAULT_LOCKOUT_TIMED_MS) * 1000);
+    mAuthTokens.setMaxAgeMs(property_get_int32(PROP_HAT_MAX_AGE_MS, DEFAULT_HAT_MAX_AGE_MS));
+    mStats.serviceStartUs = bootTimeUs();
+    mFrameRate.init();
+    memset(&mToken, 0, sizeof(mToken));
+    memset(mDisabledFeatures, 0, sizeof(mDisabledFeatures));
+    mRequests.reset(new FaceRequestQueue("FaceRequestLooper", kRequestClasses, REQUEST_CLASS_COUNT,
+            [this](FaceRequest& request) { onRequest(request); }));
+    mRequests->setClock(mClock);
+    if (property_get_bool(PROP_LAZY_OPEN, false)) {
+        // Requests posted meanwhile stay queued on the looper, which is
+        // only started once the device is usable.
+        mOpenThread = std::thread(&FaceService::openDevice, this, opener);
+    } else {
+        openDevice(opener);
+    }
+}
+
+FaceService::~FaceService() {
+    ALOGD("~FaceService()");
+    if (mOpenThread.joinable()) {
+        mOpenThread.join();
+    }
+    // Whatever is still queued never reaches the vendor library.
+    mEnrollPipeline.drain();
+    mRequests->stop();
+    if (sInstance == this) {
+        sInstance = nullptr;
+    }
+    if (mDevice == nullptr) {
+        ALOGE("No valid device");
+        return;
+    }
+    int err;
+    if (0 != (err = mDevice->common.close(
+            reinterpret_cast<hw_device_t*>(mDevice)))) {
+        ALOGE("Can't close face module, error: %d", err);
+        return;
+    }
+    mDevice = nullptr;
+}
+
+void FaceService::openDevice(Opener opener) {
+    mStats.halOpenStartUs = bootTimeUs();
+    int64_t start = mClock();
+    face_device_t* device = nullptr;
+    if (property_get_bool(PROP_ISOLATE, false)) {
+        // mHooks stays empty, the worker forwards trim and warm-up itself.
+        ALOGD("isolated vendor library: no pipelined enroll, match confirmation or frame recording");
+        mWorker.reset(new FaceWorkerClient(FaceService::notify, &mStats));
+        device = mWorker->start();
+    } else {
+        device = opener(FaceService::notify);
+        loadFaceVendorHooks(device, &mHooks);
+    }
+    mStats.halOpenDurationUs = mClock() - start;
+    {
+        std::lock_guard<std::mutex> lock(mHalStateMutex);
+        mDevice = device;
+        mHalState.store(device ? HAL_READY : HAL_FAILED, std::memory_order_release);
+    }
+    if (!device) {
+        ALOGE("Can't open HAL module");
+    } else {
+        mEnrollPipelined = mHooks.enrollCheck != nullptr && property_get_bool(PROP_ENROLL_PIPELINE, true);
+        if (mEnrollPipelined) {
+            mEnrollPipeline.start();
+            mSessionLog.watch(FaceSessionLog::PIPELINE_THREAD, mEnrollPipeline.nativeThread());
+        }
+        if (!mManualLooper) {
+            mRequests->start();
+            mSessionLog.watch(FaceSessionLog::REQUEST_THREAD, mRequests->nativeThread());
+        }
+        mIdlePolicy.start();
+    }
+    mStats.halReadyUs = bootTimeUs();
+    mHalStateCondition.notify_all();
+    ALOGD("face HAL opened in %" PRId64 "us", mStats.halOpenDurationUs.load());
+}
+
+// Blocks synchronous calls that arrive while the vendor module is still
+// being opened in the background. Returns nullptr if it is not usable.
+face_device_t* FaceService::waitForDevice() {
+    if (HAL_OPENING == mHalState.load(std::memory_order_acquire)) {
+        static const int32_t timeoutMs = property_get_int32(PROP_OPEN_TIMEOUT_MS, DEFAULT_OPEN_TIMEOUT_MS);
+        mStats.callsWaitedForHal++;
+        std::unique_lock<std::mutex> lock(mHalStateMutex);
+        if (!mHalStateCondition.wait_for(lock, std::chrono::milliseconds(timeoutMs),
+                [this] { return HAL_OPENING != mHalState.load(std::memory_order_acquire); })) {
+            mStats.callsTimedOutForHal++;
+            ALOGE("Timed out waiting for face HAL");
+            return nullptr;
+        }
+    }
+    return mDevice;
+}
+
+bool FaceService::isHalFailed() const {
+    return HAL_FAILED == mHalState.load(std::memory_order_acquire);
+}
+
+// A vendor call or an enroll session ran past its deadline, on the
+// watchdog thread. The session's frames are dropped and the client is told
+// right away, its callbacks are oneway; the looper cancels the vendor
+// library as soon as it gets to it, and whatever the vendor reports late
+// is dropped. Nothing here waits: with the vendor hung the control class
+// may be full for good.
+void FaceService::onDeadlineExceeded(const char* name, pid_t tid) {
+    if (0 == tid && mSpeculating) {
+        // Nobody asked for this session, nobody is told it ended.
+        ALOGD("%s ran out", name);
+        mExpiredSpeculation = mSessions.session();
+        schedule();
+        return;
+    }
+    ALOGE("%s missed its deadline", name);
+    if (0 == tid) {
+        mStats.sessionTimeouts++;
+    } else {
+        mStats.deadlineOverruns++;
+        if (property_get_bool(PROP_DUMP_STACK_ON_OVERRUN, false)) {
+            android::CallStack stack;
+            stack.update(0, tid);
+            stack.log(LOG_TAG, ANDROID_LOG_ERROR, name);
+        }
+    }
+    {
+        std::lock_guard<std::mutex> lock(mCancelledMutex);
+        if (mSessionStale) {
+            return;
+        }
+        mCancelled = true;
+        mSessionStale = true;
+    }
+    mSessionLog.end(mSessions.session(), FaceSessionLog::TIMED_OUT);
+    mAlgoInitialized = false;
+    endSessionTrace();
+    std::shared_ptr<FaceClient> client = sessionClient();
+    if (client != nullptr) {
+        client->callback->onError(mUserId, FACE_ERROR_TIMEOUT);
+    }
+    mTimedOutSession = mSessions.session();
+    mTimeoutPending = true;
+    schedule();
+}
+
+// On the looper, for a deadline the watchdog reported.
+void FaceService::handleTimeout() {
+    if (mSessions.owner() != kNoClient && mSessions.session() != mTimedOutSession) {
+        // The session ended meanwhile and the device went on to the next.
+        return;
+    }
+    cancelSession(kNoClient);
+}
+
+// Runs on the looper, so it never races a vendor call. Sessions in
+// progress are left alone, a PSI trim during one only gets the next one.
+void FaceService::trimResources(int reason) {
+    if (mAlgoInitialized) {
+        ALOGD("trim skipped, session in progress");
+        return;
+    }
+    if (FaceIdlePolicy::TRIM_IDLE == reason && mTrimmed) {
+        return;
+    }
+    int level = FaceIdlePolicy::TRIM_IDLE == reason ? FACE_TRIM_IDLE : FACE_TRIM_MEMORY_PRESSURE;
+    int64_t before = residentSetKb();
+    int64_t vendorBefore = before;
+    int64_t vendorAfter = -1;
+    int ret = 0;
+    ATRACE_NAME("vendor trim_memory");
+    if (mWorker) {
+        ret = mWorker->trimMemory(level, &vendorBefore, &vendorAfter);
+    } else if (mHooks.trimMemory != nullptr) {
+        ret = mHooks.trimMemory(mDevice, level);
+    }
+    if (ret != 0) {
+        ALOGE("vendor trim_memory failed: %d", ret);
+    }
+    std::shared_ptr<const FaceTemplateSnapshot> snapshot = mTemplateStore.snapshot();
+    if (snapshot != nullptr) {
+        snapshot->release();
+    }
+#ifdef M_PURGE
+    mallopt(M_PURGE, 0);
+#endif
+    int64_t after = residentSetKb();
+    if (!mWorker) {
+        vendorAfter = after;
+    }
+    mTrimmed = true;
+    if (FaceIdlePolicy::TRIM_IDLE == reason) {
+        mStats.idleTrims++;
+    } else {
+        mStats.pressureTrims++;
+    }
+    mStats.activeRssKb = before;
+    mStats.idleRssKb = after;
+    mStats.vendorActiveRssKb = vendorBefore;
+    mStats.vendorIdleRssKb = vendorAfter;
+    ALOGD("trimmed (reason %d): rss %" PRId64 "kB -> %" PRId64 "kB", reason, before, after);
+}
+
+// Runs on the looper ahead of the first session after a trim, or as soon
+// as userActivity() hints that one is coming.
+void FaceService::warmUpIfTrimmed() {
+    if (!mTrimmed.exchange(false)) {
+        return;
+    }
+    int64_t start = mClock();
+    int ret = 0;
+    ATRACE_NAME("vendor warm_up");
+    if (mWorker) {
+        ret = mWorker->warmUp();
+    } else if (mHooks.warmUp != nullptr) {
+        ret = mHooks.warmUp(mDevice);
+    }
+    if (ret != 0) {
+        ALOGE("vendor warm_up failed: %d", ret);
+    }
+    mStats.warmUps++;
+    mStats.lastWarmUpUs = mClock() - start;
+}
+
+// Never call with mCancelledMutex held: a full queue waits for the
+// request thread, which may need it.
+FaceRequest* FaceService::obtainRequest(uint32_t what, const FaceClient* client) {
+    FaceRequest* request = mRequests->beginPush(kRequestClassOf[what]);
+    request->what = what;
+    request->client = client != nullptr ? client->id : kNoClient;
+    request->session = client != nullptr ? client->session.load() : mSessionId.load(std::memory_order_relaxed);
+    return request;
+}
+
+// For a hint that may be dropped: returns nullptr if the class is full,
+// which it stays while the looper is stuck in the vendor library.
+FaceRequest* FaceService::tryObtainRequest(uint32_t what, const FaceClient* client) {
+    FaceRequest* request = mRequests->tryBeginPush(kRequestClassOf[what]);
+    if (request != nullptr) {
+        request->what = what;
+        request->client = client != nullptr ? client->id : kNoClient;
+        request->session = client != nullptr ? client->session.load() : mSessionId.load(std::memory_order_relaxed);
+    }
+    return request;
+}
+
+// Has the looper warm the vendor library up ahead of a session, unless
+// the control class is full.
+void FaceService::postWarmUp() {
+    FaceRequest* request = tryObtainRequest(WARM_UP_REQUEST);
+    if (request != nullptr) {
+        post(request);
+    }
+}
+
+// Returns nullptr if the class of the frame is full; the caller hands the
+// buffer back to the camera at once.
+FaceRequest* FaceService::obtainFrameRequest(uint32_t what, const FaceClient* client, uint32_t frame) {
+    FaceRequest* request = mRequests->tryBeginPush(kRequestClassOf[what]);
+    if (request == nullptr) {
+        mStats.droppedFrames++;
+        mSessionLog.addFrame(frameSession(client), FaceSessionLog::DROPPED);
+        endFrameTrace(frame);
+        return nullptr;
+    }
+    request->what = what;
+    request->client = client != nullptr ? client->id : kNoClient;
+    request->session = frameSession(client);
+    request->frame = frame;
+    return request;
+}
+
+void FaceService::post(FaceRequest* request) {
+    request->postedUs = mClock();
+    ATRACE_INT("face.looper_queue", ++mQueueDepth);
+    mRequests->endPush(request);
+}
+
+// First half of a pipelined enroll frame, on the request thread.
+void FaceService::checkEnrollFrame(FaceRequest& request) {
+    int64_t addr = request.args[0];
+    FaceEnrollQuality quality = {};
+    int64_t start = mClock();
+    int acquired;
+    {
+        ATRACE_NAME("vendor face_enroll_check");
+        FaceWatchdog::Scope scope(mWatchdog, "face_enroll_check", mFrameDeadlineMs);
+        acquired = mHooks.enrollCheck(mDevice, addr, request.info.data(), request.info.size(),
+                request.byteInfo.data(), request.byteInfo.size(), &quality);
+    }
+    int64_t checkUs = mClock() - start;
+    mStats.enrollChecks++;
+    mStats.enrollCheckUs += checkUs;
+    if (acquired != 0) {
+        mStats.enrollRejects++;
+        face_msg_t msg;
+        memset(&msg, 0, sizeof(msg));
+        msg.type = FACE_ACQUIRED;
+        msg.data.acquired = static_cast<decltype(msg.data.acquired)>(acquired);
+        notify(&msg);
+        replyEnrollProcessed(request.client, addr);
+        endFrameTrace(request.frame);
+    } else {
+        mEnrollCoverage.add(quality);
+        if (!mEnrollPipeline.push(request, quality)) {
+            mStats.droppedFrames++;
+            mSessionLog.addFrame(request.session, FaceSessionLog::DROPPED);
+            replyEnrollProcessed(request.client, addr);
+            endFrameTrace(request.frame);
+        }
+    }
+    // The slower of the two stages sets the pace.
+    onFrameProcessed(request, std::max(checkUs, mLastExtractUs.load(std::memory_order_relaxed)), ENROLL_FRAME_CLASS);
+}
+
+// Second half, on the pipeline thread.
+void FaceService::extractEnrollFrame(FaceRequest& frame, const FaceEnrollQuality& quality, int64_t waitUs) {
+    FaceTraceScope trace("extract", frame.session, frame.frame);
+    {
+        std::lock_guard<std::mutex> lock(mCancelledMutex);
+        if (mCancelled) {
+            endFrameTrace(frame.frame);
+            return;
+        }
+    }
+    int64_t start = mClock();
+    mFrameClient = frame.client;
+    {
+        ATRACE_NAME("vendor face_enroll_extract");
+        FaceWatchdog::Scope scope(mWatchdog, "face_enroll_extract", mFrameDeadlineMs);
+        mHooks.enrollExtract(mDevice, frame.args[0], frame.info.data(), frame.info.size(),
+                frame.byteInfo.data(), frame.byteInfo.size(), &quality);
+    }
+    int64_t extractUs = mClock() - start;
+    mLastExtractUs = extractUs;
+    mStats.enrollExtracts++;
+    mStats.enrollExtractUs += extractUs;
+    mStats.enrollWaitUs += waitUs;
+    endFrameTrace(frame.frame);
+}
+
+// Hands a frame buffer back to the client that sent it, for a frame the
+// vendor library processed or never got.
+void FaceService::replyEnrollProcessed(uint32_t clientId, int64_t addr) {
+    std::shared_ptr<FaceClient> client = mClients.get(clientId);
+    if (client != nullptr && client->has(CLIENT_FRAMES)) {
+        client->callback->onEnrollProcessed(addr);
+    }
+}
+
+void FaceService::replyAuthProcessed(uint32_t clientId, int64_t main, int64_t sub) {
+    std::shared_ptr<FaceClient> client = mClients.get(clientId);
+    if (client != nullptr && client->has(CLIENT_FRAMES)) {
+        client->callback->onAuthProcessed(main, sub);
+    }
+}
+
+// A frame call the vendor library failed; it sends no PROCESSED for it,
+// the caller hands the buffer back.
+void FaceService::dropVendorFrame(const FaceRequest& request, const char* name, int err) {
+    ALOGE("%s failed: %d, frame %u dropped", name, err, request.frame);
+    mStats.droppedFrames++;
+    mSessionLog.addFrame(request.session, FaceSessionLog::DROPPED);
+}
+
+// Called on the request thread after each frame the vendor library saw;
+// that frame still counts in its class until the handler returns.
+void FaceService::onFrameProcessed(const FaceRequest& request, int64_t latencyUs, size_t cls) {
+    mSessionLog.addFrame(request.session, FaceSessionLog::PROCESSED);
+    std::shared_ptr<FaceClient> client = mClients.get(request.client);
+    if (client != nullptr) {
+        client->frames++;
+        client->frameUs += mClock() - request.postedUs;
+    }
+    size_t queued = mRequests->size(cls);
+    uint32_t fps = mFrameRate.onFrameProcessed(latencyUs, queued > 0 ? queued - 1 : 0, mClock());
+    if (!mSpeculating) {
+        reportFrameRate(fps);
+    }
+}
+
+void FaceService::reportFrameRate(uint32_t fps) {
+    if (fps == 0) {
+        return;
+    }
+    ALOGD("onRecommendedFrameRate(%u)", fps);
+    ATRACE_INT("face.recommended_fps", fps);
+    std::shared_ptr<FaceClient> client = frameSender();
+    if (client != nullptr && client->has(CLIENT_FRAME_RATE)) {
+        client->callback->onRecommendedFrameRate(fps);
+    }
+}
+
+// The client that sends the frames of the running session: its owner, or
+// the last client registered that sends frames if the owner sends none.
+// A oneway frame carries no caller pid and is taken to be from it.
+std::shared_ptr<FaceClient> FaceService::frameSender() const {
+    std::shared_ptr<FaceClient> client = sessionClient();
+    if (client == nullptr || !client->has(CLIENT_FRAMES)) {
+        std::shared_ptr<FaceClient> sender = mClients.latestWith(CLIENT_FRAMES);
+        if (sender != nullptr) {
+            return sender;
+        }
+    }
+    return client;
+}
+
+// The session of a client that sends no frames, the front end of another
+// HAL in this process, runs on the frames of the camera client.
+bool FaceService::runsOnFramesOf(uint32_t owner, const FaceClient* sender) const {
+    if (sender == nullptr || sender->id == owner || !sender->has(CLIENT_FRAMES)) {
+        return false;
+    }
+    std::shared_ptr<FaceClient> client = mClients.get(owner);
+    return client != nullptr && !client->has(CLIENT_FRAMES);
+}
+
+// Frames are tagged with the last session their client asked for, or,
+// sent for the session of another client, the last one anybody asked for.
+uint32_t FaceService::frameSession(const FaceClient* client) const {
+    if (client == nullptr) {
+        return mSessionId.load(std::memory_order_relaxed);
+    }
+    uint32_t owner = mSessions.owner();
+    if (client->has(CLIENT_FRAMES) && client->id != owner &&
+            (owner == kNoClient || runsOnFramesOf(owner, client))) {
+        return mSessionId.load(std::memory_order_relaxed);
+    }
+    return client->session.load();
+}
+
+// The client session events go to: the owner of the device, or the last
+// client registered while nobody owns it. Nobody gets the events of a
+// session whose owner died.
+std::shared_ptr<FaceClient> FaceService::sessionClient() const {
+    uint32_t owner = mSessions.owner();
+    return owner != kNoClient ? mClients.get(owner) : mClients.latest();
+}
+
+std::shared_ptr<FaceClient> FaceService::addClient(pid_t pid, const std::shared_ptr<FaceClientCallback>& callback,
+        uint32_t flags, std::shared_ptr<FaceClient>* replaced) {
+    std::shared_ptr<FaceClient> client = mClients.add(pid, callback, flags, replaced);
+    ALOGD("client %u is pid %d", client->id, client->pid);
+    return client;
+}
+
+// On a binder thread, when a client died or cleared its callback. The
+// client is forgotten at once so nothing is sent to it anymore, and its
+// frames still queued are skipped without reaching the vendor library;
+// the request thread then cancels its session. Nothing here waits: with
+// the vendor hung the control class may be full for good.
+void FaceService::removeClient(uint32_t clientId) {
+    std::shared_ptr<FaceClient> client = mClients.remove(clientId);
+    if (client == nullptr) {
+        return;
+    }
+    ALOGE("client %u (pid %d) is gone", client->id, client->pid);
+    if (mSessions.owner() == clientId) {
+        std::lock_guard<std::mutex> lock(mCancelledMutex);
+        mCancelled = true;
+    }
+    mClientsGone = true;
+    schedule();
+}
+
+// On the looper, after clients were removed. A start one of them parked
+// is skipped once its turn comes.
+void FaceService::dropGoneClients() {
+    uint32_t maintenance = mMaintenanceClient;
+    if (maintenance != kNoClient && mClients.get(maintenance) == nullptr) {
+        mMaintenanceClient = kNoClient;
+    }
+    uint32_t owner = mSessions.owner();
+    if (owner != kNoClient && mClients.get(owner) == nullptr) {
+        {
+            std::lock_guard<std::mutex> lock(mCancelledMutex);
+            mCancelled = true;
+        }
+        stopSession(false);
+    }
+}
+
+// Session starts, on the request thread.
+void FaceService::admitSession(FaceRequest& request) {
+    if (request.client != kNoClient && mClients.get(request.client) == nullptr) {
+        ALOGD("client %u is gone, not starting its session", request.client);
+        return;
+    }
+    bool authenticate = request.what == AUTH_REQUEST;
+    if (authenticate && (joinSpeculation(request) || takeHeldMatch(request))) {
+        return;
+    }
+    if (mSpeculating) {
+        // Whatever comes in has the device before a guess.
+        stopSession(false);
+    }
+    switch (mSessions.admit(request.client, authenticate)) {
+    case FaceSessionArbiter::PARK:
+        ALOGD("client %u waits for client %u", request.client, mSessions.owner());
+        mSessions.park(request.client, request, authenticate, mClock());
+        return;
+    case FaceSessionArbiter::PREEMPT:
+        preemptSession();
+        break;
+    default:
+        break;
+    }
+    startSession(request);
+}
+
+// A speculative authenticate, on the request thread. It runs for the
+// client that sent userActivity(), on the frames that client sends
+// meanwhile, until authenticate() joins it or it runs out.
+void FaceService::startSpeculation(FaceRequest& request) {
+    std::shared_ptr<FaceClient> client = mClients.get(request.client);
+    // Anything that got the device meanwhile goes first, and a session
+    // the client started since makes the guess pointless.
+    if (mSessions.owner() != kNoClient || client == nullptr || client->session != request.session) {
+        return;
+    }
+    mHeldMatch.clear();
+    mSpeculating = true;
+    mStats.speculativeSessions++;
+    request.what = AUTH_REQUEST;
+    request.args[0] = 0;
+    startSession(request);
+    mWatchdog.armSession("speculative authenticate", mSpeculativeTimeoutMs);
+}
+
+// An authenticate from the client a speculative session runs for, and for
+// the operation it runs with, takes the session over as it is.
+bool FaceService::joinSpeculation(FaceRequest& request) {
+    {
+        std::lock_guard<std::mutex> lock(mCancelledMutex);
+        if (!mSpeculating || mSessions.owner() != request.client || request.args[0] != 0) {
+            return false;
+        }
+        mSpeculating = false;
+    }
+    ALOGD("authenticate joins speculative session %u", mSessions.session());
+    mWatchdog.disarmSession();
+    mSessionLog.rebind(mSessions.session(), request.session);
+    mSessions.grant(request.client, request.session, true, mClock());
+    mSpeculationRejected = false;
+    mStats.speculativeJoins++;
+    reportFrameRate(mFrameRate.onSessionStart(mClock()));
+    return true;
+}
+
+// Answers an authenticate with the match a speculative session already
+// made, if it was made for this user and operation and is still fresh.
+bool FaceService::takeHeldMatch(const FaceRequest& request) {
+    std::shared_ptr<FaceClient> client = mClients.get(request.client);
+    uint32_t faceId;
+    std::vector<uint8_t> token;
+    if (client == nullptr ||
+            !mHeldMatch.take(mUserId, (uint64_t)request.args[0], mClock(), mSpeculativeWindowUs, &faceId, &token)) {
+        return false;
+    }
+    ALOGD("authenticate answered by a speculative match");
+    mStats.speculativeHits++;
+    mSpeculationRejected = false;
+    int64_t latencyUs = mClock() - mAuthStartUs;
+    if (mAuthCold) {
+        mStats.coldUnlocks++;
+        mStats.lastColdUnlockUs = latencyUs;
+    } else {
+        mStats.warmUnlocks++;
+        mStats.lastWarmUnlockUs = latencyUs;
+    }
+    client->callback->onAuthenticated(faceId, mUserId, token.data(), token.size());
+    return true;
+}
+
+void FaceService::expireSpeculation(uint32_t session) {
+    // Joined or ended meanwhile.
+    if (!mSpeculating || mSessions.session() != session) {
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(mCancelledMutex);
+        mCancelled = true;
+    }
+    mSessionLog.end(session, FaceSessionLog::TIMED_OUT);
+    stopSession(false);
+}
+
+void FaceService::startSession(FaceRequest& request) {
+    {
+        std::lock_guard<std::mutex> lock(mCancelledMutex);
+        mCancelled = false;
+        mSessionStale = false;
+    }
+    mSessions.grant(request.client, request.session, request.what == AUTH_REQUEST, mClock());
+    mSessionLog.begin(request.session, request.client, request.what == AUTH_REQUEST);
+    std::shared_ptr<FaceClient> client = mClients.get(request.client);
+    if (client != nullptr) {
+        client->sessions++;
+    }
+    warmUpIfTrimmed();
+    if (request.what == ENROLL_REQUEST) {
+        int32_t timeoutSec = (int32_t)request.args[0];
+        size_t size = std::min(request.info.size(), (size_t)kMaxFeatures);
+        memset(&mToken, 0, sizeof(mToken));
+        memcpy(&mToken, request.byteInfo.data(), std::min(request.byteInfo.size(), sizeof(mToken)));
+        mDisabledFeatureMask = 0;
+        for (size_t i = 0; i < size; i++) {
+            mDisabledFeatures[i] = request.info[i];
+            mDisabledFeatureMask |= 1u << request.info[i];
+        }
+        int err;
+        {
+            ATRACE_NAME("vendor enroll");
+            FaceWatchdog::Scope scope(mWatchdog, "enroll", mControlDeadlineMs);
+            err = mDevice->enroll(mDevice, &mToken, timeoutSec, mDisabledFeatures, size);
+        }
+        // enroll() checked the features, which leaves the token.
+        mAuthTokens.onVendorVerdict(reinterpret_cast<const uint8_t*>(request.byteInfo.data()),
+                request.byteInfo.size(), err != FACE_ILLEGAL_ARGUMENT);
+        mEnrollCoverage.reset();
+        mEnrollStartUs = mClock();
+        mWatchdog.armSession("enroll session", timeoutSec * 1000);
+    } else {
+        mConfirmingMatch = !mSpeculating && confirmCachedMatch((uint64_t)request.args[0]);
+        if (!mConfirmingMatch) {
+            ATRACE_NAME("vendor authenticate");
+            FaceWatchdog::Scope scope(mWatchdog, "authenticate", mControlDeadlineMs);
+            mDevice->authenticate(mDevice, (uint64_t)request.args[0]);
+        }
+    }
+    uint32_t fps = mFrameRate.onSessionStart(mClock());
+    // A speculative session only needs the first few frames.
+    reportFrameRate(mSpeculating ? mFrameRate.minFps() : fps);
+    if (request.what == AUTH_REQUEST && !mSpeculating) {
+        mSpeculationRejected = false;
+    }
+    mAlgoInitialized = true;
+}
+
+// Starts the authenticate as a confirmation of the last match, if there is
+// a fresh one for this user. The vendor still needs a live frame of the
+// same face and signs the token for |operationId| itself.
+bool FaceService::confirmCachedMatch(uint64_t operationId) {
+    FaceRecentMatch recent;
+    if (mHooks.authenticateConfirm == nullptr ||
+            !mMatchCache.take(mUserId, mClock(), mMatchCacheWindowUs, mMatchCacheMinLiveness, &recent)) {
+        return false;
+    }
+    int ret;
+    {
+        ATRACE_NAME("vendor face_authenticate_confirm");
+        FaceWatchdog::Scope scope(mWatchdog, "authenticate_confirm", mControlDeadlineMs);
+        ret = mHooks.authenticateConfirm(mDevice, operationId, &recent);
+    }
+    ALOGD("authenticate confirms fid=%u from %" PRId64 "us ago: %d", recent.faceId, recent.ageUs, ret);
+    return ret == 0;
+}
+
+// From notify(), on a match. The liveness score is asked for on the
+// request thread, not from inside the vendor's callback. A confirmed match
+// is not cached again, or one full attempt could unlock for as long as
+// authenticates kept coming.
+void FaceService::cacheMatch(uint32_t faceId) {
+    if (mHooks.authenticateConfirm != nullptr && mMatchCacheWindowUs > 0 && !mConfirmingMatch) {
+        mMatchCache.store(faceId, mUserId, mLastAuthFrameUs);
+    }
+}
+
+// Ends another client's enroll for an authenticate.
+void FaceService::preemptSession() {
+    ALOGD("preempting the session of client %u", mSessions.owner());
+    std::shared_ptr<FaceClient> client = stopSession(true);
+    if (client != nullptr) {
+        client->preempted++;
+    }
+}
+
+void FaceService::cancelSession(uint32_t clientId) {
+    uint32_t owner = mSessions.owner();
+    if (owner != kNoClient && owner != clientId && clientId != kNoClient) {
+        // The device is another client's, only drop what this one is waiting for.
+        mSessions.unpark(clientId);
+        std::shared_ptr<FaceClient> client = mClients.get(clientId);
+        if (client != nullptr) {
+            reportCanceled(client);
+        }
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(mCancelledMutex);
+        mCancelled = true;
+    }
+    if (mSpeculating) {
+        // The client never saw this session start.
+        stopSession(false);
+        return;
+    }
+    if (owner == kNoClient) {
+        ATRACE_NAME("vendor cancel");
+        FaceWatchdog::Scope scope(mWatchdog, "cancel", mControlDeadlineMs);
+        mDevice->cancel(mDevice);
+        return;
+    }
+    // A missed deadline (no client) was already reported as TIMEOUT.
+    stopSession(clientId != kNoClient);
+}
+
+// Cancels the vendor session and hands the device back right away. The
+// owner is told here; the vendor's CANCELED may only come once the next
+// session started and would reach the wrong client.
+std::shared_ptr<FaceClient> FaceService::stopSession(bool report) {
+    {
+        std::lock_guard<std::mutex> lock(mCancelledMutex);
+        mSwallowCancel = true;
+        if (mSpeculating.exchange(false)) {
+            mStats.speculativeWasted++;
+        }
+    }
+    {
+        ATRACE_NAME("vendor cancel");
+        FaceWatchdog::Scope scope(mWatchdog, "cancel", mControlDeadlineMs);
+        mDevice->cancel(mDevice);
+    }
+    mWatchdog.disarmSession();
+    endSessionTrace();
+    mSessionLog.end(mSessions.session(), FaceSessionLog::CANCELED);
+    mAlgoInitialized = false;
+    int64_t heldUs;
+    std::shared_ptr<FaceClient> client = mClients.get(mSessions.release(mClock(), &heldUs));
+    if (client != nullptr) {
+        client->deviceUs += heldUs;
+        if (report) {
+            reportCanceled(client);
+        }
+    }
+    return client;
+}
+
+// The time left goes first, a client created during the lockout, or after
+// a reboot restored it, has not been told. A lockout that ran out since
+// it was checked still lasts the 1ms it is rounded up to.
+void FaceService::reportLockedOut(const std::shared_ptr<FaceClient>& client,
+        FaceLockoutTracker::Lockout lockout) {
+    client->callback->onLockoutChanged(lockout == FaceLockoutTracker::PERMANENT ? UINT64_MAX :
+            (uint64_t)std::max<int64_t>((mLockout.remainingUs(bootTimeUs()) + 999) / 1000, 1));
+    client->callback->onError(mUserId,
+            lockout == FaceLockoutTracker::PERMANENT ? FACE_ERROR_LOCKOUT_PERMANENT : FACE_ERROR_LOCKOUT);
+}
+
+void FaceService::reportTokenRejected(const std::shared_ptr<FaceClient>& client) {
+    client->callback->onError(mUserId, FACE_ERROR_UNABLE_TO_PROCESS);
+}
+
+void FaceService::reportLockoutChanged(uint64_t durationMs) {
+    auto clients = mClients.all();
+    for (auto& c : *clients) {
+        c->callback->onLockoutChanged(durationMs);
+    }
+}
+
+void FaceService::reportCanceled(const std::shared_ptr<FaceClient>& client) {
+    client->callback->onError(mUserId, FACE_ERROR_CANCELED);
+}
+
+// Called from notify() when the vendor ends the session, on whatever
+// thread it reports from. The request thread releases the device.
+void FaceService::endSession(FaceSessionLog::Outcome outcome) {
+    mSessionLog.end(mSessions.session(), outcome);
+    mEndedSession = mSessions.session();
+    schedule();
+}
+
+// From notify(): the looper writes the template and lockout changes the
+// vendor reported out, so the vendor's callback never waits for a file to
+// be synced. With the background class full, the next updateSessions()
+// posts the request.
+void FaceService::schedulePersist() {
+    if (!mTemplateStore.hasQueued() && !mLockout.needsSave()) {
+        return;
+    }
+    if (mPersistPosted.exchange(true)) {
+        return;
+    }
+    FaceRequest* request = mRequests->tryBeginPush(kRequestClassOf[PERSIST_REQUEST]);
+    if (request == nullptr) {
+        mPersistPosted = false;
+        return;
+    }
+    request->what = PERSIST_REQUEST;
+    post(request);
+}
+
+// Has the looper run updateSessions() soon, from a thread that must not
+// wait for room in the control class.
+void FaceService::schedule() {
+    FaceRequest* request = mRequests->tryBeginPush(kRequestClassOf[SCHEDULE_REQUEST]);
+    if (request != nullptr) {
+        // Otherwise the control requests queued run updateSessions() anyway.
+        request->what = SCHEDULE_REQUEST;
+        post(request);
+    }
+}
+
+// Start of every request: handles missed deadlines and clients that are
+// gone, and hands the device over once a session ended.
+void FaceService::updateSessions() {
+    uint32_t ended = mEndedSession.exchange(0);
+    if (ended != 0 && ended == mSessions.session()) {
+        int64_t heldUs;
+        std::shared_ptr<FaceClient> client = mClients.get(mSessions.release(mClock(), &heldUs));
+        if (client != nullptr) {
+            client->deviceUs += heldUs;
+        }
+    }
+    uint32_t expired = mExpiredSpeculation.exchange(0);
+    if (expired != 0) {
+        expireSpeculation(expired);
+    }
+    if (mTimeoutPending.exchange(false)) {
+        handleTimeout();
+    }
+    if (mClientsGone.exchange(false)) {
+        dropGoneClients();
+    }
+    // In case notify() found the background class full.
+    schedulePersist();
+    if (mHooks.matchLiveness != nullptr && mMatchCache.needsLiveness()) {
+        int32_t liveness = FaceMatchCache::kUnknownLiveness;
+        ATRACE_NAME("vendor face_match_liveness");
+        FaceWatchdog::Scope scope(mWatchdog, "match_liveness", mControlDeadlineMs);
+        if (mHooks.matchLiveness(mDevice, &liveness) != 0) {
+            liveness = FaceMatchCache::kUnknownLiveness;
+        }
+        mMatchCache.setLiveness(liveness);
+    }
+    if (mSessions.owner() != kNoClient) {
+        return;
+    }
+    FaceRequest request;
+    int64_t parkedUs;
+    std::shared_ptr<FaceClient> client;
+    do {
+        if (!mSessions.next(&request, &parkedUs, mClock())) {
+            return;
+        }
+        // A client that died meanwhile may still have a start parked.
+        client = mClients.get(request.client);
+    } while (client == nullptr && request.client != kNoClient);
+    if (client != nullptr) {
+        client->parked++;
+        client->parkedUs += parkedUs;
+    }
+    ALOGD("client %u gets the device after %" PRId64 "us", request.client, parkedUs);
+    startSession(request);
+}
+
+// Frames only reach the vendor library for the session that owns it, sent
+// by its owner or for an owner that sends none.
+bool FaceService::acceptFrame(const FaceRequest& request) {
+    uint32_t owner = mSessions.owner();
+    if (request.client != owner) {
+        std::shared_ptr<FaceClient> client = mClients.get(request.client);
+        if (!runsOnFramesOf(owner, client.get())) {
+            if (client != nullptr) {
+                client->rejectedFrames++;
+            }
+            return false;
+        }
+    }
+    // A session start jumps ahead of frames still queued for the
+    // previous session, don't feed those to the new one.
+    if (request.session != mSessions.session()) {
+        mStats.staleFrames++;
+        mSessionLog.addFrame(request.session, FaceSessionLog::SKIPPED);
+        return false;
+    }
+    return true;
+}
+
+// Enroll and authenticate sessions show up as async slices; whichever
+// event ends the session first closes the slice.
+void FaceService::beginSessionTrace() {
+    endSessionTrace();
+    uint32_t id = ++mSessionId;
+    ATRACE_ASYNC_BEGIN("face session", id);
+    mTracedSessionId = id;
+}
+
+void FaceService::endSessionTrace() {
+    uint32_t id = mTracedSessionId.exchange(0);
+    if (id != 0) {
+        ATRACE_ASYNC_END("face session", id);
+    }
+}
+
+// Frames are async slices from their binder entry until the looper is
+// done with them.
+void FaceService::endFrameTrace(uint32_t frame) {
+    ATRACE_ASYNC_END("face frame", frame);
+    ATRACE_INT("face.frames_in_flight", --mFramesInFlight);
+}
+
+// Checked when a session starts: setting the directory starts a new
+// capture file, clearing it ends the current one.
+void FaceService::updateCapture() {
+    char dir[PROPERTY_VALUE_MAX] = {0};
+    property_get(PROP_RECORD_DIR, dir, "");
+    if (dir[0] == '\0') {
+        mCapture.close();
+        return;
+    }
+    if (!mCapture.isOpen()) {
+        char path[PATH_MAX];
+        snprintf(path, sizeof(path), "%s/face_%" PRId64 ".cap", dir, bootTimeUs());
+        mCaptureFrames = property_get_bool(PROP_RECORD_FRAMES, false);
+        mCapture.open(path, (int64_t)property_get_int32(PROP_RECORD_MAX_MB, DEFAULT_RECORD_MAX_MB) * 1024 * 1024);
+    }
+}
+
+// args[0] is the buffer address of the frame.
+void FaceService::captureFrame(uint32_t type, const int64_t args[4], const int32_t* info, size_t infoSize,
+        const int8_t* byteInfo, size_t byteInfoSize) {
+    std::vector<uint8_t> frame;
+    if (mCaptureFrames && mHooks.copyFrame != nullptr) {
+        ssize_t size = mHooks.copyFrame(mDevice, args[0], nullptr, 0);
+        if (size > 0) {
+            frame.resize(size);
+            if (mHooks.copyFrame(mDevice, args[0], frame.data(), frame.size()) != size) {
+                frame.clear();
+            }
+        }
+    }
+    mCapture.append(type, args, info, infoSize, byteInfo, byteInfoSize, frame.data(), frame.size());
+}
+
+void FaceService::onServiceRegistered() {
+    mStats.serviceRegisteredUs = bootTimeUs();
+    ALOGD("service registered %" PRId64 "us after start", mStats.serviceRegisteredUs - mStats.serviceStartUs);
+}
+
+int32_t FaceService::setActiveUser(int32_t userId, const char* storePath) {
+    FaceTraceScope trace("binder setActiveUser", mSessionId, 0);
+    ALOGD("setActiveUser");
+    size_t length = strlen(storePath);
+    if (length >= PATH_MAX || length < ACTIVE_USER_STORE_PATH_MIN_LEN) {
+        ALOGE("Bad path length: %zd", length);
+        return kFaceInternalError;
+    }
+    /*if (access(storePath, W_OK)) {
+        return kFaceInternalError;
+    }*/
+
+    face_device_t* device = waitForDevice();
+    if (device == nullptr) {
+        return kFaceInternalError;
+    }
+    int32_t err;
+    {
+        ATRACE_NAME("vendor set_active_group");
+        FaceWatchdog::Scope scope(mWatchdog, "set_active_group", mControlDeadlineMs);
+        std::lock_guard<std::mutex> lock(mControlMutex);
+        err = device->set_active_group(device, userId, storePath);
+    }
+    if (FACE_OK == err) {
+        mMatchCache.clear(FaceMatchCache::USER_SWITCH);
+        mHeldMatch.clear();
+        mUserId = userId;
+        mTemplateStore.open(userId, storePath);
+        mLockout.open(userId, storePath, bootTimeUs());
+    }
+    return err;
+}
+
+int32_t FaceService::generateChallenge(uint32_t challengeTimeoutSec, uint64_t* challenge) {
+    FaceTraceScope trace("binder generateChallenge", mSessionId, 0);
+    ALOGD("generateChallenge challengeTimeoutSec:%d", challengeTimeoutSec);
+    *challenge = 0;
+    face_device_t* device = waitForDevice();
+    if (device == nullptr) {
+        return kFaceInternalError;
+    }
+    int32_t err;
+    {
+        std::lock_guard<std::mutex> lock(mControlMutex);
+        err = device->pre_enroll(device, challengeTimeoutSec, challenge);
+    }
+    if (err == FACE_OK) {
+        mAuthTokens.setChallenge(*challenge);
+    }
+    return err;
+}
+
+int32_t FaceService::enroll(pid_t pid, const uint8_t* hat, size_t hatSize, uint32_t timeoutSec,
+        const int32_t* disabledFeatures, size_t featureCount) {
+    beginSessionTrace();
+    FaceTraceScope trace("binder enroll", mSessionId, 0);
+    ALOGD("enroll(timeoutSec=%d)\n", timeoutSec);
+    if (isHalFailed()) {
+        endSessionTrace();
+        return kFaceInternalError;
+    }
+    for (size_t i = 0; i < featureCount; i++) {
+        // Features are bits of the template store's mask.
+        if (disabledFeatures[i] < 0 || disabledFeatures[i] >= 32) {
+            ALOGE("enroll: bad feature %d", disabledFeatures[i]);
+            endSessionTrace();
+            return FACE_ILLEGAL_ARGUMENT;
+        }
+    }
+    std::shared_ptr<FaceClient> client = mClients.find(pid);
+    if (mAuthTokens.check(hat, hatSize, true, bootTimeUs() / 1000) != FaceAuthTokenFilter::VALID) {
+        // Reported like the vendor reports a token it can't verify.
+        endSessionTrace();
+        if (client != nullptr) {
+            reportTokenRejected(client);
+        }
+        return FACE_OK;
+    }
+    if (client != nullptr) {
+        client->session = mSessionId.load();
+    }
+    mIdlePolicy.noteActivity();
+    updateCapture();
+    if (mCapture.isOpen()) {
+        int64_t args[4] = { (int64_t)timeoutSec };
+        mCapture.append(CAPTURE_ENROLL, args, disabledFeatures, featureCount,
+                reinterpret_cast<const int8_t*>(hat), hatSize, nullptr, 0);
+    }
+    // The token and features travel with the request, the session may
+    // only start once another client is done.
+    FaceRequest* request = obtainRequest(ENROLL_REQUEST, client.get());
+    request->args[0] = timeoutSec;
+    request->byteInfo.assign(reinterpret_cast<const int8_t*>(hat), reinterpret_cast<const int8_t*>(hat) + hatSize);
+    request->info.assign(disabledFeatures, disabledFeatures + featureCount);
+    post(request);
+    return FACE_OK;
+    //return mDevice->enroll(mDevice, authToken, timeoutSec, (uint32_t*)disabledFeatures, featureCount);
+}
+
+int32_t FaceService::revokeChallenge() {
+    FaceTraceScope trace("binder revokeChallenge", mSessionId, 0);
+    ALOGD("revokeChallenge");
+    face_device_t* device = waitForDevice();
+    if (device == nullptr) {
+        return kFaceInternalError;
+    }
+    mAuthTokens.setChallenge(0);
+    std::lock_guard<std::mutex> lock(mControlMutex);
+    return device->post_enroll(device);
+}
+
+int32_t FaceService::setFeature(uint32_t feature, bool enabled, const uint8_t* hat, size_t hatSize,
+        uint32_t faceId) {
+    FaceTraceScope trace("binder setFeature", mSessionId, 0);
+    ALOGD("setFeature feature:%d enabled:%d", feature, enabled);
+    const hw_auth_token_t* authToken = reinterpret_cast<const hw_auth_token_t*>(hat);
+    face_device_t* device = waitForDevice();
+    if (device == nullptr) {
+        return kFaceInternalError;
+    }
+    if (mAuthTokens.check(hat, hatSize, true, bootTimeUs() / 1000) != FaceAuthTokenFilter::VALID) {
+        return FACE_ILLEGAL_ARGUMENT;
+    }
+    int32_t err;
+    {
+        std::lock_guard<std::mutex> lock(mControlMutex);
+        err = device->set_feature(device, feature, enabled, authToken, faceId);
+    }
+    // Not remembered as a rejected token: the vendor says the same of an
+    // unknown face id, and the token would then be turned away on a retry
+    // with the right one.
+    return err;
+}
+
+int32_t FaceService::getFeature(uint32_t feature, uint32_t faceId, bool* enabled) {
+    FaceTraceScope trace("binder getFeature", mSessionId, 0);
+    ALOGD("getFeature feature:%d", feature);
+    *enabled = true;
+    face_device_t* device = waitForDevice();
+    if (device == nullptr) {
+        *enabled = false;
+        return kFaceInternalError;
+    }
+    std::lock_guard<std::mutex> lock(mControlMutex);
+    return device->get_feature(device, feature, faceId, enabled);
+}
+
+int32_t FaceService::getAuthenticatorId(uint64_t* id) {
+    FaceTraceScope trace("binder getAuthenticatorId", mSessionId, 0);
+    ALOGD("getAuthenticatorId");
+    *id = 0;
+    face_device_t* device = waitForDevice();
+    if (device == nullptr) {
+        return kFaceInternalError;
+    }
+    std::lock_guard<std::mutex> lock(mControlMutex);
+    return device->get_authenticator_id(device, id);
+}
+
+int32_t FaceService::cancel(pid_t pid) {
+    FaceTraceScope trace("binder cancel", mSessionId, 0);
+    ALOGD("cancel");
+    if (isHalFailed()) {
+        return kFaceInternalError;
+    }
+    mWatchdog.disarmSession();
+    if (mCapture.isOpen()) {
+        mCapture.append(CAPTURE_CANCEL, nullptr, nullptr, 0, nullptr, 0, nullptr, 0);
+    }
+    std::shared_ptr<FaceClient> client = mClients.find(pid);
+    uint32_t owner = mSessions.owner();
+    if (client == nullptr || owner == kNoClient || owner == client->id) {
+        // Stop feeding frames right away, the request thread confirms.
+        std::lock_guard<std::mutex> lock(mCancelledMutex);
+        mCancelled = true;
+    }
+    post(obtainRequest(CANCEL_REQUEST, client.get()));
+    return FACE_OK;
+    //return mDevice->cancel(mDevice);
+}
+
+int32_t FaceService::enumerate(pid_t pid) {
+    FaceTraceScope trace("binder enumerate", mSessionId, 0);
+    ALOGD("enumerate");
+    if (isHalFailed()) {
+        return kFaceInternalError;
+    }
+    std::shared_ptr<FaceClient> client = mClients.find(pid);
+    std::shared_ptr<const FaceTemplateSnapshot> snapshot = mTemplateStore.snapshot();
+    if (snapshot != nullptr && !mTemplateStore.hasQueued() && property_get_bool(PROP_STORE_ENUMERATE, false)) {
+        // Served from the mapped store, so this never waits behind an
+        // enroll or remove queued on the looper.
+        std::vector<uint32_t> faceIds;
+        snapshot->faceIds(&faceIds);
+        if (client != nullptr) {
+            client->callback->onEnumerate(faceIds.data(), faceIds.size(), mUserId);
+        }
+        return FACE_OK;
+    }
+    post(obtainRequest(ENUMERATE_REQUEST, client.get()));
+    return FACE_OK;
+    //return mDevice->enumerate(mDevice);
+}
+
+int32_t FaceService::remove(pid_t pid, uint32_t faceId) {
+    FaceTraceScope trace("binder remove", mSessionId, 0);
+    ALOGD("remove faceId:%d", faceId);
+    if (isHalFailed()) {
+        return kFaceInternalError;
+    }
+    FaceRequest* request = obtainRequest(REMOVE_REQUEST, mClients.find(pid).get());
+    request->args[0] = faceId;
+    post(request);
+    return FACE_OK;
+    //return mDevice->remove(mDevice, faceId);
+}
+
+int32_t FaceService::authenticate(pid_t pid, uint64_t operationId) {
+    beginSessionTrace();
+    FaceTraceScope trace("binder authenticate", mSessionId, 0);
+    ALOGD("authenticate(operationId=%" PRId64 ")\n", operationId);
+    if (isHalFailed()) {
+        endSessionTrace();
+        return kFaceInternalError;
+    }
+    std::shared_ptr<FaceClient> client = mClients.find(pid);
+    FaceLockoutTracker::Lockout lockout = mLockout.check(bootTimeUs());
+    if (lockout != FaceLockoutTracker::NONE) {
+        // Nothing the vendor could do but say so.
+        ALOGD("user %d is locked out", mUserId.load());
+        mStats.lockedOutAuthenticates++;
+        endSessionTrace();
+        if (client != nullptr) {
+            reportLockedOut(client, lockout);
+        }
+        return FACE_OK;
+    }
+    if (client != nullptr) {
+        client->session = mSessionId.load();
+    }
+    mIdlePolicy.noteActivity();
+    mAuthStartUs = mClock();
+    mAuthCold = mTrimmed.load();
+    updateCapture();
+    if (mCapture.isOpen()) {
+        int64_t args[4] = { (int64_t)operationId };
+        mCapture.append(CAPTURE_AUTHENTICATE, args, nullptr, 0, nullptr, 0, nullptr, 0);
+    }
+    FaceRequest* request = obtainRequest(AUTH_REQUEST, client.get());
+    request->args[0] = operationId;
+    post(request);
+    return FACE_OK;
+    //return mDevice->authenticate(mDevice, operationId);
+}
+
+int32_t FaceService::userActivity(pid_t pid) {
+    FaceTraceScope trace("binder userActivity", mSessionId, 0);
+    ALOGD("userActivity");
+    face_device_t* device = waitForDevice();
+    if (device == nullptr) {
+        return kFaceInternalError;
+    }
+    mIdlePolicy.noteActivity();
+    if (mTrimmed) {
+        postWarmUp();
+    }
+    // Only a client that sends frames can feed a speculative session.
+    std::shared_ptr<FaceClient> client = mClients.find(pid);
+    if (mSpeculative && !mSpeculationRejected && mSessions.owner() == kNoClient && client != nullptr &&
+            client->has(CLIENT_FRAMES) && mLockout.check(bootTimeUs()) == FaceLockoutTracker::NONE) {
+        beginSessionTrace();
+        client->session = mSessionId.load();
+        FaceRequest* request = tryObtainRequest(SPECULATE_REQUEST, client.get());
+        if (request != nullptr) {
+            post(request);
+        } else {
+            // A guess is not worth waiting for.
+            endSessionTrace();
+        }
+    }
+    std::lock_guard<std::mutex> lock(mControlMutex);
+    return device->user_activity(device);
+}
+
+int32_t FaceService::resetLockout(const uint8_t* hat, size_t hatSize) {
+    FaceTraceScope trace("binder resetLockout", mSessionId, 0);
+    ALOGD("resetLockout");
+    const hw_auth_token_t* authToken = reinterpret_cast<const hw_auth_token_t*>(hat);
+    face_device_t* device = waitForDevice();
+    if (device == nullptr) {
+        return kFaceInternalError;
+    }
+    if (mAuthTokens.check(hat, hatSize, false, bootTimeUs() / 1000) != FaceAuthTokenFilter::VALID) {
+        return FACE_ILLEGAL_ARGUMENT;
+    }
+    int32_t err;
+    {
+        std::lock_guard<std::mutex> lock(mControlMutex);
+        err = device->reset_lockout(device, authToken);
+    }
+    // The token is all reset_lockout takes, the error can only be about it.
+    mAuthTokens.onVendorVerdict(hat, hatSize, err != FACE_ILLEGAL_ARGUMENT);
+    if (err == FACE_OK) {
+        mLockout.reset();
+    }
+    return err;
+}
+
+int32_t FaceService::doEnrollProcess(pid_t pid, int64_t addr, const int32_t* info, size_t infoSize,
+        const int8_t* byteInfo, size_t byteInfoSize) {
+    uint32_t frame = ++mFrameSeq;
+    FaceTraceScope trace("binder doEnrollProcess", mSessionId, frame);
+    ALOGD("doEnrollProcess");
+    return queueEnrollFrame(mClients.find(pid), frame, addr, info, infoSize, byteInfo, byteInfoSize);
+}
+
+int32_t FaceService::doAuthenticateProcess(pid_t pid, int64_t main, int64_t sub, int64_t otp, const int32_t* info,
+        size_t infoSize, const int8_t* byteInfo, size_t byteInfoSize) {
+    uint32_t frame = ++mFrameSeq;
+    FaceTraceScope trace("binder doAuthenticateProcess", mSessionId, frame);
+    ALOGD("doAuthenticateProcess");
+    return queueAuthenticateFrame(mClients.find(pid), frame, main, sub, otp, info, infoSize, byteInfo,
+            byteInfoSize);
+}
+
+int32_t FaceService::queueEnrollFrame(const std::shared_ptr<FaceClient>& client, uint32_t frame, int64_t addr,
+        const int32_t* info, size_t infoSize, const int8_t* byteInfo, size_t byteInfoSize) {
+    if (isHalFailed()) {
+        return kFaceInternalError;
+    }
+    ATRACE_ASYNC_BEGIN("face frame", frame);
+    ATRACE_INT("face.frames_in_flight", ++mFramesInFlight);
+    mIdlePolicy.noteActivity();
+    if (mCapture.isOpen()) {
+        int64_t args[4] = { addr };
+        captureFrame(CAPTURE_ENROLL_FRAME, args, info, infoSize, byteInfo, byteInfoSize);
+    }
+    FaceRequest* request = obtainFrameRequest(ENROLL_PROCESS_REQUEST, client.get(), frame);
+    if (request == nullptr) {
+        replyEnrollProcessed(client != nullptr ? client->id : kNoClient, addr);
+        return FACE_OK;
+    }
+    request->args[0] = addr;
+    request->info.assign(info, info + infoSize);
+    request->byteInfo.assign(byteInfo, byteInfo + byteInfoSize);
+    post(request);
+    return FACE_OK;
+}
+
+int32_t FaceService::queueAuthenticateFrame(const std::shared_ptr<FaceClient>& client, uint32_t frame,
+        int64_t main, int64_t sub, int64_t otp, const int32_t* info, size_t infoSize, const int8_t* byteInfo,
+        size_t byteInfoSize) {
+    if (isHalFailed()) {
+        return kFaceInternalError;
+    }
+    if (mLockout.check(bootTimeUs()) != FaceLockoutTracker::NONE) {
+        // The frame could not unlock anything, hand it straight back.
+        mStats.lockedOutFrames++;
+        replyAuthProcessed(client != nullptr ? client->id : kNoClient, main, sub);
+        return FACE_OK;
+    }
+    ATRACE_ASYNC_BEGIN("face frame", frame);
+    ATRACE_INT("face.frames_in_flight", ++mFramesInFlight);
+    mIdlePolicy.noteActivity();
+    if (mCapture.isOpen()) {
+        int64_t args[4] = { main, sub, otp };
+        captureFrame(CAPTURE_AUTHENTICATE_FRAME, args, info, infoSize, byteInfo, byteInfoSize);
+    }
+    FaceRequest* request = obtainFrameRequest(AUTH_PROCESS_REQUEST, client.get(), frame);
+    if (request == nullptr) {
+        replyAuthProcessed(client != nullptr ? client->id : kNoClient, main, sub);
+        return FACE_OK;
+    }
+    request->args[0] = main;
+    request->args[1] = sub;
+    request->args[2] = otp;
+    request->info.assign(info, info + infoSize);
+    request->byteInfo.assign(byteInfo, byteInfo + byteInfoSize);
+    post(request);
+    return FACE_OK;
+}
+
+void FaceService::updateLivenessMode(int32_t value, int32_t userId) {
+    FaceTraceScope trace("binder updateLivenessMode", mSessionId, 0);
+    ALOGD("updateLivenessMode");
+    char prop[128] = {0};
+    char value_s[8] = {0};
+    sprintf(prop, "persist.vendor.faceid.livenessmode%d", userId);
+    sprintf(value_s, "%d", value);
+    if(0 != property_set(prop, value_s)) {
+        ALOGE("updateLivenessMode fail");
+    }
+}
+
+void FaceService::submitEnrollFrame(int64_t addr, const int32_t* info, size_t infoSize, const int8_t* byteInfo,
+        size_t byteInfoSize) {
+    uint32_t frame = ++mFrameSeq;
+    FaceTraceScope trace("binder submitEnrollFrame", mSessionId, frame);
+    std::shared_ptr<FaceClient> client = frameSender();
+    if (queueEnrollFrame(client, frame, addr, info, infoSize, byteInfo, byteInfoSize) != FACE_OK) {
+        replyEnrollProcessed(client != nullptr ? client->id : kNoClient, addr);
+    }
+}
+
+void FaceService::submitAuthenticateFrame(int64_t main, int64_t sub, int64_t otp, const int32_t* info,
+        size_t infoSize, const int8_t* byteInfo, size_t byteInfoSize) {
+    uint32_t frame = ++mFrameSeq;
+    FaceTraceScope trace("binder submitAuthenticateFrame", mSessionId, frame);
+    std::shared_ptr<FaceClient> client = frameSender();
+    if (queueAuthenticateFrame(client, frame, main, sub, otp, info, infoSize, byteInfo, byteInfoSize) != FACE_OK) {
+        replyAuthProcessed(client != nullptr ? client->id : kNoClient, main, sub);
+    }
+}
+
+void FaceService::updateScreenState(bool interactive) {
+    FaceTraceScope trace("binder updateScreenState", mSessionId, 0);
+    ALOGD("updateScreenState(%d)", interactive);
+    if (!interactive) {
+        mMatchCache.clear(FaceMatchCache::SCREEN_OFF);
+        mHeldMatch.clear();
+    } else if (mTrimmed && !isHalFailed()) {
+        postWarmUp();
+    }
+}
+
+void FaceService::dump(int fd) {
+    dprintf(fd, "user=%d device=%p trimmed=%d\n", mUserId.load(), mDevice, mTrimmed.load());
+    mStats.dump(fd);
+    mRequests->dump(fd);
+    dprintf(fd, "device owner: client %u\n", mSessions.owner());
+    mClients.dump(fd);
+    dprintf(fd, "enroll pipeline: %s\n", mEnrollPipelined ? "on" : "off");
+    mEnrollCoverage.dump(fd);
+    dprintf(fd, "frame rate: recommended=%ufps avg_latency=%" PRId64 "us updates=%u\n",
+            mFrameRate.recommendedFps(), mFrameRate.averageLatencyUs(), mFrameRate.updatesSent());
+    mTemplateStore.dump(fd);
+    mSessionLog.dump(fd);
+    mMatchCache.dump(fd);
+    mLockout.dump(fd, bootTimeUs());
+    mAuthTokens.dump(fd);
+}
+static const char* notifyTraceName(int32_t type) {
+    switch (type) {
+        case FACE_ERROR: return "notify FACE_ERROR";
+        case FACE_ACQUIRED: return "notify FACE_ACQUIRED";
+        case FACE_TEMPLATE_REMOVED: return "notify FACE_TEMPLATE_REMOVED";
+        case FACE_TEMPLATE_ENROLLING: return "notify FACE_TEMPLATE_ENROLLING";
+        case FACE_AUTHENTICATED: return "notify FACE_AUTHENTICATED";
+        case FACE_TEMPLATE_ENUMERATED: return "notify FACE_TEMPLATE_ENUMERATED";
+        case FACE_LOCKOUT_CHANGED: return "notify FACE_LOCKOUT_CHANGED";
+        case FACE_ENROLL_PROCESSED: return "notify FACE_ENROLL_PROCESSED";
+        case FACE_AUTHENTICATE_PROCESSED: return "notify FACE_AUTHENTICATE_PROCESSED";
+        default: return "notify";
+    }
+}
+
+static FaceSessionLog::Outcome errorOutcome(int32_t error) {
+    switch (error) {
+        case FACE_ERROR_CANCELED: return FaceSessionLog::CANCELED;
+        case FACE_ERROR_TIMEOUT: return FaceSessionLog::TIMED_OUT;
+        default: return FaceSessionLog::FAILED;
+    }
+}
+
+// Events of a speculative session, from notify(). A match is held for
+// authenticate() to take, anything else ends the session unseen. Returns
+// false for what goes on as usual: frame buffers handed back, lockouts,
+// and events that raced with authenticate() joining the session.
+bool FaceService::onSpeculativeEvent(const face_msg_t* msg) {
+    switch (msg->type) {
+        case FACE_ACQUIRED:
+            return true;
+        case FACE_ERROR:
+        case FACE_AUTHENTICATED:
+            break;
+        default:
+            return false;
+    }
+    std::lock_guard<std::mutex> lock(mCancelledMutex);
+    if (!mSpeculating || (msg->type == FACE_ERROR && FACE_ERROR_CANCELED == msg->data.error && mSwallowCancel)) {
+        return false;
+    }
+    mSpeculating = false;
+    if (msg->type == FACE_ERROR &&
+            (FACE_ERROR_LOCKOUT == msg->data.error || FACE_ERROR_LOCKOUT_PERMANENT == msg->data.error)) {
+        mStats.speculativeWasted++;
+        return false;
+    }
+    endSessionTrace();
+    mWatchdog.disarmSession();
+    mAlgoInitialized = false;
+    if (msg->type == FACE_AUTHENTICATED && msg->data.authenticated.fid != 0) {
+        const hw_auth_token_t& hat = msg->data.authenticated.hat;
+        mHeldMatch.hold(msg->data.authenticated.fid, mUserId, hat.challenge,
+                reinterpret_cast<const uint8_t*>(&hat), sizeof(hat), mClock());
+        cacheMatch(msg->data.authenticated.fid);
+        endSession(FaceSessionLog::SUCCEEDED);
+        return true;
+    }
+    mStats.speculativeWasted++;
+    if (msg->type == FACE_AUTHENTICATED) {
+        mSpeculationRejected = true;
+        mMatchCache.clear(FaceMatchCache::REJECTED);
+        endSession(FaceSessionLog::REJECTED);
+    } else {
+        endSession(errorOutcome(msg->data.error));
+    }
+    return true;
+}
+
+// Called for every frame the vendor library processes. No path allocates
+// once the template store's queue has grown to the changes one session
+// reports (FaceNotify_test.cpp checks), nothing waits for a file, and the
+// per frame events only log at verbose level.
+void FaceService::notify(const face_msg_t *msg) {
+    FaceService* thisPtr = sInstance;
+    if (thisPtr == nullptr) {
+        ALOGE("Receiving callbacks before the service is up.");
+        return;
+    }
+    if (thisPtr->mSpeculating && thisPtr->onSpeculativeEvent(msg)) {
+        return;
+    }
+    // Session events go to the owner of the device, enumerate and remove
+    // results to whoever asked, lockout changes to everyone.
+    std::shared_ptr<FaceClient> client;
+    if (msg->type == FACE_TEMPLATE_ENUMERATED || msg->type == FACE_TEMPLATE_REMOVED) {
+        client = thisPtr->mClients.get(thisPtr->mMaintenanceClient);
+    }
+    if (client == nullptr) {
+        client = thisPtr->sessionClient();
+    }
+    if (client == nullptr) {
+        // No client yet, or the owner of the session died and is being
+        // cancelled; the cancel it causes needs no more swallowing.
+        if (msg->type == FACE_ERROR && FACE_ERROR_CANCELED == msg->data.error) {
+            std::lock_guard<std::mutex> lock(thisPtr->mCancelledMutex);
+            thisPtr->mSwallowCancel = false;
+        }
+        ALOGE("Receiving callbacks without a client callback to send them to.");
+        return;
+    }
+    FaceClientCallback* clientCallback = client->callback.get();
+    FaceTraceScope trace(notifyTraceName(msg->type), thisPtr->mSessionId, thisPtr->mCurrentFrame);
+    switch (msg->type) {
+        case FACE_ERROR: {
+                ALOGD("onError(%d)", msg->data.error);
+                if (FACE_ERROR_LOCKOUT == msg->data.error || FACE_ERROR_LOCKOUT_PERMANENT == msg->data.error) {
+                    thisPtr->mMatchCache.clear(FaceMatchCache::LOCKOUT);
+                    thisPtr->mLockout.onVendorLockout(FACE_ERROR_LOCKOUT == msg->data.error ?
+                            -1 : FaceLockoutTracker::kPermanentUs, bootTimeUs());
+                    thisPtr->schedulePersist();
+                }
+                thisPtr->endSessionTrace();
+                thisPtr->mWatchdog.disarmSession();
+                {
+                    std::lock_guard<std::mutex> lock(thisPtr->mCancelledMutex);
+                    if (FACE_ERROR_CANCELED == msg->data.error && thisPtr->mSwallowCancel) {
+                        thisPtr->mSwallowCancel = false; // the preempted client was told
+                        return;
+                    }
+                    thisPtr->endSession(errorOutcome(msg->data.error));
+                    if(thisPtr->mSessionStale) return; // already reported as TIMEOUT
+                    // if cancelled, just exit from cancel error
+                    if(FACE_ERROR_CANCELED != msg->data.error && thisPtr->mCancelled) return;
+                }
+                thisPtr->mAlgoInitialized = false;
+                clientCallback->onError(thisPtr->mUserId, msg->data.error);
+            }
+            break;
+        case FACE_ACQUIRED: {
+                ALOGV("onAcquired(%d)", msg->data.acquired);
+                clientCallback->onAcquired(thisPtr->mUserId, msg->data.acquired);
+            }
+            break;
+        case FACE_TEMPLATE_REMOVED: {
+                ALOGD("onRemoved(fid=%d)", msg->data.removed.fid);
+                uint32_t faceId = msg->data.removed.fid; // unisoc support just 1 template
+                thisPtr->mTemplateStore.queueRemove(msg->data.removed.fid);
+                thisPtr->schedulePersist();
+                clientCallback->onRemoved(&faceId, 1, thisPtr->mUserId);
+            }
+            break;
+        case FACE_TEMPLATE_ENROLLING: {
+                ALOGD("onEnrollResult(fid=%d)", msg->data.enroll.fid);
+                thisPtr->endSessionTrace();
+                thisPtr->mWatchdog.disarmSession();
+                thisPtr->endSession(msg->data.enroll.fid > 0 ? FaceSessionLog::SUCCEEDED : FaceSessionLog::FAILED);
+                {
+                    std::lock_guard<std::mutex> lock(thisPtr->mCancelledMutex);
+                    if(thisPtr->mCancelled) return; // if cancelled, just exit from cancel error
+                }
+                thisPtr->mAlgoInitialized = false;
+                if(msg->data.enroll.fid <= 0) {
+                    clientCallback->onError(thisPtr->mUserId, FACE_ERROR_TIMEOUT);
+                } else {
+                    thisPtr->mMatchCache.clear(FaceMatchCache::TEMPLATES_CHANGED);
+                    thisPtr->mTemplateStore.queueAdd(msg->data.enroll.fid, thisPtr->mDisabledFeatureMask);
+                    thisPtr->schedulePersist();
+                    thisPtr->mStats.lastEnrollSessionUs = thisPtr->mClock() - thisPtr->mEnrollStartUs;
+                    clientCallback->onEnrollResult(msg->data.enroll.fid, thisPtr->mUserId, 0);
+                }
+            }
+            break;
+        case FACE_AUTHENTICATED: {
+                ALOGD("onAuthenticated(fid=%d)", msg->data.authenticated.fid);
+                FaceLockoutTracker::Lockout lockout = FaceLockoutTracker::NONE;
+                if (msg->data.authenticated.fid == 0) {
+                    thisPtr->mMatchCache.clear(FaceMatchCache::REJECTED);
+                    lockout = thisPtr->mLockout.onRejected(bootTimeUs());
+                } else {
+                    thisPtr->mLockout.onAccepted(bootTimeUs());
+                }
+                thisPtr->schedulePersist();
+                thisPtr->endSessionTrace();
+                thisPtr->endSession(msg->data.authenticated.fid != 0 ? FaceSessionLog::SUCCEEDED : FaceSessionLog::REJECTED);
+                {
+                    std::lock_guard<std::mutex> lock(thisPtr->mCancelledMutex);
+                    if(thisPtr->mCancelled) return; // if cancelled, just exit from cancel error
+                }
+                thisPtr->mAlgoInitialized = false;
+                if (msg->data.authenticated.fid != 0) {
+                    thisPtr->cacheMatch(msg->data.authenticated.fid);
+                    int64_t latencyUs = thisPtr->mClock() - thisPtr->mAuthStartUs;
+                    if (thisPtr->mAuthCold) {
+                        thisPtr->mStats.coldUnlocks++;
+                        thisPtr->mStats.lastColdUnlockUs = latencyUs;
+                    } else {
+                        thisPtr->mStats.warmUnlocks++;
+                        thisPtr->mStats.lastWarmUnlockUs = latencyUs;
+                    }
+                    // The vendor's message outlives the callback, lend the
+                    // token out of it.
+                    clientCallback->onAuthenticated(msg->data.authenticated.fid, thisPtr->mUserId,
+                            reinterpret_cast<const uint8_t*>(&msg->data.authenticated.hat),
+                            sizeof(msg->data.authenticated.hat));
+                } else {
+                    // Not a recognized face
+                    clientCallback->onAuthenticated(msg->data.authenticated.fid, thisPtr->mUserId, nullptr, 0);
+                    if (lockout != FaceLockoutTracker::NONE) {
+                        // The service's own thresholds, the vendor says nothing.
+                        thisPtr->reportLockoutChanged(lockout == FaceLockoutTracker::PERMANENT ? UINT64_MAX :
+                                (uint64_t)(thisPtr->mLockout.remainingUs(bootTimeUs()) / 1000));
+                    }
+                }
+            }
+            break;
+        case FACE_TEMPLATE_ENUMERATED: {
+                ALOGD("onEnumerate(fid=%d)", msg->data.enumerated.fid);
+                uint32_t faceId = msg->data.enumerated.fid; // unisoc support just 1 template
+                // So this is the whole enumeration.
+                thisPtr->mTemplateStore.queueEnumerated(msg->data.enumerated.fid);
+                thisPtr->schedulePersist();
+                clientCallback->onEnumerate(&faceId, 1, thisPtr->mUserId);
+            }
+            break;
+        case FACE_LOCKOUT_CHANGED: {
+                uint32_t duration = (uint32_t)(msg->data.lockout.duration / 1000);
+                ALOGD("onLockoutChanged(duration=%d)", duration);
+                if (msg->data.lockout.duration != 0) {
+                    thisPtr->mMatchCache.clear(FaceMatchCache::LOCKOUT);
+                }
+                thisPtr->mLockout.onVendorLockout(msg->data.lockout.duration == UINT64_MAX ?
+                        FaceLockoutTracker::kPermanentUs : (int64_t)msg->data.lockout.duration * 1000, bootTimeUs());
+                thisPtr->schedulePersist();
+                thisPtr->reportLockoutChanged(msg->data.lockout.duration);
+            }
+            break;
+        case FACE_ENROLL_PROCESSED: {
+                ALOGV("onEnrollProcessed(addr=%" PRId64", remaining=%d)",
+                        msg->data.enroll_processed.addr,
+                        msg->data.enroll_processed.remaining);
+                // The buffer goes back to whoever sent the frame.
+                thisPtr->replyEnrollProcessed(thisPtr->mFrameClient, msg->data.enroll_processed.addr);
+                clientCallback->onEnrollResult(0, thisPtr->mUserId, msg->data.enroll_processed.remaining);
+            }
+            break;
+        case FACE_AUTHENTICATE_PROCESSED: {
+                ALOGV("onAuthProcessed(main=%" PRId64", sub=%" PRId64")",
+                        msg->data.authenticate_processed.main,
+                        msg->data.authenticate_processed.sub);
+                thisPtr->replyAuthProcessed(thisPtr->mFrameClient, msg->data.authenticate_processed.main,
+                        msg->data.authenticate_processed.sub);
+            }
+            break;
+        default:
+            ALOGE("invalid msg type: %d", msg->type);
+            return;
+    }
+}
+
+}  // namespace implementation
+}  // namespace V1_0
+}  // namespace face
+}  // namespace hardware
+}  // namespace sprd
+}  // namespace vendor
@@ -0,0 +1,304 @@
+// FIXME: your file license if you have one
+
+#pragma once
+
+#include <hardware/hardware.h>
+#include <hardware/face.h>
+#include <limits.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "FaceAuthToken.h"
+#include "FaceCapture.h"
+#include "FaceClients.h"
+#include "FaceEnrollPipeline.h"
+#include "FaceFrameRate.h"
+#include "FaceIdlePolicy.h"
+#include "FaceLockout.h"
+#include "FaceRequestQueue.h"
+#include "FaceRequests.h"
+#include "FaceSessionLog.h"
+#include "FaceStats.h"
+#include "FaceTemplateStore.h"
+#include "FaceVendorHooks.h"
+#include "FaceWatchdog.h"
+#include "FaceWorker.h"
+
+namespace vendor {
+namespace sprd {
+namespace hardware {
+namespace face {
+namespace V1_0 {
+namespace implementation {
+
+// Status of a call the vendor library never got, because it is not open
+// or the arguments could not be handed to it. Every other status is the
+// face.h code the vendor returned.
+static const int32_t kFaceInternalError = INT32_MIN;
+
+// The face service without its transport: the request thread and what it
+// dispatches, the sessions of the clients and the vendor adapter. Calls
+// take face.h codes and return them; a front end registers a
+// FaceClientCallback per client and translates for its own interface.
+class FaceService {
+public:
+    // Opens the vendor module in the calling process.
+    typedef face_device_t* (*Opener)(FaceNotifyFn notify);
+
+    // What the host tests change; the defaults are the service's.
+    struct Options {
+        Options() : clock(nullptr), manualLooper(false) {}
+        // Clock of the requests, the sessions and the frame rate, instead
+        // of monotonicUs().
+        FaceRequestQueue::Clock clock;
+        // No request thread: the caller runs the requests one by one with
+        // handleNextRequest().
+        bool manualLooper;
+    };
+
+    explicit FaceService(Opener opener, const Options& options = Options());
+    ~FaceService();
+
+    // The callback given to the vendor library. Events go to the most
+    // recently created service.
+    static void notify(const face_msg_t* msg);
+
+    // nullptr until the vendor module is open.
+    face_device_t* device() const { return mDevice; }
+    // Blocks while the vendor module is still being opened in the
+    // background. Returns nullptr if it is not usable.
+    face_device_t* waitForDevice();
+    void onServiceRegistered();
+
+    // Returns the new client and, in |replaced|, the one it took over
+    // from; CLIENT_* |flags| say what else it takes.
+    std::shared_ptr<FaceClient> addClient(pid_t pid, const std::shared_ptr<FaceClientCallback>& callback,
+            uint32_t flags, std::shared_ptr<FaceClient>* replaced);
+    // A client died or cleared its callback.
+    void removeClient(uint32_t clientId);
+    std::shared_ptr<const std::vector<std::shared_ptr<FaceClient>>> clients() const { return mClients.all(); }
+
+    // The calls of the clients; |pid| is the caller's.
+    int32_t setActiveUser(int32_t userId, const char* storePath);
+    int32_t generateChallenge(uint32_t challengeTimeoutSec, uint64_t* challenge);
+    int32_t enroll(pid_t pid, const uint8_t* hat, size_t hatSize, uint32_t timeoutSec,
+            const int32_t* disabledFeatures, size_t featureCount);
+    int32_t revokeChallenge();
+    int32_t setFeature(uint32_t feature, bool enabled, const uint8_t* hat, size_t hatSize, uint32_t faceId);
+    int32_t getFeature(uint32_t feature, uint32_t faceId, bool* enabled);
+    int32_t getAuthenticatorId(uint64_t* id);
+    int32_t cancel(pid_t pid);
+    int32_t enumerate(pid_t pid);
+    int32_t remove(pid_t pid, uint32_t faceId);
+    int32_t authenticate(pid_t pid, uint64_t operationId);
+    int32_t userActivity(pid_t pid);
+    int32_t resetLockout(const uint8_t* hat, size_t hatSize);
+
+    // Frames of the camera client. The submit* variants are oneway and
+    // carry no caller pid; a frame that can't be queued is handed back
+    // right away so the camera can reuse its buffer.
+    int32_t doEnrollProcess(pid_t pid, int64_t addr, const int32_t* info, size_t infoSize,
+            const int8_t* byteInfo, size_t byteInfoSize);
+    int32_t doAuthenticateProcess(pid_t pid, int64_t main, int64_t sub, int64_t otp, const int32_t* info,
+            size_t infoSize, const int8_t* byteInfo, size_t byteInfoSize);
+    void submitEnrollFrame(int64_t addr, const int32_t* info, size_t infoSize, const int8_t* byteInfo,
+            size_t byteInfoSize);
+    void submitAuthenticateFrame(int64_t main, int64_t sub, int64_t otp, const int32_t* info, size_t infoSize,
+            const int8_t* byteInfo, size_t byteInfoSize);
+
+    void updateLivenessMode(int32_t value, int32_t userId);
+    void updateScreenState(bool interactive);
+
+    std::vector<FaceSessionLog::Record> sessionRecords() const { return mSessionLog.records(); }
+    void dump(int fd);
+
+    // Options::manualLooper only: handles the highest request ready on the
+    // calling thread. Returns false if none is queued.
+    bool handleNextRequest() { return mRequests->handleNext(); }
+    // Requests queued in |requestClass|, one of the *_CLASS of FaceRequests.h.
+    size_t queuedRequests(size_t requestClass) const { return mRequests->size(requestClass); }
+
+private:
+    // Runs the requests queued for the vendor device, one at a time, on the
+    // request thread.
+    void onRequest(FaceRequest& request);
+    void openDevice(Opener opener);
+    bool isHalFailed() const;
+    void onDeadlineExceeded(const char* name, pid_t tid);
+    void handleTimeout();
+    void trimResources(int reason);
+    void warmUpIfTrimmed();
+    void updateCapture();
+    FaceRequest* obtainRequest(uint32_t what, const FaceClient* client = nullptr);
+    FaceRequest* tryObtainRequest(uint32_t what, const FaceClient* client = nullptr);
+    void postWarmUp();
+    FaceRequest* obtainFrameRequest(uint32_t what, const FaceClient* client, uint32_t frame);
+    void onFrameProcessed(const FaceRequest& request, int64_t latencyUs, size_t cls);
+    void dropVendorFrame(const FaceRequest& request, const char* name, int err);
+    void checkEnrollFrame(FaceRequest& request);
+    void extractEnrollFrame(FaceRequest& frame, const FaceEnrollQuality& quality, int64_t waitUs);
+    void replyEnrollProcessed(uint32_t clientId, int64_t addr);
+    void replyAuthProcessed(uint32_t clientId, int64_t main, int64_t sub);
+    std::shared_ptr<FaceClient> sessionClient() const;
+    std::shared_ptr<FaceClient> frameSender() const;
+    bool runsOnFramesOf(uint32_t owner, const FaceClient* sender) const;
+    uint32_t frameSession(const FaceClient* client) const;
+    int32_t queueEnrollFrame(const std::shared_ptr<FaceClient>& client, uint32_t frame, int64_t addr,
+            const int32_t* info, size_t infoSize, const int8_t* byteInfo, size_t byteInfoSize);
+    int32_t queueAuthenticateFrame(const std::shared_ptr<FaceClient>& client, uint32_t frame, int64_t main,
+            int64_t sub, int64_t otp, const int32_t* info, size_t infoSize, const int8_t* byteInfo,
+            size_t byteInfoSize);
+    void admitSession(FaceRequest& request);
+    void startSpeculation(FaceRequest& request);
+    bool joinSpeculation(FaceRequest& request);
+    bool takeHeldMatch(const FaceRequest& request);
+    void expireSpeculation(uint32_t session);
+    bool onSpeculativeEvent(const face_msg_t* msg);
+    bool confirmCachedMatch(uint64_t operationId);
+    void cacheMatch(uint32_t faceId);
+    void startSession(FaceRequest& request);
+    void preemptSession();
+    void cancelSession(uint32_t clientId);
+    void dropGoneClients();
+    void reportCanceled(const std::shared_ptr<FaceClient>& client);
+    void reportLockedOut(const std::shared_ptr<FaceClient>& client, FaceLockoutTracker::Lockout lockout);
+    void reportTokenRejected(const std::shared_ptr<FaceClient>& client);
+    void reportLockoutChanged(uint64_t durationMs);
+    std::shared_ptr<FaceClient> stopSession(bool report);
+    void endSession(FaceSessionLog::Outcome outcome);
+    void schedule();
+    void schedulePersist();
+    void updateSessions();
+    bool acceptFrame(const FaceRequest& request);
+    void reportFrameRate(uint32_t fps);
+    void post(FaceRequest* request);
+    void beginSessionTrace();
+    void endSessionTrace();
+    void endFrameTrace(uint32_t frame);
+    void captureFrame(uint32_t type, const int64_t args[4], const int32_t* info, size_t infoSize,
+            const int8_t* byteInfo, size_t byteInfoSize);
+
+    static const size_t kMaxFeatures = 2;
+    static FaceService* sInstance;
+
+    const FaceRequestQueue::Clock mClock;
+    const bool mManualLooper;
+    FaceClientRegistry mClients;
+    FaceSessionArbiter mSessions;
+    // Who asked for the enumerate or remove the vendor is working on.
+    std::atomic<uint32_t> mMaintenanceClient;
+    // Who sent the frame the vendor is working on; its buffer goes back there.
+    std::atomic<uint32_t> mFrameClient;
+    // Session the vendor reported the end of, released on the request thread.
+    std::atomic<uint32_t> mEndedSession;
+    // The vendor's CANCELED for a preempted session was already reported.
+    bool mSwallowCancel;
+    // Left by the watchdog for the request thread: a session that missed
+    // its deadline and a speculative session that ran out.
+    std::atomic<bool> mTimeoutPending;
+    std::atomic<uint32_t> mTimedOutSession;
+    std::atomic<uint32_t> mExpiredSpeculation;
+    // Left by removeClient() for the request thread.
+    std::atomic<bool> mClientsGone;
+    // A PERSIST_REQUEST is queued.
+    std::atomic<bool> mPersistPosted;
+    std::atomic<int32_t> mUserId;
+    face_device_t *mDevice;
+    std::unique_ptr<FaceRequestQueue> mRequests;
+    bool mCancelled;
+    // Set when the session missed a deadline; its late events are dropped
+    // until the next enroll or authenticate.
+    bool mSessionStale;
+    std::mutex mCancelledMutex;
+    // Binder threads run the control calls concurrently; the vendor's
+    // synchronous entry points are taken one at a time.
+    std::mutex mControlMutex;
+    // What the running enroll was started with.
+    hw_auth_token_t mToken;
+    uint32_t mDisabledFeatures[kMaxFeatures];
+    uint32_t mDisabledFeatureMask;
+    // A session runs on the vendor library. Also cleared from the watchdog
+    // thread.
+    std::atomic<bool> mAlgoInitialized;
+    FaceTemplateStore mTemplateStore;
+    FaceLockoutTracker mLockout;
+    FaceAuthTokenFilter mAuthTokens;
+    FaceStats mStats;
+    FaceSessionLog mSessionLog;
+    FaceWatchdog mWatchdog;
+    int32_t mControlDeadlineMs;
+    int32_t mFrameDeadlineMs;
+
+    enum {
+        HAL_OPENING,
+        HAL_READY,
+        HAL_FAILED,
+    };
+    std::atomic<int> mHalState;
+    std::mutex mHalStateMutex;
+    std::condition_variable mHalStateCondition;
+    std::thread mOpenThread;
+    std::unique_ptr<FaceWorkerClient> mWorker;
+    FaceVendorHooks mHooks;
+
+    FaceIdlePolicy mIdlePolicy;
+    // Set once pools and vendor models were released, cleared by the next
+    // warm up.
+    std::atomic<bool> mTrimmed;
+    std::atomic<int64_t> mAuthStartUs;
+    std::atomic<bool> mAuthCold;
+
+    FaceCaptureWriter mCapture;
+    std::atomic<bool> mCaptureFrames;
+
+    FaceFrameRateController mFrameRate;
+
+    FaceEnrollPipeline mEnrollPipeline;
+    FaceEnrollCoverage mEnrollCoverage;
+    bool mEnrollPipelined;
+    std::atomic<int64_t> mEnrollStartUs;
+    std::atomic<int64_t> mLastExtractUs;
+
+    // userActivity() may start an authenticate before the framework asks
+    // for one; authenticate() then joins it or takes the match it made.
+    bool mSpeculative;
+    int32_t mSpeculativeTimeoutMs;
+    int64_t mSpeculativeWindowUs;
+    // The running session is speculative: its results are held, not reported.
+    std::atomic<bool> mSpeculating;
+    // A speculative session was rejected. Rejections may count towards the
+    // vendor's lockout, so no more speculation until a real authenticate.
+    std::atomic<bool> mSpeculationRejected;
+    FaceHeldMatch mHeldMatch;
+
+    // An authenticate shortly after a match only has the vendor confirm it
+    // on one frame, when the vendor library can.
+    int64_t mMatchCacheWindowUs;
+    int32_t mMatchCacheMinLiveness;
+    FaceMatchCache mMatchCache;
+    // When the authenticate frame last given to the vendor was.
+    std::atomic<int64_t> mLastAuthFrameUs;
+    // The running authenticate confirms a cached match.
+    std::atomic<bool> mConfirmingMatch;
+
+    // Tracing: ids put on every slice and the counter tracks.
+    std::atomic<uint32_t> mSessionId;
+    std::atomic<uint32_t> mTracedSessionId;
+    std::atomic<uint32_t> mFrameSeq;
+    std::atomic<uint32_t> mCurrentFrame;
+    std::atomic<int32_t> mQueueDepth;
+    std::atomic<int32_t> mFramesInFlight;
+};
+
+}  // namespace implementation
+}  // namespace V1_0
+}  // namespace face
+}  // namespace hardware
+}  // namespace sprd
+}  // namespace vendor
@@ -0,0 +1,595 @@
+// FIXME: your file license if you have one
+
+// Tests of the parts of the service that do not need the transport or the
+// vendor library; they run on the host as well as on a device.
+
+#include <gtest/gtest.h>
+#include <endian.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <zlib.h>
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "FaceAuthToken.h"
+#include "FaceEnrollPipeline.h"
+#include "FaceFrameRate.h"
+#include "FaceLockout.h"
+#include "FaceRequestQueue.h"
+#include "FaceSession.h"
+#include "FaceSessionLog.h"
+#include "FaceStats.h"
+#include "FaceTemplateStore.h"
+
+using namespace ::vendor::sprd::hardware::face::V1_0::implementation;
+
+static const FaceRequestClass kClasses[] = {
+    { "high", 8, 0 },
+    { "low", 8, 20 },
+};
+
+struct Handled {
+    std::mutex mutex;
+    std::vector<uint32_t> what;
+
+    void add(uint32_t w) {
+        std::lock_guard<std::mutex> lock(mutex);
+        what.push_back(w);
+    }
+
+    size_t size() {
+        std::lock_guard<std::mutex> lock(mutex);
+        return what.size();
+    }
+
+    void waitFor(size_t count) {
+        while (size() < count) {
+            usleep(1000);
+        }
+    }
+};
+
+static void push(FaceRequestQueue& queue, size_t cls, uint32_t what) {
+    FaceRequest* request = queue.beginPush(cls);
+    request->what = what;
+    queue.endPush(request);
+}
+
+TEST(FaceRequestQueueTest, HigherClassGoesFirst) {
+    Handled handled;
+    FaceRequestQueue queue("test", kClasses, 2, [&](FaceRequest& request) { handled.add(request.what); });
+    push(queue, 1, 10);
+    push(queue, 1, 11);
+    push(queue, 0, 1);
+    push(queue, 0, 2);
+    EXPECT_EQ(4u, queue.size());
+    EXPECT_EQ(2u, queue.size(1));
+    queue.start();
+    handled.waitFor(4);
+    EXPECT_EQ((std::vector<uint32_t>{ 1, 2, 10, 11 }), handled.what);
+}
+
+TEST(FaceRequestQueueTest, OverdueLowerClassIsNotStarved) {
+    Handled handled;
+    FaceRequestQueue queue("test", kClasses, 2, [&](FaceRequest& request) { handled.add(request.what); });
+    push(queue, 1, 10);
+    push(queue, 0, 1);
+    // Past the 20ms the low class may wait.
+    usleep(30000);
+    queue.start();
+    handled.waitFor(2);
+    EXPECT_EQ((std::vector<uint32_t>{ 10, 1 }), handled.what);
+}
+
+TEST(FaceRequestQueueTest, TryBeginPushFailsWhenFull) {
+    FaceRequestQueue queue("test", kClasses, 2, [](FaceRequest&) {});
+    for (size_t i = 0; i < kClasses[0].slots; i++) {
+        FaceRequest* request = queue.tryBeginPush(0);
+        ASSERT_NE(nullptr, request);
+        queue.endPush(request);
+    }
+    EXPECT_EQ(nullptr, queue.tryBeginPush(0));
+    EXPECT_NE(nullptr, queue.tryBeginPush(1));
+}
+
+TEST(FaceSessionArbiterTest, AuthenticatePreemptsEnroll) {
+    FaceSessionArbiter arbiter;
+    EXPECT_EQ(FaceSessionArbiter::START, arbiter.admit(1, false));
+    arbiter.grant(1, 100, false, 0);
+    EXPECT_EQ(1u, arbiter.owner());
+    EXPECT_EQ(100u, arbiter.session());
+    EXPECT_EQ(FaceSessionArbiter::START, arbiter.admit(1, true));
+    EXPECT_EQ(FaceSessionArbiter::PARK, arbiter.admit(2, false));
+    EXPECT_EQ(FaceSessionArbiter::PREEMPT, arbiter.admit(2, true));
+    arbiter.grant(1, 101, true, 0);
+    EXPECT_EQ(FaceSessionArbiter::PARK, arbiter.admit(2, true));
+}
+
+TEST(FaceSessionArbiterTest, ParkedAuthenticatesGoFirstThenTurns) {
+    FaceSessionArbiter arbiter;
+    arbiter.grant(2, 100, false, 0);
+    FaceRequest request;
+    request.client = 1;
+    arbiter.park(1, request, false, 10);
+    request.client = 3;
+    arbiter.park(3, request, false, 20);
+    request.client = 4;
+    arbiter.park(4, request, true, 30);
+    int64_t heldUs;
+    EXPECT_EQ(2u, arbiter.release(50, &heldUs));
+    EXPECT_EQ(50, heldUs);
+    EXPECT_EQ(kNoClient, arbiter.owner());
+
+    FaceRequest next;
+    int64_t parkedUs;
+    ASSERT_TRUE(arbiter.next(&next, &parkedUs, 60));
+    EXPECT_EQ(4u, next.client);
+    EXPECT_EQ(30, parkedUs);
+    // Then the client after the last owner (2), wrapping around.
+    ASSERT_TRUE(arbiter.next(&next, &parkedUs, 60));
+    EXPECT_EQ(3u, next.client);
+    ASSERT_TRUE(arbiter.next(&next, &parkedUs, 60));
+    EXPECT_EQ(1u, next.client);
+    EXPECT_FALSE(arbiter.next(&next, &parkedUs, 60));
+}
+
+TEST(FaceSessionArbiterTest, UnparkDropsTheStart) {
+    FaceSessionArbiter arbiter;
+    arbiter.grant(1, 100, false, 0);
+    FaceRequest request;
+    request.client = 2;
+    arbiter.park(2, request, false, 0);
+    EXPECT_TRUE(arbiter.unpark(2));
+    EXPECT_FALSE(arbiter.unpark(2));
+    int64_t heldUs;
+    arbiter.release(10, &heldUs);
+    FaceRequest next;
+    int64_t parkedUs;
+    EXPECT_FALSE(arbiter.next(&next, &parkedUs, 10));
+}
+
+TEST(FaceHeldMatchTest, HandedOutOnceForTheSameUserAndOperation) {
+    FaceHeldMatch match;
+    const uint8_t token[] = { 1, 2, 3 };
+    uint32_t faceId = 0;
+    std::vector<uint8_t> taken;
+    match.hold(5, 10, 0, token, sizeof(token), 1000);
+    EXPECT_TRUE(match.take(10, 0, 1500, 1000, &faceId, &taken));
+    EXPECT_EQ(5u, faceId);
+    EXPECT_EQ((std::vector<uint8_t>{ 1, 2, 3 }), taken);
+    EXPECT_FALSE(match.take(10, 0, 1500, 1000, &faceId, &taken));
+
+    // Another operation, another user or too late: gone all the same.
+    match.hold(5, 10, 0, token, sizeof(token), 1000);
+    EXPECT_FALSE(match.take(10, 42, 1500, 1000, &faceId, &taken));
+    EXPECT_FALSE(match.take(10, 0, 1500, 1000, &faceId, &taken));
+    match.hold(5, 10, 0, token, sizeof(token), 1000);
+    EXPECT_FALSE(match.take(11, 0, 1500, 1000, &faceId, &taken));
+    match.hold(5, 10, 0, token, sizeof(token), 1000);
+    EXPECT_FALSE(match.take(10, 0, 2001, 1000, &faceId, &taken));
+}
+
+TEST(FaceMatchCacheTest, ConfirmsOnceWithLivenessWhileFresh) {
+    FaceMatchCache cache;
+    FaceRecentMatch match;
+    cache.store(5, 10, 1000);
+    // Not before the vendor gave its liveness score.
+    EXPECT_TRUE(cache.needsLiveness());
+    EXPECT_FALSE(cache.take(10, 1500, 1000, 0, &match));
+    cache.store(5, 10, 1000);
+    cache.setLiveness(80);
+    EXPECT_FALSE(cache.needsLiveness());
+    ASSERT_TRUE(cache.take(10, 1500, 1000, 50, &match));
+    EXPECT_EQ(5u, match.faceId);
+    EXPECT_EQ(80, match.liveness);
+    EXPECT_EQ(500, match.ageUs);
+    EXPECT_FALSE(cache.take(10, 1500, 1000, 50, &match));
+
+    // Another user, too late, not live enough, unknown or cleared: gone.
+    cache.store(5, 10, 1000);
+    cache.setLiveness(80);
+    EXPECT_FALSE(cache.take(11, 1500, 1000, 50, &match));
+    EXPECT_FALSE(cache.take(10, 1500, 1000, 50, &match));
+    cache.store(5, 10, 1000);
+    cache.setLiveness(80);
+    EXPECT_FALSE(cache.take(10, 2001, 1000, 50, &match));
+    cache.store(5, 10, 1000);
+    cache.setLiveness(40);
+    EXPECT_FALSE(cache.take(10, 1500, 1000, 50, &match));
+    cache.store(5, 10, 1000);
+    cache.setLiveness(FaceMatchCache::kUnknownLiveness);
+    EXPECT_FALSE(cache.needsLiveness());
+    EXPECT_FALSE(cache.take(10, 1500, 1000, FaceMatchCache::kUnknownLiveness, &match));
+    cache.store(5, 10, 1000);
+    cache.setLiveness(80);
+    cache.clear(FaceMatchCache::SCREEN_OFF);
+    EXPECT_FALSE(cache.take(10, 1500, 1000, 50, &match));
+}
+
+// A directory of its own under the test's temporary directory.
+static std::string makeTempDir(const char* name) {
+    std::string dir = ::testing::TempDir() + name + "_XXXXXX";
+    if (mkdtemp(&dir[0]) == nullptr) {
+        return std::string();
+    }
+    return dir;
+}
+
+TEST(FaceLockoutTrackerTest, ThresholdsLockOutAndVendorEventsWin) {
+    FaceLockoutTracker lockout;
+    lockout.setThresholds(3, 6, 30000000);
+    lockout.open(10, "/nonexistent", 0);
+    EXPECT_EQ(FaceLockoutTracker::NONE, lockout.onRejected(100));
+    EXPECT_EQ(FaceLockoutTracker::NONE, lockout.onRejected(200));
+    EXPECT_EQ(FaceLockoutTracker::TIMED, lockout.onRejected(300));
+    EXPECT_EQ(FaceLockoutTracker::TIMED, lockout.check(30000299));
+    EXPECT_EQ(FaceLockoutTracker::NONE, lockout.check(30000300));
+    // A success before the next lockout starts the count over.
+    lockout.onAccepted(40000000);
+    EXPECT_EQ(FaceLockoutTracker::NONE, lockout.onRejected(40000100));
+    EXPECT_EQ(FaceLockoutTracker::NONE, lockout.onRejected(40000200));
+    EXPECT_EQ(FaceLockoutTracker::TIMED, lockout.onRejected(40000300));
+    // The vendor ended it early.
+    lockout.onVendorLockout(0, 40000400);
+    EXPECT_EQ(FaceLockoutTracker::NONE, lockout.check(40000400));
+    for (int64_t t = 40000500; t < 40000800; t += 100) {
+        lockout.onRejected(t);
+    }
+    EXPECT_EQ(FaceLockoutTracker::PERMANENT, lockout.check(INT64_MAX - 1));
+    // Only a reset ends the service's own permanent lockout.
+    lockout.onVendorLockout(0, 50000000);
+    EXPECT_EQ(FaceLockoutTracker::PERMANENT, lockout.check(50000000));
+    lockout.reset();
+    EXPECT_EQ(FaceLockoutTracker::NONE, lockout.check(50000000));
+
+    // Without a duration the vendor keeps answering for itself.
+    lockout.onVendorLockout(-1, 60000000);
+    EXPECT_EQ(FaceLockoutTracker::NONE, lockout.check(60000000));
+    lockout.onVendorLockout(5000000, 60000000);
+    EXPECT_EQ(5000000, lockout.remainingUs(60000000));
+}
+
+TEST(FaceLockoutTrackerTest, StateSurvivesARestartPerUser) {
+    std::string dir = makeTempDir("face_lockout");
+    ASSERT_FALSE(dir.empty());
+    {
+        FaceLockoutTracker lockout;
+        lockout.open(10, dir, 1000);
+        lockout.onRejected(1000);
+        lockout.onVendorLockout(FaceLockoutTracker::kPermanentUs, 2000);
+        EXPECT_TRUE(lockout.needsSave());
+        lockout.save(2000);
+        EXPECT_FALSE(lockout.needsSave());
+    }
+    FaceLockoutTracker lockout;
+    lockout.open(11, dir, 0);
+    EXPECT_EQ(FaceLockoutTracker::NONE, lockout.check(0));
+    lockout.open(10, dir, 0);
+    EXPECT_EQ(FaceLockoutTracker::PERMANENT, lockout.check(0));
+    lockout.reset();
+    lockout.onVendorLockout(30000000, 1000);
+    {
+        // Not written before save().
+        FaceLockoutTracker restarted;
+        restarted.open(10, dir, 5000000);
+        EXPECT_EQ(FaceLockoutTracker::NONE, restarted.check(5000000));
+    }
+    lockout.save(1000);
+    FaceLockoutTracker restarted;
+    restarted.open(10, dir, 5000000);
+    EXPECT_EQ(FaceLockoutTracker::TIMED, restarted.check(5000000));
+    EXPECT_LE(restarted.remainingUs(5000000), 30000000);
+    EXPECT_GT(restarted.remainingUs(5000000), 29000000);
+    std::string path = dir + "/face_lockout.bin";
+    unlink(path.c_str());
+    rmdir(dir.c_str());
+}
+
+static std::vector<uint8_t> authToken(uint64_t challenge, int64_t timestampMs, uint8_t hmac) {
+    hw_auth_token_t hat;
+    memset(&hat, 0, sizeof(hat));
+    hat.version = HW_AUTH_TOKEN_VERSION;
+    hat.challenge = challenge;
+    hat.timestamp = htobe64(timestampMs);
+    memset(hat.hmac, hmac, sizeof(hat.hmac));
+    const uint8_t* bytes = reinterpret_cast<const uint8_t*>(&hat);
+    return std::vector<uint8_t>(bytes, bytes + sizeof(hat));
+}
+
+TEST(FaceAuthTokenFilterTest, TurnsAwayMalformedAndKnownBadTokens) {
+    FaceAuthTokenFilter filter;
+    filter.setMaxAgeMs(600000);
+    std::vector<uint8_t> hat = authToken(42, 1000000, 1);
+    EXPECT_EQ(FaceAuthTokenFilter::BAD_SIZE, filter.check(hat.data(), hat.size() - 1, true, 1000000));
+    std::vector<uint8_t> bad = hat;
+    bad[0] = HW_AUTH_TOKEN_VERSION + 1;
+    EXPECT_EQ(FaceAuthTokenFilter::BAD_VERSION, filter.check(bad.data(), bad.size(), true, 1000000));
+    // The vendor decides about the challenge while none is outstanding.
+    EXPECT_EQ(FaceAuthTokenFilter::VALID, filter.check(hat.data(), hat.size(), true, 1000000));
+    filter.setChallenge(43);
+    EXPECT_EQ(FaceAuthTokenFilter::WRONG_CHALLENGE, filter.check(hat.data(), hat.size(), true, 1000000));
+    EXPECT_EQ(FaceAuthTokenFilter::VALID, filter.check(hat.data(), hat.size(), false, 1000000));
+    filter.setChallenge(42);
+    EXPECT_EQ(FaceAuthTokenFilter::STALE, filter.check(hat.data(), hat.size(), true, 1600001));
+    EXPECT_EQ(FaceAuthTokenFilter::STALE, filter.check(hat.data(), hat.size(), true, 399999));
+    EXPECT_EQ(FaceAuthTokenFilter::VALID, filter.check(hat.data(), hat.size(), true, 1600000));
+
+    // Once the vendor rejected it, the same token stops here until the
+    // challenge changes.
+    filter.onVendorVerdict(hat.data(), hat.size(), false);
+    EXPECT_EQ(FaceAuthTokenFilter::REJECTED_BEFORE, filter.check(hat.data(), hat.size(), true, 1000000));
+    std::vector<uint8_t> other = authToken(42, 1000000, 2);
+    EXPECT_EQ(FaceAuthTokenFilter::VALID, filter.check(other.data(), other.size(), true, 1000000));
+    filter.setChallenge(0);
+    EXPECT_EQ(FaceAuthTokenFilter::VALID, filter.check(hat.data(), hat.size(), true, 1000000));
+}
+
+TEST(FaceSessionLogTest, RecordsOutcomeFramesAndCpu) {
+    FaceSessionLog log;
+    log.watch(FaceSessionLog::REQUEST_THREAD, pthread_self());
+    log.begin(7, 1, true);
+    log.addFrame(7, FaceSessionLog::PROCESSED);
+    log.addFrame(7, FaceSessionLog::PROCESSED);
+    log.addFrame(6, FaceSessionLog::PROCESSED);
+    log.addFrame(7, FaceSessionLog::DROPPED);
+    // Burn some CPU on the watched thread.
+    int64_t start = monotonicUs();
+    volatile uint64_t sink = 0;
+    while (monotonicUs() - start < 20000) {
+        sink = sink + 1;
+    }
+    log.end(7, FaceSessionLog::SUCCEEDED);
+    log.end(7, FaceSessionLog::CANCELED);
+    // Late frames still count for the session they were sent for.
+    log.addFrame(7, FaceSessionLog::SKIPPED);
+
+    std::vector<FaceSessionLog::Record> records = log.records();
+    ASSERT_EQ(1u, records.size());
+    const FaceSessionLog::Record& r = records[0];
+    EXPECT_EQ(7u, r.session);
+    EXPECT_TRUE(r.authenticate);
+    EXPECT_EQ(FaceSessionLog::SUCCEEDED, r.outcome);
+    EXPECT_EQ(2u, r.frames[FaceSessionLog::PROCESSED]);
+    EXPECT_EQ(1u, r.frames[FaceSessionLog::DROPPED]);
+    EXPECT_EQ(1u, r.frames[FaceSessionLog::SKIPPED]);
+    EXPECT_GE(r.wallUs, 20000);
+    EXPECT_GE(r.threadCpuUs[FaceSessionLog::REQUEST_THREAD], 10000);
+    EXPECT_GE(r.processUserUs + r.processSystemUs, r.threadCpuUs[FaceSessionLog::REQUEST_THREAD] - 1000);
+}
+
+TEST(FaceSessionLogTest, KeepsTheMostRecentSessions) {
+    FaceSessionLog log;
+    for (uint32_t i = 1; i <= FaceSessionLog::kRecords + 3; i++) {
+        log.begin(i, 1, false);
+        log.end(i, FaceSessionLog::CANCELED);
+    }
+    log.begin(100, 2, true);
+    std::vector<FaceSessionLog::Record> records = log.records();
+    ASSERT_EQ(FaceSessionLog::kRecords + 1, records.size());
+    EXPECT_EQ(4u, records[0].session);
+    EXPECT_EQ(FaceSessionLog::kRecords + 3, records[FaceSessionLog::kRecords - 1].session);
+    EXPECT_EQ(100u, records.back().session);
+    EXPECT_EQ(FaceSessionLog::ACTIVE, records.back().outcome);
+}
+
+TEST(FaceFrameRateTest, SlowLibraryLowersTheRate) {
+    FaceFrameRateController controller;
+    controller.init();
+    ASSERT_TRUE(controller.enabled());
+    controller.onSessionStart(0);
+    // 150ms per frame leaves room for about 6fps.
+    for (int64_t i = 1; i <= 40; i++) {
+        controller.onFrameProcessed(150000, 0, i * 150000);
+    }
+    EXPECT_NEAR(6, (int)controller.recommendedFps(), 1);
+    EXPECT_GT(controller.updatesSent(), 0u);
+}
+
+TEST(FaceEnrollCoverageTest, CountsDistinctPoseBins) {
+    FaceEnrollCoverage coverage;
+    EXPECT_EQ(0, coverage.coveredBins());
+    EXPECT_TRUE(coverage.add({ 0, 0, 0, 90 }));
+    EXPECT_FALSE(coverage.add({ 1, -1, 0, 90 }));
+    EXPECT_TRUE(coverage.add({ 40, 0, 0, 90 }));
+    EXPECT_TRUE(coverage.add({ -40, 30, 0, 90 }));
+    EXPECT_EQ(3, coverage.coveredBins());
+    coverage.reset();
+    EXPECT_EQ(0, coverage.coveredBins());
+}
+
+TEST(FaceEnrollPipelineTest, ExtractsInOrderAndDrains) {
+    std::vector<int64_t> extracted;
+    std::atomic<bool> busy(false);
+    FaceEnrollPipeline pipeline([&](FaceRequest& frame, const FaceEnrollQuality&, int64_t) {
+        EXPECT_FALSE(busy.exchange(true));
+        usleep(2000);
+        extracted.push_back(frame.args[0]);
+        busy = false;
+    });
+    pipeline.start();
+    int64_t pushed = 0;
+    for (int64_t i = 0; i < 20; i++) {
+        FaceRequest request;
+        request.args[0] = i;
+        if (pipeline.push(request, FaceEnrollQuality())) {
+            pushed++;
+        } else {
+            pipeline.drain();
+        }
+    }
+    pipeline.drain();
+    ASSERT_EQ((size_t)pushed, extracted.size());
+    for (size_t i = 1; i < extracted.size(); i++) {
+        EXPECT_LT(extracted[i - 1], extracted[i]);
+    }
+}
+
+static void removeTemplateStore(const std::string& dir) {
+    std::string path = dir + "/face_templates.bin";
+    unlink(path.c_str());
+    rmdir(dir.c_str());
+}
+
+TEST(FaceTemplateStoreTest, AddsAndRemoves) {
+    std::string dir = makeTempDir("face_templates");
+    ASSERT_FALSE(dir.empty());
+    FaceTemplateStore store;
+    EXPECT_FALSE(store.open(10, dir));
+    EXPECT_EQ(nullptr, store.snapshot());
+    ASSERT_TRUE(store.add(1, 0));
+    ASSERT_TRUE(store.add(2, 4));
+    ASSERT_TRUE(store.add(2, 4));
+    std::shared_ptr<const FaceTemplateSnapshot> before = store.snapshot();
+    ASSERT_NE(nullptr, before);
+    EXPECT_EQ(2u, before->count());
+    EXPECT_EQ(4u, before->recordAt(1)->disabledFeatures);
+
+    ASSERT_TRUE(store.remove(1));
+    std::shared_ptr<const FaceTemplateSnapshot> after = store.snapshot();
+    EXPECT_FALSE(after->contains(1));
+    EXPECT_TRUE(after->contains(2));
+    EXPECT_GT(after->generation(), before->generation());
+    // A reader keeps the version it took.
+    EXPECT_TRUE(before->contains(1));
+
+    ASSERT_TRUE(store.remove(0));
+    EXPECT_EQ(0u, store.snapshot()->count());
+    removeTemplateStore(dir);
+}
+
+TEST(FaceTemplateStoreTest, QueuedChangesWaitForFlush) {
+    std::string dir = makeTempDir("face_templates");
+    ASSERT_FALSE(dir.empty());
+    FaceTemplateStore store;
+    store.open(10, dir);
+    store.queueAdd(1, 0);
+    store.queueAdd(2, 0);
+    store.queueRemove(1);
+    EXPECT_TRUE(store.hasQueued());
+    EXPECT_EQ(nullptr, store.snapshot());
+    ASSERT_TRUE(store.flush());
+    EXPECT_FALSE(store.hasQueued());
+    EXPECT_EQ(1u, store.snapshot()->count());
+    EXPECT_TRUE(store.snapshot()->contains(2));
+
+    // Switching users writes what the previous one queued first.
+    store.queueAdd(3, 0);
+    store.open(11, dir);
+    EXPECT_FALSE(store.hasQueued());
+    EXPECT_EQ(nullptr, store.snapshot());
+    EXPECT_TRUE(store.open(10, dir));
+    EXPECT_TRUE(store.snapshot()->contains(3));
+    removeTemplateStore(dir);
+}
+
+TEST(FaceTemplateStoreTest, EnumerationDropsWhatTheVendorLost) {
+    std::string dir = makeTempDir("face_templates");
+    ASSERT_FALSE(dir.empty());
+    FaceTemplateStore store;
+    store.open(10, dir);
+    ASSERT_TRUE(store.add(1, 4));
+    ASSERT_TRUE(store.add(2, 0));
+    store.queueEnumerated(1);
+    ASSERT_TRUE(store.flush());
+    EXPECT_EQ(1u, store.snapshot()->count());
+    EXPECT_EQ(4u, store.snapshot()->recordAt(0)->disabledFeatures);
+
+    uint64_t generation = store.snapshot()->generation();
+    store.queueEnumerated(1);
+    ASSERT_TRUE(store.flush());
+    EXPECT_EQ(generation, store.snapshot()->generation());
+
+    // Wiped on the vendor's side, then enrolled again.
+    store.queueEnumerated(0);
+    store.queueEnumerated(3);
+    ASSERT_TRUE(store.flush());
+    EXPECT_EQ(1u, store.snapshot()->count());
+    EXPECT_TRUE(store.snapshot()->contains(3));
+    removeTemplateStore(dir);
+}
+
+// Resident bytes of the mapping holding |address|, as the kernel accounts
+// them to this process.
+static int64_t residentBytes(const void* address) {
+    FILE* smaps = fopen("/proc/self/smaps", "re");
+    if (smaps == nullptr) {
+        return -1;
+    }
+    uintptr_t target = reinterpret_cast<uintptr_t>(address);
+    bool inside = false;
+    int64_t resident = -1;
+    char line[512];
+    while (resident < 0 && fgets(line, sizeof(line), smaps) != nullptr) {
+        uintptr_t start;
+        uintptr_t end;
+        long kb;
+        if (sscanf(line, "%" SCNxPTR "-%" SCNxPTR " ", &start, &end) == 2) {
+            inside = start <= target && target < end;
+        } else if (inside && sscanf(line, "Rss: %ld kB", &kb) == 1) {
+            resident = (int64_t)kb * 1024;
+        }
+    }
+    fclose(smaps);
+    return resident;
+}
+
+static bool writeTemplateFile(const std::string& path, int32_t userId, uint32_t count) {
+    std::vector<uint8_t> file(sizeof(FaceTemplateFileHeader) + (size_t)count * sizeof(FaceTemplateRecord));
+    FaceTemplateFileHeader* header = reinterpret_cast<FaceTemplateFileHeader*>(file.data());
+    header->magic = 0x54414653;
+    header->version = 1;
+    header->headerSize = sizeof(FaceTemplateFileHeader);
+    header->recordSize = sizeof(FaceTemplateRecord);
+    header->userId = userId;
+    header->count = count;
+    header->generation = 1;
+    header->headerCrc = crc32(0L, file.data(), offsetof(FaceTemplateFileHeader, headerCrc));
+    FaceTemplateRecord* records = reinterpret_cast<FaceTemplateRecord*>(file.data() + sizeof(*header));
+    for (uint32_t i = 0; i < count; i++) {
+        records[i].faceId = i + 1;
+        records[i].crc = crc32(0L, reinterpret_cast<const Bytef*>(&records[i]), offsetof(FaceTemplateRecord, crc));
+    }
+    int fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+    if (fd < 0) {
+        return false;
+    }
+    bool ok = write(fd, file.data(), file.size()) == (ssize_t)file.size();
+    close(fd);
+    return ok;
+}
+
+// Loading a large store maps it without reading it: the load time and the
+// resident set only grow once the records are walked, and shrink back
+// once they are released. Prints what it measured.
+TEST(FaceTemplateStoreTest, LargeStoreLoadsLazily) {
+    static const uint32_t kTemplates = 1000000;
+    std::string dir = makeTempDir("face_templates");
+    ASSERT_FALSE(dir.empty());
+    ASSERT_TRUE(writeTemplateFile(dir + "/face_templates.bin", 10, kTemplates));
+
+    FaceTemplateStore store;
+    ASSERT_TRUE(store.open(10, dir));
+    std::shared_ptr<const FaceTemplateSnapshot> snapshot = store.snapshot();
+    // Brings in the header's page only.
+    const void* mapping = snapshot->recordAt(0);
+    int64_t loaded = residentBytes(mapping);
+    EXPECT_FALSE(snapshot->contains(kTemplates + 1));
+    int64_t walked = residentBytes(mapping);
+    snapshot->release();
+    int64_t released = residentBytes(mapping);
+    int64_t mapped = snapshot->mappedBytes();
+    printf("%u templates, %" PRId64 " bytes: load %" PRId64 "us, resident %" PRId64 " after load, %" PRId64
+            " walked, %" PRId64 " released\n", kTemplates, mapped, store.lastLoadUs(), loaded, walked, released);
+    if (loaded >= 0) {
+        EXPECT_LT(loaded, mapped / 4);
+        EXPECT_GE(walked, mapped / 2);
+        EXPECT_LT(released, mapped / 4);
+    }
+    removeTemplateStore(dir);
+}
@@ -0,0 +1,198 @@
+// FIXME: your file license if you have one
+
+#include <stdio.h>
+#include <string.h>
+#include "FaceSession.h"
+
+namespace vendor {
+namespace sprd {
+namespace hardware {
+namespace face {
+namespace V1_0 {
+namespace implementation {
+
+FaceSessionArbiter::FaceSessionArbiter()
+        : mOwner(kNoClient), mSession(0), mAuthenticating(false), mGrantedUs(0), mLastOwner(kNoClient) {}
+
+FaceSessionArbiter::Decision FaceSessionArbiter::admit(uint32_t client, bool authenticate) {
+    uint32_t owner = mOwner.load(std::memory_order_relaxed);
+    if (owner == kNoClient || owner == client) {
+        return START;
+    }
+    if (authenticate && !mAuthenticating) {
+        return PREEMPT;
+    }
+    return PARK;
+}
+
+void FaceSessionArbiter::grant(uint32_t client, uint32_t session, bool authenticate, int64_t nowUs) {
+    if (mOwner.load(std::memory_order_relaxed) != client) {
+        mGrantedUs = nowUs;
+    }
+    mAuthenticating = authenticate;
+    mSession.store(session, std::memory_order_release);
+    mOwner.store(client, std::memory_order_release);
+}
+
+uint32_t FaceSessionArbiter::release(int64_t nowUs, int64_t* heldUs) {
+    uint32_t owner = mOwner.exchange(kNoClient, std::memory_order_acq_rel);
+    *heldUs = owner != kNoClient ? nowUs - mGrantedUs : 0;
+    if (owner != kNoClient) {
+        mLastOwner = owner;
+    }
+    return owner;
+}
+
+void FaceSessionArbiter::park(uint32_t client, FaceRequest& request, bool authenticate, int64_t nowUs) {
+    for (auto& p : mParked) {
+        if (p.client == client) {
+            p.authenticate = authenticate;
+            p.parkedUs = nowUs;
+            p.request = std::move(request);
+            return;
+        }
+    }
+    mParked.push_back(Parked{ client, authenticate, nowUs, std::move(request) });
+}
+
+bool FaceSessionArbiter::next(FaceRequest* request, int64_t* parkedUs, int64_t nowUs) {
+    if (mParked.empty()) {
+        return false;
+    }
+    // Authenticates first, then the client after the last owner in id order.
+    size_t best = 0;
+    for (size_t i = 1; i < mParked.size(); i++) {
+        const Parked& a = mParked[i];
+        const Parked& b = mParked[best];
+        if (a.authenticate != b.authenticate) {
+            if (a.authenticate) {
+                best = i;
+            }
+            continue;
+        }
+        uint32_t da = a.client - mLastOwner - 1;
+        uint32_t db = b.client - mLastOwner - 1;
+        if (da < db) {
+            best = i;
+        }
+    }
+    *request = std::move(mParked[best].request);
+    *parkedUs = nowUs - mParked[best].parkedUs;
+    mParked.erase(mParked.begin() + best);
+    return true;
+}
+
+bool FaceSessionArbiter::unpark(uint32_t client) {
+    for (size_t i = 0; i < mParked.size(); i++) {
+        if (mParked[i].client == client) {
+            mParked.erase(mParked.begin() + i);
+            return true;
+        }
+    }
+    return false;
+}
+
+FaceHeldMatch::FaceHeldMatch() : mHeld(false), mFaceId(0), mUserId(0), mChallenge(0), mHeldUs(0) {}
+
+void FaceHeldMatch::hold(uint32_t faceId, int32_t userId, uint64_t challenge, const uint8_t* token,
+        size_t size, int64_t nowUs) {
+    std::lock_guard<std::mutex> lock(mMutex);
+    mHeld = true;
+    mFaceId = faceId;
+    mUserId = userId;
+    mChallenge = challenge;
+    mHeldUs = nowUs;
+    mToken.assign(token, token + size);
+}
+
+bool FaceHeldMatch::take(int32_t userId, uint64_t challenge, int64_t nowUs, int64_t windowUs,
+        uint32_t* faceId, std::vector<uint8_t>* token) {
+    std::lock_guard<std::mutex> lock(mMutex);
+    bool valid = mHeld && mUserId == userId && mChallenge == challenge && nowUs - mHeldUs <= windowUs;
+    if (valid) {
+        *faceId = mFaceId;
+        token->swap(mToken);
+    }
+    mHeld = false;
+    // The token is a credential, don't leave copies around.
+    memset(mToken.data(), 0, mToken.size());
+    mToken.clear();
+    return valid;
+}
+
+void FaceHeldMatch::clear() {
+    std::lock_guard<std::mutex> lock(mMutex);
+    mHeld = false;
+    memset(mToken.data(), 0, mToken.size());
+    mToken.clear();
+}
+
+const int32_t FaceMatchCache::kUnknownLiveness;
+
+FaceMatchCache::FaceMatchCache()
+        : mValid(false), mFaceId(0), mUserId(0), mLiveness(kUnknownLiveness), mLastFrameUs(0), mLivenessPending(false),
+          mStores(0),
+          mHits(0), mMisses(0), mClears() {}
+
+void FaceMatchCache::store(uint32_t faceId, int32_t userId, int64_t lastFrameUs) {
+    std::lock_guard<std::mutex> lock(mMutex);
+    mValid = true;
+    mFaceId = faceId;
+    mUserId = userId;
+    mLiveness = kUnknownLiveness;
+    mLastFrameUs = lastFrameUs;
+    mLivenessPending = true;
+    mStores++;
+}
+
+bool FaceMatchCache::needsLiveness() const {
+    std::lock_guard<std::mutex> lock(mMutex);
+    return mValid && mLivenessPending;
+}
+
+void FaceMatchCache::setLiveness(int32_t liveness) {
+    std::lock_guard<std::mutex> lock(mMutex);
+    mLiveness = liveness;
+    mLivenessPending = false;
+}
+
+bool FaceMatchCache::take(int32_t userId, int64_t nowUs, int64_t windowUs, int32_t minLiveness,
+        FaceRecentMatch* match) {
+    std::lock_guard<std::mutex> lock(mMutex);
+    if (!mValid) {
+        return false;
+    }
+    mValid = false;
+    if (mUserId != userId || nowUs - mLastFrameUs > windowUs || mLiveness == kUnknownLiveness ||
+            mLiveness < minLiveness) {
+        mMisses++;
+        return false;
+    }
+    match->faceId = mFaceId;
+    match->liveness = mLiveness;
+    match->ageUs = nowUs - mLastFrameUs;
+    mHits++;
+    return true;
+}
+
+void FaceMatchCache::clear(ClearReason reason) {
+    std::lock_guard<std::mutex> lock(mMutex);
+    if (mValid) {
+        mValid = false;
+        mClears[reason]++;
+    }
+}
+
+void FaceMatchCache::dump(int fd) const {
+    std::lock_guard<std::mutex> lock(mMutex);
+    dprintf(fd, "match cache: held=%d stored=%u hits=%u misses=%u cleared rejected=%u lockout=%u user=%u "
+            "screen_off=%u templates=%u\n", mValid, mStores, mHits, mMisses, mClears[REJECTED], mClears[LOCKOUT],
+            mClears[USER_SWITCH], mClears[SCREEN_OFF], mClears[TEMPLATES_CHANGED]);
+}
+
+}  // namespace implementation
+}  // namespace V1_0
+}  // namespace face
+}  // namespace hardware
+}  // namespace sprd
+}  // namespace vendor
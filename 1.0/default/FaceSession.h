@@ -0,0 +1,158 @@
+// FIXME: your file license if you have one
+
+#pragma once
+
+#include <stdint.h>
+#include <atomic>
+#include <mutex>
+#include <vector>
+#include "FaceRequestQueue.h"
+
+namespace vendor {
+namespace sprd {
+namespace hardware {
+namespace face {
+namespace V1_0 {
+namespace implementation {
+
+// No client, or a caller that never registered a callback.
+static const uint32_t kNoClient = 0;
+
+// Shares the one vendor session between clients; used on the request
+// thread only, apart from the owner getters.
+//
+// A session start from the client that owns the device, or with no owner,
+// runs at once. An authenticate preempts another client's enroll, so a
+// foreground unlock never waits behind a background enrollment. Anything
+// else is parked, one start per client, until the device is released;
+// parked authenticates go first, then clients take turns.
+class FaceSessionArbiter {
+public:
+    enum Decision {
+        START,
+        PREEMPT,
+        PARK,
+    };
+
+    FaceSessionArbiter();
+
+    Decision admit(uint32_t client, bool authenticate);
+    void grant(uint32_t client, uint32_t session, bool authenticate, int64_t nowUs);
+    // Returns the client that owned the device, kNoClient if none did, and
+    // how long it held it.
+    uint32_t release(int64_t nowUs, int64_t* heldUs);
+    // Takes over |request|, replacing a start the client had parked.
+    void park(uint32_t client, FaceRequest& request, bool authenticate, int64_t nowUs);
+    // Moves the next parked start into |request|.
+    bool next(FaceRequest* request, int64_t* parkedUs, int64_t nowUs);
+    bool unpark(uint32_t client);
+
+    uint32_t owner() const { return mOwner.load(std::memory_order_acquire); }
+    uint32_t session() const { return mSession.load(std::memory_order_acquire); }
+
+private:
+    struct Parked {
+        uint32_t client;
+        bool authenticate;
+        int64_t parkedUs;
+        FaceRequest request;
+    };
+
+    std::atomic<uint32_t> mOwner;
+    std::atomic<uint32_t> mSession;
+    bool mAuthenticating;
+    int64_t mGrantedUs;
+    uint32_t mLastOwner;
+    std::vector<Parked> mParked;
+};
+
+// A match the vendor made in a speculative session, before anyone asked
+// for it. It is handed out at most once, to an authenticate for the same
+// user and operation (the challenge its token was signed for), and only
+// while it is fresh. Held from the vendor's callback thread, taken on the
+// request thread.
+class FaceHeldMatch {
+public:
+    FaceHeldMatch();
+
+    void hold(uint32_t faceId, int32_t userId, uint64_t challenge, const uint8_t* token, size_t size,
+            int64_t nowUs);
+    // Any held match is gone after this, handed out or not.
+    bool take(int32_t userId, uint64_t challenge, int64_t nowUs, int64_t windowUs, uint32_t* faceId,
+            std::vector<uint8_t>* token);
+    void clear();
+
+private:
+    std::mutex mMutex;
+    bool mHeld;
+    uint32_t mFaceId;
+    int32_t mUserId;
+    uint64_t mChallenge;
+    int64_t mHeldUs;
+    std::vector<uint8_t> mToken;
+};
+
+// A recent match, as handed to face_authenticate_confirm().
+struct FaceRecentMatch {
+    uint32_t faceId;
+    // The vendor's liveness score of the match.
+    int32_t liveness;
+    // Since the last frame of the match.
+    int64_t ageUs;
+};
+
+// The last successful authenticate, so that another one shortly after
+// (the lock screen, then an app's prompt) only needs the vendor to confirm
+// the face on one frame. It holds no token: the vendor still signs one for
+// the new operation once that frame matched. One entry, handed out once,
+// and only with the liveness score the vendor gave it, which is read on
+// the request thread after the match.
+class FaceMatchCache {
+public:
+    // Why the entry was dropped; anything that should make the user go
+    // through a full attempt again.
+    enum ClearReason {
+        REJECTED,
+        LOCKOUT,
+        USER_SWITCH,
+        SCREEN_OFF,
+        TEMPLATES_CHANGED,
+        REASON_COUNT,
+    };
+
+    static const int32_t kUnknownLiveness = -1;
+
+    FaceMatchCache();
+
+    void store(uint32_t faceId, int32_t userId, int64_t lastFrameUs);
+    // The stored match is still waiting for its liveness score; one the
+    // vendor could not give stays kUnknownLiveness and is never taken.
+    bool needsLiveness() const;
+    void setLiveness(int32_t liveness);
+    // Hands out the match, once, if it is |userId|'s, its last frame is no
+    // older than |windowUs| and its liveness is at least |minLiveness|.
+    bool take(int32_t userId, int64_t nowUs, int64_t windowUs, int32_t minLiveness, FaceRecentMatch* match);
+    void clear(ClearReason reason);
+
+    void dump(int fd) const;
+
+private:
+    mutable std::mutex mMutex;
+    bool mValid;
+    uint32_t mFaceId;
+    int32_t mUserId;
+    int32_t mLiveness;
+    int64_t mLastFrameUs;
+    bool mLivenessPending;
+    uint32_t mStores;
+    uint32_t mHits;
+    uint32_t mMisses;
+    uint32_t mClears[REASON_COUNT];
+};
+
+}  // namespace implementation
+}  // namespace V1_0
+}  // namespace face
+}  // namespace hardware
+}  // namespace sprd
+}  // namespace vendor
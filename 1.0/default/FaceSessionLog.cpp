@@ -0,0 +1,168 @@
+// FIXME: your file license if you have one
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/resource.h>
+#include "FaceSessionLog.h"
+#include "FaceStats.h"
+
+namespace vendor {
+namespace sprd {
+namespace hardware {
+namespace face {
+namespace V1_0 {
+namespace implementation {
+
+static int64_t timevalUs(const struct timeval& tv) {
+    return (int64_t)tv.tv_sec * 1000000 + tv.tv_usec;
+}
+
+FaceSessionLog::FaceSessionLog() : mWatched(), mClocks(), mRecords(), mCount(0), mNext(0), mActive(), mStart() {}
+
+void FaceSessionLog::watch(Thread thread, pthread_t handle) {
+    std::lock_guard<std::mutex> lock(mMutex);
+    mWatched[thread] = pthread_getcpuclockid(handle, &mClocks[thread]) == 0;
+}
+
+// Under mMutex.
+void FaceSessionLog::sample(Sample* sample) const {
+    for (size_t i = 0; i < THREAD_COUNT; i++) {
+        struct timespec ts;
+        // A thread that exited no longer has a clock.
+        if (mWatched[i] && clock_gettime(mClocks[i], &ts) == 0) {
+            sample->threadCpuUs[i] = (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+        } else {
+            sample->threadCpuUs[i] = 0;
+        }
+    }
+    struct rusage usage;
+    memset(&usage, 0, sizeof(usage));
+    getrusage(RUSAGE_SELF, &usage);
+    sample->processUserUs = timevalUs(usage.ru_utime);
+    sample->processSystemUs = timevalUs(usage.ru_stime);
+    sample->voluntarySwitches = usage.ru_nvcsw;
+    sample->involuntarySwitches = usage.ru_nivcsw;
+}
+
+void FaceSessionLog::begin(uint32_t session, uint32_t client, bool authenticate) {
+    std::lock_guard<std::mutex> lock(mMutex);
+    memset(&mActive, 0, sizeof(mActive));
+    mActive.session = session;
+    mActive.client = client;
+    mActive.authenticate = authenticate;
+    mActive.outcome = ACTIVE;
+    mActive.startUs = monotonicUs();
+    sample(&mStart);
+}
+
+// Under mMutex: the active session's costs so far.
+void FaceSessionLog::measure(Record* record) const {
+    Sample now;
+    sample(&now);
+    record->wallUs = monotonicUs() - mActive.startUs;
+    for (size_t i = 0; i < THREAD_COUNT; i++) {
+        record->threadCpuUs[i] = now.threadCpuUs[i] - mStart.threadCpuUs[i];
+    }
+    record->processUserUs = now.processUserUs - mStart.processUserUs;
+    record->processSystemUs = now.processSystemUs - mStart.processSystemUs;
+    record->voluntarySwitches = now.voluntarySwitches - mStart.voluntarySwitches;
+    record->involuntarySwitches = now.involuntarySwitches - mStart.involuntarySwitches;
+}
+
+void FaceSessionLog::end(uint32_t session, Outcome outcome) {
+    std::lock_guard<std::mutex> lock(mMutex);
+    if (mActive.outcome != ACTIVE || mActive.session != session || session == 0) {
+        return;
+    }
+    measure(&mActive);
+    mActive.outcome = outcome;
+    mRecords[mNext] = mActive;
+    mNext = (mNext + 1) % kRecords;
+    if (mCount < kRecords) {
+        mCount++;
+    }
+}
+
+void FaceSessionLog::addFrame(uint32_t session, Fate fate) {
+    if (session == 0) {
+        return;
+    }
+    std::lock_guard<std::mutex> lock(mMutex);
+    if (mActive.outcome == ACTIVE && mActive.session == session) {
+        mActive.frames[fate]++;
+        return;
+    }
+    // Frames the camera had in flight when the session closed; it is
+    // almost always the newest record.
+    for (size_t i = 1; i <= mCount; i++) {
+        Record& record = mRecords[(mNext + kRecords - i) % kRecords];
+        if (record.session == session) {
+            record.frames[fate]++;
+            return;
+        }
+    }
+}
+
+void FaceSessionLog::rebind(uint32_t from, uint32_t to) {
+    std::lock_guard<std::mutex> lock(mMutex);
+    if (mActive.outcome == ACTIVE && mActive.session == from) {
+        mActive.session = to;
+    }
+}
+
+std::vector<FaceSessionLog::Record> FaceSessionLog::records() const {
+    std::lock_guard<std::mutex> lock(mMutex);
+    std::vector<Record> records;
+    records.reserve(mCount + 1);
+    for (size_t i = 0; i < mCount; i++) {
+        records.push_back(mRecords[(mNext + kRecords - mCount + i) % kRecords]);
+    }
+    if (mActive.outcome == ACTIVE && mActive.session != 0) {
+        records.push_back(mActive);
+        measure(&records.back());
+    }
+    return records;
+}
+
+const char* FaceSessionLog::outcomeName(Outcome outcome) {
+    switch (outcome) {
+        case ACTIVE: return "active";
+        case SUCCEEDED: return "succeeded";
+        case REJECTED: return "rejected";
+        case FAILED: return "failed";
+        case CANCELED: return "canceled";
+        case TIMED_OUT: return "timed_out";
+    }
+    return "unknown";
+}
+
+void FaceSessionLog::dump(int fd) const {
+    std::vector<Record> all = records();
+    uint32_t unlocks = 0;
+    int64_t unlockCpuUs = 0;
+    for (const Record& r : all) {
+        if (r.authenticate && r.outcome == SUCCEEDED) {
+            unlocks++;
+            unlockCpuUs += r.processUserUs + r.processSystemUs;
+        }
+    }
+    dprintf(fd, "sessions: %zu recorded, unlocks=%u cpu per unlock=%" PRId64 "us\n", all.size(), unlocks,
+            unlocks > 0 ? unlockCpuUs / unlocks : 0);
+    for (const Record& r : all) {
+        dprintf(fd, "  #%u client=%u %s %s wall=%" PRId64 "us cpu request=%" PRId64 "us pipeline=%" PRId64
+                "us process user=%" PRId64 "us sys=%" PRId64 "us csw=%" PRId64 "/%" PRId64
+                " frames processed=%u dropped=%u skipped=%u\n",
+                r.session, r.client, r.authenticate ? "authenticate" : "enroll", outcomeName(r.outcome),
+                r.wallUs, r.threadCpuUs[REQUEST_THREAD], r.threadCpuUs[PIPELINE_THREAD], r.processUserUs,
+                r.processSystemUs, r.voluntarySwitches, r.involuntarySwitches, r.frames[PROCESSED],
+                r.frames[DROPPED], r.frames[SKIPPED]);
+    }
+}
+
+}  // namespace implementation
+}  // namespace V1_0
+}  // namespace face
+}  // namespace hardware
+}  // namespace sprd
+}  // namespace vendor
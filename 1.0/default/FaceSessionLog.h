@@ -0,0 +1,118 @@
+// FIXME: your file license if you have one
+
+#pragma once
+
+#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <time.h>
+#include <mutex>
+#include <vector>
+
+namespace vendor {
+namespace sprd {
+namespace hardware {
+namespace face {
+namespace V1_0 {
+namespace implementation {
+
+// What each enroll and authenticate session cost: wall time, the CPU time
+// of the request and enroll pipeline threads, the CPU time and context
+// switches of the whole process (vendor threads included), and what
+// happened to its frames. The last kRecords sessions are kept.
+//
+// Thread clocks are read through pthread_getcpuclockid(), so begin() and
+// end() may run on any thread, the vendor's callback thread included.
+class FaceSessionLog {
+public:
+    enum Outcome {
+        ACTIVE,
+        SUCCEEDED,
+        // An authenticate that did not recognize the face.
+        REJECTED,
+        FAILED,
+        CANCELED,
+        TIMED_OUT,
+    };
+
+    enum Fate {
+        PROCESSED,
+        // Never queued, the frame's class was full.
+        DROPPED,
+        // Queued but not given to the vendor library.
+        SKIPPED,
+    };
+
+    // Threads whose CPU time is accounted separately.
+    enum Thread {
+        REQUEST_THREAD,
+        PIPELINE_THREAD,
+        THREAD_COUNT,
+    };
+
+    struct Record {
+        uint32_t session;
+        uint32_t client;
+        bool authenticate;
+        Outcome outcome;
+        int64_t startUs;
+        int64_t wallUs;
+        int64_t threadCpuUs[THREAD_COUNT];
+        int64_t processUserUs;
+        int64_t processSystemUs;
+        int64_t voluntarySwitches;
+        int64_t involuntarySwitches;
+        uint32_t frames[SKIPPED + 1];
+    };
+
+    static const size_t kRecords = 32;
+
+    FaceSessionLog();
+
+    // Called once each thread runs; until then its CPU time reads as 0.
+    void watch(Thread thread, pthread_t handle);
+
+    void begin(uint32_t session, uint32_t client, bool authenticate);
+    // The first outcome reported for the active session closes it; later
+    // ones are ignored.
+    void end(uint32_t session, Outcome outcome);
+    // Frames still count for a recent session after it closed, those are
+    // the ones the camera sent too late.
+    void addFrame(uint32_t session, Fate fate);
+    // The active session carries on under another id.
+    void rebind(uint32_t from, uint32_t to);
+
+    // Closed sessions, oldest first, then the active one if any.
+    std::vector<Record> records() const;
+    void dump(int fd) const;
+
+    static const char* outcomeName(Outcome outcome);
+
+private:
+    struct Sample {
+        int64_t threadCpuUs[THREAD_COUNT];
+        int64_t processUserUs;
+        int64_t processSystemUs;
+        int64_t voluntarySwitches;
+        int64_t involuntarySwitches;
+    };
+
+    void sample(Sample* sample) const;
+    void measure(Record* record) const;
+
+    mutable std::mutex mMutex;
+    bool mWatched[THREAD_COUNT];
+    clockid_t mClocks[THREAD_COUNT];
+    Record mRecords[kRecords];
+    size_t mCount;
+    size_t mNext;
+    Record mActive;
+    Sample mStart;
+};
+
+}  // namespace implementation
+}  // namespace V1_0
+}  // namespace face
+}  // namespace hardware
+}  // namespace sprd
+}  // namespace vendor
@@ -0,0 +1,126 @@
+// FIXME: your file license if you have one
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <time.h>
+#include <unistd.h>
+#include "FaceStats.h"
+
+namespace vendor {
+namespace sprd {
+namespace hardware {
+namespace face {
+namespace V1_0 {
+namespace implementation {
+
+static int64_t clockUs(clockid_t clock) {
+    struct timespec ts;
+    clock_gettime(clock, &ts);
+    return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+int64_t bootTimeUs() {
+    return clockUs(CLOCK_BOOTTIME);
+}
+
+int64_t monotonicUs() {
+    return clockUs(CLOCK_MONOTONIC);
+}
+
+int64_t residentSetKb() {
+    FILE* file = fopen("/proc/self/statm", "re");
+    if (file == nullptr) {
+        return -1;
+    }
+    long size = 0;
+    long resident = 0;
+    int n = fscanf(file, "%ld %ld", &size, &resident);
+    fclose(file);
+    if (n != 2) {
+        return -1;
+    }
+    return (int64_t)resident * (sysconf(_SC_PAGESIZE) / 1024);
+}
+
+FaceStats::FaceStats()
+        : serviceStartUs(0), serviceRegisteredUs(0), halOpenStartUs(0),
+          halOpenDurationUs(0), halReadyUs(0), callsWaitedForHal(0),
+          callsTimedOutForHal(0), workerDeaths(0), workerCallTimeouts(0),
+          workerRestarts(0), lastWorkerRecoveryUs(0), maxWorkerRecoveryUs(0),
+          deadlineOverruns(0), sessionTimeouts(0), idleTrims(0), pressureTrims(0),
+          activeRssKb(0), idleRssKb(0), vendorActiveRssKb(0), vendorIdleRssKb(0),
+          warmUps(0), lastWarmUpUs(0), warmUnlocks(0), lastWarmUnlockUs(0),
+          coldUnlocks(0), lastColdUnlockUs(0), droppedFrames(0), staleFrames(0),
+          enrollChecks(0), enrollRejects(0), enrollCheckUs(0), enrollExtracts(0), enrollExtractUs(0),
+          enrollWaitUs(0), lastEnrollSessionUs(0), speculativeSessions(0), speculativeJoins(0),
+          speculativeHits(0), speculativeWasted(0), lockedOutAuthenticates(0), lockedOutFrames(0) {}
+
+static int64_t average(int64_t total, uint32_t count) {
+    return count > 0 ? total / count : 0;
+}
+
+void FaceStats::dump(int fd) const {
+    dprintf(fd, "startup (boot time us): service=%" PRId64 " registered=%" PRId64
+            " hal_open_start=%" PRId64 " hal_ready=%" PRId64 "\n",
+            serviceStartUs.load(std::memory_order_relaxed),
+            serviceRegisteredUs.load(std::memory_order_relaxed),
+            halOpenStartUs.load(std::memory_order_relaxed),
+            halReadyUs.load(std::memory_order_relaxed));
+    dprintf(fd, "  hal_open=%" PRId64 "us waited=%u timed_out=%u\n",
+            halOpenDurationUs.load(std::memory_order_relaxed),
+            callsWaitedForHal.load(std::memory_order_relaxed),
+            callsTimedOutForHal.load(std::memory_order_relaxed));
+    dprintf(fd, "worker: deaths=%u call_timeouts=%u restarts=%u recovery last=%" PRId64
+            "us max=%" PRId64 "us\n",
+            workerDeaths.load(std::memory_order_relaxed),
+            workerCallTimeouts.load(std::memory_order_relaxed),
+            workerRestarts.load(std::memory_order_relaxed),
+            lastWorkerRecoveryUs.load(std::memory_order_relaxed),
+            maxWorkerRecoveryUs.load(std::memory_order_relaxed));
+    dprintf(fd, "deadlines: call_overruns=%u session_timeouts=%u\n",
+            deadlineOverruns.load(std::memory_order_relaxed),
+            sessionTimeouts.load(std::memory_order_relaxed));
+    dprintf(fd, "idle: trims idle=%u pressure=%u rss active=%" PRId64 "kB idle=%" PRId64
+            "kB vendor active=%" PRId64 "kB idle=%" PRId64 "kB\n",
+            idleTrims.load(std::memory_order_relaxed),
+            pressureTrims.load(std::memory_order_relaxed),
+            activeRssKb.load(std::memory_order_relaxed),
+            idleRssKb.load(std::memory_order_relaxed),
+            vendorActiveRssKb.load(std::memory_order_relaxed),
+            vendorIdleRssKb.load(std::memory_order_relaxed));
+    dprintf(fd, "  warm_ups=%u last=%" PRId64 "us unlock warm=%u last=%" PRId64
+            "us cold=%u last=%" PRId64 "us\n",
+            warmUps.load(std::memory_order_relaxed),
+            lastWarmUpUs.load(std::memory_order_relaxed),
+            warmUnlocks.load(std::memory_order_relaxed),
+            lastWarmUnlockUs.load(std::memory_order_relaxed),
+            coldUnlocks.load(std::memory_order_relaxed),
+            lastColdUnlockUs.load(std::memory_order_relaxed));
+    dprintf(fd, "frames: dropped=%u stale=%u\n",
+            droppedFrames.load(std::memory_order_relaxed),
+            staleFrames.load(std::memory_order_relaxed));
+    uint32_t checks = enrollChecks.load(std::memory_order_relaxed);
+    uint32_t extracts = enrollExtracts.load(std::memory_order_relaxed);
+    dprintf(fd, "enroll: checks=%u rejected=%u avg=%" PRId64 "us extracts=%u avg=%" PRId64
+            "us wait avg=%" PRId64 "us last_session=%" PRId64 "us\n",
+            checks, enrollRejects.load(std::memory_order_relaxed),
+            average(enrollCheckUs.load(std::memory_order_relaxed), checks), extracts,
+            average(enrollExtractUs.load(std::memory_order_relaxed), extracts),
+            average(enrollWaitUs.load(std::memory_order_relaxed), extracts),
+            lastEnrollSessionUs.load(std::memory_order_relaxed));
+    dprintf(fd, "speculative: sessions=%u joined=%u hits=%u wasted=%u\n",
+            speculativeSessions.load(std::memory_order_relaxed),
+            speculativeJoins.load(std::memory_order_relaxed),
+            speculativeHits.load(std::memory_order_relaxed),
+            speculativeWasted.load(std::memory_order_relaxed));
+    dprintf(fd, "locked out: authenticates=%u frames=%u\n",
+            lockedOutAuthenticates.load(std::memory_order_relaxed),
+            lockedOutFrames.load(std::memory_order_relaxed));
+}
+
+}  // namespace implementation
+}  // namespace V1_0
+}  // namespace face
+}  // namespace hardware
+}  // namespace sprd
+}  // namespace vendor
@@ -0,0 +1,101 @@
+// FIXME: your file license if you have one
+
+#pragma once
+
+#include <stdint.h>
+#include <atomic>
+
+namespace vendor {
+namespace sprd {
+namespace hardware {
+namespace face {
+namespace V1_0 {
+namespace implementation {
+
+// Microseconds on CLOCK_BOOTTIME, comparable with the kernel boot timeline.
+int64_t bootTimeUs();
+// Microseconds on CLOCK_MONOTONIC, for durations.
+int64_t monotonicUs();
+// Resident set size of the calling process in kB, -1 if unknown.
+int64_t residentSetKb();
+
+// Counters reported through lshal debug. Everything is updated with relaxed
+// atomics so that the binder and looper threads never contend on them.
+struct FaceStats {
+    FaceStats();
+
+    void dump(int fd) const;
+
+    // Startup
+    std::atomic<int64_t> serviceStartUs;
+    std::atomic<int64_t> serviceRegisteredUs;
+    std::atomic<int64_t> halOpenStartUs;
+    std::atomic<int64_t> halOpenDurationUs;
+    std::atomic<int64_t> halReadyUs;
+    std::atomic<uint32_t> callsWaitedForHal;
+    std::atomic<uint32_t> callsTimedOutForHal;
+
+    // Vendor worker process
+    std::atomic<uint32_t> workerDeaths;
+    std::atomic<uint32_t> workerCallTimeouts;
+    std::atomic<uint32_t> workerRestarts;
+    std::atomic<int64_t> lastWorkerRecoveryUs;
+    std::atomic<int64_t> maxWorkerRecoveryUs;
+
+    // Deadlines
+    std::atomic<uint32_t> deadlineOverruns;
+    std::atomic<uint32_t> sessionTimeouts;
+
+    // Idle trimming. RSS is sampled right before and after a trim; the
+    // vendor figures are the worker's own when it runs isolated.
+    std::atomic<uint32_t> idleTrims;
+    std::atomic<uint32_t> pressureTrims;
+    std::atomic<int64_t> activeRssKb;
+    std::atomic<int64_t> idleRssKb;
+    std::atomic<int64_t> vendorActiveRssKb;
+    std::atomic<int64_t> vendorIdleRssKb;
+    std::atomic<uint32_t> warmUps;
+    std::atomic<int64_t> lastWarmUpUs;
+    // authenticate() to a successful onAuthenticated, split by whether the
+    // service had been trimmed when the request came in.
+    std::atomic<uint32_t> warmUnlocks;
+    std::atomic<int64_t> lastWarmUnlockUs;
+    std::atomic<uint32_t> coldUnlocks;
+    std::atomic<int64_t> lastColdUnlockUs;
+
+    // Frames answered without reaching the vendor library: their class was
+    // full, or a new session had started by the time they were handled.
+    std::atomic<uint32_t> droppedFrames;
+    std::atomic<uint32_t> staleFrames;
+
+    // Enroll phases. Checks only happen in pipelined mode; otherwise the
+    // whole do_enroll_process call counts as the extraction.
+    std::atomic<uint32_t> enrollChecks;
+    std::atomic<uint32_t> enrollRejects;
+    std::atomic<int64_t> enrollCheckUs;
+    std::atomic<uint32_t> enrollExtracts;
+    std::atomic<int64_t> enrollExtractUs;
+    std::atomic<int64_t> enrollWaitUs;
+    // ENROLL_REQUEST handled to the template enrolled
+    std::atomic<int64_t> lastEnrollSessionUs;
+
+    // Speculative authenticates started on userActivity(): joined by an
+    // authenticate while running, matches handed out after they ended,
+    // and ones that ran out or were thrown away.
+    std::atomic<uint32_t> speculativeSessions;
+    std::atomic<uint32_t> speculativeJoins;
+    std::atomic<uint32_t> speculativeHits;
+    std::atomic<uint32_t> speculativeWasted;
+
+    // Authenticates and frames turned away while the user was locked out,
+    // without reaching the vendor library.
+    std::atomic<uint32_t> lockedOutAuthenticates;
+    std::atomic<uint32_t> lockedOutFrames;
+};
+
+}  // namespace implementation
+}  // namespace V1_0
+}  // namespace face
+}  // namespace hardware
+}  // namespace sprd
+}  // namespace vendor
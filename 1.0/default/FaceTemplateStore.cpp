@@ -0,0 +1,403 @@
+// FIXME: your file license if you have one
+
+#define LOG_TAG "vendor.sprd.hardware.face@1.0-service"
+
+#include <log/log.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+#include <zlib.h>
+#include "FaceTemplateStore.h"
+
+namespace vendor {
+namespace sprd {
+namespace hardware {
+namespace face {
+namespace V1_0 {
+namespace implementation {
+
+static const uint32_t kStoreMagic = 0x54414653; // "SFAT"
+static const uint32_t kStoreVersion = 1;
+static const char kStoreFileName[] = "/face_templates.bin";
+static const char kStoreTmpSuffix[] = ".tmp";
+// Changes the vendor can report between two flushes without the queue
+// growing.
+static const size_t kQueueReserve = 16;
+
+static int64_t nowUs(clockid_t clock) {
+    struct timespec ts;
+    clock_gettime(clock, &ts);
+    return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+// A rename is only durable once the directory holding it is synced.
+static bool syncDir(const std::string& dir) {
+    int fd = TEMP_FAILURE_RETRY(::open(dir.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC));
+    if (fd < 0) {
+        return false;
+    }
+    bool ok = fsync(fd) == 0;
+    close(fd);
+    return ok;
+}
+
+static uint32_t checksum(const void* data, size_t size) {
+    return (uint32_t)crc32(0L, reinterpret_cast<const Bytef*>(data), size);
+}
+
+FaceTemplateSnapshot::FaceTemplateSnapshot(void* base, size_t size)
+        : mBase(base), mSize(size),
+          mHeader(reinterpret_cast<const FaceTemplateFileHeader*>(base)),
+          mRecords(reinterpret_cast<const FaceTemplateRecord*>(
+                  reinterpret_cast<const uint8_t*>(base) + sizeof(FaceTemplateFileHeader))) {}
+
+FaceTemplateSnapshot::~FaceTemplateSnapshot() {
+    munmap(mBase, mSize);
+}
+
+std::shared_ptr<const FaceTemplateSnapshot> FaceTemplateSnapshot::map(const std::string& path, int32_t userId) {
+    int fd = TEMP_FAILURE_RETRY(::open(path.c_str(), O_RDONLY | O_CLOEXEC));
+    if (fd < 0) {
+        if (errno != ENOENT) {
+            ALOGE("Can't open template store %s: %s", path.c_str(), strerror(errno));
+        }
+        return nullptr;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(FaceTemplateFileHeader)) {
+        ALOGE("Template store %s is truncated", path.c_str());
+        close(fd);
+        return nullptr;
+    }
+    size_t size = (size_t)st.st_size;
+    void* base = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (base == MAP_FAILED) {
+        ALOGE("Can't map template store %s: %s", path.c_str(), strerror(errno));
+        return nullptr;
+    }
+    std::shared_ptr<const FaceTemplateSnapshot> snapshot(new FaceTemplateSnapshot(base, size));
+
+    // Only the header is validated here, records are checked as they are
+    // paged in so that loading stays independent of the template count.
+    const FaceTemplateFileHeader* header = snapshot->mHeader;
+    if (header->magic != kStoreMagic || header->version != kStoreVersion ||
+            header->headerSize != sizeof(FaceTemplateFileHeader) ||
+            header->recordSize != sizeof(FaceTemplateRecord) ||
+            header->headerCrc != checksum(header, offsetof(FaceTemplateFileHeader, headerCrc))) {
+        ALOGE("Template store %s has a bad header", path.c_str());
+        return nullptr;
+    }
+    if (header->userId != userId ||
+            header->count > (size - sizeof(FaceTemplateFileHeader)) / sizeof(FaceTemplateRecord)) {
+        ALOGE("Template store %s does not match user %d", path.c_str(), userId);
+        return nullptr;
+    }
+    return snapshot;
+}
+
+size_t FaceTemplateSnapshot::residentBytes() const {
+    long pageSize = sysconf(_SC_PAGESIZE);
+    size_t pages = (mSize + pageSize - 1) / pageSize;
+    std::vector<unsigned char> vec(pages);
+    if (mincore(mBase, mSize, vec.data()) != 0) {
+        return 0;
+    }
+    size_t resident = 0;
+    for (size_t i = 0; i < pages; i++) {
+        if (vec[i] & 1) {
+            resident += pageSize;
+        }
+    }
+    return resident;
+}
+
+void FaceTemplateSnapshot::release() const {
+    madvise(mBase, mSize, MADV_DONTNEED);
+}
+
+const FaceTemplateRecord* FaceTemplateSnapshot::recordAt(uint32_t index) const {
+    if (index >= mHeader->count) {
+        return nullptr;
+    }
+    const FaceTemplateRecord* record = &mRecords[index];
+    if (record->crc != checksum(record, offsetof(FaceTemplateRecord, crc))) {
+        ALOGE("Template record %u is corrupted", index);
+        return nullptr;
+    }
+    return record;
+}
+
+bool FaceTemplateSnapshot::contains(uint32_t faceId) const {
+    for (uint32_t i = 0; i < mHeader->count; i++) {
+        const FaceTemplateRecord* record = recordAt(i);
+        if (record != nullptr && record->faceId == faceId) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void FaceTemplateSnapshot::faceIds(std::vector<uint32_t>* out) const {
+    out->clear();
+    out->reserve(mHeader->count);
+    for (uint32_t i = 0; i < mHeader->count; i++) {
+        const FaceTemplateRecord* record = recordAt(i);
+        if (record != nullptr) {
+            out->push_back(record->faceId);
+        }
+    }
+}
+
+FaceTemplateStore::FaceTemplateStore() : mQueued(false), mUserId(-1), mLastLoadUs(0) {
+    mQueue.reserve(kQueueReserve);
+    mFlushing.reserve(kQueueReserve);
+}
+
+bool FaceTemplateStore::open(int32_t userId, const std::string& storePath) {
+    std::lock_guard<std::mutex> lock(mWriteMutex);
+    flushLocked();
+    int64_t start = nowUs(CLOCK_MONOTONIC);
+    std::string path = storePath + kStoreFileName;
+    std::shared_ptr<const FaceTemplateSnapshot> snapshot = FaceTemplateSnapshot::map(path, userId);
+    mLastLoadUs = nowUs(CLOCK_MONOTONIC) - start;
+    mDir = storePath;
+    mPath = path;
+    mTmpPath = path + kStoreTmpSuffix;
+    mUserId = userId;
+    std::atomic_store(&mSnapshot, snapshot);
+    if (snapshot != nullptr) {
+        ALOGD("Template store of user %d: %u templates, %zu bytes mapped in %" PRId64 "us",
+                userId, snapshot->count(), snapshot->mappedBytes(), mLastLoadUs);
+    }
+    return snapshot != nullptr;
+}
+
+std::shared_ptr<const FaceTemplateSnapshot> FaceTemplateStore::snapshot() const {
+    return std::atomic_load(&mSnapshot);
+}
+
+int32_t FaceTemplateStore::userId() const {
+    std::lock_guard<std::mutex> lock(mWriteMutex);
+    return mUserId;
+}
+
+bool FaceTemplateStore::add(uint32_t faceId, uint32_t disabledFeatures) {
+    std::lock_guard<std::mutex> lock(mWriteMutex);
+    return addLocked(faceId, disabledFeatures);
+}
+
+bool FaceTemplateStore::remove(uint32_t faceId) {
+    std::lock_guard<std::mutex> lock(mWriteMutex);
+    return removeLocked(faceId);
+}
+
+void FaceTemplateStore::queueAdd(uint32_t faceId, uint32_t disabledFeatures) {
+    queue({ ADD, faceId, disabledFeatures });
+}
+
+void FaceTemplateStore::queueRemove(uint32_t faceId) {
+    queue({ REMOVE, faceId, 0 });
+}
+
+void FaceTemplateStore::queueEnumerated(uint32_t faceId) {
+    queue({ ENUMERATED, faceId, 0 });
+}
+
+void FaceTemplateStore::queue(const Change& change) {
+    std::lock_guard<std::mutex> lock(mQueueMutex);
+    mQueue.push_back(change);
+    mQueued.store(true, std::memory_order_release);
+}
+
+bool FaceTemplateStore::flush() {
+    if (!hasQueued()) {
+        return true;
+    }
+    std::lock_guard<std::mutex> lock(mWriteMutex);
+    return flushLocked();
+}
+
+bool FaceTemplateStore::flushLocked() {
+    {
+        std::lock_guard<std::mutex> lock(mQueueMutex);
+        mFlushing.swap(mQueue);
+        mQueued.store(false, std::memory_order_release);
+    }
+    bool ok = true;
+    for (const Change& change : mFlushing) {
+        ok = applyLocked(change) && ok;
+    }
+    mFlushing.clear();
+    return ok;
+}
+
+bool FaceTemplateStore::applyLocked(const Change& change) {
+    switch (change.type) {
+    case ADD:
+        return addLocked(change.faceId, change.disabledFeatures);
+    case REMOVE:
+        return removeLocked(change.faceId);
+    default:
+        return retainLocked(change.faceId);
+    }
+}
+
+bool FaceTemplateStore::addLocked(uint32_t faceId, uint32_t disabledFeatures) {
+    if (mPath.empty() || faceId == 0) {
+        return false;
+    }
+    std::shared_ptr<const FaceTemplateSnapshot> current = std::atomic_load(&mSnapshot);
+    std::vector<FaceTemplateRecord> records;
+    uint64_t generation = 0;
+    if (current != nullptr) {
+        if (current->contains(faceId)) {
+            return true;
+        }
+        records.reserve(current->count() + 1);
+        for (uint32_t i = 0; i < current->count(); i++) {
+            const FaceTemplateRecord* record = current->recordAt(i);
+            if (record != nullptr) {
+                records.push_back(*record);
+            }
+        }
+        generation = current->generation();
+    }
+    FaceTemplateRecord record;
+    memset(&record, 0, sizeof(record));
+    record.faceId = faceId;
+    record.enrolledAtMs = nowUs(CLOCK_REALTIME) / 1000;
+    record.disabledFeatures = disabledFeatures;
+    records.push_back(record);
+    return commitLocked(records, generation + 1);
+}
+
+bool FaceTemplateStore::removeLocked(uint32_t faceId) {
+    if (mPath.empty()) {
+        return false;
+    }
+    std::shared_ptr<const FaceTemplateSnapshot> current = std::atomic_load(&mSnapshot);
+    // A removal the vendor reports for a template the store never had
+    // changes nothing, don't copy the records for it.
+    if (current != nullptr && faceId != 0 && !current->contains(faceId)) {
+        return true;
+    }
+    std::vector<FaceTemplateRecord> records;
+    uint64_t generation = 0;
+    if (current != nullptr) {
+        generation = current->generation();
+        for (uint32_t i = 0; faceId != 0 && i < current->count(); i++) {
+            const FaceTemplateRecord* record = current->recordAt(i);
+            if (record != nullptr && record->faceId != faceId) {
+                records.push_back(*record);
+            }
+        }
+    }
+    return commitLocked(records, generation + 1);
+}
+
+// Templates the vendor no longer has, after a wipe on its side or a
+// remove whose report was lost, go; the one it has is added if missing.
+bool FaceTemplateStore::retainLocked(uint32_t faceId) {
+    if (mPath.empty()) {
+        return false;
+    }
+    std::shared_ptr<const FaceTemplateSnapshot> current = std::atomic_load(&mSnapshot);
+    if (current != nullptr) {
+        std::vector<FaceTemplateRecord> records;
+        for (uint32_t i = 0; i < current->count(); i++) {
+            const FaceTemplateRecord* record = current->recordAt(i);
+            if (record != nullptr && record->faceId == faceId) {
+                records.push_back(*record);
+            }
+        }
+        if (records.size() != current->count()) {
+            ALOGD("Dropping %zu templates the vendor no longer has", current->count() - records.size());
+            if (!commitLocked(records, current->generation() + 1)) {
+                return false;
+            }
+        }
+    }
+    return faceId == 0 || addLocked(faceId, 0);
+}
+
+bool FaceTemplateStore::commitLocked(const std::vector<FaceTemplateRecord>& records, uint64_t generation) {
+    std::vector<uint8_t> file(sizeof(FaceTemplateFileHeader) + records.size() * sizeof(FaceTemplateRecord));
+    FaceTemplateFileHeader* header = reinterpret_cast<FaceTemplateFileHeader*>(file.data());
+    header->magic = kStoreMagic;
+    header->version = kStoreVersion;
+    header->headerSize = sizeof(FaceTemplateFileHeader);
+    header->recordSize = sizeof(FaceTemplateRecord);
+    header->userId = mUserId;
+    header->count = records.size();
+    header->generation = generation;
+    header->reserved = 0;
+    header->headerCrc = checksum(header, offsetof(FaceTemplateFileHeader, headerCrc));
+    FaceTemplateRecord* out = reinterpret_cast<FaceTemplateRecord*>(file.data() + sizeof(FaceTemplateFileHeader));
+    for (size_t i = 0; i < records.size(); i++) {
+        out[i] = records[i];
+        out[i].crc = checksum(&out[i], offsetof(FaceTemplateRecord, crc));
+    }
+
+    const std::string& tmpPath = mTmpPath;
+    int fd = TEMP_FAILURE_RETRY(::open(tmpPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600));
+    if (fd < 0) {
+        ALOGE("Can't create %s: %s", tmpPath.c_str(), strerror(errno));
+        return false;
+    }
+    size_t written = 0;
+    while (written < file.size()) {
+        ssize_t n = TEMP_FAILURE_RETRY(write(fd, file.data() + written, file.size() - written));
+        if (n <= 0) {
+            ALOGE("Can't write %s: %s", tmpPath.c_str(), strerror(errno));
+            close(fd);
+            unlink(tmpPath.c_str());
+            return false;
+        }
+        written += n;
+    }
+    if (fsync(fd) != 0) {
+        ALOGE("Can't sync %s: %s", tmpPath.c_str(), strerror(errno));
+        close(fd);
+        unlink(tmpPath.c_str());
+        return false;
+    }
+    close(fd);
+    if (rename(tmpPath.c_str(), mPath.c_str()) != 0) {
+        ALOGE("Can't replace %s: %s", mPath.c_str(), strerror(errno));
+        unlink(tmpPath.c_str());
+        return false;
+    }
+    if (!syncDir(mDir)) {
+        // The new file is in place, a power loss may still bring the old one back.
+        ALOGE("Can't sync %s: %s", mDir.c_str(), strerror(errno));
+    }
+
+    // Readers holding the previous snapshot keep the old inode mapped.
+    std::shared_ptr<const FaceTemplateSnapshot> snapshot = FaceTemplateSnapshot::map(mPath, mUserId);
+    std::atomic_store(&mSnapshot, snapshot);
+    return snapshot != nullptr;
+}
+
+void FaceTemplateStore::dump(int fd) const {
+    std::lock_guard<std::mutex> lock(mWriteMutex);
+    std::shared_ptr<const FaceTemplateSnapshot> current = std::atomic_load(&mSnapshot);
+    dprintf(fd, "template store: user=%d path=%s load=%" PRId64 "us\n", mUserId, mPath.c_str(), mLastLoadUs);
+    if (current != nullptr) {
+        dprintf(fd, "  templates=%u generation=%" PRIu64 " mapped=%zu resident=%zu\n",
+                current->count(), current->generation(), current->mappedBytes(), current->residentBytes());
+    }
+}
+
+}  // namespace implementation
+}  // namespace V1_0
+}  // namespace face
+}  // namespace hardware
+}  // namespace sprd
+}  // namespace vendor
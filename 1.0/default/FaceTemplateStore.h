@@ -0,0 +1,149 @@
+// FIXME: your file license if you have one
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace vendor {
+namespace sprd {
+namespace hardware {
+namespace face {
+namespace V1_0 {
+namespace implementation {
+
+// On-disk layout of the per-user template store. The file is written once
+// and only ever replaced as a whole (write to a temporary file, fsync,
+// rename, fsync the directory), so a mapping of it never changes under a
+// reader.
+struct FaceTemplateFileHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t headerSize;
+    uint32_t recordSize;
+    int32_t userId;
+    uint32_t count;
+    uint64_t generation;
+    uint32_t reserved;
+    uint32_t headerCrc; // crc32 of the header up to this field
+};
+
+struct FaceTemplateRecord {
+    uint32_t faceId;
+    uint32_t flags;
+    int64_t enrolledAtMs;
+    uint32_t disabledFeatures;
+    uint32_t crc; // crc32 of the record up to this field
+};
+
+// Immutable view of one version of the store file. Pages are only brought
+// in when a record is touched.
+class FaceTemplateSnapshot {
+public:
+    ~FaceTemplateSnapshot();
+
+    static std::shared_ptr<const FaceTemplateSnapshot> map(const std::string& path, int32_t userId);
+
+    uint32_t count() const { return mHeader->count; }
+    uint64_t generation() const { return mHeader->generation; }
+    size_t mappedBytes() const { return mSize; }
+    size_t residentBytes() const;
+    // Drops the resident pages, they are read back from the file on demand.
+    void release() const;
+
+    // Returns nullptr if the record fails its checksum.
+    const FaceTemplateRecord* recordAt(uint32_t index) const;
+    bool contains(uint32_t faceId) const;
+    void faceIds(std::vector<uint32_t>* out) const;
+
+private:
+    FaceTemplateSnapshot(void* base, size_t size);
+
+    void* mBase;
+    size_t mSize;
+    const FaceTemplateFileHeader* mHeader;
+    const FaceTemplateRecord* mRecords;
+};
+
+// Service owned store of the templates enrolled for the active user.
+// Readers take a snapshot without locking; writers serialize among
+// themselves and publish a new snapshot once the new file is renamed in.
+//
+// The vendor's callback only queues its changes, which neither blocks on
+// a write in progress nor allocates while few are queued; the request
+// thread writes them out with flush().
+class FaceTemplateStore {
+public:
+    FaceTemplateStore();
+
+    // Maps the store of |userId| under |storePath|, once the changes queued
+    // for the previous user are written. A missing file is not an error,
+    // the store is created on the first update.
+    bool open(int32_t userId, const std::string& storePath);
+
+    std::shared_ptr<const FaceTemplateSnapshot> snapshot() const;
+    bool add(uint32_t faceId, uint32_t disabledFeatures);
+    // faceId 0 removes every template of the user.
+    bool remove(uint32_t faceId);
+
+    void queueAdd(uint32_t faceId, uint32_t disabledFeatures);
+    void queueRemove(uint32_t faceId);
+    // The vendor enumerated |faceId| as the only template of the user, 0
+    // for none: the store drops every other one.
+    void queueEnumerated(uint32_t faceId);
+    bool hasQueued() const { return mQueued.load(std::memory_order_acquire); }
+    // Applies the queued changes in order. Returns false if one failed.
+    bool flush();
+
+    int32_t userId() const;
+    int64_t lastLoadUs() const { return mLastLoadUs; }
+    void dump(int fd) const;
+
+private:
+    enum ChangeType {
+        ADD,
+        REMOVE,
+        ENUMERATED,
+    };
+
+    struct Change {
+        ChangeType type;
+        uint32_t faceId;
+        uint32_t disabledFeatures;
+    };
+
+    void queue(const Change& change);
+    bool flushLocked();
+    bool applyLocked(const Change& change);
+    bool addLocked(uint32_t faceId, uint32_t disabledFeatures);
+    bool removeLocked(uint32_t faceId);
+    bool retainLocked(uint32_t faceId);
+    bool commitLocked(const std::vector<FaceTemplateRecord>& records, uint64_t generation);
+
+    // Only held to swap the queue, never across a write.
+    std::mutex mQueueMutex;
+    std::vector<Change> mQueue;
+    std::atomic<bool> mQueued;
+    // The changes being written, under mWriteMutex.
+    std::vector<Change> mFlushing;
+
+    mutable std::mutex mWriteMutex;
+    std::string mDir;
+    std::string mPath;
+    std::string mTmpPath;
+    int32_t mUserId;
+    int64_t mLastLoadUs;
+    std::shared_ptr<const FaceTemplateSnapshot> mSnapshot;
+};
+
+}  // namespace implementation
+}  // namespace V1_0
+}  // namespace face
+}  // namespace hardware
+}  // namespace sprd
+}  // namespace vendor
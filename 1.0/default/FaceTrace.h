@@ -0,0 +1,48 @@
+// FIXME: your file license if you have one
+
+#pragma once
+
+#ifndef ATRACE_TAG
+#define ATRACE_TAG ATRACE_TAG_HAL
+#endif
+
+#include <stdint.h>
+#include <stdio.h>
+#include <utils/Trace.h>
+
+namespace vendor {
+namespace sprd {
+namespace hardware {
+namespace face {
+namespace V1_0 {
+namespace implementation {
+
+// Trace slice named after the session and frame it works for, so that the
+// face pipeline lines up with camera and system_server in one timeline.
+// The name is only formatted while tracing is enabled.
+class FaceTraceScope {
+public:
+    FaceTraceScope(const char* name, uint32_t session, uint32_t frame)
+            : mActive(ATRACE_ENABLED()) {
+        if (mActive) {
+            char buf[96];
+            snprintf(buf, sizeof(buf), "%s session=%u frame=%u", name, session, frame);
+            atrace_begin(ATRACE_TAG, buf);
+        }
+    }
+    ~FaceTraceScope() {
+        if (mActive) {
+            atrace_end(ATRACE_TAG);
+        }
+    }
+
+private:
+    bool mActive;
+};
+
+}  // namespace implementation
+}  // namespace V1_0
+}  // namespace face
+}  // namespace hardware
+}  // namespace sprd
+}  // namespace vendor
@@ -0,0 +1,54 @@
+// FIXME: your file license if you have one
+
+#define LOG_TAG "vendor.sprd.hardware.face@1.0-service"
+
+#include <log/log.h>
+#include <dlfcn.h>
+#include <string.h>
+#include "FaceVendorHooks.h"
+
+namespace vendor {
+namespace sprd {
+namespace hardware {
+namespace face {
+namespace V1_0 {
+namespace implementation {
+
+void loadFaceVendorHooks(const face_device_t* device, FaceVendorHooks* hooks) {
+    memset(hooks, 0, sizeof(*hooks));
+    if (device == nullptr || device->common.module == nullptr || device->common.module->dso == nullptr) {
+        return;
+    }
+    void* dso = device->common.module->dso;
+    hooks->trimMemory = reinterpret_cast<int (*)(face_device_t*, int)>(dlsym(dso, "face_trim_memory"));
+    hooks->warmUp = reinterpret_cast<int (*)(face_device_t*)>(dlsym(dso, "face_warm_up"));
+    hooks->copyFrame = reinterpret_cast<ssize_t (*)(face_device_t*, int64_t, void*, size_t)>(
+            dlsym(dso, "face_copy_frame"));
+    hooks->enrollCheck = reinterpret_cast<int (*)(face_device_t*, int64_t, const int32_t*, size_t,
+            const int8_t*, size_t, FaceEnrollQuality*)>(dlsym(dso, "face_enroll_check"));
+    hooks->enrollExtract = reinterpret_cast<int (*)(face_device_t*, int64_t, const int32_t*, size_t,
+            const int8_t*, size_t, const FaceEnrollQuality*)>(dlsym(dso, "face_enroll_extract"));
+    hooks->matchLiveness = reinterpret_cast<int (*)(face_device_t*, int32_t*)>(dlsym(dso, "face_match_liveness"));
+    hooks->authenticateConfirm = reinterpret_cast<int (*)(face_device_t*, uint64_t, const FaceRecentMatch*)>(
+            dlsym(dso, "face_authenticate_confirm"));
+    // The halves are only useful together.
+    if (hooks->enrollCheck == nullptr || hooks->enrollExtract == nullptr) {
+        hooks->enrollCheck = nullptr;
+        hooks->enrollExtract = nullptr;
+    }
+    // A match is only confirmed with the liveness it was made with.
+    if (hooks->matchLiveness == nullptr || hooks->authenticateConfirm == nullptr) {
+        hooks->matchLiveness = nullptr;
+        hooks->authenticateConfirm = nullptr;
+    }
+    ALOGD("vendor hooks: trim_memory=%d warm_up=%d copy_frame=%d enroll_pipeline=%d match_confirm=%d",
+            hooks->trimMemory != nullptr, hooks->warmUp != nullptr, hooks->copyFrame != nullptr,
+            hooks->enrollCheck != nullptr, hooks->authenticateConfirm != nullptr);
+}
+
+}  // namespace implementation
+}  // namespace V1_0
+}  // namespace face
+}  // namespace hardware
+}  // namespace sprd
+}  // namespace vendor
@@ -0,0 +1,67 @@
+// FIXME: your file license if you have one
+
+#pragma once
+
+#include <hardware/hardware.h>
+#include <hardware/face.h>
+#include <sys/types.h>
+#include "FaceEnrollPipeline.h"
+#include "FaceSession.h"
+
+namespace vendor {
+namespace sprd {
+namespace hardware {
+namespace face {
+namespace V1_0 {
+namespace implementation {
+
+// Levels passed to face_trim_memory()
+#define FACE_TRIM_IDLE 1
+#define FACE_TRIM_MEMORY_PRESSURE 2
+
+// Optional entry points a vendor library may export next to
+// HAL_MODULE_INFO_SYM. face.h is shared with libraries that predate them,
+// so they are looked up by name and any of them may be missing.
+struct FaceVendorHooks {
+    // int face_trim_memory(face_device_t* dev, int level)
+    // Releases model and cache memory; nothing is running on the device.
+    int (*trimMemory)(face_device_t* dev, int level);
+    // int face_warm_up(face_device_t* dev)
+    // Reloads what face_trim_memory() released ahead of the next session.
+    int (*warmUp)(face_device_t* dev);
+    // ssize_t face_copy_frame(face_device_t* dev, int64_t addr, void* out, size_t capacity)
+    // Copies the frame behind a buffer address passed to do_*_process for
+    // recording. Returns the frame size, copying only if it fits |capacity|.
+    ssize_t (*copyFrame)(face_device_t* dev, int64_t addr, void* out, size_t capacity);
+    // int face_enroll_check(face_device_t* dev, int64_t addr, const int32_t* info, size_t info_size,
+    //         const int8_t* byte_info, size_t byte_info_size, FaceEnrollQuality* quality)
+    // First half of do_enroll_process: quality and pose of the frame.
+    // Returns 0 if it is usable, or the face_acquired_info_t why not.
+    int (*enrollCheck)(face_device_t* dev, int64_t addr, const int32_t* info, size_t infoSize,
+            const int8_t* byteInfo, size_t byteInfoSize, FaceEnrollQuality* quality);
+    // int face_enroll_extract(face_device_t* dev, int64_t addr, const int32_t* info, size_t info_size,
+    //         const int8_t* byte_info, size_t byte_info_size, const FaceEnrollQuality* quality)
+    // Second half: extracts the features of a checked frame and reports
+    // like do_enroll_process. May run while face_enroll_check() looks at
+    // the next frame on another thread, never alongside other calls.
+    int (*enrollExtract)(face_device_t* dev, int64_t addr, const int32_t* info, size_t infoSize,
+            const int8_t* byteInfo, size_t byteInfoSize, const FaceEnrollQuality* quality);
+    // int face_match_liveness(face_device_t* dev, int32_t* liveness)
+    // Liveness score of the last FACE_AUTHENTICATED match, called after it
+    // was reported. Returns nonzero if there is none.
+    int (*matchLiveness)(face_device_t* dev, int32_t* liveness);
+    // int face_authenticate_confirm(face_device_t* dev, uint64_t operation_id, const FaceRecentMatch* recent)
+    // Like authenticate(), but the session only has to confirm |recent| on
+    // one live frame before it reports, token signed for |operation_id| as
+    // usual. Returns nonzero to have authenticate() run instead.
+    int (*authenticateConfirm)(face_device_t* dev, uint64_t operationId, const FaceRecentMatch* recent);
+};
+
+void loadFaceVendorHooks(const face_device_t* device, FaceVendorHooks* hooks);
+
+}  // namespace implementation
+}  // namespace V1_0
+}  // namespace face
+}  // namespace hardware
+}  // namespace sprd
+}  // namespace vendor
@@ -0,0 +1,123 @@
+// FIXME: your file license if you have one
+
+#include <unistd.h>
+#include "FaceStats.h"
+#include "FaceWatchdog.h"
+
+namespace vendor {
+namespace sprd {
+namespace hardware {
+namespace face {
+namespace V1_0 {
+namespace implementation {
+
+FaceWatchdog::FaceWatchdog(OverrunCallback callback)
+        : mCallback(callback), mNextId(1), mSessionId(0), mExiting(false) {
+    mThread = std::thread(&FaceWatchdog::loop, this);
+}
+
+FaceWatchdog::~FaceWatchdog() {
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        mExiting = true;
+    }
+    mCondition.notify_all();
+    mThread.join();
+}
+
+FaceWatchdog::Scope::Scope(FaceWatchdog& watchdog, const char* name, int32_t deadlineMs)
+        : mWatchdog(watchdog), mId(0) {
+    if (deadlineMs > 0) {
+        mId = mWatchdog.arm(name, gettid(), deadlineMs);
+    }
+}
+
+FaceWatchdog::Scope::~Scope() {
+    if (mId != 0) {
+        mWatchdog.disarm(mId);
+    }
+}
+
+void FaceWatchdog::armSession(const char* name, int32_t deadlineMs) {
+    disarmSession();
+    if (deadlineMs <= 0) {
+        return;
+    }
+    uint64_t id = arm(name, 0, deadlineMs);
+    std::lock_guard<std::mutex> lock(mMutex);
+    mSessionId = id;
+}
+
+void FaceWatchdog::disarmSession() {
+    uint64_t id;
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        id = mSessionId;
+        mSessionId = 0;
+    }
+    if (id != 0) {
+        disarm(id);
+    }
+}
+
+uint64_t FaceWatchdog::arm(const char* name, pid_t tid, int32_t deadlineMs) {
+    std::lock_guard<std::mutex> lock(mMutex);
+    Entry entry = { mNextId++, name, tid, monotonicUs() + (int64_t)deadlineMs * 1000, false };
+    mEntries.push_back(entry);
+    mCondition.notify_all();
+    return entry.id;
+}
+
+void FaceWatchdog::disarm(uint64_t id) {
+    std::lock_guard<std::mutex> lock(mMutex);
+    for (size_t i = 0; i < mEntries.size(); i++) {
+        if (mEntries[i].id == id) {
+            mEntries[i] = mEntries.back();
+            mEntries.pop_back();
+            return;
+        }
+    }
+}
+
+void FaceWatchdog::loop() {
+    std::unique_lock<std::mutex> lock(mMutex);
+    while (!mExiting) {
+        int64_t now = monotonicUs();
+        int64_t next = INT64_MAX;
+        for (size_t i = 0; i < mEntries.size(); i++) {
+            Entry& entry = mEntries[i];
+            if (entry.fired) {
+                continue;
+            }
+            if (entry.deadlineUs <= now) {
+                entry.fired = true;
+                const char* name = entry.name;
+                pid_t tid = entry.tid;
+                lock.unlock();
+                mCallback(name, tid);
+                lock.lock();
+                // The entry list may have changed meanwhile, rescan.
+                next = now;
+                break;
+            }
+            if (entry.deadlineUs < next) {
+                next = entry.deadlineUs;
+            }
+        }
+        if (next == now) {
+            continue;
+        }
+        if (next == INT64_MAX) {
+            mCondition.wait(lock);
+        } else {
+            mCondition.wait_for(lock, std::chrono::microseconds(next - now));
+        }
+    }
+}
+
+}  // namespace implementation
+}  // namespace V1_0
+}  // namespace face
+}  // namespace hardware
+}  // namespace sprd
+}  // namespace vendor
@@ -0,0 +1,75 @@
+// FIXME: your file license if you have one
+
+#pragma once
+
+#include <stdint.h>
+#include <sys/types.h>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace vendor {
+namespace sprd {
+namespace hardware {
+namespace face {
+namespace V1_0 {
+namespace implementation {
+
+// Watches deadlines of calls into the vendor library. The callback runs on
+// the watchdog thread, once per missed deadline, while the late call may
+// still be blocked.
+class FaceWatchdog {
+public:
+    typedef std::function<void(const char* name, pid_t tid)> OverrunCallback;
+
+    explicit FaceWatchdog(OverrunCallback callback);
+    ~FaceWatchdog();
+
+    // Puts a deadline on the vendor call made by the calling thread while
+    // the scope is alive. A deadline <= 0 disables it.
+    class Scope {
+    public:
+        Scope(FaceWatchdog& watchdog, const char* name, int32_t deadlineMs);
+        ~Scope();
+
+    private:
+        FaceWatchdog& mWatchdog;
+        uint64_t mId;
+    };
+
+    // Deadline of a whole enroll or authenticate session, not bound to a
+    // thread. Arming again replaces the previous session deadline.
+    void armSession(const char* name, int32_t deadlineMs);
+    void disarmSession();
+
+private:
+    struct Entry {
+        uint64_t id;
+        const char* name;
+        pid_t tid;
+        int64_t deadlineUs;
+        bool fired;
+    };
+
+    uint64_t arm(const char* name, pid_t tid, int32_t deadlineMs);
+    void disarm(uint64_t id);
+    void loop();
+
+    OverrunCallback mCallback;
+    std::mutex mMutex;
+    std::condition_variable mCondition;
+    std::vector<Entry> mEntries;
+    uint64_t mNextId;
+    uint64_t mSessionId;
+    bool mExiting;
+    std::thread mThread;
+};
+
+}  // namespace implementation
+}  // namespace V1_0
+}  // namespace face
+}  // namespace hardware
+}  // namespace sprd
+}  // namespace vendor
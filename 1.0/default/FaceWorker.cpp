@@ -0,0 +1,172 @@
+// FIXME: your file license if you have one
+
+#define LOG_TAG "vendor.sprd.hardware.face@1.0-service"
+
+#include <log/log.h>
+#include <errno.h>
+#include <malloc.h>
+#include <poll.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include "ExtBiometricsFace.h"
+#include "FaceVendorHooks.h"
+#include "FaceWorker.h"
+
+namespace vendor {
+namespace sprd {
+namespace hardware {
+namespace face {
+namespace V1_0 {
+namespace implementation {
+
+static FaceWorkerShared* sShared = nullptr;
+static std::mutex sEventMutex;
+static FaceVendorHooks sHooks;
+
+// The vendor library may notify from its own threads, so producers of the
+// event ring are serialized here.
+static void pushEvent(uint32_t type, uint32_t seq, int32_t ret, uint64_t out, const face_msg_t* msg) {
+    std::lock_guard<std::mutex> lock(sEventMutex);
+    FaceWorkerEvent* event;
+    while ((event = sShared->events.beginPush()) == nullptr) {
+        // Never drop a notification, the service drains the ring continuously.
+        usleep(1000);
+    }
+    event->type = type;
+    event->seq = seq;
+    event->ret = ret;
+    event->out = out;
+    if (msg != nullptr) {
+        event->msg = *msg;
+    } else {
+        memset(&event->msg, 0, sizeof(event->msg));
+    }
+    sShared->events.endPush();
+    char bell = 0;
+    send(WORKER_SOCK_FD, &bell, sizeof(bell), MSG_DONTWAIT | MSG_NOSIGNAL);
+}
+
+static void workerNotify(const face_msg_t* msg) {
+    pushEvent(WORKER_EVENT_NOTIFY, 0, 0, 0, msg);
+}
+
+static int execute(face_device_t* device, FaceWorkerCommand* command, uint64_t* out) {
+    uint8_t* first = command->payload;
+    uint8_t* second = command->payload + WORKER_PAYLOAD_ALIGN(command->size[0]);
+    const hw_auth_token_t* hat = command->size[0] >= sizeof(hw_auth_token_t) ?
+            reinterpret_cast<const hw_auth_token_t*>(first) : nullptr;
+    switch (command->op) {
+    case WORKER_SET_ACTIVE_GROUP:
+        first[WORKER_PAYLOAD_SIZE - 1] = 0;
+        return device->set_active_group(device, (uint32_t)command->args[0], reinterpret_cast<const char*>(first));
+    case WORKER_PRE_ENROLL:
+        return device->pre_enroll(device, (uint32_t)command->args[0], out);
+    case WORKER_ENROLL:
+        return device->enroll(device, hat, (uint32_t)command->args[0],
+                reinterpret_cast<uint32_t*>(second), command->size[1] / sizeof(uint32_t));
+    case WORKER_POST_ENROLL:
+        return device->post_enroll(device);
+    case WORKER_GET_AUTHENTICATOR_ID:
+        return device->get_authenticator_id(device, out);
+    case WORKER_CANCEL:
+        return device->cancel(device);
+    case WORKER_ENUMERATE:
+        return device->enumerate(device);
+    case WORKER_REMOVE:
+        return device->remove(device, (uint32_t)command->args[0]);
+    case WORKER_AUTHENTICATE:
+        return device->authenticate(device, (uint64_t)command->args[0]);
+    case WORKER_SET_FEATURE:
+        return device->set_feature(device, (uint32_t)command->args[0], command->args[1] != 0,
+                hat, (uint32_t)command->args[2]);
+    case WORKER_GET_FEATURE: {
+        bool enabled = false;
+        int ret = device->get_feature(device, (uint32_t)command->args[0], (uint32_t)command->args[1], &enabled);
+        *out = enabled;
+        return ret;
+    }
+    case WORKER_USER_ACTIVITY:
+        return device->user_activity(device);
+    case WORKER_RESET_LOCKOUT:
+        return device->reset_lockout(device, hat);
+    case WORKER_ENROLL_PROCESS:
+        return device->do_enroll_process(device, command->args[0],
+                reinterpret_cast<int32_t*>(first), command->size[0] / sizeof(int32_t),
+                reinterpret_cast<int8_t*>(second), command->size[1]);
+    case WORKER_AUTHENTICATE_PROCESS:
+        return device->do_authenticate_process(device, command->args[0], command->args[1], command->args[2],
+                reinterpret_cast<int32_t*>(first), command->size[0] / sizeof(int32_t),
+                reinterpret_cast<int8_t*>(second), command->size[1]);
+    case WORKER_TRIM_MEMORY: {
+        uint64_t before = (uint64_t)residentSetKb();
+        int ret = sHooks.trimMemory ? sHooks.trimMemory(device, (int)command->args[0]) : 0;
+#ifdef M_PURGE
+        mallopt(M_PURGE, 0);
+#endif
+        uint64_t after = (uint64_t)residentSetKb();
+        *out = (before << 32) | (after & 0xffffffff);
+        return ret;
+    }
+    case WORKER_WARM_UP:
+        return sHooks.warmUp ? sHooks.warmUp(device) : 0;
+    default:
+        ALOGE("invalid face worker op: %u", command->op);
+        return -EINVAL;
+    }
+}
+
+int runFaceWorker(int /* argc */, char** /* argv */) {
+    void* base = mmap(nullptr, sizeof(FaceWorkerShared), PROT_READ | PROT_WRITE, MAP_SHARED, WORKER_SHM_FD, 0);
+    if (base == MAP_FAILED) {
+        ALOGE("face worker can't map shared memory: %s", strerror(errno));
+        return 1;
+    }
+    sShared = reinterpret_cast<FaceWorkerShared*>(base);
+    if (sShared->magic != WORKER_MAGIC || sShared->version != WORKER_VERSION) {
+        ALOGE("face worker shared memory mismatch");
+        return 1;
+    }
+
+    face_device_t* device = ExtBiometricsFace::openHal(workerNotify);
+    loadFaceVendorHooks(device, &sHooks);
+    pushEvent(WORKER_EVENT_READY, 0, device ? 0 : -ENODEV, 0, nullptr);
+    if (!device) {
+        return 1;
+    }
+
+    for (;;) {
+        struct pollfd pfd = { WORKER_SOCK_FD, POLLIN, 0 };
+        if (poll(&pfd, 1, -1) < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            ALOGE("face worker poll failed: %s", strerror(errno));
+            return 1;
+        }
+        char bells[64];
+        ssize_t n;
+        while ((n = recv(WORKER_SOCK_FD, bells, sizeof(bells), MSG_DONTWAIT)) > 0) {}
+        if (n == 0) {
+            ALOGD("face service went away, worker exiting");
+            return 0;
+        }
+
+        FaceWorkerCommand* command;
+        while ((command = sShared->commands.front()) != nullptr) {
+            uint64_t out = 0;
+            int ret = execute(device, command, &out);
+            uint32_t seq = command->seq;
+            sShared->commands.pop();
+            pushEvent(WORKER_EVENT_RESULT, seq, ret, out, nullptr);
+        }
+    }
+}
+
+}  // namespace implementation
+}  // namespace V1_0
+}  // namespace face
+}  // namespace hardware
+}  // namespace sprd
+}  // namespace vendor
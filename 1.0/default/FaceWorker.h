@@ -0,0 +1,235 @@
+// FIXME: your file license if you have one
+
+#pragma once
+
+#include <hardware/hardware.h>
+#include <hardware/face.h>
+#include <hardware/hw_auth_token.h>
+#include <sys/types.h>
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+#include "FaceStats.h"
+
+namespace vendor {
+namespace sprd {
+namespace hardware {
+namespace face {
+namespace V1_0 {
+namespace implementation {
+
+// Command line switch that turns the service binary into a vendor worker.
+extern const char kFaceWorkerArg[];
+
+typedef void (*FaceNotifyFn)(const face_msg_t* msg);
+
+enum {
+    WORKER_SET_ACTIVE_GROUP,
+    WORKER_PRE_ENROLL,
+    WORKER_ENROLL,
+    WORKER_POST_ENROLL,
+    WORKER_GET_AUTHENTICATOR_ID,
+    WORKER_CANCEL,
+    WORKER_ENUMERATE,
+    WORKER_REMOVE,
+    WORKER_AUTHENTICATE,
+    WORKER_SET_FEATURE,
+    WORKER_GET_FEATURE,
+    WORKER_USER_ACTIVITY,
+    WORKER_RESET_LOCKOUT,
+    WORKER_ENROLL_PROCESS,
+    WORKER_AUTHENTICATE_PROCESS,
+    WORKER_TRIM_MEMORY,
+    WORKER_WARM_UP,
+};
+
+enum {
+    WORKER_EVENT_READY,
+    WORKER_EVENT_RESULT,
+    WORKER_EVENT_NOTIFY,
+};
+
+#define WORKER_MAGIC 0x4b524f57 // "WORK"
+#define WORKER_VERSION 1
+// Descriptors the worker inherits the shared memory and the doorbell socket on
+#define WORKER_SHM_FD 3
+#define WORKER_SOCK_FD 4
+
+// Large enough for the info/byteInfo vectors of one frame, a HAT or a
+// store path.
+#define WORKER_PAYLOAD_SIZE (16 * 1024)
+#define WORKER_COMMAND_SLOTS 4
+#define WORKER_EVENT_SLOTS 64
+
+struct FaceWorkerCommand {
+    uint32_t op;
+    uint32_t seq;
+    int64_t args[4];
+    uint32_t size[2];
+    uint8_t payload[WORKER_PAYLOAD_SIZE];
+};
+
+struct FaceWorkerEvent {
+    uint32_t type;
+    uint32_t seq;
+    int32_t ret;
+    uint64_t out;
+    face_msg_t msg;
+};
+
+// Variable sized arguments are packed back to back, each starting on an
+// 8 byte boundary.
+#define WORKER_PAYLOAD_ALIGN(size) (((size) + 7) & ~7u)
+
+// Single producer, single consumer ring living in memory shared by the
+// service and the worker. Slots are filled in place to avoid copying
+// frame payloads twice.
+template <typename T, uint32_t N>
+struct FaceWorkerRing {
+    std::atomic<uint32_t> head;
+    std::atomic<uint32_t> tail;
+    T slots[N];
+
+    T* beginPush() {
+        uint32_t h = head.load(std::memory_order_relaxed);
+        if (h - tail.load(std::memory_order_acquire) == N) {
+            return nullptr;
+        }
+        return &slots[h % N];
+    }
+    void endPush() {
+        head.store(head.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+    }
+    T* front() {
+        uint32_t t = tail.load(std::memory_order_relaxed);
+        if (t == head.load(std::memory_order_acquire)) {
+            return nullptr;
+        }
+        return &slots[t % N];
+    }
+    void pop() {
+        tail.store(tail.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+    }
+};
+
+struct FaceWorkerShared {
+    uint32_t magic;
+    uint32_t version;
+    FaceWorkerRing<FaceWorkerCommand, WORKER_COMMAND_SLOTS> commands;
+    FaceWorkerRing<FaceWorkerEvent, WORKER_EVENT_SLOTS> events;
+};
+
+// Describes one call into the worker. data/size carry the variable sized
+// arguments that are copied into the command payload.
+struct FaceWorkerCall {
+    uint32_t op;
+    int64_t args[4];
+    const void* data[2];
+    uint32_t size[2];
+};
+
+// Stand-in face_device_t whose methods are forwarded to the vendor library
+// running in a supervised child process. A call that misses its deadline
+// or a worker that dies gets the child killed and restarted, while the
+// HIDL service stays registered.
+class FaceWorkerClient {
+public:
+    FaceWorkerClient(FaceNotifyFn notify, FaceStats* stats);
+    ~FaceWorkerClient();
+
+    // Spawns the worker and waits for the vendor module to be opened.
+    face_device_t* start();
+    // Forward to the optional vendor hooks inside the worker. The worker
+    // reports its own RSS around the trim, in kB.
+    int trimMemory(int level, int64_t* rssBeforeKb, int64_t* rssAfterKb);
+    int warmUp();
+
+private:
+    struct ProxyDevice {
+        face_device_t device;
+        FaceWorkerClient* client;
+    };
+
+    static FaceWorkerClient* from(face_device_t* dev);
+    static int proxyClose(hw_device_t* dev);
+    static int proxySetNotify(face_device_t* dev, FaceNotifyFn notify);
+    static int proxySetActiveGroup(face_device_t* dev, uint32_t gid, const char* storePath);
+    static int proxyPreEnroll(face_device_t* dev, uint32_t timeoutSec, uint64_t* challenge);
+    static int proxyEnroll(face_device_t* dev, const hw_auth_token_t* hat, uint32_t timeoutSec,
+            const uint32_t* disabledFeatures, uint32_t numDisabledFeatures);
+    static int proxyPostEnroll(face_device_t* dev);
+    static int proxyGetAuthenticatorId(face_device_t* dev, uint64_t* id);
+    static int proxyCancel(face_device_t* dev);
+    static int proxyEnumerate(face_device_t* dev);
+    static int proxyRemove(face_device_t* dev, uint32_t faceId);
+    static int proxyAuthenticate(face_device_t* dev, uint64_t operationId);
+    static int proxySetFeature(face_device_t* dev, uint32_t feature, bool enabled,
+            const hw_auth_token_t* hat, uint32_t faceId);
+    static int proxyGetFeature(face_device_t* dev, uint32_t feature, uint32_t faceId, bool* enabled);
+    static int proxyUserActivity(face_device_t* dev);
+    static int proxyResetLockout(face_device_t* dev, const hw_auth_token_t* hat);
+    static int proxyDoEnrollProcess(face_device_t* dev, int64_t addr,
+            int32_t* info, size_t infoSize, int8_t* byteInfo, size_t byteInfoSize);
+    static int proxyDoAuthenticateProcess(face_device_t* dev, int64_t main, int64_t sub, int64_t otp,
+            int32_t* info, size_t infoSize, int8_t* byteInfo, size_t byteInfoSize);
+
+    int call(const FaceWorkerCall& call, uint64_t* out);
+    int callLocked(const FaceWorkerCall& call, uint64_t* out);
+    bool spawnLocked();
+    void stopLocked();
+    void shutdown();
+    void restartLoop();
+    void restart(uint32_t generation);
+    void eventLoop(int sock, FaceWorkerShared* shared, uint32_t generation);
+    void onWorkerDied(uint32_t generation);
+
+    ProxyDevice mProxy;
+    FaceNotifyFn mNotify;
+    FaceStats* mStats;
+    std::string mExePath;
+    int32_t mDeadlineMs;
+    int32_t mFrameDeadlineMs;
+
+    // Serializes calls and worker restarts.
+    std::mutex mCallMutex;
+    int mShmFd;
+    int mSock;
+    // Also under mStateMutex, calls read it there to kill a stuck worker.
+    pid_t mPid;
+    FaceWorkerShared* mShared;
+    std::thread mEventThread;
+    uint32_t mSeq;
+    bool mShuttingDown;
+    bool mHasActiveGroup;
+    uint32_t mActiveGroup;
+    std::string mActiveGroupPath;
+
+    // Protects the result handshake with the event thread.
+    std::mutex mStateMutex;
+    std::condition_variable mStateCondition;
+    uint32_t mGeneration;
+    bool mReady;
+    bool mDead;
+    uint32_t mResultSeq;
+    int32_t mResultRet;
+    uint64_t mResultOut;
+    int64_t mDiedAtUs;
+    // Hands a dead worker's generation from the event thread to the
+    // restart thread, which the shutdown joins.
+    std::condition_variable mRestartCondition;
+    uint32_t mRestartGeneration;
+    bool mRestartExiting;
+    std::thread mRestartThread;
+};
+
+// Entry point of the worker process, see kFaceWorkerArg.
+int runFaceWorker(int argc, char** argv);
+
+}  // namespace implementation
+}  // namespace V1_0
+}  // namespace face
+}  // namespace hardware
+}  // namespace sprd
+}  // namespace vendor
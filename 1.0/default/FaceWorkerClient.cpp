@@ -0,0 +1,543 @@
+// FIXME: your file license if you have one
+
+#define LOG_TAG "vendor.sprd.hardware.face@1.0-service"
+
+#include <log/log.h>
+#include <cutils/properties.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <limits.h>
+#include <poll.h>
+#include <signal.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/prctl.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include "FaceWorker.h"
+
+namespace vendor {
+namespace sprd {
+namespace hardware {
+namespace face {
+namespace V1_0 {
+namespace implementation {
+
+// Deadline of a control call into the worker
+#define PROP_WORKER_DEADLINE_MS "ro.vendor.faceid.worker_deadline_ms"
+#define DEFAULT_WORKER_DEADLINE_MS 3000
+// Deadline of one doEnrollProcess/doAuthenticateProcess frame
+#define PROP_WORKER_FRAME_DEADLINE_MS "ro.vendor.faceid.worker_frame_deadline_ms"
+#define DEFAULT_WORKER_FRAME_DEADLINE_MS 1000
+// How long a freshly spawned worker may take to open the vendor module
+#define WORKER_START_TIMEOUT_MS 10000
+
+const char kFaceWorkerArg[] = "--face-worker";
+
+FaceWorkerClient::FaceWorkerClient(FaceNotifyFn notify, FaceStats* stats)
+        : mNotify(notify), mStats(stats), mShmFd(-1), mSock(-1), mPid(-1),
+          mShared(nullptr), mSeq(0), mShuttingDown(false), mHasActiveGroup(false),
+          mActiveGroup(0), mGeneration(0), mReady(false), mDead(false),
+          mResultSeq(0), mResultRet(0), mResultOut(0), mDiedAtUs(0), mRestartGeneration(0),
+          mRestartExiting(false) {
+    memset(&mProxy, 0, sizeof(mProxy));
+    mProxy.client = this;
+    mProxy.device.common.tag = HARDWARE_DEVICE_TAG;
+    mProxy.device.common.version = HARDWARE_MODULE_API_VERSION(1, 0);
+    mProxy.device.common.close = proxyClose;
+    mProxy.device.set_notify = proxySetNotify;
+    mProxy.device.set_active_group = proxySetActiveGroup;
+    mProxy.device.pre_enroll = proxyPreEnroll;
+    mProxy.device.enroll = proxyEnroll;
+    mProxy.device.post_enroll = proxyPostEnroll;
+    mProxy.device.get_authenticator_id = proxyGetAuthenticatorId;
+    mProxy.device.cancel = proxyCancel;
+    mProxy.device.enumerate = proxyEnumerate;
+    mProxy.device.remove = proxyRemove;
+    mProxy.device.authenticate = proxyAuthenticate;
+    mProxy.device.set_feature = proxySetFeature;
+    mProxy.device.get_feature = proxyGetFeature;
+    mProxy.device.user_activity = proxyUserActivity;
+    mProxy.device.reset_lockout = proxyResetLockout;
+    mProxy.device.do_enroll_process = proxyDoEnrollProcess;
+    mProxy.device.do_authenticate_process = proxyDoAuthenticateProcess;
+
+    mDeadlineMs = property_get_int32(PROP_WORKER_DEADLINE_MS, DEFAULT_WORKER_DEADLINE_MS);
+    mFrameDeadlineMs = property_get_int32(PROP_WORKER_FRAME_DEADLINE_MS, DEFAULT_WORKER_FRAME_DEADLINE_MS);
+
+    char exe[PATH_MAX] = {0};
+    ssize_t len = readlink("/proc/self/exe", exe, sizeof(exe) - 1);
+    if (len > 0) {
+        mExePath.assign(exe, len);
+    }
+}
+
+FaceWorkerClient::~FaceWorkerClient() {
+    shutdown();
+}
+
+// The restart thread takes mCallMutex, it is joined before.
+void FaceWorkerClient::shutdown() {
+    {
+        std::lock_guard<std::mutex> lock(mStateMutex);
+        mRestartExiting = true;
+        mRestartCondition.notify_all();
+    }
+    if (mRestartThread.joinable()) {
+        mRestartThread.join();
+    }
+    std::lock_guard<std::mutex> lock(mCallMutex);
+    mShuttingDown = true;
+    stopLocked();
+}
+
+face_device_t* FaceWorkerClient::start() {
+    std::lock_guard<std::mutex> lock(mCallMutex);
+    if (mExePath.empty()) {
+        ALOGE("Can't resolve the service executable for the face worker");
+        return nullptr;
+    }
+    if (!spawnLocked()) {
+        return nullptr;
+    }
+    mRestartThread = std::thread(&FaceWorkerClient::restartLoop, this);
+    return &mProxy.device;
+}
+
+bool FaceWorkerClient::spawnLocked() {
+    int shmFd = memfd_create("face-worker", MFD_CLOEXEC);
+    if (shmFd < 0 || ftruncate(shmFd, sizeof(FaceWorkerShared)) != 0) {
+        ALOGE("Can't create face worker shared memory: %s", strerror(errno));
+        if (shmFd >= 0) {
+            close(shmFd);
+        }
+        return false;
+    }
+    void* base = mmap(nullptr, sizeof(FaceWorkerShared), PROT_READ | PROT_WRITE, MAP_SHARED, shmFd, 0);
+    if (base == MAP_FAILED) {
+        ALOGE("Can't map face worker shared memory: %s", strerror(errno));
+        close(shmFd);
+        return false;
+    }
+    // A fresh memfd is zero filled, which is the empty state of both rings.
+    FaceWorkerShared* shared = reinterpret_cast<FaceWorkerShared*>(base);
+    shared->magic = WORKER_MAGIC;
+    shared->version = WORKER_VERSION;
+
+    int socks[2];
+    if (socketpair(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0, socks) != 0) {
+        ALOGE("Can't create face worker socket: %s", strerror(errno));
+        munmap(base, sizeof(FaceWorkerShared));
+        close(shmFd);
+        return false;
+    }
+
+    const char* exe = mExePath.c_str();
+    pid_t pid = fork();
+    if (pid == 0) {
+        // Only async-signal-safe calls until exec.
+        prctl(PR_SET_PDEATHSIG, SIGKILL);
+        int shm = fcntl(shmFd, F_DUPFD, 10);
+        int sock = fcntl(socks[1], F_DUPFD, 10);
+        if (shm < 0 || sock < 0 || dup2(shm, WORKER_SHM_FD) < 0 || dup2(sock, WORKER_SOCK_FD) < 0) {
+            _exit(127);
+        }
+        // The copies don't have FD_CLOEXEC, unlike the originals.
+        close(shm);
+        close(sock);
+        char* const argv[] = { const_cast<char*>(exe), const_cast<char*>(kFaceWorkerArg), nullptr };
+        execv(exe, argv);
+        _exit(127);
+    }
+    close(socks[1]);
+    if (pid < 0) {
+        ALOGE("Can't fork face worker: %s", strerror(errno));
+        close(socks[0]);
+        munmap(base, sizeof(FaceWorkerShared));
+        close(shmFd);
+        return false;
+    }
+
+    mShmFd = shmFd;
+    mSock = socks[0];
+    mShared = shared;
+    uint32_t generation;
+    {
+        std::lock_guard<std::mutex> lock(mStateMutex);
+        mPid = pid;
+        generation = ++mGeneration;
+        mReady = false;
+        mDead = false;
+    }
+    mEventThread = std::thread(&FaceWorkerClient::eventLoop, this, mSock, mShared, generation);
+
+    int64_t start = monotonicUs();
+    {
+        std::unique_lock<std::mutex> lock(mStateMutex);
+        mStateCondition.wait_for(lock, std::chrono::milliseconds(WORKER_START_TIMEOUT_MS),
+                [this] { return mReady || mDead; });
+        if (!mReady) {
+            lock.unlock();
+            ALOGE("face worker %d failed to open the vendor module", pid);
+            stopLocked();
+            return false;
+        }
+    }
+    mStats->halOpenDurationUs = monotonicUs() - start;
+    ALOGD("face worker %d ready", pid);
+
+    if (mHasActiveGroup) {
+        FaceWorkerCall call = { WORKER_SET_ACTIVE_GROUP, { mActiveGroup },
+                { mActiveGroupPath.c_str() }, { (uint32_t)mActiveGroupPath.size() + 1 } };
+        if (callLocked(call, nullptr) != 0) {
+            ALOGE("face worker %d failed to restore group %u", pid, mActiveGroup);
+        }
+    }
+    return true;
+}
+
+void FaceWorkerClient::stopLocked() {
+    pid_t pid;
+    {
+        // Keeps the event thread from treating this as a crash.
+        std::lock_guard<std::mutex> lock(mStateMutex);
+        mDead = true;
+        mReady = false;
+        pid = mPid;
+        mPid = -1;
+        mStateCondition.notify_all();
+    }
+    if (pid > 0) {
+        kill(pid, SIGKILL);
+        TEMP_FAILURE_RETRY(waitpid(pid, nullptr, 0));
+    }
+    if (mEventThread.joinable()) {
+        // The event thread sees the socket hang up once the worker is gone.
+        mEventThread.join();
+    }
+    if (mSock >= 0) {
+        close(mSock);
+        mSock = -1;
+    }
+    if (mShared != nullptr) {
+        munmap(mShared, sizeof(FaceWorkerShared));
+        mShared = nullptr;
+    }
+    if (mShmFd >= 0) {
+        close(mShmFd);
+        mShmFd = -1;
+    }
+}
+
+void FaceWorkerClient::restartLoop() {
+    for (;;) {
+        uint32_t generation;
+        {
+            std::unique_lock<std::mutex> lock(mStateMutex);
+            mRestartCondition.wait(lock, [this] { return mRestartGeneration != 0 || mRestartExiting; });
+            if (mRestartExiting) {
+                return;
+            }
+            generation = mRestartGeneration;
+            mRestartGeneration = 0;
+        }
+        restart(generation);
+    }
+}
+
+void FaceWorkerClient::restart(uint32_t generation) {
+    std::lock_guard<std::mutex> lock(mCallMutex);
+    {
+        std::lock_guard<std::mutex> stateLock(mStateMutex);
+        if (generation != mGeneration) {
+            return;
+        }
+    }
+    stopLocked();
+    if (mShuttingDown) {
+        return;
+    }
+    mStats->workerRestarts++;
+    if (!spawnLocked()) {
+        ALOGE("face worker restart failed");
+        return;
+    }
+    int64_t recoveryUs = monotonicUs() - mDiedAtUs;
+    mStats->lastWorkerRecoveryUs = recoveryUs;
+    if (recoveryUs > mStats->maxWorkerRecoveryUs) {
+        mStats->maxWorkerRecoveryUs = recoveryUs;
+    }
+    ALOGD("face worker recovered in %" PRId64 "us", recoveryUs);
+}
+
+void FaceWorkerClient::eventLoop(int sock, FaceWorkerShared* shared, uint32_t generation) {
+    bool alive = true;
+    while (alive) {
+        struct pollfd pfd = { sock, POLLIN, 0 };
+        if (poll(&pfd, 1, -1) < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            break;
+        }
+        char bells[64];
+        ssize_t n;
+        while ((n = recv(sock, bells, sizeof(bells), MSG_DONTWAIT)) > 0) {}
+        if (n == 0 || (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK)) {
+            alive = false;
+        }
+
+        // Events that made it into the ring before the worker died are
+        // still delivered.
+        FaceWorkerEvent* event;
+        while ((event = shared->events.front()) != nullptr) {
+            switch (event->type) {
+            case WORKER_EVENT_READY: {
+                std::lock_guard<std::mutex> lock(mStateMutex);
+                mReady = (0 == event->ret);
+                mStateCondition.notify_all();
+                break;
+            }
+            case WORKER_EVENT_RESULT: {
+                std::lock_guard<std::mutex> lock(mStateMutex);
+                mResultSeq = event->seq;
+                mResultRet = event->ret;
+                mResultOut = event->out;
+                mStateCondition.notify_all();
+                break;
+            }
+            case WORKER_EVENT_NOTIFY:
+                mNotify(&event->msg);
+                break;
+            default:
+                ALOGE("invalid face worker event: %u", event->type);
+                break;
+            }
+            shared->events.pop();
+        }
+    }
+    onWorkerDied(generation);
+}
+
+void FaceWorkerClient::onWorkerDied(uint32_t generation) {
+    {
+        std::lock_guard<std::mutex> lock(mStateMutex);
+        if (generation != mGeneration || mDead) {
+            return;
+        }
+        bool wasReady = mReady;
+        mDead = true;
+        mReady = false;
+        mDiedAtUs = monotonicUs();
+        mStateCondition.notify_all();
+        if (!wasReady) {
+            // Died while opening the vendor module, spawnLocked() reports it.
+            return;
+        }
+        mRestartGeneration = generation;
+        mRestartCondition.notify_all();
+    }
+    mStats->workerDeaths++;
+    ALOGE("face worker died, restarting it");
+
+    // Whatever session the client had running is gone with the worker.
+    face_msg_t msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.type = FACE_ERROR;
+    msg.data.error = FACE_ERROR_HW_UNAVAILABLE;
+    mNotify(&msg);
+}
+
+int FaceWorkerClient::call(const FaceWorkerCall& call, uint64_t* out) {
+    std::lock_guard<std::mutex> lock(mCallMutex);
+    return callLocked(call, out);
+}
+
+int FaceWorkerClient::callLocked(const FaceWorkerCall& call, uint64_t* out) {
+    uint32_t generation;
+    {
+        std::lock_guard<std::mutex> lock(mStateMutex);
+        if (!mReady || mDead) {
+            return -ENODEV;
+        }
+        generation = mGeneration;
+    }
+    if (WORKER_PAYLOAD_ALIGN(call.size[0]) + call.size[1] > WORKER_PAYLOAD_SIZE) {
+        ALOGE("face worker payload too large: %u + %u", call.size[0], call.size[1]);
+        return -EINVAL;
+    }
+    FaceWorkerCommand* command = mShared->commands.beginPush();
+    if (command == nullptr) {
+        return -EBUSY;
+    }
+    uint32_t seq = ++mSeq;
+    command->op = call.op;
+    command->seq = seq;
+    memcpy(command->args, call.args, sizeof(command->args));
+    command->size[0] = call.size[0];
+    command->size[1] = call.size[1];
+    if (call.size[0] > 0) {
+        memcpy(command->payload, call.data[0], call.size[0]);
+    }
+    if (call.size[1] > 0) {
+        memcpy(command->payload + WORKER_PAYLOAD_ALIGN(call.size[0]), call.data[1], call.size[1]);
+    }
+    mShared->commands.endPush();
+    char bell = 0;
+    send(mSock, &bell, sizeof(bell), MSG_DONTWAIT | MSG_NOSIGNAL);
+
+    bool frame = (WORKER_ENROLL_PROCESS == call.op || WORKER_AUTHENTICATE_PROCESS == call.op);
+    int32_t deadlineMs = frame ? mFrameDeadlineMs : mDeadlineMs;
+    std::unique_lock<std::mutex> lock(mStateMutex);
+    bool done = mStateCondition.wait_for(lock, std::chrono::milliseconds(deadlineMs),
+            [&] { return seq == mResultSeq || mDead || generation != mGeneration; });
+    if (!done) {
+        pid_t pid = mPid;
+        lock.unlock();
+        mStats->workerCallTimeouts++;
+        ALOGE("face worker missed the %dms deadline of op %u, killing it", deadlineMs, call.op);
+        if (pid > 0) {
+            kill(pid, SIGKILL);
+        }
+        return -ETIMEDOUT;
+    }
+    if (seq != mResultSeq) {
+        return -ENODEV;
+    }
+    if (out != nullptr) {
+        *out = mResultOut;
+    }
+    int ret = mResultRet;
+    lock.unlock();
+
+    if (WORKER_SET_ACTIVE_GROUP == call.op && 0 == ret) {
+        mHasActiveGroup = true;
+        mActiveGroup = (uint32_t)call.args[0];
+        mActiveGroupPath = static_cast<const char*>(call.data[0]);
+    }
+    return ret;
+}
+
+FaceWorkerClient* FaceWorkerClient::from(face_device_t* dev) {
+    return reinterpret_cast<ProxyDevice*>(dev)->client;
+}
+
+int FaceWorkerClient::proxyClose(hw_device_t* dev) {
+    from(reinterpret_cast<face_device_t*>(dev))->shutdown();
+    return 0;
+}
+
+int FaceWorkerClient::proxySetNotify(face_device_t* dev, FaceNotifyFn notify) {
+    from(dev)->mNotify = notify;
+    return 0;
+}
+
+int FaceWorkerClient::proxySetActiveGroup(face_device_t* dev, uint32_t gid, const char* storePath) {
+    FaceWorkerCall call = { WORKER_SET_ACTIVE_GROUP, { gid }, { storePath }, { (uint32_t)strlen(storePath) + 1 } };
+    return from(dev)->call(call, nullptr);
+}
+
+int FaceWorkerClient::proxyPreEnroll(face_device_t* dev, uint32_t timeoutSec, uint64_t* challenge) {
+    FaceWorkerCall call = { WORKER_PRE_ENROLL, { timeoutSec }, {}, {} };
+    return from(dev)->call(call, challenge);
+}
+
+int FaceWorkerClient::proxyEnroll(face_device_t* dev, const hw_auth_token_t* hat, uint32_t timeoutSec,
+        const uint32_t* disabledFeatures, uint32_t numDisabledFeatures) {
+    FaceWorkerCall call = { WORKER_ENROLL, { timeoutSec }, { hat, disabledFeatures },
+            { sizeof(hw_auth_token_t), (uint32_t)(numDisabledFeatures * sizeof(uint32_t)) } };
+    return from(dev)->call(call, nullptr);
+}
+
+int FaceWorkerClient::proxyPostEnroll(face_device_t* dev) {
+    FaceWorkerCall call = { WORKER_POST_ENROLL, {}, {}, {} };
+    return from(dev)->call(call, nullptr);
+}
+
+int FaceWorkerClient::proxyGetAuthenticatorId(face_device_t* dev, uint64_t* id) {
+    FaceWorkerCall call = { WORKER_GET_AUTHENTICATOR_ID, {}, {}, {} };
+    return from(dev)->call(call, id);
+}
+
+int FaceWorkerClient::proxyCancel(face_device_t* dev) {
+    FaceWorkerCall call = { WORKER_CANCEL, {}, {}, {} };
+    return from(dev)->call(call, nullptr);
+}
+
+int FaceWorkerClient::proxyEnumerate(face_device_t* dev) {
+    FaceWorkerCall call = { WORKER_ENUMERATE, {}, {}, {} };
+    return from(dev)->call(call, nullptr);
+}
+
+int FaceWorkerClient::proxyRemove(face_device_t* dev, uint32_t faceId) {
+    FaceWorkerCall call = { WORKER_REMOVE, { faceId }, {}, {} };
+    return from(dev)->call(call, nullptr);
+}
+
+int FaceWorkerClient::proxyAuthenticate(face_device_t* dev, uint64_t operationId) {
+    FaceWorkerCall call = { WORKER_AUTHENTICATE, { (int64_t)operationId }, {}, {} };
+    return from(dev)->call(call, nullptr);
+}
+
+int FaceWorkerClient::proxySetFeature(face_device_t* dev, uint32_t feature, bool enabled,
+        const hw_auth_token_t* hat, uint32_t faceId) {
+    FaceWorkerCall call = { WORKER_SET_FEATURE, { feature, enabled, faceId }, { hat },
+            { hat != nullptr ? (uint32_t)sizeof(hw_auth_token_t) : 0 } };
+    return from(dev)->call(call, nullptr);
+}
+
+int FaceWorkerClient::proxyGetFeature(face_device_t* dev, uint32_t feature, uint32_t faceId, bool* enabled) {
+    FaceWorkerCall call = { WORKER_GET_FEATURE, { feature, faceId }, {}, {} };
+    uint64_t out = 0;
+    int ret = from(dev)->call(call, &out);
+    *enabled = (out != 0);
+    return ret;
+}
+
+int FaceWorkerClient::proxyUserActivity(face_device_t* dev) {
+    FaceWorkerCall call = { WORKER_USER_ACTIVITY, {}, {}, {} };
+    return from(dev)->call(call, nullptr);
+}
+
+int FaceWorkerClient::proxyResetLockout(face_device_t* dev, const hw_auth_token_t* hat) {
+    FaceWorkerCall call = { WORKER_RESET_LOCKOUT, {}, { hat },
+            { hat != nullptr ? (uint32_t)sizeof(hw_auth_token_t) : 0 } };
+    return from(dev)->call(call, nullptr);
+}
+
+int FaceWorkerClient::proxyDoEnrollProcess(face_device_t* dev, int64_t addr,
+        int32_t* info, size_t infoSize, int8_t* byteInfo, size_t byteInfoSize) {
+    FaceWorkerCall call = { WORKER_ENROLL_PROCESS, { addr }, { info, byteInfo },
+            { (uint32_t)(infoSize * sizeof(int32_t)), (uint32_t)(byteInfoSize * sizeof(int8_t)) } };
+    return from(dev)->call(call, nullptr);
+}
+
+int FaceWorkerClient::proxyDoAuthenticateProcess(face_device_t* dev, int64_t main, int64_t sub, int64_t otp,
+        int32_t* info, size_t infoSize, int8_t* byteInfo, size_t byteInfoSize) {
+    FaceWorkerCall call = { WORKER_AUTHENTICATE_PROCESS, { main, sub, otp }, { info, byteInfo },
+            { (uint32_t)(infoSize * sizeof(int32_t)), (uint32_t)(byteInfoSize * sizeof(int8_t)) } };
+    return from(dev)->call(call, nullptr);
+}
+
+int FaceWorkerClient::trimMemory(int level, int64_t* rssBeforeKb, int64_t* rssAfterKb) {
+    FaceWorkerCall trim = { WORKER_TRIM_MEMORY, { level }, {}, {} };
+    uint64_t out = 0;
+    int ret = call(trim, &out);
+    *rssBeforeKb = (int64_t)(out >> 32);
+    *rssAfterKb = (int64_t)(out & 0xffffffff);
+    return ret;
+}
+
+int FaceWorkerClient::warmUp() {
+    FaceWorkerCall warm = { WORKER_WARM_UP, {}, {}, {} };
+    return call(warm, nullptr);
+}
+
+}  // namespace implementation
+}  // namespace V1_0
+}  // namespace face
+}  // namespace hardware
+}  // namespace sprd
+}  // namespace vendor
@@ -0,0 +1,278 @@
+// FIXME: your file license if you have one
+
+#define LOG_TAG "face_replay"
+
+#include <log/log.h>
+#include <hardware/hw_auth_token.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <vendor/sprd/hardware/face/1.0/IExtBiometricsFace.h>
+#include <vendor/sprd/hardware/face/1.1/IExtBiometricsFaceClientCallback.h>
+#include "FaceCapture.h"
+#include "FaceStats.h"
+
+using ::android::sp;
+using ::android::hardware::hidl_string;
+using ::android::hardware::hidl_vec;
+using ::android::hardware::Return;
+using ::android::hardware::Void;
+using ::android::hardware::biometrics::face::V1_0::FaceAcquiredInfo;
+using ::android::hardware::biometrics::face::V1_0::FaceError;
+using ::android::hardware::biometrics::face::V1_0::Feature;
+using ::android::hardware::biometrics::face::V1_0::OptionalUint64;
+using ::android::hardware::biometrics::face::V1_0::Status;
+using ::vendor::sprd::hardware::face::V1_0::IExtBiometricsFace;
+using ::vendor::sprd::hardware::face::V1_1::IExtBiometricsFaceClientCallback;
+using namespace ::vendor::sprd::hardware::face::V1_0::implementation;
+
+static const int32_t kDefaultUserId = 99;
+static const char kDefaultStorePath[] = "/data/system/users/0/facedata";
+// How long to wait for the results of the frames still in flight at the end
+static const int64_t kDrainTimeoutUs = 5000000;
+
+// Matches each processed callback with the frame that was sent with the
+// same buffer address. Cameras cycle through a few buffers, so several
+// frames may be in flight per address.
+class ReplayCallback : public IExtBiometricsFaceClientCallback {
+public:
+    void sent(int64_t addr) {
+        std::lock_guard<std::mutex> lock(mMutex);
+        mSent[addr].push_back(monotonicUs());
+        mInFlight++;
+    }
+
+    bool drain(int64_t timeoutUs) {
+        std::unique_lock<std::mutex> lock(mMutex);
+        return mCondition.wait_for(lock, std::chrono::microseconds(timeoutUs),
+                [this] { return mInFlight == 0; });
+    }
+
+    void report(int64_t elapsedUs) {
+        std::lock_guard<std::mutex> lock(mMutex);
+        std::sort(mLatencies.begin(), mLatencies.end());
+        size_t n = mLatencies.size();
+        printf("frames processed: %zu in %.3fs (%.1f fps), %zu unanswered\n", n, elapsedUs / 1e6,
+                elapsedUs > 0 ? n * 1e6 / elapsedUs : 0.0, mInFlight);
+        if (n > 0) {
+            printf("latency us: p50=%" PRId64 " p95=%" PRId64 " p99=%" PRId64 " max=%" PRId64 "\n",
+                    mLatencies[n / 2], mLatencies[n * 95 / 100], mLatencies[n * 99 / 100], mLatencies[n - 1]);
+        }
+        printf("authenticated=%u rejected=%u enrolled=%u errors=%u\n",
+                mAuthenticated, mRejected, mEnrolled, mErrors);
+        printf("recommended frame rate: %u updates, last %ufps\n", mFrameRateUpdates, mRecommendedFps);
+    }
+
+    Return<void> onEnrollProcessed(uint64_t, int64_t addr) override {
+        processed(addr);
+        return Void();
+    }
+
+    Return<void> onAuthProcessed(uint64_t, int64_t main, int64_t) override {
+        processed(main);
+        return Void();
+    }
+
+    Return<void> onEnrollResult(uint64_t, uint32_t faceId, int32_t, uint32_t remaining) override {
+        if (faceId != 0 && remaining == 0) {
+            std::lock_guard<std::mutex> lock(mMutex);
+            mEnrolled++;
+        }
+        return Void();
+    }
+
+    Return<void> onAuthenticated(uint64_t, uint32_t faceId, int32_t, const hidl_vec<uint8_t>&) override {
+        std::lock_guard<std::mutex> lock(mMutex);
+        if (faceId != 0) {
+            mAuthenticated++;
+        } else {
+            mRejected++;
+        }
+        return Void();
+    }
+
+    Return<void> onAcquired(uint64_t, int32_t, FaceAcquiredInfo, int32_t) override {
+        return Void();
+    }
+
+    Return<void> onError(uint64_t, int32_t, FaceError error, int32_t vendorCode) override {
+        ALOGD("onError(%d, %d)", (int)error, vendorCode);
+        std::lock_guard<std::mutex> lock(mMutex);
+        mErrors++;
+        return Void();
+    }
+
+    Return<void> onRemoved(uint64_t, const hidl_vec<uint32_t>&, int32_t) override {
+        return Void();
+    }
+
+    Return<void> onEnumerate(uint64_t, const hidl_vec<uint32_t>&, int32_t) override {
+        return Void();
+    }
+
+    Return<void> onLockoutChanged(uint64_t) override {
+        return Void();
+    }
+
+    // Replay keeps the recorded timing, the recommendation is only reported.
+    Return<void> onRecommendedFrameRate(uint64_t, uint32_t fps) override {
+        std::lock_guard<std::mutex> lock(mMutex);
+        mFrameRateUpdates++;
+        mRecommendedFps = fps;
+        return Void();
+    }
+
+private:
+    void processed(int64_t addr) {
+        int64_t now = monotonicUs();
+        std::lock_guard<std::mutex> lock(mMutex);
+        auto it = mSent.find(addr);
+        if (it == mSent.end() || it->second.empty()) {
+            return;
+        }
+        mLatencies.push_back(now - it->second.front());
+        it->second.pop_front();
+        mInFlight--;
+        mCondition.notify_all();
+    }
+
+    std::mutex mMutex;
+    std::condition_variable mCondition;
+    std::map<int64_t, std::deque<int64_t>> mSent;
+    std::vector<int64_t> mLatencies;
+    size_t mInFlight = 0;
+    uint32_t mAuthenticated = 0;
+    uint32_t mRejected = 0;
+    uint32_t mEnrolled = 0;
+    uint32_t mErrors = 0;
+    uint32_t mFrameRateUpdates = 0;
+    uint32_t mRecommendedFps = 0;
+};
+
+static void usage(const char* name) {
+    fprintf(stderr, "usage: %s [-m] [-u userId] [-d storePath] capture\n"
+            "  -m  replay at maximum speed instead of the recorded timing\n", name);
+}
+
+static void replayEnroll(const sp<IExtBiometricsFace>& face, const FaceCaptureRecord* record) {
+    // The recorded HAT was minted for a challenge the HAL has forgotten;
+    // ask for a new one and patch it in. Fine for the simulated HAL, a
+    // real one also checks the HMAC.
+    uint64_t challenge = 0;
+    face->generateChallenge((uint32_t)record->args[0], [&](const OptionalUint64& result) {
+        challenge = result.value;
+    });
+    std::vector<uint8_t> hat(reinterpret_cast<const uint8_t*>(record->byteInfo()),
+            reinterpret_cast<const uint8_t*>(record->byteInfo()) + record->byteInfoCount);
+    if (hat.size() >= sizeof(hw_auth_token_t)) {
+        reinterpret_cast<hw_auth_token_t*>(hat.data())->challenge = challenge;
+    }
+    hidl_vec<Feature> disabledFeatures(record->infoCount);
+    for (uint32_t i = 0; i < record->infoCount; i++) {
+        disabledFeatures[i] = static_cast<Feature>(record->info()[i]);
+    }
+    face->enroll(hidl_vec<uint8_t>(hat), (uint32_t)record->args[0], disabledFeatures);
+}
+
+int main(int argc, char** argv) {
+    bool maxSpeed = false;
+    int32_t userId = kDefaultUserId;
+    const char* storePath = kDefaultStorePath;
+    int opt;
+    while ((opt = getopt(argc, argv, "mu:d:")) != -1) {
+        switch (opt) {
+        case 'm':
+            maxSpeed = true;
+            break;
+        case 'u':
+            userId = atoi(optarg);
+            break;
+        case 'd':
+            storePath = optarg;
+            break;
+        default:
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    if (optind != argc - 1) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    FaceCaptureReader reader;
+    if (!reader.open(argv[optind])) {
+        fprintf(stderr, "can't read capture %s\n", argv[optind]);
+        return 1;
+    }
+    sp<IExtBiometricsFace> face = IExtBiometricsFace::getService();
+    if (face == nullptr) {
+        fprintf(stderr, "face service not available\n");
+        return 1;
+    }
+    sp<ReplayCallback> callback = new ReplayCallback();
+    face->setCallback(callback, [](const OptionalUint64&) {});
+    if (Status::OK != face->setActiveUser(userId, hidl_string(storePath))) {
+        fprintf(stderr, "setActiveUser(%d, %s) failed\n", userId, storePath);
+        return 1;
+    }
+
+    int64_t start = monotonicUs();
+    int64_t due = start;
+    uint32_t records = 0;
+    const FaceCaptureRecord* record;
+    while ((record = reader.next()) != nullptr) {
+        records++;
+        if (!maxSpeed) {
+            due += record->deltaUs;
+            int64_t now = monotonicUs();
+            if (due > now) {
+                usleep(due - now);
+            }
+        }
+        hidl_vec<int32_t> info;
+        hidl_vec<int8_t> byteInfo;
+        switch (record->type) {
+        case CAPTURE_ENROLL:
+            replayEnroll(face, record);
+            break;
+        case CAPTURE_AUTHENTICATE:
+            face->authenticate((uint64_t)record->args[0]);
+            break;
+        case CAPTURE_ENROLL_FRAME:
+            info.setToExternal(const_cast<int32_t*>(record->info()), record->infoCount);
+            byteInfo.setToExternal(const_cast<int8_t*>(record->byteInfo()), record->byteInfoCount);
+            callback->sent(record->args[0]);
+            face->doEnrollProcess(record->args[0], info, byteInfo);
+            break;
+        case CAPTURE_AUTHENTICATE_FRAME:
+            info.setToExternal(const_cast<int32_t*>(record->info()), record->infoCount);
+            byteInfo.setToExternal(const_cast<int8_t*>(record->byteInfo()), record->byteInfoCount);
+            callback->sent(record->args[0]);
+            face->doAuthenticateProcess(record->args[0], record->args[1], record->args[2], info, byteInfo);
+            break;
+        case CAPTURE_CANCEL:
+            face->cancel();
+            break;
+        default:
+            ALOGE("skipping unknown capture record %u", record->type);
+            break;
+        }
+    }
+    if (!callback->drain(kDrainTimeoutUs)) {
+        fprintf(stderr, "some frames were never answered\n");
+    }
+    printf("records replayed: %u (%s speed)\n", records, maxSpeed ? "maximum" : "recorded");
+    callback->report(monotonicUs() - start);
+    return 0;
+}
@@ -1,26 +1,42 @@
 #define LOG_TAG "vendor.sprd.hardware.face@1.0-service"
 
 #include <android/log.h>
+#include <cutils/properties.h>
+#include <string.h>
+#include <algorithm>
 #include <hidl/HidlSupport.h>
 #include <hidl/HidlTransportSupport.h>
 #include "ExtBiometricsFace.h"
 
-using vendor::sprd::hardware::face::V1_0::IExtBiometricsFace;
+using vendor::sprd::hardware::face::V1_1::IExtBiometricsFace;
 using vendor::sprd::hardware::face::V1_0::implementation::ExtBiometricsFace;
+using vendor::sprd::hardware::face::V1_0::implementation::kFaceWorkerArg;
+using vendor::sprd::hardware::face::V1_0::implementation::runFaceWorker;
 using android::hardware::configureRpcThreadpool;
 using android::hardware::joinRpcThreadpool;
 using android::sp;
 
-int main() {
+// Binder threads serving the clients. Frames keep coming in while a
+// control call waits for the vendor, one thread would queue them behind it.
+#define PROP_BINDER_THREADS "ro.vendor.faceid.binder_threads"
+#define DEFAULT_BINDER_THREADS 4
+
+int main(int argc, char** argv) {
+    if (argc > 1 && 0 == strcmp(argv[1], kFaceWorkerArg)) {
+        return runFaceWorker(argc, argv);
+    }
+
     android::sp<IExtBiometricsFace> face = ExtBiometricsFace::getInstance();
 
-    configureRpcThreadpool(1, true /*callerWillJoin*/);
+    int32_t threads = std::max(1, property_get_int32(PROP_BINDER_THREADS, DEFAULT_BINDER_THREADS));
+    configureRpcThreadpool(threads, true /*callerWillJoin*/);
 
     if (face != nullptr) {
         if(::android::OK != face->registerAsService()) {
             ALOGE("ExtBiometricsFace registerAsService fail");
             return 1;
         }
+        static_cast<ExtBiometricsFace*>(face.get())->onServiceRegistered();
     } else {
         ALOGE("Can't create instance of BiometricsFace, nullptr");
     }
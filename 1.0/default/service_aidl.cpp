@@ -0,0 +1,61 @@
+#define LOG_TAG "vendor.sprd.hardware.face-aidl"
+
+#include <android/binder_manager.h>
+#include <android/binder_process.h>
+#include <android/log.h>
+#include <cutils/properties.h>
+#include <string.h>
+#include <hidl/HidlSupport.h>
+#include <hidl/HidlTransportSupport.h>
+#include <algorithm>
+#include <string>
+#include "ExtBiometricsFace.h"
+#include "FaceAidl.h"
+
+using vendor::sprd::hardware::face::V1_1::IExtBiometricsFace;
+using vendor::sprd::hardware::face::V1_0::implementation::ExtBiometricsFace;
+using vendor::sprd::hardware::face::V1_0::implementation::FaceAidl;
+using vendor::sprd::hardware::face::V1_0::implementation::kFaceWorkerArg;
+using vendor::sprd::hardware::face::V1_0::implementation::runFaceWorker;
+using android::hardware::configureRpcThreadpool;
+using android::hardware::joinRpcThreadpool;
+using android::sp;
+
+// Binder threads serving each of the two front ends.
+#define PROP_BINDER_THREADS "ro.vendor.faceid.binder_threads"
+#define DEFAULT_BINDER_THREADS 4
+
+// The AIDL face HAL for the framework, and IExtBiometricsFace for the
+// camera client's frames, both on the one service core.
+int main(int argc, char** argv) {
+    if (argc > 1 && 0 == strcmp(argv[1], kFaceWorkerArg)) {
+        return runFaceWorker(argc, argv);
+    }
+
+    android::sp<IExtBiometricsFace> face = ExtBiometricsFace::getInstance();
+    if (face == nullptr) {
+        ALOGE("Can't create instance of BiometricsFace, nullptr");
+        return 1;
+    }
+
+    int32_t threads = std::max(1, property_get_int32(PROP_BINDER_THREADS, DEFAULT_BINDER_THREADS));
+    configureRpcThreadpool(threads, true /*callerWillJoin*/);
+    ABinderProcess_setThreadPoolMaxThreadCount(threads);
+
+    if (::android::OK != face->registerAsService()) {
+        ALOGE("ExtBiometricsFace registerAsService fail");
+        return 1;
+    }
+    std::shared_ptr<FaceAidl> aidl = ndk::SharedRefBase::make<FaceAidl>(static_cast<ExtBiometricsFace*>(face.get()));
+    const std::string instance = std::string() + FaceAidl::descriptor + "/default";
+    if (STATUS_OK != AServiceManager_addService(aidl->asBinder().get(), instance.c_str())) {
+        ALOGE("%s addService fail", instance.c_str());
+        return 1;
+    }
+    static_cast<ExtBiometricsFace*>(face.get())->onServiceRegistered();
+
+    ABinderProcess_startThreadPool();
+    joinRpcThreadpool();
+
+    return 0; // should never get here
+}
@@ -0,0 +1,493 @@
+/*
+ * Simulated face vendor library. It implements face_device_t without any
+ * camera or algorithm so that the service can be exercised end to end.
+ * Select it with ro.hardware.face=sim; its behaviour is scripted through
+ * the vendor.faceid.sim.* properties below.
+ */
+
+#define LOG_TAG "face.sim"
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <inttypes.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <cutils/properties.h>
+#include <hardware/face.h>
+#include <hardware/hardware.h>
+#include <hardware/hw_auth_token.h>
+#include <log/log.h>
+
+/* Time spent in each do_*_process call */
+#define PROP_PROCESS_MS "vendor.faceid.sim.process_ms"
+/* Frames needed before an authentication matches, 0 never matches */
+#define PROP_MATCH_FRAMES "vendor.faceid.sim.match_frames"
+/* Frames needed to finish an enrollment */
+#define PROP_ENROLL_FRAMES "vendor.faceid.sim.enroll_frames"
+/* Blocks the next do_authenticate_process for that long */
+#define PROP_HANG_MS "vendor.faceid.sim.hang_ms"
+/* Aborts in the next do_authenticate_process */
+#define PROP_CRASH "vendor.faceid.sim.crash"
+/* Size of the model kept resident between face_trim_memory and face_warm_up */
+#define PROP_MODEL_KB "vendor.faceid.sim.model_kb"
+
+#define SIM_FACE_ID 1
+
+/* The service calls in from its request thread and its binder threads at
+ * once; |lock| guards the state below, never held while notifying. */
+typedef struct sim_face_device {
+    face_device_t device;
+    void (*notify)(const face_msg_t *msg);
+    pthread_mutex_t lock;
+    uint64_t challenge;
+    uint64_t operation_id;
+    uint32_t gid;
+    uint32_t enrolled_fid;
+    bool enrolling;
+    bool authenticating;
+    int32_t frames;
+    int32_t checked;
+    void *model;
+} sim_face_device_t;
+
+static sim_face_device_t *to_sim(face_device_t *dev) {
+    return (sim_face_device_t *)dev;
+}
+
+static void sim_notify(sim_face_device_t *sim, face_msg_t *msg) {
+    if (sim->notify != NULL) {
+        sim->notify(msg);
+    }
+}
+
+static void sim_notify_error(sim_face_device_t *sim, int error) {
+    face_msg_t msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.type = FACE_ERROR;
+    msg.data.error = error;
+    sim_notify(sim, &msg);
+}
+
+static void sim_notify_acquired(sim_face_device_t *sim, int acquired) {
+    face_msg_t msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.type = FACE_ACQUIRED;
+    msg.data.acquired = acquired;
+    sim_notify(sim, &msg);
+}
+
+static bool sim_token_valid(const hw_auth_token_t *hat) {
+    return hat != NULL && hat->version == HW_AUTH_TOKEN_VERSION && hat->challenge != 0;
+}
+
+/* Set by face_sim_set_delay() */
+static void (*sim_delay_hook)(int32_t ms);
+
+static void sim_delay(int32_t ms) {
+    if (sim_delay_hook != NULL) {
+        sim_delay_hook(ms);
+    } else if (ms > 0) {
+        usleep(ms * 1000);
+    }
+}
+
+static void sim_process_delay(void) {
+    sim_delay(property_get_int32(PROP_PROCESS_MS, 30));
+}
+
+/* Stands in for the algorithm's models: dirty memory that has to be
+ * rebuilt, at a cost, after it was dropped. */
+static void sim_load_model(sim_face_device_t *sim) {
+    if (sim->model != NULL) {
+        return;
+    }
+    size_t size = (size_t)property_get_int32(PROP_MODEL_KB, 4096) * 1024;
+    if (size == 0) {
+        return;
+    }
+    sim->model = malloc(size);
+    if (sim->model != NULL) {
+        memset(sim->model, 0x5a, size);
+    }
+}
+
+static int sim_close(hw_device_t *dev) {
+    sim_face_device_t *sim = to_sim((face_device_t *)dev);
+    free(sim->model);
+    pthread_mutex_destroy(&sim->lock);
+    free(dev);
+    return 0;
+}
+
+static int sim_set_notify(face_device_t *dev, void (*notify)(const face_msg_t *msg)) {
+    to_sim(dev)->notify = notify;
+    return 0;
+}
+
+static int sim_pre_enroll(face_device_t *dev, uint32_t timeout_sec __unused, uint64_t *challenge) {
+    sim_face_device_t *sim = to_sim(dev);
+    pthread_mutex_lock(&sim->lock);
+    sim->challenge = ((uint64_t)lrand48() << 32) | (uint64_t)lrand48() | 1;
+    *challenge = sim->challenge;
+    pthread_mutex_unlock(&sim->lock);
+    return 0;
+}
+
+static int sim_enroll(face_device_t *dev, const hw_auth_token_t *hat, uint32_t timeout_sec __unused,
+        const uint32_t *disabled_features __unused, uint32_t num_disabled_features __unused) {
+    sim_face_device_t *sim = to_sim(dev);
+    pthread_mutex_lock(&sim->lock);
+    if (!sim_token_valid(hat) || hat->challenge != sim->challenge) {
+        pthread_mutex_unlock(&sim->lock);
+        sim_notify_error(sim, FACE_ERROR_UNABLE_TO_PROCESS);
+        return 0;
+    }
+    sim_load_model(sim);
+    sim->enrolling = true;
+    sim->checked = 0;
+    sim->authenticating = false;
+    sim->frames = 0;
+    pthread_mutex_unlock(&sim->lock);
+    return 0;
+}
+
+static int sim_post_enroll(face_device_t *dev) {
+    sim_face_device_t *sim = to_sim(dev);
+    pthread_mutex_lock(&sim->lock);
+    sim->challenge = 0;
+    pthread_mutex_unlock(&sim->lock);
+    return 0;
+}
+
+static int sim_get_authenticator_id(face_device_t *dev, uint64_t *id) {
+    sim_face_device_t *sim = to_sim(dev);
+    pthread_mutex_lock(&sim->lock);
+    *id = sim->enrolled_fid != 0 ? 0x5349u : 0;
+    pthread_mutex_unlock(&sim->lock);
+    return 0;
+}
+
+static int sim_cancel(face_device_t *dev) {
+    sim_face_device_t *sim = to_sim(dev);
+    pthread_mutex_lock(&sim->lock);
+    sim->enrolling = false;
+    sim->authenticating = false;
+    pthread_mutex_unlock(&sim->lock);
+    sim_notify_error(sim, FACE_ERROR_CANCELED);
+    return 0;
+}
+
+static int sim_enumerate(face_device_t *dev) {
+    sim_face_device_t *sim = to_sim(dev);
+    face_msg_t msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.type = FACE_TEMPLATE_ENUMERATED;
+    pthread_mutex_lock(&sim->lock);
+    msg.data.enumerated.fid = sim->enrolled_fid;
+    pthread_mutex_unlock(&sim->lock);
+    sim_notify(sim, &msg);
+    return 0;
+}
+
+static int sim_remove(face_device_t *dev, uint32_t face_id) {
+    sim_face_device_t *sim = to_sim(dev);
+    face_msg_t msg;
+    pthread_mutex_lock(&sim->lock);
+    if (face_id == 0 || face_id == sim->enrolled_fid) {
+        sim->enrolled_fid = 0;
+    }
+    pthread_mutex_unlock(&sim->lock);
+    memset(&msg, 0, sizeof(msg));
+    msg.type = FACE_TEMPLATE_REMOVED;
+    msg.data.removed.fid = face_id;
+    sim_notify(sim, &msg);
+    return 0;
+}
+
+static int sim_set_active_group(face_device_t *dev, uint32_t gid, const char *store_path) {
+    sim_face_device_t *sim = to_sim(dev);
+    face_msg_t msg;
+    if (store_path == NULL || access(store_path, W_OK) != 0) {
+        return FACE_ILLEGAL_ARGUMENT;
+    }
+    pthread_mutex_lock(&sim->lock);
+    if (gid != sim->gid) {
+        sim->enrolled_fid = 0;
+    }
+    sim->gid = gid;
+    pthread_mutex_unlock(&sim->lock);
+    memset(&msg, 0, sizeof(msg));
+    msg.type = FACE_LOCKOUT_CHANGED;
+    msg.data.lockout.duration = 0;
+    sim_notify(sim, &msg);
+    return 0;
+}
+
+static int sim_authenticate(face_device_t *dev, uint64_t operation_id) {
+    sim_face_device_t *sim = to_sim(dev);
+    pthread_mutex_lock(&sim->lock);
+    sim_load_model(sim);
+    sim->authenticating = true;
+    sim->enrolling = false;
+    sim->operation_id = operation_id;
+    sim->frames = 0;
+    pthread_mutex_unlock(&sim->lock);
+    return 0;
+}
+
+static int sim_set_feature(face_device_t *dev, uint32_t feature __unused, bool enabled __unused,
+        const hw_auth_token_t *hat, uint32_t face_id) {
+    sim_face_device_t *sim = to_sim(dev);
+    bool known;
+    pthread_mutex_lock(&sim->lock);
+    known = face_id != 0 && face_id == sim->enrolled_fid;
+    pthread_mutex_unlock(&sim->lock);
+    if (!sim_token_valid(hat) || !known) {
+        return FACE_ILLEGAL_ARGUMENT;
+    }
+    return 0;
+}
+
+static int sim_get_feature(face_device_t *dev, uint32_t feature __unused, uint32_t face_id, bool *enabled) {
+    sim_face_device_t *sim = to_sim(dev);
+    bool known;
+    pthread_mutex_lock(&sim->lock);
+    known = face_id != 0 && face_id == sim->enrolled_fid;
+    pthread_mutex_unlock(&sim->lock);
+    if (!known) {
+        return FACE_ILLEGAL_ARGUMENT;
+    }
+    *enabled = true;
+    return 0;
+}
+
+static int sim_user_activity(face_device_t *dev __unused) {
+    return 0;
+}
+
+static int sim_reset_lockout(face_device_t *dev __unused, const hw_auth_token_t *hat) {
+    return sim_token_valid(hat) ? 0 : FACE_ILLEGAL_ARGUMENT;
+}
+
+/* Second half of an enroll frame: counts it towards the enrollment */
+static void sim_enroll_extract(sim_face_device_t *sim, int64_t addr) {
+    face_msg_t msg;
+    int32_t needed = property_get_int32(PROP_ENROLL_FRAMES, 5);
+    int32_t frames;
+    sim_notify_acquired(sim, FACE_ACQUIRED_GOOD);
+    pthread_mutex_lock(&sim->lock);
+    frames = ++sim->frames;
+    if (frames >= needed) {
+        sim->enrolling = false;
+        sim->enrolled_fid = SIM_FACE_ID;
+    }
+    pthread_mutex_unlock(&sim->lock);
+    memset(&msg, 0, sizeof(msg));
+    msg.type = FACE_ENROLL_PROCESSED;
+    msg.data.enroll_processed.addr = addr;
+    msg.data.enroll_processed.remaining = needed > frames ? needed - frames : 0;
+    sim_notify(sim, &msg);
+    if (frames >= needed) {
+        memset(&msg, 0, sizeof(msg));
+        msg.type = FACE_TEMPLATE_ENROLLING;
+        msg.data.enroll.fid = SIM_FACE_ID;
+        sim_notify(sim, &msg);
+    }
+}
+
+static bool sim_enrolling(sim_face_device_t *sim) {
+    bool enrolling;
+    pthread_mutex_lock(&sim->lock);
+    enrolling = sim->enrolling;
+    pthread_mutex_unlock(&sim->lock);
+    return enrolling;
+}
+
+static int sim_do_enroll_process(face_device_t *dev, int64_t addr, int32_t *info __unused,
+        size_t info_size __unused, int8_t *byte_info __unused, size_t byte_info_size __unused) {
+    sim_face_device_t *sim = to_sim(dev);
+    if (!sim_enrolling(sim)) {
+        return 0;
+    }
+    sim_process_delay();
+    sim_enroll_extract(sim, addr);
+    return 0;
+}
+
+static int sim_do_authenticate_process(face_device_t *dev, int64_t main, int64_t sub, int64_t otp __unused,
+        int32_t *info __unused, size_t info_size __unused, int8_t *byte_info __unused,
+        size_t byte_info_size __unused) {
+    sim_face_device_t *sim = to_sim(dev);
+    face_msg_t msg;
+    int32_t needed = property_get_int32(PROP_MATCH_FRAMES, 3);
+    int32_t hang_ms = property_get_int32(PROP_HANG_MS, 0);
+    bool authenticating;
+    bool matched;
+    uint32_t fid;
+    if (property_get_bool(PROP_CRASH, false)) {
+        property_set(PROP_CRASH, "0");
+        ALOGE("simulated crash");
+        abort();
+    }
+    if (hang_ms > 0) {
+        property_set(PROP_HANG_MS, "0");
+        ALOGE("simulated hang of %dms", hang_ms);
+        usleep(hang_ms * 1000);
+    }
+    pthread_mutex_lock(&sim->lock);
+    authenticating = sim->authenticating;
+    pthread_mutex_unlock(&sim->lock);
+    if (!authenticating) {
+        return 0;
+    }
+    sim_process_delay();
+    memset(&msg, 0, sizeof(msg));
+    pthread_mutex_lock(&sim->lock);
+    sim->frames++;
+    fid = sim->enrolled_fid;
+    matched = needed > 0 && sim->frames >= needed && fid != 0;
+    if (matched) {
+        sim->authenticating = false;
+        msg.data.authenticated.hat.challenge = sim->operation_id;
+        msg.data.authenticated.hat.user_id = sim->gid;
+    }
+    pthread_mutex_unlock(&sim->lock);
+    if (matched) {
+        msg.type = FACE_AUTHENTICATED;
+        msg.data.authenticated.fid = fid;
+        msg.data.authenticated.hat.version = HW_AUTH_TOKEN_VERSION;
+        msg.data.authenticated.hat.authenticator_type = htonl(HW_AUTH_BIOMETRIC);
+        sim_notify(sim, &msg);
+        return 0;
+    }
+    sim_notify_acquired(sim, fid != 0 ? FACE_ACQUIRED_GOOD : FACE_ACQUIRED_NOT_DETECTED);
+    memset(&msg, 0, sizeof(msg));
+    msg.type = FACE_AUTHENTICATE_PROCESSED;
+    msg.data.authenticate_processed.main = main;
+    msg.data.authenticate_processed.sub = sub;
+    sim_notify(sim, &msg);
+    return 0;
+}
+
+static int sim_open(const hw_module_t *module, const char *id __unused, hw_device_t **device) {
+    sim_face_device_t *sim = calloc(1, sizeof(sim_face_device_t));
+    if (sim == NULL) {
+        return -ENOMEM;
+    }
+    sim->device.common.tag = HARDWARE_DEVICE_TAG;
+    sim->device.common.version = HARDWARE_MODULE_API_VERSION(1, 0);
+    sim->device.common.module = (hw_module_t *)module;
+    sim->device.common.close = sim_close;
+    sim->device.set_notify = sim_set_notify;
+    sim->device.pre_enroll = sim_pre_enroll;
+    sim->device.enroll = sim_enroll;
+    sim->device.post_enroll = sim_post_enroll;
+    sim->device.get_authenticator_id = sim_get_authenticator_id;
+    sim->device.cancel = sim_cancel;
+    sim->device.enumerate = sim_enumerate;
+    sim->device.remove = sim_remove;
+    sim->device.set_active_group = sim_set_active_group;
+    sim->device.authenticate = sim_authenticate;
+    sim->device.set_feature = sim_set_feature;
+    sim->device.get_feature = sim_get_feature;
+    sim->device.user_activity = sim_user_activity;
+    sim->device.reset_lockout = sim_reset_lockout;
+    sim->device.do_enroll_process = sim_do_enroll_process;
+    sim->device.do_authenticate_process = sim_do_authenticate_process;
+    pthread_mutex_init(&sim->lock, NULL);
+    sim_load_model(sim);
+    *device = &sim->device.common;
+    return 0;
+}
+
+/* Optional hooks looked up by the service, see FaceVendorHooks.h */
+__attribute__((visibility("default")))
+int face_trim_memory(face_device_t *dev, int level) {
+    sim_face_device_t *sim = to_sim(dev);
+    ALOGD("trim_memory(level=%d)", level);
+    pthread_mutex_lock(&sim->lock);
+    free(sim->model);
+    sim->model = NULL;
+    pthread_mutex_unlock(&sim->lock);
+    return 0;
+}
+
+__attribute__((visibility("default")))
+int face_warm_up(face_device_t *dev) {
+    sim_face_device_t *sim = to_sim(dev);
+    pthread_mutex_lock(&sim->lock);
+    sim_load_model(sim);
+    pthread_mutex_unlock(&sim->lock);
+    return 0;
+}
+
+/* Layout of FaceEnrollQuality in FaceVendorHooks.h */
+typedef struct sim_enroll_quality {
+    int32_t yaw;
+    int32_t pitch;
+    int32_t roll;
+    int32_t score;
+} sim_enroll_quality_t;
+
+/* Split of PROP_PROCESS_MS between the check and the extraction */
+#define SIM_CHECK_SHARE 3
+
+/* Walks the user through the 3x3 pose grid, one bin per frame */
+__attribute__((visibility("default")))
+int face_enroll_check(face_device_t *dev, int64_t addr __unused, const int32_t *info __unused,
+        size_t info_size __unused, const int8_t *byte_info __unused, size_t byte_info_size __unused,
+        sim_enroll_quality_t *quality) {
+    sim_face_device_t *sim = to_sim(dev);
+    int32_t bin;
+    pthread_mutex_lock(&sim->lock);
+    bin = sim->checked++ % 9;
+    pthread_mutex_unlock(&sim->lock);
+    sim_delay(property_get_int32(PROP_PROCESS_MS, 30) / SIM_CHECK_SHARE);
+    memset(quality, 0, sizeof(*quality));
+    quality->yaw = (bin % 3 - 1) * 20;
+    quality->pitch = (1 - bin / 3) * 15;
+    quality->score = 80;
+    return 0;
+}
+
+__attribute__((visibility("default")))
+int face_enroll_extract(face_device_t *dev, int64_t addr, const int32_t *info __unused,
+        size_t info_size __unused, const int8_t *byte_info __unused, size_t byte_info_size __unused,
+        const sim_enroll_quality_t *quality __unused) {
+    sim_face_device_t *sim = to_sim(dev);
+    int32_t ms = property_get_int32(PROP_PROCESS_MS, 30);
+    if (!sim_enrolling(sim)) {
+        return 0;
+    }
+    sim_delay(ms - ms / SIM_CHECK_SHARE);
+    sim_enroll_extract(sim, addr);
+    return 0;
+}
+
+/* Hands the simulated processing time to |delay| instead of sleeping, so
+ * that a harness can run the library on a virtual clock and script its
+ * latencies; NULL sleeps again. Not a hook of the service. */
+__attribute__((visibility("default")))
+void face_sim_set_delay(void (*delay)(int32_t ms)) {
+    sim_delay_hook = delay;
+}
+
+static struct hw_module_methods_t sim_module_methods = {
+    .open = sim_open,
+};
+
+face_module_t HAL_MODULE_INFO_SYM = {
+    .common = {
+        .tag = HARDWARE_MODULE_TAG,
+        .module_api_version = HARDWARE_MODULE_API_VERSION(1, 0),
+        .hal_api_version = HARDWARE_HAL_API_VERSION,
+        .id = FACE_HARDWARE_MODULE_ID,
+        .name = "Simulated face HAL",
+        .author = "sprd",
+        .methods = &sim_module_methods,
+    },
+};
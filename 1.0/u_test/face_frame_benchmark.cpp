@@ -0,0 +1,185 @@
+#define LOG_TAG "face_frame_benchmark"
+
+// How long the camera client blocks handing a frame to the face service,
+// doAuthenticateProcess against the oneway submitAuthenticateFrame, alone
+// and with other threads making control calls at the same time. Runs
+// against the service on the device, meant for the simulated vendor
+// library (ro.hardware.face=sim).
+//
+// The time of each iteration is the submission only; the counters give
+// its p50, p99 and max and the jitter, p99 less p50, in microseconds.
+
+#include <benchmark/benchmark.h>
+#include <cutils/properties.h>
+
+#include <android/hardware/biometrics/face/1.0/IBiometricsFace.h>
+#include <hidl/HidlSupport.h>
+
+#include <vendor/sprd/hardware/face/1.1/IExtBiometricsFace.h>
+#include <vendor/sprd/hardware/face/1.1/IExtBiometricsFaceClientCallback.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+using android::sp;
+using android::hardware::hidl_string;
+using android::hardware::hidl_vec;
+using android::hardware::Return;
+using android::hardware::biometrics::face::V1_0::FaceAcquiredInfo;
+using android::hardware::biometrics::face::V1_0::FaceError;
+using android::hardware::biometrics::face::V1_0::Feature;
+using android::hardware::biometrics::face::V1_0::OptionalBool;
+using android::hardware::biometrics::face::V1_0::OptionalUint64;
+using android::hardware::biometrics::face::V1_0::Status;
+
+using ::vendor::sprd::hardware::face::V1_1::IExtBiometricsFace;
+using ::vendor::sprd::hardware::face::V1_1::IExtBiometricsFaceClientCallback;
+
+static const int32_t kUserId = 99;
+static const char kStorePath[] = "/data/system/users/0/facedata";
+// Buffers the camera has, a submission waits for one to come back.
+static const int64_t kBuffers = 4;
+static const size_t kInfoCount = 8;
+static const size_t kByteInfoSize = 64;
+// A buffer not back by then is taken as lost.
+static const int64_t kLostUs = 1000000;
+
+static int64_t nowUs() {
+	return std::chrono::duration_cast<std::chrono::microseconds>(
+			std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static int64_t percentile(const std::vector<int64_t>& sorted, uint32_t permille) {
+	return sorted.empty() ? 0 : sorted[std::min(sorted.size() - 1, sorted.size() * permille / 1000)];
+}
+
+static std::atomic<int64_t> sReturned(0);
+
+class BenchCallback : public IExtBiometricsFaceClientCallback {
+	public:
+	Return<void> onEnrollResult(uint64_t, uint32_t, int32_t, uint32_t) override {
+		return Return<void>();
+	}
+
+	Return<void> onAuthenticated(uint64_t, uint32_t, int32_t, const hidl_vec<uint8_t>&) override {
+		return Return<void>();
+	}
+
+	Return<void> onAcquired(uint64_t, int32_t, FaceAcquiredInfo, int32_t) override {
+		return Return<void>();
+	}
+
+	Return<void> onError(uint64_t, int32_t, FaceError, int32_t) override {
+		return Return<void>();
+	}
+
+	Return<void> onRemoved(uint64_t, const hidl_vec<uint32_t>&, int32_t) override {
+		return Return<void>();
+	}
+
+	Return<void> onEnumerate(uint64_t, const hidl_vec<uint32_t>&, int32_t) override {
+		return Return<void>();
+	}
+
+	Return<void> onLockoutChanged(uint64_t) override {
+		return Return<void>();
+	}
+
+	Return<void> onEnrollProcessed(uint64_t, int64_t) override {
+		sReturned++;
+		return Return<void>();
+	}
+
+	Return<void> onAuthProcessed(uint64_t, int64_t, int64_t) override {
+		sReturned++;
+		return Return<void>();
+	}
+
+	Return<void> onRecommendedFrameRate(uint64_t, uint32_t) override {
+		return Return<void>();
+	}
+};
+
+// The settings app and the framework querying the service meanwhile,
+// with calls that leave the running authenticate alone.
+static void controlLoop(sp<IExtBiometricsFace> service, std::atomic<bool>* stop) {
+	while(!*stop) {
+		service->generateChallenge(60, [](const OptionalUint64&) {});
+		service->getFeature(Feature::REQUIRE_ATTENTION, 0, [](const OptionalBool&) {});
+		service->getAuthenticatorId([](const OptionalUint64&) {});
+		service->revokeChallenge();
+	}
+}
+
+// range(0): 1 for the oneway submission; range(1): control threads.
+static void BM_SubmitAuthenticateFrame(benchmark::State& state) {
+	sp<IExtBiometricsFace> service = IExtBiometricsFace::getService();
+	if(service == nullptr) {
+		state.SkipWithError("face service not available");
+		return;
+	}
+	service->setCallback(new BenchCallback(), [](const OptionalUint64&) {});
+	if(Status::OK != service->setActiveUser(kUserId, hidl_string(kStorePath))) {
+		state.SkipWithError("setActiveUser failed");
+		return;
+	}
+	// Nothing matches, the session runs through the whole benchmark.
+	property_set("vendor.faceid.sim.match_frames", "0");
+	service->authenticate(0);
+
+	bool oneway = state.range(0) != 0;
+	std::atomic<bool> stop(false);
+	std::vector<std::thread> controls;
+	for(int64_t i = 0; i < state.range(1); i++) {
+		controls.emplace_back(controlLoop, service, &stop);
+	}
+	hidl_vec<int32_t> info(kInfoCount);
+	hidl_vec<int8_t> byteInfo(kByteInfoSize);
+	std::vector<int64_t> latencies;
+	int64_t sent = 0;
+	int64_t lost = 0;
+	sReturned = 0;
+	for(auto _ : state) {
+		int64_t waitStart = nowUs();
+		while(sent - lost - sReturned.load() >= kBuffers) {
+			if(nowUs() - waitStart > kLostUs) {
+				lost++;
+				break;
+			}
+			std::this_thread::yield();
+		}
+		int64_t addr = ++sent;
+		int64_t start = nowUs();
+		if(oneway) {
+			service->submitAuthenticateFrame(addr, addr, 0, info, byteInfo);
+		} else {
+			service->doAuthenticateProcess(addr, addr, 0, info, byteInfo);
+		}
+		int64_t us = nowUs() - start;
+		latencies.push_back(us);
+		state.SetIterationTime(us / 1e6);
+	}
+	stop = true;
+	for(auto& t : controls) {
+		t.join();
+	}
+	service->cancel();
+	property_set("vendor.faceid.sim.match_frames", "");
+
+	std::sort(latencies.begin(), latencies.end());
+	state.counters["p50_us"] = percentile(latencies, 500);
+	state.counters["p99_us"] = percentile(latencies, 990);
+	state.counters["max_us"] = latencies.empty() ? 0 : latencies.back();
+	state.counters["jitter_us"] = percentile(latencies, 990) - percentile(latencies, 500);
+	state.counters["lost"] = lost;
+}
+BENCHMARK(BM_SubmitAuthenticateFrame)
+		->ArgNames({"oneway", "controls"})
+		->ArgsProduct({{0, 1}, {0, 2}})
+		->UseManualTime()
+		->Iterations(2000);
+
+BENCHMARK_MAIN();
@@ -0,0 +1,230 @@
+#define LOG_TAG "face_frontend_benchmark"
+
+// Round trips through the two front ends of the face service: the HIDL
+// IBiometricsFace of vendor.sprd.hardware.face@1.0-service and the AIDL
+// ISession of android.hardware.biometrics.face-service.sprd. Both sit on
+// the same core, so the difference is the front end and its transport.
+// Whichever service the device doesn't run is skipped; meant for the
+// simulated vendor library (ro.hardware.face=sim).
+
+#include <benchmark/benchmark.h>
+#include <aidl/android/hardware/biometrics/face/BnSessionCallback.h>
+#include <aidl/android/hardware/biometrics/face/IFace.h>
+#include <android/binder_manager.h>
+#include <android/binder_process.h>
+
+#include <android/hardware/biometrics/face/1.0/IBiometricsFace.h>
+#include <android/hardware/biometrics/face/1.0/IBiometricsFaceClientCallback.h>
+#include <hidl/HidlSupport.h>
+
+#include <condition_variable>
+#include <mutex>
+#include <string>
+
+using android::sp;
+using android::hardware::hidl_string;
+using android::hardware::hidl_vec;
+using android::hardware::Return;
+using android::hardware::biometrics::face::V1_0::FaceAcquiredInfo;
+using android::hardware::biometrics::face::V1_0::FaceError;
+using android::hardware::biometrics::face::V1_0::IBiometricsFace;
+using android::hardware::biometrics::face::V1_0::IBiometricsFaceClientCallback;
+using android::hardware::biometrics::face::V1_0::OptionalUint64;
+using android::hardware::biometrics::face::V1_0::Status;
+
+namespace aidlface = ::aidl::android::hardware::biometrics::face;
+namespace aidlcommon = ::aidl::android::hardware::biometrics::common;
+using ::aidl::android::hardware::keymaster::HardwareAuthToken;
+
+static const int32_t kUserId = 99;
+static const char kStorePath[] = "/data/system/users/0/facedata";
+
+// Counts the events the benchmark waits for, from either front end.
+class Events {
+	public:
+	void post() {
+		std::lock_guard<std::mutex> lock(mutex);
+		count++;
+		cond.notify_one();
+	}
+
+	void wait() {
+		std::unique_lock<std::mutex> lock(mutex);
+		cond.wait(lock, [this] { return count > 0; });
+		count--;
+	}
+
+	std::mutex mutex;
+	std::condition_variable cond;
+	int count = 0;
+};
+
+static Events sCanceled;
+static Events sAuthenticatorIds;
+
+class HidlCallback : public IBiometricsFaceClientCallback {
+	public:
+	Return<void> onEnrollResult(uint64_t, uint32_t, int32_t, uint32_t) override {
+		return Return<void>();
+	}
+
+	Return<void> onAuthenticated(uint64_t, uint32_t, int32_t, const hidl_vec<uint8_t>&) override {
+		return Return<void>();
+	}
+
+	Return<void> onAcquired(uint64_t, int32_t, FaceAcquiredInfo, int32_t) override {
+		return Return<void>();
+	}
+
+	Return<void> onError(uint64_t, int32_t, FaceError error, int32_t) override {
+		if(FaceError::CANCELED == error) {
+			sCanceled.post();
+		}
+		return Return<void>();
+	}
+
+	Return<void> onRemoved(uint64_t, const hidl_vec<uint32_t>&, int32_t) override {
+		return Return<void>();
+	}
+
+	Return<void> onEnumerate(uint64_t, const hidl_vec<uint32_t>&, int32_t) override {
+		return Return<void>();
+	}
+
+	Return<void> onLockoutChanged(uint64_t) override {
+		return Return<void>();
+	}
+};
+
+class AidlCallback : public aidlface::BnSessionCallback {
+	public:
+	ndk::ScopedAStatus onChallengeGenerated(int64_t) override { return ndk::ScopedAStatus::ok(); }
+	ndk::ScopedAStatus onChallengeRevoked(int64_t) override { return ndk::ScopedAStatus::ok(); }
+	ndk::ScopedAStatus onAuthenticationFrame(const aidlface::AuthenticationFrame&) override {
+		return ndk::ScopedAStatus::ok();
+	}
+	ndk::ScopedAStatus onEnrollmentFrame(const aidlface::EnrollmentFrame&) override {
+		return ndk::ScopedAStatus::ok();
+	}
+	ndk::ScopedAStatus onError(aidlface::Error error, int32_t) override {
+		if(aidlface::Error::CANCELED == error) {
+			sCanceled.post();
+		}
+		return ndk::ScopedAStatus::ok();
+	}
+	ndk::ScopedAStatus onEnrollmentProgress(int32_t, int32_t) override { return ndk::ScopedAStatus::ok(); }
+	ndk::ScopedAStatus onAuthenticationSucceeded(int32_t, const HardwareAuthToken&) override {
+		return ndk::ScopedAStatus::ok();
+	}
+	ndk::ScopedAStatus onAuthenticationFailed() override { return ndk::ScopedAStatus::ok(); }
+	ndk::ScopedAStatus onLockoutTimed(int64_t) override { return ndk::ScopedAStatus::ok(); }
+	ndk::ScopedAStatus onLockoutPermanent() override { return ndk::ScopedAStatus::ok(); }
+	ndk::ScopedAStatus onLockoutCleared() override { return ndk::ScopedAStatus::ok(); }
+	ndk::ScopedAStatus onInteractionDetected() override { return ndk::ScopedAStatus::ok(); }
+	ndk::ScopedAStatus onEnrollmentsEnumerated(const std::vector<int32_t>&) override {
+		return ndk::ScopedAStatus::ok();
+	}
+	ndk::ScopedAStatus onFeaturesRetrieved(const std::vector<aidlface::Feature>&) override {
+		return ndk::ScopedAStatus::ok();
+	}
+	ndk::ScopedAStatus onFeatureSet(aidlface::Feature) override { return ndk::ScopedAStatus::ok(); }
+	ndk::ScopedAStatus onEnrollmentsRemoved(const std::vector<int32_t>&) override {
+		return ndk::ScopedAStatus::ok();
+	}
+	ndk::ScopedAStatus onAuthenticatorIdRetrieved(int64_t) override {
+		sAuthenticatorIds.post();
+		return ndk::ScopedAStatus::ok();
+	}
+	ndk::ScopedAStatus onAuthenticatorIdInvalidated(int64_t) override { return ndk::ScopedAStatus::ok(); }
+	ndk::ScopedAStatus onSessionClosed() override { return ndk::ScopedAStatus::ok(); }
+};
+
+static sp<IBiometricsFace> hidlService() {
+	sp<IBiometricsFace> service = IBiometricsFace::tryGetService();
+	if(service != nullptr) {
+		service->setCallback(new HidlCallback(), [](const OptionalUint64&) {});
+		service->setActiveUser(kUserId, hidl_string(kStorePath));
+	}
+	return service;
+}
+
+static std::shared_ptr<aidlface::ISession> aidlSession() {
+	const std::string instance = std::string() + aidlface::IFace::descriptor + "/default";
+	if(!AServiceManager_isDeclared(instance.c_str())) {
+		return nullptr;
+	}
+	std::shared_ptr<aidlface::IFace> face = aidlface::IFace::fromBinder(
+			ndk::SpAIBinder(AServiceManager_waitForService(instance.c_str())));
+	std::shared_ptr<aidlface::ISession> session;
+	if(face == nullptr ||
+			!face->createSession(0, kUserId, ndk::SharedRefBase::make<AidlCallback>(), &session).isOk()) {
+		return nullptr;
+	}
+	return session;
+}
+
+static void BM_HidlGetAuthenticatorId(benchmark::State& state) {
+	sp<IBiometricsFace> service = hidlService();
+	if(service == nullptr) {
+		state.SkipWithError("HIDL face service not running");
+		return;
+	}
+	for(auto _ : state) {
+		service->getAuthenticatorId([](const OptionalUint64&) {});
+	}
+}
+BENCHMARK(BM_HidlGetAuthenticatorId);
+
+static void BM_AidlGetAuthenticatorId(benchmark::State& state) {
+	std::shared_ptr<aidlface::ISession> session = aidlSession();
+	if(session == nullptr) {
+		state.SkipWithError("AIDL face service not running");
+		return;
+	}
+	for(auto _ : state) {
+		session->getAuthenticatorId();
+		sAuthenticatorIds.wait();
+	}
+	session->close();
+}
+BENCHMARK(BM_AidlGetAuthenticatorId);
+
+// Start an authenticate and cancel it: the session start, the cancel and
+// the CANCELED event, through the scheduler and the vendor library.
+static void BM_HidlAuthenticateCancel(benchmark::State& state) {
+	sp<IBiometricsFace> service = hidlService();
+	if(service == nullptr) {
+		state.SkipWithError("HIDL face service not running");
+		return;
+	}
+	for(auto _ : state) {
+		service->authenticate(0);
+		service->cancel();
+		sCanceled.wait();
+	}
+}
+BENCHMARK(BM_HidlAuthenticateCancel);
+
+static void BM_AidlAuthenticateCancel(benchmark::State& state) {
+	std::shared_ptr<aidlface::ISession> session = aidlSession();
+	if(session == nullptr) {
+		state.SkipWithError("AIDL face service not running");
+		return;
+	}
+	for(auto _ : state) {
+		std::shared_ptr<aidlcommon::ICancellationSignal> cancellation;
+		session->authenticate(0, &cancellation);
+		cancellation->cancel();
+		sCanceled.wait();
+	}
+	session->close();
+}
+BENCHMARK(BM_AidlAuthenticateCancel);
+
+int main(int argc, char** argv) {
+	ABinderProcess_setThreadPoolMaxThreadCount(1);
+	ABinderProcess_startThreadPool();
+	benchmark::Initialize(&argc, argv);
+	benchmark::RunSpecifiedBenchmarks();
+	return 0;
+}
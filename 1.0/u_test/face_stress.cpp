@@ -0,0 +1,470 @@
+#define LOG_TAG "face_stress"
+
+// Stress and soak test of the face service core. Client threads, each its
+// own client process to the service, call into it at the same time with a
+// random but seeded schedule, so a failing run can be repeated with the
+// same -s seed. The service runs in this process on the simulated vendor
+// library, on the host as on a device; face_stress is built with
+// AddressSanitizer and face_stress_tsan, host only, with ThreadSanitizer.
+//
+// Reports per call throughput and latency, how many frames were never
+// answered, requests the service still holds once everything drained,
+// and exits with 2 when a call does not come back.
+
+#include <log/log.h>
+#include <hardware/face.h>
+#include <hardware/hardware.h>
+#include <hardware/hw_auth_token.h>
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "FaceRequests.h"
+#include "FaceService.h"
+
+using ::vendor::sprd::hardware::face::V1_0::implementation::CLIENT_FRAMES;
+using ::vendor::sprd::hardware::face::V1_0::implementation::CLIENT_FRAME_RATE;
+using ::vendor::sprd::hardware::face::V1_0::implementation::FaceClient;
+using ::vendor::sprd::hardware::face::V1_0::implementation::FaceClientCallback;
+using ::vendor::sprd::hardware::face::V1_0::implementation::FaceNotifyFn;
+using ::vendor::sprd::hardware::face::V1_0::implementation::FaceService;
+using ::vendor::sprd::hardware::face::V1_0::implementation::REQUEST_CLASS_COUNT;
+
+extern "C" {
+extern face_module_t HAL_MODULE_INFO_SYM;
+void face_sim_set_delay(void (*delay)(int32_t ms));
+}
+
+static const uint32_t kDefaultThreads = 8;
+static const uint32_t kDefaultSeconds = 60;
+static const int32_t kDefaultUserId = 99;
+#ifdef __ANDROID__
+static const char kDefaultStorePath[] = "/data/local/tmp/face_stress";
+#else
+static const char kDefaultStorePath[] = "/tmp/face_stress";
+#endif
+// Pid of the client of the first thread, the others follow.
+static const pid_t kFirstPid = 1000;
+// What the simulated library spends on a frame.
+static const int32_t kProcessMs = 5;
+// A call that takes longer than this is reported as a deadlock.
+static const int64_t kStuckUs = 10000000;
+// How long the frames still in flight get to be answered at the end
+static const int64_t kDrainUs = 5000000;
+
+enum {
+	OP_AUTHENTICATE,
+	OP_CANCEL,
+	OP_FRAMES,
+	OP_SET_ACTIVE_USER,
+	OP_ENUMERATE,
+	OP_REMOVE,
+	OP_SET_CALLBACK,
+	OP_COUNT,
+};
+
+static const char* const kOpNames[OP_COUNT] = {
+	"authenticate",
+	"cancel",
+	"doAuthenticateProcess",
+	"setActiveUser",
+	"enumerate",
+	"remove",
+	"setCallback",
+};
+
+// How often each call is picked, frame floods dominate like in real use.
+static const uint32_t kOpWeights[OP_COUNT] = { 10, 8, 30, 2, 5, 3, 2 };
+
+static int64_t nowUs() {
+	return std::chrono::duration_cast<std::chrono::microseconds>(
+			std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static int64_t percentile(const std::vector<int64_t>& sorted, uint32_t permille) {
+	return sorted.empty() ? 0 : sorted[std::min(sorted.size() - 1, sorted.size() * permille / 1000)];
+}
+
+// Frames in flight and the events the service sent, shared by every
+// callback object the threads register.
+class Tracker {
+	public:
+	void sent(int64_t addr) {
+		std::lock_guard<std::mutex> lock(mutex);
+		inFlight[addr] = nowUs();
+		framesSent++;
+	}
+
+	void processed(int64_t addr) {
+		int64_t now = nowUs();
+		std::lock_guard<std::mutex> lock(mutex);
+		auto it = inFlight.find(addr);
+		if(it == inFlight.end()) {
+			unknownFrames++;
+			return;
+		}
+		frameLatencies.push_back(now - it->second);
+		inFlight.erase(it);
+	}
+
+	size_t pending() {
+		std::lock_guard<std::mutex> lock(mutex);
+		return inFlight.size();
+	}
+
+	std::mutex mutex;
+	std::map<int64_t, int64_t> inFlight;
+	std::vector<int64_t> frameLatencies;
+	uint64_t framesSent = 0;
+	uint64_t unknownFrames = 0;
+	std::atomic<uint32_t> enrolled{0};
+	std::atomic<uint32_t> authenticated{0};
+	std::atomic<uint32_t> rejected{0};
+	std::atomic<uint32_t> errors{0};
+	std::atomic<uint32_t> canceled{0};
+	std::atomic<uint32_t> enumerated{0};
+	std::atomic<uint32_t> removed{0};
+	std::atomic<uint32_t> lockouts{0};
+	std::atomic<uint32_t> frameRates{0};
+};
+
+class StressClient : public FaceClientCallback {
+	public:
+	explicit StressClient(Tracker& tracker) : tracker(tracker) {}
+
+	void onEnrollResult(uint32_t faceId, int32_t, uint32_t remaining) override {
+		if(faceId != 0 && remaining == 0) {
+			tracker.enrolled = faceId;
+		}
+	}
+
+	void onAuthenticated(uint32_t faceId, int32_t, const uint8_t*, size_t) override {
+		if(faceId != 0) {
+			tracker.authenticated++;
+		} else {
+			tracker.rejected++;
+		}
+	}
+
+	void onAcquired(int32_t, int32_t) override {}
+
+	void onError(int32_t, int32_t error) override {
+		if(FACE_ERROR_CANCELED == error) {
+			tracker.canceled++;
+		} else {
+			tracker.errors++;
+		}
+	}
+
+	void onRemoved(const uint32_t*, size_t, int32_t) override {
+		tracker.removed++;
+	}
+
+	void onEnumerate(const uint32_t*, size_t, int32_t) override {
+		tracker.enumerated++;
+	}
+
+	void onLockoutChanged(uint64_t) override {
+		tracker.lockouts++;
+	}
+
+	void onEnrollProcessed(int64_t addr) override {
+		tracker.processed(addr);
+	}
+
+	void onAuthProcessed(int64_t main, int64_t) override {
+		tracker.processed(main);
+	}
+
+	void onRecommendedFrameRate(uint32_t) override {
+		tracker.frameRates++;
+	}
+
+	Tracker& tracker;
+};
+
+struct StressThread {
+	std::thread thread;
+	pid_t pid = 0;
+	std::mt19937 random;
+	std::vector<int64_t> latencies[OP_COUNT];
+	// Start of the call in progress and which one it is, 0 when idle.
+	std::atomic<int64_t> callStartUs{0};
+	std::atomic<int> op{0};
+};
+
+static std::unique_ptr<FaceService> sService;
+static Tracker sTracker;
+static std::atomic<int64_t> sNextAddr(1);
+static std::atomic<bool> sStop(false);
+static int32_t sUserId = kDefaultUserId;
+static const char* sStorePath = kDefaultStorePath;
+
+static face_device_t* openSimulator(FaceNotifyFn notify) {
+	hw_device_t* device = nullptr;
+	if(HAL_MODULE_INFO_SYM.common.methods->open(&HAL_MODULE_INFO_SYM.common, FACE_HARDWARE_MODULE_ID,
+			&device) != 0) {
+		return nullptr;
+	}
+	face_device_t* face = reinterpret_cast<face_device_t*>(device);
+	face->set_notify(face, notify);
+	return face;
+}
+
+static void simulatedDelay(int32_t) {
+	std::this_thread::sleep_for(std::chrono::milliseconds(kProcessMs));
+}
+
+static void registerClient(pid_t pid) {
+	std::shared_ptr<FaceClient> replaced;
+	sService->addClient(pid, std::make_shared<StressClient>(sTracker), CLIENT_FRAMES | CLIENT_FRAME_RATE,
+			&replaced);
+}
+
+// Enrolls the face the simulated library matches, so that sessions can
+// also end in a match.
+static bool enrollFace(pid_t pid) {
+	uint64_t challenge = 0;
+	if(FACE_OK != sService->generateChallenge(60, &challenge)) {
+		return false;
+	}
+	hw_auth_token_t hat;
+	memset(&hat, 0, sizeof(hat));
+	hat.version = HW_AUTH_TOKEN_VERSION;
+	hat.challenge = challenge;
+	if(FACE_OK != sService->enroll(pid, reinterpret_cast<const uint8_t*>(&hat), sizeof(hat), 60, nullptr, 0)) {
+		return false;
+	}
+	for(int i = 0; i < 100 && sTracker.enrolled == 0; i++) {
+		int64_t addr = sNextAddr++;
+		sTracker.sent(addr);
+		sService->doEnrollProcess(pid, addr, nullptr, 0, nullptr, 0);
+		std::this_thread::sleep_for(std::chrono::milliseconds(4 * kProcessMs));
+	}
+	sService->revokeChallenge();
+	return sTracker.enrolled != 0;
+}
+
+static void sendFrames(StressThread& t) {
+	uint32_t count = 1 + t.random() % 30;
+	for(uint32_t i = 0; i < count; i++) {
+		int64_t addr = sNextAddr++;
+		std::vector<int32_t> info(1 + t.random() % 8);
+		std::vector<int8_t> byteInfo(t.random() % 64);
+		for(auto& v : info) {
+			v = (int32_t)t.random();
+		}
+		for(auto& v : byteInfo) {
+			v = (int8_t)t.random();
+		}
+		sTracker.sent(addr);
+		sService->doAuthenticateProcess(t.pid, addr, addr, 0, info.data(), info.size(), byteInfo.data(),
+				byteInfo.size());
+	}
+}
+
+static void runOp(StressThread& t, int op) {
+	switch(op) {
+	case OP_AUTHENTICATE:
+		sService->authenticate(t.pid, t.random());
+		break;
+	case OP_CANCEL:
+		sService->cancel(t.pid);
+		break;
+	case OP_FRAMES:
+		sendFrames(t);
+		break;
+	case OP_SET_ACTIVE_USER:
+		sService->setActiveUser(sUserId, sStorePath);
+		break;
+	case OP_ENUMERATE:
+		sService->enumerate(t.pid);
+		break;
+	case OP_REMOVE:
+		// Never the enrolled face, sessions keep matching.
+		sService->remove(t.pid, sTracker.enrolled + 1 + t.random() % 5);
+		break;
+	case OP_SET_CALLBACK:
+		// A new callback object each time, the service swaps it in while
+		// the other threads' calls are in flight.
+		registerClient(t.pid);
+		break;
+	}
+}
+
+static void stressLoop(StressThread* t) {
+	uint32_t total = 0;
+	for(uint32_t w : kOpWeights) {
+		total += w;
+	}
+	while(!sStop) {
+		uint32_t pick = t->random() % total;
+		int op = 0;
+		while(pick >= kOpWeights[op]) {
+			pick -= kOpWeights[op++];
+		}
+		int64_t start = nowUs();
+		t->op = op;
+		t->callStartUs = start;
+		runOp(*t, op);
+		t->callStartUs = 0;
+		t->latencies[op].push_back(nowUs() - start);
+		std::this_thread::sleep_for(std::chrono::microseconds(t->random() % 2000));
+	}
+}
+
+// Any call that does not come back is a deadlock in the service; dump
+// what it knows and give up.
+static void watchLoop(std::vector<StressThread>* threads) {
+	while(!sStop) {
+		std::this_thread::sleep_for(std::chrono::milliseconds(500));
+		int64_t now = nowUs();
+		for(size_t i = 0; i < threads->size(); i++) {
+			int64_t start = (*threads)[i].callStartUs;
+			if(start != 0 && now - start > kStuckUs) {
+				printf("DEADLOCK: thread %zu stuck in %s for %" PRId64 "ms\n", i,
+						kOpNames[(*threads)[i].op.load()], (now - start) / 1000);
+				fflush(stdout);
+				sService->dump(STDOUT_FILENO);
+				_exit(2);
+			}
+		}
+	}
+}
+
+static void usage(const char* name) {
+	fprintf(stderr, "usage: %s [-s seed] [-t threads] [-d seconds] [-u userId] [-p storePath]\n", name);
+}
+
+int main(int argc, char** argv) {
+	uint32_t seed = 1;
+	uint32_t threadCount = kDefaultThreads;
+	uint32_t seconds = kDefaultSeconds;
+	int opt;
+	while((opt = getopt(argc, argv, "s:t:d:u:p:")) != -1) {
+		switch(opt) {
+		case 's':
+			seed = strtoul(optarg, nullptr, 0);
+			break;
+		case 't':
+			threadCount = std::max(1ul, strtoul(optarg, nullptr, 0));
+			break;
+		case 'd':
+			seconds = strtoul(optarg, nullptr, 0);
+			break;
+		case 'u':
+			sUserId = atoi(optarg);
+			break;
+		case 'p':
+			sStorePath = optarg;
+			break;
+		default:
+			usage(argv[0]);
+			return 1;
+		}
+	}
+
+	mkdir(sStorePath, 0700);
+	face_sim_set_delay(simulatedDelay);
+	sService.reset(new FaceService(openSimulator));
+	if(sService->waitForDevice() == nullptr) {
+		fprintf(stderr, "simulated vendor library did not open\n");
+		return 1;
+	}
+	std::vector<StressThread> threads(threadCount);
+	for(uint32_t i = 0; i < threadCount; i++) {
+		threads[i].pid = kFirstPid + i;
+		registerClient(threads[i].pid);
+	}
+	if(FACE_OK != sService->setActiveUser(sUserId, sStorePath)) {
+		fprintf(stderr, "setActiveUser(%d, %s) failed\n", sUserId, sStorePath);
+		return 1;
+	}
+	if(!enrollFace(threads[0].pid)) {
+		fprintf(stderr, "enroll failed\n");
+		return 1;
+	}
+
+	printf("seed=%u threads=%u duration=%us\n", seed, threadCount, seconds);
+	int64_t start = nowUs();
+	for(uint32_t i = 0; i < threadCount; i++) {
+		threads[i].random.seed(seed + i);
+		threads[i].thread = std::thread(stressLoop, &threads[i]);
+	}
+	std::thread watch(watchLoop, &threads);
+	std::this_thread::sleep_for(std::chrono::seconds(seconds));
+	sStop = true;
+	for(auto& t : threads) {
+		t.thread.join();
+	}
+	watch.join();
+	int64_t elapsedUs = nowUs() - start;
+
+	sService->cancel(threads[0].pid);
+	int64_t drainStart = nowUs();
+	while(sTracker.pending() > 0 && nowUs() - drainStart < kDrainUs) {
+		std::this_thread::sleep_for(std::chrono::milliseconds(50));
+	}
+
+	printf("%-22s %8s %8s %8s %8s %8s\n", "call", "count", "per_s", "p50_us", "p99_us", "max_us");
+	for(int op = 0; op < OP_COUNT; op++) {
+		std::vector<int64_t> all;
+		for(auto& t : threads) {
+			all.insert(all.end(), t.latencies[op].begin(), t.latencies[op].end());
+		}
+		std::sort(all.begin(), all.end());
+		printf("%-22s %8zu %8.1f %8" PRId64 " %8" PRId64 " %8" PRId64 "\n", kOpNames[op], all.size(),
+				all.size() * 1e6 / elapsedUs, percentile(all, 500), percentile(all, 990),
+				all.empty() ? 0 : all.back());
+	}
+	{
+		std::lock_guard<std::mutex> lock(sTracker.mutex);
+		std::vector<int64_t>& latencies = sTracker.frameLatencies;
+		std::sort(latencies.begin(), latencies.end());
+		// The service drops frames that arrive after a cancel without an
+		// answer, so some unanswered frames are expected here.
+		printf("frames: sent=%" PRIu64 " answered=%zu unanswered=%zu unknown=%" PRIu64 "\n",
+				sTracker.framesSent, latencies.size(), sTracker.inFlight.size(), sTracker.unknownFrames);
+		printf("frame latency us: p50=%" PRId64 " p99=%" PRId64 " p99.9=%" PRId64 " max=%" PRId64 "\n",
+				percentile(latencies, 500), percentile(latencies, 990), percentile(latencies, 999),
+				latencies.empty() ? 0 : latencies.back());
+	}
+	printf("events: authenticated=%u rejected=%u canceled=%u errors=%u enumerated=%u removed=%u"
+			" lockouts=%u frame_rates=%u\n",
+			sTracker.authenticated.load(), sTracker.rejected.load(), sTracker.canceled.load(),
+			sTracker.errors.load(), sTracker.enumerated.load(), sTracker.removed.load(),
+			sTracker.lockouts.load(), sTracker.frameRates.load());
+
+	// Everything was answered or dropped by now, a request the service
+	// still holds has leaked.
+	fflush(stdout);
+	sService->dump(STDOUT_FILENO);
+	size_t leaked = 0;
+	for(size_t cls = 0; cls < REQUEST_CLASS_COUNT; cls++) {
+		leaked += sService->queuedRequests(cls);
+	}
+	// Stops the request thread and closes the library, under the
+	// sanitizers too.
+	sService.reset();
+	face_sim_set_delay(nullptr);
+	if(leaked > 0) {
+		printf("FAIL: %zu requests still queued in the service\n", leaked);
+		return 1;
+	}
+	printf("OK\n");
+	return 0;
+}
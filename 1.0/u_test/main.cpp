@@ -2,6 +2,7 @@
 
 #include <log/log.h>
 #include <android/log.h>
+#include <cutils/properties.h>
 
 #include <android/hardware/biometrics/face/1.0/IBiometricsFace.h>
 #include <android/hardware/biometrics/face/1.0/IBiometricsFaceClientCallback.h>
@@ -11,9 +12,11 @@
 
 #include <vendor/sprd/hardware/face/1.0/IExtBiometricsFace.h>
 #include <vendor/sprd/hardware/face/1.0/IExtBiometricsFaceClientCallback.h>
+#include <vendor/sprd/hardware/face/1.1/IExtBiometricsFaceClientCallback.h>
 
 #include <cinttypes>
 #include <cstdint>
+#include <cstring>
 #include <future>
 #include <utility>
 
@@ -637,6 +640,143 @@ fail:
 	ALOGE("OnLockoutChangedTest Fail");
 }
 
+// Only meaningful with ro.vendor.faceid.isolate=1 and the simulated vendor
+// library (ro.hardware.face=sim), which honours vendor.faceid.sim.hang_ms.
+void IsolatedHangRecoveryTest() {
+	ALOGD("IsolatedHangRecoveryTest");
+	if(!property_get_bool("ro.vendor.faceid.isolate", false) || mExtService == nullptr) {
+		ALOGD("IsolatedHangRecoveryTest skipped");
+		return;
+	}
+	bool cb_r = true;
+	std::promise<void> promise;
+	sp<ErrorCallback> cb = new ErrorCallback(true, FaceError::HW_UNAVAILABLE);
+	mService->setCallback(cb, ASSERTCALLBACKISSET);
+	if(!waitForCallback(promise.get_future()) || !cb_r) {
+		ALOGE("IsolatedHangRecoveryTest Fail");
+		return;
+	}
+
+	property_set("vendor.faceid.sim.hang_ms", "30000");
+	mService->authenticate(0);
+	auto start = std::chrono::steady_clock::now();
+	mExtService->doAuthenticateProcess(0, 0, 0, hidl_vec<int32_t>(), hidl_vec<int8_t>());
+	if(!waitForCallback(cb->promise.get_future(), std::chrono::seconds(10))) {
+		ALOGE("IsolatedHangRecoveryTest Fail, hang was not detected");
+		return;
+	}
+	auto detected = std::chrono::steady_clock::now();
+
+	// The service answers again once the worker is back.
+	Status status = Status::INTERNAL_ERROR;
+	while(Status::OK != status && std::chrono::steady_clock::now() - detected < std::chrono::seconds(10)) {
+		mService->getAuthenticatorId([&](const OptionalUint64& res) { status = res.status; });
+	}
+	auto recovered = std::chrono::steady_clock::now();
+	if(Status::OK != status) {
+		ALOGE("IsolatedHangRecoveryTest Fail, worker did not recover");
+		return;
+	}
+	ALOGD("IsolatedHangRecoveryTest OK, detected after %lldms, recovered after %lldms",
+			(long long)std::chrono::duration_cast<std::chrono::milliseconds>(detected - start).count(),
+			(long long)std::chrono::duration_cast<std::chrono::milliseconds>(recovered - detected).count());
+}
+
+class FrameRateCallback : public ::vendor::sprd::hardware::face::V1_1::IExtBiometricsFaceClientCallback {
+	public:
+	FrameRateCallback(uint32_t maxFps) : maxFps(maxFps), done(false), fps(0) {}
+
+	Return<void> onEnrollResult(uint64_t, uint32_t, int32_t, uint32_t) override {
+		return Return<void>();
+	}
+
+	Return<void> onAuthenticated(uint64_t, uint32_t, int32_t, const hidl_vec<uint8_t>&) override {
+		return Return<void>();
+	}
+
+	Return<void> onAcquired(uint64_t, int32_t, FaceAcquiredInfo, int32_t) override {
+		return Return<void>();
+	}
+
+	Return<void> onError(uint64_t, int32_t, FaceError, int32_t) override {
+		return Return<void>();
+	}
+
+	Return<void> onRemoved(uint64_t, const hidl_vec<uint32_t>&, int32_t) override {
+		return Return<void>();
+	}
+
+	Return<void> onEnumerate(uint64_t, const hidl_vec<uint32_t>&, int32_t) override {
+		return Return<void>();
+	}
+
+	Return<void> onLockoutChanged(uint64_t) override {
+		return Return<void>();
+	}
+
+	Return<void> onEnrollProcessed(uint64_t, int64_t) override {
+		return Return<void>();
+	}
+
+	Return<void> onAuthProcessed(uint64_t, int64_t, int64_t) override {
+		return Return<void>();
+	}
+
+	Return<void> onRecommendedFrameRate(uint64_t, uint32_t fps) override {
+		ALOGD("RecommendedFrameRate callback called, fps=%u", fps);
+		if(!done && fps <= maxFps) {
+			done = true;
+			this->fps = fps;
+			promise.set_value();
+		}
+		return Return<void>();
+	}
+
+	uint32_t maxFps;
+	bool done;
+	uint32_t fps;
+	std::promise<void> promise;
+};
+
+// Only meaningful with the simulated vendor library (ro.hardware.face=sim):
+// frames sent at 30fps to a library that needs 150ms each must bring the
+// recommended rate down to what it can process.
+void FrameRateFeedbackTest() {
+	ALOGD("FrameRateFeedbackTest");
+	char hardware[PROPERTY_VALUE_MAX];
+	property_get("ro.hardware.face", hardware, "");
+	if(strcmp(hardware, "sim") || mExtService == nullptr) {
+		ALOGD("FrameRateFeedbackTest skipped");
+		return;
+	}
+	bool cb_r = true;
+	std::promise<void> promise;
+	sp<FrameRateCallback> cb = new FrameRateCallback(10);
+	mService->setCallback(cb, ASSERTCALLBACKISSET);
+	if(!waitForCallback(promise.get_future()) || !cb_r) {
+		ALOGE("FrameRateFeedbackTest Fail");
+		return;
+	}
+
+	property_set("vendor.faceid.sim.process_ms", "150");
+	property_set("vendor.faceid.sim.match_frames", "0");
+	mService->authenticate(0);
+	std::future<void> future = cb->promise.get_future();
+	bool reported = false;
+	for(int i = 0; i < 90 && !reported; i++) {
+		mExtService->doAuthenticateProcess(i, i, 0, hidl_vec<int32_t>(), hidl_vec<int8_t>());
+		reported = std::future_status::ready == future.wait_for(std::chrono::milliseconds(33));
+	}
+	mService->cancel();
+	property_set("vendor.faceid.sim.process_ms", "");
+	property_set("vendor.faceid.sim.match_frames", "");
+	if(!reported) {
+		ALOGE("FrameRateFeedbackTest Fail, rate was not lowered");
+		return;
+	}
+	ALOGD("FrameRateFeedbackTest OK, recommended %ufps", cb->fps);
+}
+
 static test_case s_cases[] = {
 	ConnectTest,
 	ConnectNullTest,
@@ -657,6 +797,8 @@ static test_case s_cases[] = {
 	SetActiveUserNullTest,
 	CancelTest,
 	OnLockoutChangedTest,
+	IsolatedHangRecoveryTest,
+	FrameRateFeedbackTest,
 };
 
 int main(/*int argc, char** argv*/) {